@@ -0,0 +1,41 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the BSD 3-Clause License within the LICENSE file.
+
+#pragma once
+
+#include <tev/Common.h>
+
+#include <istream>
+#include <memory>
+#include <string>
+#include <vector>
+
+TEV_NAMESPACE_BEGIN
+
+// Whether the path refers to an existing zip archive, whose members are opened as separate images.
+bool isZipArchive(const filesystem::path& path);
+
+// Returns the paths of all files within the zip archive, in the form `<archive>/<member>`.
+// Throws runtime_error if the archive can not be read.
+std::vector<filesystem::path> listZipMembers(const filesystem::path& archivePath);
+
+// Opens the image at `path` for reading. Gzip-compressed files, including ones consisting of
+// several concatenated members, and members of zip archives (see listZipMembers) are
+// decompressed into memory while they are read, such that nothing is written to disk. Any
+// other file is read from disk as-is. Throws runtime_error if decompression fails.
+std::unique_ptr<std::istream> openImageFile(const filesystem::path& path);
+
+// Like openImageFile, but decompresses at most the first `maxNumBytes` of compressed files,
+// which suffices to read the headers of most formats without inflating whole images. If the
+// decompressed file is longer, the returned MemoryStream is not complete.
+std::unique_ptr<std::istream> openImageFileHead(const filesystem::path& path, size_t maxNumBytes);
+
+// Like openImageFile, but for the bytes of a file that already reside in memory, e.g. ones
+// received over IPC.
+std::unique_ptr<std::istream> openImageData(std::vector<char> data);
+
+// The path by which loaders recognize the decompressed contents of a file, i.e. the path
+// without a trailing `.gz`.
+filesystem::path contentPath(const filesystem::path& path);
+
+TEV_NAMESPACE_END
@@ -0,0 +1,119 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the BSD 3-Clause License within the LICENSE file.
+
+#pragma once
+
+#include <tev/Common.h>
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+TEV_NAMESPACE_BEGIN
+
+// Recycles large buffers, such as channels, texture staging data, and the data of IPC packets,
+// which would otherwise be returned to the operating system and faulted in again page by page
+// by the next operation. Requests are rounded up to size classes, of which there are four per
+// power of two, and freed blocks are kept per size class until `maxFreeBytes` are held.
+// Small requests are passed through to the regular allocator.
+class BufferPool {
+public:
+    // Requests below this size are not pooled.
+    static const size_t MIN_POOLED_BYTES = 256 * 1024;
+    // Pooled blocks of at least this size are aligned to it, such that the operating system
+    // can back them with huge pages. Size classes from 8 MiB on are multiples of it.
+    static const size_t HUGE_PAGE_BYTES = 2 * 1024 * 1024;
+
+    struct Statistics {
+        size_t numAllocations;
+        // Allocations that were served by a previously freed block.
+        size_t numReuses;
+        // Bytes of pooled blocks that are currently handed out.
+        size_t usedBytes;
+        // Bytes of freed blocks that are kept for reuse.
+        size_t freeBytes;
+        size_t peakBytes;
+    };
+
+    static BufferPool& global();
+
+    BufferPool(size_t maxFreeBytes) : mMaxFreeBytes{maxFreeBytes} {}
+    ~BufferPool();
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    void* allocate(size_t bytes);
+    // `bytes` must be the same as when the memory was allocated.
+    void deallocate(void* ptr, size_t bytes);
+
+    // Returns all freed blocks to the operating system.
+    void trim();
+
+    // Reads atomic counters only and never locks.
+    Statistics statistics() const;
+
+    static size_t sizeClass(size_t bytes);
+
+private:
+    void releaseFreeBlocks(size_t targetBytes);
+
+    size_t mMaxFreeBytes;
+
+    std::mutex mMutex;
+    std::map<size_t, std::vector<void*>> mFreeBlocks;
+
+    std::atomic<size_t> mNumAllocations{0};
+    std::atomic<size_t> mNumReuses{0};
+    std::atomic<size_t> mUsedBytes{0};
+    std::atomic<size_t> mFreeBytes{0};
+    std::atomic<size_t> mPeakBytes{0};
+};
+
+// Allocates from the global buffer pool, such that standard containers can draw from it. Like
+// the elements of Eigen matrices, elements are left uninitialized when a container is resized
+// without an explicit value, since large buffers are usually overwritten right away.
+template <typename T>
+class PooledAllocator {
+public:
+    using value_type = T;
+
+    PooledAllocator() = default;
+    template <typename U>
+    PooledAllocator(const PooledAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+        return (T*)BufferPool::global().allocate(n * sizeof(T));
+    }
+
+    void deallocate(T* ptr, size_t n) {
+        BufferPool::global().deallocate(ptr, n * sizeof(T));
+    }
+
+    template <typename U>
+    void construct(U* ptr) {
+        ::new((void*)ptr) U;
+    }
+
+    template <typename U, typename... Args>
+    void construct(U* ptr, Args&&... args) {
+        ::new((void*)ptr) U(std::forward<Args>(args)...);
+    }
+
+    template <typename U>
+    bool operator==(const PooledAllocator<U>&) const {
+        return true;
+    }
+
+    template <typename U>
+    bool operator!=(const PooledAllocator<U>&) const {
+        return false;
+    }
+};
+
+template <typename T>
+using PooledVector = std::vector<T, PooledAllocator<T>>;
+
+TEV_NAMESPACE_END
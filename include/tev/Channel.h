@@ -3,13 +3,13 @@
 
 #pragma once
 
+#include <tev/BufferPool.h>
 #include <tev/Common.h>
 
-#include <nanogui/vector.h>
-
 #include <Eigen/Dense>
 
 #include <future>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -21,60 +21,96 @@ public:
 
     Channel(const std::string& name, Eigen::Vector2i size);
 
+    // Wraps data that is owned elsewhere, such as decoded pixels that tev instances share via
+    // SharedImageCache, and kept alive by `data`. The data is never written to: modifications
+    // like updateTile() work on a copy. It must hence not be written to via at().
+    Channel(const std::string& name, Eigen::Vector2i size, std::shared_ptr<const float> data);
+
+    // Copies own their data, whereas snapshots share it.
+    Channel(const Channel& other);
+    Channel& operator=(const Channel& other);
+    Channel(Channel&& other) = default;
+    Channel& operator=(Channel&& other) = default;
+
+    // Returns a channel that shares the current data. Since updates copy the data while it is
+    // shared, the snapshot remains unchanged and can be read while the channel is updated.
+    Channel snapshot() const;
+
     const std::string& name() const {
         return mName;
     }
 
-    const RowMatrixXf& data() const {
-        return mData;
+    Eigen::Map<const RowMatrixXf> data() const {
+        return {mData.get(), mSize.y(), mSize.x()};
     }
 
     float eval(Eigen::DenseIndex index) const {
-        if (index >= mData.size()) {
+        if (index >= count()) {
             return 0;
         }
-        return mData(index);
+        return mData.get()[index];
     }
 
     float eval(Eigen::Vector2i index) const {
-        if (index.x() < 0 || index.x() >= mData.cols() ||
-            index.y() < 0 || index.y() >= mData.rows()) {
+        if (index.x() < 0 || index.x() >= mSize.x() ||
+            index.y() < 0 || index.y() >= mSize.y()) {
             return 0;
         }
 
-        return mData(index.x() + index.y() * mData.cols());
+        return mData.get()[index.x() + index.y() * (Eigen::DenseIndex)mSize.x()];
     }
 
     float& at(Eigen::DenseIndex index) {
-        return mData(index);
+        return mData.get()[index];
     }
 
     float at(Eigen::DenseIndex index) const {
-        return mData(index);
+        return mData.get()[index];
     }
 
     float& at(Eigen::Vector2i index) {
-        return at(index.x() + index.y() * mData.cols());
+        return at(index.x() + index.y() * (Eigen::DenseIndex)mSize.x());
     }
 
     float at(Eigen::Vector2i index) const {
-        return at(index.x() + index.y() * mData.cols());
+        return at(index.x() + index.y() * (Eigen::DenseIndex)mSize.x());
     }
 
     Eigen::DenseIndex count() const {
-        return mData.size();
+        return (Eigen::DenseIndex)mSize.x() * mSize.y();
     }
 
     Eigen::Vector2i size() const {
-        return {mData.cols(), mData.rows()};
+        return mSize;
     }
 
     void divideByAsync(const Channel& other, std::vector<std::future<void>>& futures);
     void multiplyWithAsync(const Channel& other, std::vector<std::future<void>>& futures);
 
-    void setZero() { mData.setZero(); }
+    void setZero();
+
+    // Replaces the data by a losslessly compressed copy. The data must not be accessed until
+    // the channel is decompressed again.
+    void compress();
+    void decompress();
+
+    bool isCompressed() const {
+        return mIsCompressed;
+    }
+
+    // Takes over the data of `other`, compressed or not, but keeps the name, such that the
+    // name can still be read by threads that do not access the data.
+    void replaceData(Channel&& other);
+
+    size_t compressedBytes() const;
+
+    // Whether the data is owned elsewhere, see the constructor.
+    bool isReadOnly() const {
+        return mIsReadOnly;
+    }
 
-    void updateTile(int x, int y, int width, int height, const std::vector<float>& newData);
+    // Copies the data first if it is shared with snapshots or read-only.
+    void updateTile(int x, int y, int width, int height, const PooledVector<float>& newData);
 
     static std::pair<std::string, std::string> split(const std::string& fullChannel);
 
@@ -83,11 +119,23 @@ public:
 
     static bool isTopmost(const std::string& fullChannel);
 
-    static nanogui::Color color(std::string fullChannel);
-
 private:
+    Channel(const std::string& name, Eigen::Vector2i size, std::shared_ptr<float> data, bool isReadOnly);
+
+    // Replaces the data by a copy that this channel owns exclusively unless it already does.
+    void makeWritable();
+
     std::string mName;
-    RowMatrixXf mData;
+    Eigen::Vector2i mSize;
+    // Points to the first value of either a vector drawn from the buffer pool, such that the
+    // channels of closed images and of temporary results are reused rather than faulted in
+    // again, or of read-only data owned elsewhere. Each version of the data is shared by the
+    // snapshots that were taken of it.
+    std::shared_ptr<float> mData;
+    bool mIsReadOnly = false;
+
+    bool mIsCompressed = false;
+    std::vector<std::vector<char>> mCompressedTiles;
 };
 
 TEV_NAMESPACE_END
@@ -54,13 +54,19 @@
 #   define TEV_VERSION "undefined"
 #endif
 
-struct NVGcontext;
-
 TEV_NAMESPACE_BEGIN
 
 class ThreadPool;
 extern ThreadPool* gThreadPool;
 
+inline uint16_t swapBytes(uint16_t value) {
+#ifdef _WIN32
+    return _byteswap_ushort(value);
+#else
+    return __builtin_bswap16(value);
+#endif
+}
+
 inline uint32_t swapBytes(uint32_t value) {
 #ifdef _WIN32
     return _byteswap_ulong(value);
@@ -82,6 +88,14 @@ inline float swapBytes(float value) {
     return result;
 }
 
+inline uint64_t swapBytes(uint64_t value) {
+#ifdef _WIN32
+    return _byteswap_uint64(value);
+#else
+    return __builtin_bswap64(value);
+#endif
+}
+
 inline bool isSystemLittleEndian() {
     uint16_t beef = 0xbeef;
     return *reinterpret_cast<const uint8_t*>(&beef) == 0xef;
@@ -133,6 +147,16 @@ T round(T value, T decimals) {
     return std::round(value * precision) / precision;
 }
 
+// Computes `a * b + c` without overflowing and returns false if the result exceeds `limit`.
+inline bool mulAddWithin(uint64_t a, uint64_t b, uint64_t c, uint64_t limit, uint64_t& result) {
+    if (c > limit || (b != 0 && a > (limit - c) / b)) {
+        return false;
+    }
+
+    result = a * b + c;
+    return true;
+}
+
 template <typename T>
 std::string join(const T& components, const std::string& delim) {
     std::ostringstream s;
@@ -157,8 +181,6 @@ inline bool matchesFuzzyOrRegex(const std::string& text, const std::string& filt
     return isRegex ? matchesRegex(text, filter) : matchesFuzzy(text, filter);
 }
 
-void drawTextWithShadow(NVGcontext* ctx, float x, float y, std::string text, float shadowAlpha = 1.0f);
-
 inline float toSRGB(float linear, float gamma = 2.4f) {
     static const float a = 0.055f;
     if (linear <= 0.0031308f) {
@@ -183,10 +205,10 @@ std::string errorString(int errorId);
 
 filesystem::path homeDirectory();
 
-void toggleConsole();
+// Returns the names of all entries of the directory, excluding "." and "..".
+std::vector<std::string> listDirectory(const filesystem::path& directory);
 
-// Implemented in main.cpp
-void scheduleToMainThread(const std::function<void()>& fun);
+void toggleConsole();
 
 enum ETonemap : int {
     SRGB = 0,
@@ -215,6 +237,22 @@ enum EMetric : int {
 
 EMetric toMetric(std::string name);
 
+// How a reference of a different resolution is brought onto the pixel grid of the image.
+enum EResampling : int {
+    // Compares center-aligned pixels and treats pixels outside of the reference as 0.
+    Centered = 0,
+    Box,
+    Bilinear,
+    Lanczos,
+
+    // This enum value should never be used directly.
+    // It facilitates looping over all members of this enum.
+    NumResamplings,
+};
+
+// Throws invalid_argument for unknown names.
+EResampling toResampling(std::string name);
+
 enum EDirection {
     Forward,
     Backward,
@@ -0,0 +1,20 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the BSD 3-Clause License within the LICENSE file.
+
+#pragma once
+
+#include <tev/Common.h>
+
+#include <vector>
+
+TEV_NAMESPACE_BEGIN
+
+// Losslessly compresses floats by shuffling their bytes into planes, i.e. all first bytes
+// followed by all second bytes and so on, and deflating the result. Neighboring pixels tend
+// to share their sign and exponent bytes, which become long runs once grouped together.
+std::vector<char> compressFloats(const float* data, size_t count);
+
+// `count` must be the number of floats that were compressed.
+void decompressFloats(const std::vector<char>& compressed, float* data, size_t count);
+
+TEV_NAMESPACE_END
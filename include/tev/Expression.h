@@ -0,0 +1,78 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the BSD 3-Clause License within the LICENSE file.
+
+#pragma once
+
+#include <tev/Common.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+TEV_NAMESPACE_BEGIN
+
+// A channel that is derived from other channels of the same image, defined like
+// `Y = 0.2126*R + 0.7152*G + 0.0722*B` or `diff = abs(img.R - ref.R)`. Expressions support
+// numbers, channel names, + - * / ^, the comparisons < <= > >= (yielding 0 or 1), and the
+// functions abs, sqrt, exp, log, min, max, and pow. Channel names that contain characters
+// other than letters, digits, '_', and '.' may be enclosed in single quotes.
+class ChannelExpression {
+public:
+    // Throws invalid_argument if the definition is malformed.
+    ChannelExpression(const std::string& definition);
+
+    const std::string& name() const {
+        return mName;
+    }
+
+    const std::string& definition() const {
+        return mDefinition;
+    }
+
+    // The names of the channels the expression reads. Each name appears once.
+    const std::vector<std::string>& inputs() const {
+        return mInputs;
+    }
+
+    // Computes `count` values, where `inputs[i]` points to the values of the i-th input.
+    void evaluate(const std::vector<const float*>& inputs, float* result, size_t count) const;
+
+    enum class EOp : uint8_t {
+        Constant,
+        Input,
+        Negate,
+        Add,
+        Subtract,
+        Multiply,
+        Divide,
+        Power,
+        Minimum,
+        Maximum,
+        Less,
+        LessEqual,
+        Greater,
+        GreaterEqual,
+        Abs,
+        Sqrt,
+        Exp,
+        Log,
+    };
+
+    // Instructions of a stack machine. Each instruction operates on whole blocks of values,
+    // such that interpreting it is cheap compared to the vectorized arithmetic.
+    struct Instruction {
+        EOp op;
+        float constant;
+        size_t input;
+    };
+
+private:
+    std::string mName;
+    std::string mDefinition;
+    std::vector<std::string> mInputs;
+
+    std::vector<Instruction> mInstructions;
+    size_t mStackSize = 0;
+};
+
+TEV_NAMESPACE_END
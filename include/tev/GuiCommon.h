@@ -0,0 +1,16 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the BSD 3-Clause License within the LICENSE file.
+
+#pragma once
+
+#include <tev/Common.h>
+
+#include <string>
+
+struct NVGcontext;
+
+TEV_NAMESPACE_BEGIN
+
+void drawTextWithShadow(NVGcontext* ctx, float x, float y, std::string text, float shadowAlpha = 1.0f);
+
+TEV_NAMESPACE_END
@@ -0,0 +1,161 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the BSD 3-Clause License within the LICENSE file.
+
+#pragma once
+
+#include <tev/Common.h>
+#include <tev/Image.h>
+#include <tev/ImageProcessing.h>
+#include <tev/Ipc.h>
+#include <tev/SharedQueue.h>
+#include <tev/ThreadPool.h>
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+TEV_NAMESPACE_BEGIN
+
+enum class EReportFormat {
+    Json,
+    Csv,
+};
+
+struct ImageArgument {
+    std::string path;
+    std::string channelSelector;
+};
+
+struct HeadlessSettings {
+    std::vector<ImageArgument> images;
+
+    // If set, all images are compared against this reference. Otherwise, images are
+    // compared in pairs, i.e. the first against the second, the third against the fourth, ...
+    bool hasReference = false;
+    ImageArgument reference;
+
+    // A comparison fails if the mean error of `metric` in any channel group exceeds the
+    // threshold. For the signed error, the magnitude of the mean is used.
+    bool hasThreshold = false;
+    float threshold = 0;
+    EMetric metric = Error;
+    ComparisonFilter comparisonFilter;
+
+    EReportFormat format = EReportFormat::Json;
+
+    // Empty for stdout.
+    std::string outputPath;
+
+    // The file name pattern of exported images. `{name}` is replaced by the file name of the
+    // image without extension, `{dir}` by its directory, and `{index}` by its position among
+    // all exported images. The extension of the pattern selects the file format.
+    std::string exportPattern;
+    // The first channel group whose name contains this string is exported. If empty, the
+    // first channel group is exported.
+    std::string channelGroup;
+    DisplaySettings displaySettings;
+};
+
+// Print the statistics of each image or their errors with respect to references without
+// opening a window. Images are loaded and processed concurrently. The returned exit code
+// is 0 on success, 1 if a comparison exceeded the threshold, and 2 if an image could not
+// be loaded.
+int computeStatisticsHeadless(const HeadlessSettings& settings);
+int compareImagesHeadless(const HeadlessSettings& settings);
+
+// Saves the images in the format given by the extension of the export pattern, tonemapped
+// like the GUI would when saving them. If a reference is set, the error with respect to it
+// is exported instead. Images are decoded, tonemapped, and encoded in an overlapping
+// pipeline, such that only a few images are held in memory at once. The returned exit code
+// is 0 on success, 2 if an image could not be loaded, and 3 if an image could not be saved.
+int exportImagesHeadless(const HeadlessSettings& settings);
+
+EReportFormat toReportFormat(std::string name);
+
+// A long-running instance without a window. It keeps images in memory and answers the
+// queries of IPC clients, such that many short-lived scripts can share decoded images
+// rather than each decoding them again.
+class HeadlessServer {
+public:
+    // Images that can be reloaded from disk are evicted in least-recently-used order
+    // whenever the decoded images exceed `memoryBudget` bytes. 0 stands for no limit.
+    HeadlessServer(std::shared_ptr<Ipc> ipc, size_t memoryBudget);
+
+    void open(const std::string& path, const std::string& channelSelector);
+
+    // Applies to all comparisons of images with references.
+    void setComparisonFilter(const ComparisonFilter& filter) {
+        mComparisonFilter = filter;
+    }
+
+    // Clients export images to relative paths within `directory`, and only overwrite existing
+    // files if `allowOverwrite` is set. Exports are refused while no directory is set.
+    void setExportDirectory(const filesystem::path& directory, bool allowOverwrite) {
+        mExportDirectory = directory;
+        mAllowOverwrite = allowOverwrite;
+    }
+
+    // Services IPC clients until `shallShutdown` becomes true.
+    void run(const std::atomic<bool>& shallShutdown);
+
+private:
+    struct Entry {
+        std::string name;
+        // Deferred until first used and nullptr while evicted.
+        std::shared_ptr<Image> image;
+        filesystem::path path;
+        std::string channelSelector;
+        // Images that were created or updated over IPC can not be reloaded.
+        bool canReload;
+        size_t lastUse;
+        Eigen::Vector2i size;
+        std::vector<ChannelGroup> channelGroups;
+    };
+
+    void schedule(int clientId, std::function<void()> task);
+    void runClientTasks(int clientId);
+
+    void handlePacket(const IpcPacket& packet, int clientId);
+
+    void openImages(const std::string& path, const std::string& channelSelector);
+    void addImage(const std::shared_ptr<Image>& image, bool canReload);
+    void closeImage(const std::string& name);
+    // Applies consecutive updates of one client in one go, see Image::updateChannels.
+    void updateImages(const std::vector<IpcPacket>& packets);
+
+    // Returns the decoded image of the given name, decoding it if needed.
+    std::shared_ptr<Image> acquire(const std::string& name);
+    void evictToBudget();
+
+    std::string queryImages();
+    std::string computeStatistics(const IpcPacketComputeStatistics& info);
+    std::string exportImage(const IpcPacketExportImage& info);
+
+    std::shared_ptr<Ipc> mIpc;
+    size_t mMemoryBudget;
+    ComparisonFilter mComparisonFilter;
+    filesystem::path mExportDirectory;
+    bool mAllowOverwrite = false;
+
+    std::mutex mEntriesMutex;
+    std::vector<Entry> mEntries;
+    size_t mNumUses = 0;
+
+    // Tasks of a single client are run in order, such that e.g. an image is always created
+    // before it is queried, but the tasks of different clients run in parallel.
+    std::mutex mClientTasksMutex;
+    std::map<int, std::deque<std::function<void()>>> mClientTasks;
+
+    // Replies are sent from the thread that services the IPC connections.
+    SharedQueue<std::pair<int, IpcPacket>> mReplies;
+
+    ThreadPool mWorkers{4};
+};
+
+TEV_NAMESPACE_END
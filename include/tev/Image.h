@@ -4,27 +4,43 @@
 #pragma once
 
 #include <tev/Channel.h>
+#include <tev/Expression.h>
+#include <tev/MemoryUsage.h>
 #include <tev/SharedQueue.h>
 #include <tev/ThreadPool.h>
 
-#include <nanogui/texture.h>
-
 #include <Eigen/Dense>
 
 #include <atomic>
+#include <chrono>
+#include <functional>
 #include <istream>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
 TEV_NAMESPACE_BEGIN
 
 class ImageLoader;
+class ImageSequence;
 
 struct ImageData {
     std::vector<Channel> channels;
     std::vector<std::string> layers;
+
+    // Converts the R, G, and B channels of each layer from the primaries of the file to the
+    // sRGB / Rec.709 primaries that are displayed. Loaders apply it to the returned channels.
+    Eigen::Matrix3f toRec709 = Eigen::Matrix3f::Identity();
+    // The names of the channels that toRec709 was applied to, in triples of R, G, and B.
+    std::vector<std::string> convertedChannels;
+};
+
+// Metadata of an image that can be read without decoding its pixels.
+struct ImageHeader {
+    Eigen::Vector2i size;
+    std::vector<std::string> channels;
 };
 
 struct ChannelGroup {
@@ -32,16 +48,28 @@ struct ChannelGroup {
     std::vector<std::string> channels;
 };
 
-struct ImageTexture {
-    nanogui::ref<nanogui::Texture> nanoguiTexture;
-    std::vector<std::string> channels;
-    bool mipmapDirty;
+// New values of a rectangle of a channel, which `data` holds row by row.
+struct ChannelUpdate {
+    std::string channelName;
+    int x, y, width, height;
+    const PooledVector<float>* data;
 };
 
 class Image {
 public:
-    Image(const filesystem::path& path, std::istream& iStream, const std::string& channelSelector);
-    virtual ~Image();
+    // Shares the decoded channels with other tev instances under `sharedCacheKey` unless
+    // it is empty (see SharedImageCache).
+    Image(const filesystem::path& path, std::istream& iStream, const std::string& channelSelector, const std::string& sharedCacheKey = "");
+
+    // Creates an image from channels that were decoded before, e.g. by another tev instance.
+    // Their alpha must already be premultiplied.
+    Image(const filesystem::path& path, ImageData data, const std::string& channelSelector);
+
+    // Creates a deferred image which knows its resolution and channels, but whose pixels
+    // are only decoded by a call to `decode()`.
+    Image(const filesystem::path& path, const ImageHeader& header, const std::string& channelSelector);
+
+    virtual ~Image() {}
 
     const filesystem::path& path() const {
         return mPath;
@@ -70,18 +98,27 @@ public:
         }
     }
 
-    nanogui::Texture* texture(const std::string& channelGroupName);
-    nanogui::Texture* texture(const std::vector<std::string>& channelNames);
+    std::vector<std::string> channelNames() const {
+        std::vector<std::string> result;
+        for (const auto& c : mData.channels) {
+            result.emplace_back(c.name());
+        }
+        return result;
+    }
 
     std::vector<std::string> channelsInGroup(const std::string& groupName) const;
     std::vector<std::string> getSortedChannels(const std::string& layerName) const;
 
     Eigen::Vector2i size() const {
-        return mData.channels.front().size();
+        return mSize;
     }
 
     Eigen::DenseIndex count() const {
-        return mData.channels.front().count();
+        return (Eigen::DenseIndex)mSize.x() * mSize.y();
+    }
+
+    size_t numChannels() const {
+        return mData.channels.size();
     }
 
     const std::vector<ChannelGroup>& channelGroups() const {
@@ -96,14 +133,103 @@ public:
         mId = sId++;
     }
 
-    void updateChannel(const std::string& channelName, int x, int y, int width, int height, const std::vector<float>& data);
+    // Returns the names of the derived channels that changed along with the updated channel.
+    std::vector<std::string> updateChannel(const std::string& channelName, int x, int y, int width, int height, const PooledVector<float>& data);
+
+    // Applies all updates at once, such that no snapshot can be taken in between. Channels
+    // whose current data is still read via snapshots are hence copied once per batch rather
+    // than once per update (see Channel::updateTile). Returns the names of the derived
+    // channels that changed.
+    std::vector<std::string> updateChannels(const std::vector<ChannelUpdate>& updates);
+
+    // Whether the colors were converted from the primaries of the file when loading.
+    bool hasColorConversion() const {
+        return !mData.convertedChannels.empty();
+    }
+
+    bool showsRawColors() const {
+        return mShowsRawColors;
+    }
+
+    // Switches between the converted colors and the raw values of the file, which are computed
+    // through the inverse conversion. Returns the names of the channels that changed,
+    // including derived ones.
+    std::vector<std::string> setShowsRawColors(bool value);
+
+    // Images loaded afterwards gain a derived channel for each expression whose inputs they
+    // have. Derived channels are computed once their image is first pinned and kept up to
+    // date when their inputs are updated. Must be set before images are loaded.
+    static void setChannelExpressions(const std::vector<ChannelExpression>& expressions) {
+        sChannelExpressions = expressions;
+    }
+
+    // Memory held on behalf of this image, including its textures and cached statistics.
+    const std::shared_ptr<MemoryUsage>& memoryUsage() const {
+        return mMemoryUsage;
+    }
+
+    bool isDeferred() const {
+        return mIsDeferred;
+    }
+
+    // Keeps the channel data decompressed for as long as it exists. Channel data must only be
+    // accessed while the image is pinned.
+    class Pin {
+    public:
+        Pin(const Image* image) : mImage{image} {}
+        ~Pin() {
+            if (mImage) {
+                mImage->unpin();
+            }
+        }
+
+        Pin(const Pin&) = delete;
+        Pin& operator=(const Pin&) = delete;
+        Pin(Pin&& other) : mImage{other.mImage} {
+            other.mImage = nullptr;
+        }
+
+    private:
+        const Image* mImage;
+    };
+
+    // Decompresses the channel data and computes derived channels if needed. Accepts nullptr
+    // for convenience.
+    static Pin pin(const Image* image) {
+        return image ? image->pin() : Pin{nullptr};
+    }
+
+    Pin pin() const;
+
+    // Returns immutable copies of the given channels that share their data until it is next
+    // updated, such that they can be read on any thread while the image is being updated.
+    std::vector<Channel> snapshot(const std::vector<std::string>& channelNames) const;
+
+    // Like snapshot(), but resampled to `size` unless the image already has that size and then
+    // blurred by a Gaussian of standard deviation `blurSigma` pixels. Such channels are cached
+    // until the image is next updated or compressed, such that comparing against this image
+    // as a reference only filters it once.
+    std::vector<Channel> resampledSnapshot(const std::vector<std::string>& channelNames, const Eigen::Vector2i& size, EResampling resampling, float blurSigma = 0) const;
+
+    // Losslessly compresses the channel data unless the image is pinned or was pinned within
+    // the last `minIdleTime`. Returns whether the image was compressed.
+    bool compress(std::chrono::steady_clock::duration minIdleTime);
+
+    bool isCompressed() const {
+        return mIsCompressed;
+    }
+
+    // Decodes the pixels of a deferred image into a new, fully loaded image. Concurrent
+    // and repeated calls decode only once. Returns nullptr if decoding failed.
+    std::shared_ptr<Image> decode();
 
     std::string toString() const;
 
 private:
     static std::atomic<int> sId;
+    static std::vector<ChannelExpression> sChannelExpressions;
 
-    Channel* mutableChannel(const std::string& channelName) {
+    Channel* mutableChannel(const std::string& channelName) const {
         auto it = std::find_if(std::begin(mData.channels), std::end(mData.channels), [&channelName](const Channel& c) { return c.name() == channelName; });
         if (it != std::end(mData.channels)) {
             return &(*it);
@@ -122,39 +248,144 @@ private:
 
     void ensureValid();
 
+    // Adds derived channels and channel groups once the decoded channels are known.
+    void initializeChannels();
+
+    void addDerivedChannels();
+
+    // The following must only be called while holding mDataMutex.
+    // The shown channels followed by the hidden converted colors (see setShowsRawColors), all
+    // of which are compressed together and count as pixel memory.
+    std::vector<Channel*> compressibleChannels() const;
+    void decompress() const;
+    void evaluateDerivedChannels() const;
+    // Writes the values of the rectangle row by row to `result`.
+    void evaluateExpression(const ChannelExpression& expression, int x, int y, int width, int height, float* result) const;
+    std::vector<std::string> updateChannelLocked(const std::string& channelName, int x, int y, int width, int height, const PooledVector<float>& data);
+    // Evaluates the rectangle of the derived channels that depend on the updated channels
+    // again. Returns their names.
+    std::vector<std::string> updateDerivedChannels(std::vector<std::string> updatedChannels, int x, int y, int width, int height);
+    // Brings the hidden converted colors (see setShowsRawColors) of the rectangle up to date
+    // with the shown raw channel that was just updated.
+    void updateHiddenColors(const std::string& channelName, int x, int y, int width, int height);
+
+    // Like evaluateExpression above, but reads the inputs from `inputs`, which point to the
+    // full channels in the order of the expression's inputs, and hence needs no lock.
+    void evaluateExpression(const ChannelExpression& expression, const std::vector<const float*>& inputs, int x, int y, int width, int height, float* result) const;
+
+    void unpin() const;
+
     filesystem::path mPath;
     std::string mChannelSelector;
 
     std::string mName;
 
-    std::map<std::string, ImageTexture> mTextures;
-
-    ImageData mData;
+    // Compression changes the representation of the channel data, but not its contents, so
+    // even const images may decompress it. The channels themselves and their names never
+    // change once the image is constructed; only their data is replaced while holding
+    // mDataMutex. Names can hence be looked up without the lock, but data must be pinned.
+    mutable ImageData mData;
+    Eigen::Vector2i mSize;
 
     std::vector<ChannelGroup> mChannelGroups;
 
+    struct DerivedChannel {
+        ChannelExpression expression;
+        bool isEvaluated;
+    };
+
+    // In dependency order, since expressions may use derived channels that precede them.
+    mutable std::vector<DerivedChannel> mDerivedChannels;
+
+    bool mShowsRawColors = false;
+    // The converted channels while the raw ones are shown, in the order of
+    // ImageData::convertedChannels.
+    mutable std::vector<Channel> mConvertedChannels;
+
     int mId;
+
+    std::shared_ptr<MemoryUsage> mMemoryUsage = std::make_shared<MemoryUsage>();
+    mutable MemoryAllocation mPixelMemory;
+
+    struct ResampledChannel {
+        Channel channel;
+        MemoryAllocation memory;
+    };
+
+    // Guards compression, snapshots, and updates of the channel data as well as the resampled
+    // channels, which are keyed by channel name, size, resampling, and blur.
+    mutable std::mutex mDataMutex;
+    mutable std::map<std::string, ResampledChannel> mResampledChannels;
+    // Incremented by updates and compression, such that channels resampled, compressed, or
+    // decompressed meanwhile are discarded.
+    mutable size_t mDataVersion = 0;
+    mutable int mNumPins = 0;
+    mutable std::chrono::steady_clock::time_point mLastPinned = std::chrono::steady_clock::now();
+    mutable std::atomic<bool> mIsCompressed{false};
+
+    bool mIsDeferred = false;
+    std::mutex mDecodeMutex;
+    bool mWasDecoded = false;
+    std::shared_ptr<Image> mDecoded;
 };
 
-std::shared_ptr<Image> tryLoadImage(filesystem::path path, std::istream& iStream, std::string channelSelector);
+std::shared_ptr<Image> tryLoadImage(filesystem::path path, std::istream& iStream, std::string channelSelector, std::string sharedCacheKey = "");
+// Maps the pixels of images that another tev instance decoded already if SharedImageCache is enabled.
 std::shared_ptr<Image> tryLoadImage(filesystem::path path, std::string channelSelector);
+// Decodes the bytes of an encoded file, e.g. received over IPC, without writing them to disk.
+// `path` names the image and its extension helps to recognize formats without a magic number.
+std::shared_ptr<Image> tryLoadImage(filesystem::path path, std::vector<char> data, std::string channelSelector);
+
+// Returns a deferred image if the header of the file can be read on its own, and nullptr otherwise.
+std::shared_ptr<Image> tryLoadImageHeader(filesystem::path path, std::string channelSelector);
+
+// Expands directories, zip archives, and glob patterns such as `renders/**/*.exr` into the
+// image files they contain, sorted by path. Any other path is returned as-is.
+std::vector<filesystem::path> resolveImagePaths(const std::string& pathOrPattern);
 
 struct ImageAddition {
     bool shallSelect;
     std::shared_ptr<Image> image;
+    // Set if the image is the first frame of a sequence.
+    std::shared_ptr<ImageSequence> sequence;
+    // Set if the image is the decoded version of a deferred image. The image is nullptr if
+    // decoding failed.
+    std::shared_ptr<Image> deferredImage;
 };
 
 class BackgroundImagesLoader {
 public:
+    // The callback is invoked from a worker thread whenever new images can be popped.
+    BackgroundImagesLoader(std::function<void()> imagesLoadedCallback = {}) : mImagesLoadedCallback{imagesLoadedCallback} {}
+
     void enqueue(const filesystem::path& path, const std::string& channelSelector, bool shallSelect);
+    void enqueueDecode(const std::shared_ptr<Image>& deferredImage);
+    void enqueueData(const std::string& name, std::vector<char> data, const std::string& channelSelector, bool shallSelect);
+    // Streams `numImages` images from `loadImage` through a per-pixel statistics accumulator
+    // and adds the resulting image once done. See computeTemporalStatistics().
+    void enqueueTemporalStatistics(const std::string& name, size_t numImages, std::function<std::shared_ptr<Image>(size_t)> loadImage);
     ImageAddition tryPop() { return mLoadedImages.tryPop(); }
+    size_t numQueuedImages() const { return mLoadedImages.size(); }
 
 private:
+    void notifyImagesLoaded() {
+        if (mImagesLoadedCallback) {
+            mImagesLoadedCallback();
+        }
+    }
+
+    // Populates the images with their headers only and defers decoding their pixels.
+    void loadDeferred(const std::vector<filesystem::path>& paths, const filesystem::path& origin, const std::string& channelSelector, bool shallSelect);
+
+    std::function<void()> mImagesLoadedCallback;
+
     // A single worker is enough, since parallelization will happen _within_ each image load.
     // We want to focus all resources to load images in order as fast as possible, rather than
     // our of order.
     ThreadPool mWorkers{1};
     SharedQueue<ImageAddition> mLoadedImages;
+    // Declared last, such that it is shut down while the above can still take its results.
+    ThreadPool mStatisticsWorkers{1};
 };
 
 TEV_NAMESPACE_END
@@ -25,6 +25,8 @@ public:
         return mCaption;
     }
 
+    void setCaption(const std::string& caption);
+
     void setReferenceCallback(const std::function<void(bool)> &callback) {
         mReferenceCallback = callback;
     }
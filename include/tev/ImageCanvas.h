@@ -5,20 +5,34 @@
 
 #include <tev/UberShader.h>
 #include <tev/Image.h>
+#include <tev/ImageProcessing.h>
 #include <tev/Lazy.h>
 
 #include <nanogui/canvas.h>
+#include <nanogui/texture.h>
 
+#include <chrono>
+#include <map>
 #include <memory>
+#include <vector>
 
 TEV_NAMESPACE_BEGIN
 
-struct CanvasStatistics {
-    float mean;
-    float maximum;
-    float minimum;
-    Eigen::MatrixXf histogram;
-    int histogramZero;
+// Pipeline state that only the viewer knows about, shown in the performance HUD.
+struct HudInfo {
+    // Time spent running the tasks that were scheduled to the UI thread.
+    float taskSeconds = 0;
+    size_t numQueuedTasks = 0;
+    size_t numQueuedImages = 0;
+};
+
+struct ImageTexture {
+    nanogui::ref<nanogui::Texture> nanoguiTexture;
+    std::vector<std::string> channels;
+    bool mipmapDirty;
+    MemoryAllocation memory;
+    // Filtered or resampled for comparing, such that tiles of the image do not map onto it.
+    bool isFiltered;
 };
 
 class ImageCanvas : public nanogui::Canvas {
@@ -80,9 +94,8 @@ public:
         mTonemap = tonemap;
     }
 
-    static Eigen::Vector3f applyTonemap(const Eigen::Vector3f& value, float gamma, ETonemap tonemap);
     Eigen::Vector3f applyTonemap(const Eigen::Vector3f& value) const {
-        return applyTonemap(value, mGamma, mTonemap);
+        return tev::applyTonemap(value, mGamma, mTonemap);
     }
 
     EMetric metric() const {
@@ -93,9 +106,16 @@ public:
         mMetric = metric;
     }
 
-    static float applyMetric(float value, float reference, EMetric metric);
     float applyMetric(float value, float reference) const {
-        return applyMetric(value, reference, mMetric);
+        return tev::applyMetric(value, reference, mMetric);
+    }
+
+    const ComparisonFilter& comparisonFilter() const {
+        return mComparisonFilter;
+    }
+
+    void setComparisonFilter(const ComparisonFilter& filter) {
+        mComparisonFilter = filter;
     }
 
     const nanogui::Color& backgroundColor() {
@@ -117,13 +137,31 @@ public:
         return mClipToLdr;
     }
 
-    std::vector<float> getHdrImageData(bool divideAlpha) const;
-    std::vector<char> getLdrImageData(bool divideAlpha) const;
+    PooledVector<float> getHdrImageData(bool divideAlpha) const {
+        return tev::getHdrImageData(mImage, mReference, mRequestedChannelGroup, mMetric, mComparisonFilter, divideAlpha);
+    }
+
+    PooledVector<char> getLdrImageData(bool divideAlpha) const {
+        return tev::getLdrImageData(mImage, mReference, mRequestedChannelGroup, mMetric, mComparisonFilter, divideAlpha, {mExposure, mOffset, mGamma, mTonemap});
+    }
 
     void saveImage(const filesystem::path& filename) const;
 
     std::shared_ptr<Lazy<std::shared_ptr<CanvasStatistics>>> canvasStatistics();
 
+    // Uploads a changed region of the channel to all textures that display it.
+    void updateTextures(const Image& image, const std::string& channelName, int x, int y, int width, int height);
+
+    bool isHudVisible() const {
+        return mHudVisible;
+    }
+
+    void setHudVisible(bool value);
+
+    void setHudInfo(const HudInfo& info) {
+        mHudInfo = info;
+    }
+
     static nanogui::Matrix3f toNanogui(const Eigen::Matrix3f& transform) {
         nanogui::Matrix3f result;
         for (int m = 0; m < 3; ++m) {
@@ -135,22 +173,25 @@ public:
     }
 
 private:
-    static std::vector<Channel> channelsFromImages(
-        std::shared_ptr<Image> image,
-        std::shared_ptr<Image> reference,
-        const std::string& requestedChannelGroup,
-        EMetric metric
-    );
-
-    static std::shared_ptr<CanvasStatistics> computeCanvasStatistics(
-        std::shared_ptr<Image> image,
-        std::shared_ptr<Image> reference,
-        const std::string& requestedChannelGroup,
-        EMetric metric
-    );
+    static nanogui::Color channelColor(std::string channel);
+
+    nanogui::Texture* texture(const std::shared_ptr<Image>& image, const std::string& channelGroupName);
+    nanogui::Texture* texture(const std::shared_ptr<Image>& image, const std::vector<std::string>& channelNames);
+
+    // Whether the image and the reference are compared via filtered channels rather than their
+    // own, i.e. if the comparison is filtered or the reference has a different resolution.
+    bool isComparisonFiltered() const;
+    // The texture of the channels of the image or the reference as they enter the comparison.
+    nanogui::Texture* filteredTexture(const std::shared_ptr<Image>& image, const std::vector<std::string>& channelNames);
+
+    // Releases the textures of images that no longer exist.
+    void pruneTextures();
 
     Eigen::Vector2f pixelOffset(const Eigen::Vector2i& size) const;
 
+    void recordFrame(float drawSeconds);
+    void drawHud(NVGcontext* ctx);
+
     // Assembles the transform from canonical space to
     // the [-1, 1] square for the current image.
     Eigen::Transform<float, 2, 2> transform(const Image* image);
@@ -174,6 +215,32 @@ private:
 
     ETonemap mTonemap = SRGB;
     EMetric mMetric = Error;
+    ComparisonFilter mComparisonFilter;
+
+    // Textures are owned by the canvas rather than by the images, such that images remain
+    // free of OpenGL state and are always released on the main thread.
+    struct ImageTextures {
+        std::weak_ptr<Image> image;
+        std::map<std::string, ImageTexture> textures;
+    };
+    std::map<const Image*, ImageTextures> mTextures;
+
+    bool mHudVisible = false;
+    HudInfo mHudInfo;
+
+    // Ring buffers over the most recent frames. Unlike the performance counters, they are
+    // only ever touched by the main thread.
+    static const size_t NUM_HUD_FRAMES = 240;
+    std::vector<float> mFrameSeconds;
+    std::vector<float> mDrawSeconds;
+    std::vector<size_t> mFrameUploadedBytes;
+    size_t mNumFrames = 0;
+    std::chrono::steady_clock::time_point mLastFrame;
+    size_t mLastUploadedBytes = 0;
+
+    std::chrono::steady_clock::time_point mLastIpcSample;
+    size_t mLastIpcPackets = 0;
+    float mIpcPacketsPerSecond = 0;
 
     std::map<std::string, std::shared_ptr<Lazy<std::shared_ptr<CanvasStatistics>>>> mMeanValues;
     // A custom threadpool is used to ensure progress
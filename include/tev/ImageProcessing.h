@@ -0,0 +1,133 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the BSD 3-Clause License within the LICENSE file.
+
+#pragma once
+
+#include <tev/BufferPool.h>
+#include <tev/Channel.h>
+#include <tev/Common.h>
+#include <tev/Image.h>
+#include <tev/MemoryUsage.h>
+
+#include <Eigen/Dense>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+TEV_NAMESPACE_BEGIN
+
+struct CanvasStatistics {
+    float mean;
+    float maximum;
+    float minimum;
+    Eigen::MatrixXf histogram;
+    int histogramZero;
+
+    // Accounted to the image the statistics were computed of.
+    MemoryAllocation memory;
+};
+
+// Settings which map HDR values to displayable LDR values, mirroring what the GUI shows.
+struct DisplaySettings {
+    float exposure = 0;
+    float offset = 0;
+    float gamma = 2.2f;
+    ETonemap tonemap = SRGB;
+};
+
+// How the image and the reference are prepared before comparing them. Blurring or downsampling
+// both keeps the comparison of noisy renders from being dominated by the noise.
+struct ComparisonFilter {
+    // Brings a reference of a different resolution onto the pixel grid of the image.
+    EResampling resampling = Bilinear;
+    // Standard deviation of a Gaussian blur in pixels of the image. 0 disables blurring.
+    float blurSigma = 0;
+    // Averages blocks of `downsampling` x `downsampling` pixels. 1 disables downsampling.
+    int downsampling = 1;
+
+    bool isActive() const {
+        return blurSigma > 0 || downsampling > 1;
+    }
+
+    // The resolution at which an image of the given size is compared.
+    Eigen::Vector2i comparisonSize(const Eigen::Vector2i& size) const {
+        return (size / std::max(downsampling, 1)).cwiseMax(Eigen::Vector2i::Ones());
+    }
+};
+
+float applyExposureAndOffset(float value, float exposure, float offset);
+Eigen::Vector3f applyTonemap(const Eigen::Vector3f& value, float gamma, ETonemap tonemap);
+float applyMetric(float value, float reference, EMetric metric);
+
+// Flattens the channels of the requested channel group of `image` into a list of channels.
+// If a reference is given, the channels contain the error with respect to it instead, which
+// is computed after applying `filter` and thus at its comparison size.
+std::vector<Channel> channelsFromImages(
+    std::shared_ptr<Image> image,
+    std::shared_ptr<Image> reference,
+    const std::string& requestedChannelGroup,
+    EMetric metric,
+    const ComparisonFilter& filter
+);
+
+// Returns the channels of an image as they enter a comparison against an image of size
+// `imageSize` in which it is the image itself or the reference, i.e. resampled to the comparison
+// size and filtered.
+std::vector<Channel> filteredChannels(
+    const Image& image,
+    const std::vector<std::string>& channelNames,
+    const Eigen::Vector2i& imageSize,
+    const ComparisonFilter& filter
+);
+
+// The histogram is only needed for display and can be skipped by headless callers.
+std::shared_ptr<CanvasStatistics> computeCanvasStatistics(
+    std::shared_ptr<Image> image,
+    std::shared_ptr<Image> reference,
+    const std::string& requestedChannelGroup,
+    EMetric metric,
+    const ComparisonFilter& filter,
+    bool computeHistogram = true
+);
+
+// Like computeCanvasStatistics without a histogram, but for every metric, indexed by EMetric.
+// The image and the reference are read and filtered only once for all of them. `image` must
+// not be null.
+std::vector<std::shared_ptr<CanvasStatistics>> computeMetricStatistics(
+    std::shared_ptr<Image> image,
+    std::shared_ptr<Image> reference,
+    const std::string& requestedChannelGroup,
+    const ComparisonFilter& filter
+);
+
+// Interleaves up to four channels of `image` into RGBA data as it is uploaded to the GPU.
+// Missing color channels are filled with 0 and a missing alpha channel with 1.
+PooledVector<float> getTextureData(const Image& image, const std::vector<std::string>& channelNames);
+// Like the above, but interleaves already obtained channels, e.g. a resampled reference.
+PooledVector<float> getTextureData(const std::vector<Channel>& channels, const Eigen::Vector2i& size);
+
+// Returns interleaved RGBA data of the requested channel group. Errors that were computed at a
+// lower resolution are brought back onto the pixels of the image.
+PooledVector<float> getHdrImageData(
+    std::shared_ptr<Image> image,
+    std::shared_ptr<Image> reference,
+    const std::string& requestedChannelGroup,
+    EMetric metric,
+    const ComparisonFilter& filter,
+    bool divideAlpha
+);
+
+// Like getHdrImageData, but exposed and tonemapped to 8 bits per channel.
+PooledVector<char> getLdrImageData(
+    std::shared_ptr<Image> image,
+    std::shared_ptr<Image> reference,
+    const std::string& requestedChannelGroup,
+    EMetric metric,
+    const ComparisonFilter& filter,
+    bool divideAlpha,
+    const DisplaySettings& displaySettings
+);
+
+TEV_NAMESPACE_END
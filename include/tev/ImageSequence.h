@@ -0,0 +1,112 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the BSD 3-Clause License within the LICENSE file.
+
+#pragma once
+
+#include <tev/Image.h>
+#include <tev/ThreadPool.h>
+
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+TEV_NAMESPACE_BEGIN
+
+// A sequence of image files that is described by a single frame pattern, e.g.
+// `render.####.exr`, `render.%04d.exr`, or `render.####.exr@1-100x2`. Rather than
+// keeping all frames in memory, frames are decoded on demand within a memory window
+// around the playhead and prefetched in the direction of playback.
+class ImageSequence {
+public:
+    ImageSequence(const std::string& pattern, const std::vector<filesystem::path>& framePaths, const std::string& channelSelector);
+    ~ImageSequence();
+
+    static bool isPattern(const std::string& str);
+
+    // Returns the paths of all existing frames matching the pattern in ascending frame order.
+    static std::vector<filesystem::path> expandPattern(const std::string& pattern);
+
+    const std::string& pattern() const {
+        return mPattern;
+    }
+
+    const std::string& channelSelector() const {
+        return mChannelSelector;
+    }
+
+    size_t numFrames() const {
+        return mFramePaths.size();
+    }
+
+    const filesystem::path& framePath(size_t index) const {
+        return mFramePaths.at(index);
+    }
+
+    // Returns the index of the given frame within this sequence or -1 if it does not belong to it.
+    int frameIndex(const std::shared_ptr<Image>& frame) const;
+
+    size_t nextFrame(size_t index, EDirection direction) const;
+
+    bool hasFailed(size_t index) const;
+
+    // Moves the playhead to the given frame and schedules the frames ahead of it for decoding.
+    // Returns the frame if it was already decoded and nullptr otherwise.
+    std::shared_ptr<Image> frame(size_t index, EDirection direction);
+
+    // Like frame(), but blocks until the frame was decoded. Returns nullptr if decoding failed.
+    std::shared_ptr<Image> waitForFrame(size_t index, EDirection direction);
+
+    // Drops all decoded frames such that they will be read from disk again.
+    void clear();
+
+    // Invoked from a worker thread whenever a frame was decoded or failed to decode, such
+    // that frames requested via frame() can be shown once they are ready.
+    void setFrameDecodedCallback(std::function<void()> callback);
+
+    size_t memoryBudget() const {
+        return mMemoryBudget;
+    }
+
+    void setMemoryBudget(size_t bytes);
+
+private:
+    void movePlayhead(size_t index, EDirection direction);
+    void windowExtent(size_t& ahead, size_t& behind) const;
+    bool isInWindow(size_t index) const;
+    void enqueueDecode(size_t index);
+
+    std::string mPattern;
+    std::vector<filesystem::path> mFramePaths;
+    std::string mChannelSelector;
+
+    mutable std::mutex mMutex;
+    std::condition_variable mFrameDecoded;
+    std::function<void()> mFrameDecodedCallback;
+
+    std::map<size_t, std::shared_ptr<Image>> mFrames;
+    std::map<std::string, size_t> mIndicesByPath;
+    std::set<size_t> mPending;
+    std::set<size_t> mFailed;
+
+    size_t mPlayhead = 0;
+    EDirection mDirection = Forward;
+
+    size_t mMemoryBudget = (size_t)2 * 1024 * 1024 * 1024;
+    size_t mBytesPerFrame = 0;
+
+    // Incremented by clear() to invalidate frames that are being decoded.
+    size_t mGeneration = 0;
+
+    // Like in BackgroundImagesLoader, a single worker suffices since each frame
+    // is decoded in parallel internally.
+    ThreadPool mWorkers{1};
+};
+
+std::shared_ptr<ImageSequence> tryLoadImageSequence(const std::string& pattern, const std::string& channelSelector);
+
+TEV_NAMESPACE_END
@@ -7,15 +7,20 @@
 #include <tev/Image.h>
 #include <tev/ImageButton.h>
 #include <tev/ImageCanvas.h>
+#include <tev/ImageSequence.h>
 #include <tev/Lazy.h>
+#include <tev/MemoryWindow.h>
 #include <tev/MultiGraph.h>
 #include <tev/SharedQueue.h>
+#include <tev/ThreadPool.h>
 
 #include <nanogui/opengl.h>
 #include <nanogui/screen.h>
 #include <nanogui/slider.h>
 #include <nanogui/textbox.h>
 
+#include <chrono>
+#include <map>
 #include <memory>
 #include <set>
 #include <vector>
@@ -63,7 +68,7 @@ public:
         const std::string& channel,
         int x, int y,
         int width, int height,
-        const std::vector<float>& imageData
+        const PooledVector<float>& imageData
     );
 
     void selectImage(const std::shared_ptr<Image>& image, bool stopPlayback = true);
@@ -91,6 +96,12 @@ public:
     void setGamma(float value);
 
     void normalizeExposureAndOffset();
+    // Switches the current image between colors converted from the primaries of its file
+    // and the raw values of the file.
+    void toggleRawColors();
+    // Adds an image holding the per-pixel mean, variance, standard error, minimum, and maximum
+    // across the frames of the current sequence or, otherwise, across all visible images.
+    void computeTemporalStatistics();
     void resetImage();
 
     ETonemap tonemap() {
@@ -105,6 +116,18 @@ public:
 
     void setMetric(EMetric metric);
 
+    const ComparisonFilter& comparisonFilter() {
+        return mImageCanvas->comparisonFilter();
+    }
+
+    void setComparisonFilter(const ComparisonFilter& filter);
+
+    // Images other than the current one and the reference are compressed in memory once
+    // they have not been used for `seconds`. Non-positive values disable compression.
+    void setIdleCompressionDelay(float seconds) {
+        mIdleCompressionDelay = seconds;
+    }
+
     nanogui::Vector2i sizeToFitImage(const std::shared_ptr<Image>& image);
     nanogui::Vector2i sizeToFitAllImages();
     bool setFilter(const std::string& filter);
@@ -122,6 +145,7 @@ public:
     void setUiVisible(bool shouldBeVisible);
 
     void toggleHelpWindow();
+    void toggleMemoryWindow();
 
     void openImageDialog();
     void saveImageDialog();
@@ -149,6 +173,30 @@ private:
     std::string nthVisibleGroup(size_t n);
 
     std::shared_ptr<Image> nextImage(const std::shared_ptr<Image>& image, EDirection direction);
+    std::shared_ptr<ImageSequence> imageSequence(const std::shared_ptr<Image>& image) const;
+
+    // Swaps out an image in-place, retaining its position in the list as well as its selection state.
+    void replaceImage(std::shared_ptr<Image> image, std::shared_ptr<Image> newImage);
+
+    void updateImage(
+        const std::shared_ptr<Image>& image,
+        bool shallSelect,
+        const std::string& channel,
+        int x, int y,
+        int width, int height,
+        const PooledVector<float>& imageData
+    );
+
+    // Moves the current image to the next frame of its sequence once that frame was decoded,
+    // such that the interface remains responsive meanwhile. During playback, a frame that is
+    // still being decoded is held rather than skipped, whereas manual steps continue from
+    // the requested frame. Returns false if the current image is not part of a sequence.
+    bool stepSequence(EDirection direction, bool isPlayback);
+
+    // Shows the given frame of the sequence in place of its current frame once it was decoded.
+    void requestFrame(const std::shared_ptr<ImageSequence>& sequence, size_t index, EDirection direction);
+    // Shows the requested frames that were decoded meanwhile.
+    void updateRequestedFrames();
     std::shared_ptr<Image> nthVisibleImage(size_t n);
     std::shared_ptr<Image> imageByName(const std::string& imageName);
 
@@ -193,9 +241,35 @@ private:
 
     std::shared_ptr<Image> mCurrentImage;
     std::shared_ptr<Image> mCurrentReference;
+    // Deferred images that become the current image or reference once they were decoded in
+    // the background.
+    std::shared_ptr<Image> mPendingImage;
+    std::shared_ptr<Image> mPendingReference;
 
     std::vector<std::shared_ptr<Image>> mImages;
 
+    // Sequences are represented by their currently shown frame within mImages.
+    std::map<std::shared_ptr<Image>, std::shared_ptr<ImageSequence>> mImageSequences;
+
+    struct RequestedFrame {
+        size_t index;
+        EDirection direction;
+    };
+
+    // Frames that replace the current frame of their sequence once they were decoded.
+    std::map<std::shared_ptr<ImageSequence>, RequestedFrame> mRequestedFrames;
+
+    struct PendingUpdate {
+        bool shallSelect;
+        std::string channel;
+        int x, y, width, height;
+        PooledVector<float> data;
+    };
+
+    // Updates of deferred images, which are applied in order once the images were decoded in
+    // the background.
+    std::map<std::shared_ptr<Image>, std::vector<PendingUpdate>> mPendingUpdates;
+
     MultiGraph* mHistogram;
     std::set<std::shared_ptr<Image>> mToBump;
 
@@ -224,6 +298,13 @@ private:
 
     HelpWindow* mHelpWindow = nullptr;
 
+    MemoryWindow* mMemoryWindow = nullptr;
+    std::chrono::steady_clock::time_point mLastMemoryWindowUpdate;
+
+    float mIdleCompressionDelay = 0;
+    std::chrono::steady_clock::time_point mLastIdleCompression;
+    ThreadPool mCompressionWorker{1};
+
     bool mIsDraggingSidebar = false;
     bool mIsDraggingImage = false;
     bool mIsDraggingImageButton = false;
@@ -3,10 +3,12 @@
 
 #pragma once
 
+#include <tev/BufferPool.h>
 #include <tev/Common.h>
 
 #include <filesystem/path.h>
 
+#include <algorithm>
 #include <list>
 #include <vector>
 
@@ -18,6 +20,15 @@ struct IpcPacketOpenImage {
     bool grabFocus;
 };
 
+// Opens an image from the bytes of an encoded file, e.g. an EXR or PNG, rather than from a
+// path. The name takes the place of the path, so its extension may help to recognize the format.
+struct IpcPacketOpenImageData {
+    std::string imageName;
+    std::string channelSelector;
+    bool grabFocus;
+    std::vector<char> imageData;
+};
+
 struct IpcPacketReloadImage {
     std::string imageName;
     bool grabFocus;
@@ -31,7 +42,7 @@ struct IpcPacketUpdateImage {
     std::vector<int64_t> channelOffsets;
     std::vector<int64_t> channelStrides;
     int32_t x, y, width, height;
-    std::vector<std::vector<float>> imageData; // One set of data per channel
+    std::vector<PooledVector<float>> imageData; // One set of data per channel
 };
 
 struct IpcPacketCloseImage {
@@ -46,6 +57,33 @@ struct IpcPacketCreateImage {
     std::vector<std::string> channelNames;
 };
 
+// Requests the statistics of an image, or of its error with respect to a reference if one
+// is given. An empty channel group stands for all channel groups.
+struct IpcPacketComputeStatistics {
+    std::string imageName;
+    std::string referenceName;
+    std::string channelGroup;
+    std::string metric;
+};
+
+// Requests saving an image to a path on the machine tev is running on.
+struct IpcPacketExportImage {
+    std::string imageName;
+    std::string referenceName;
+    std::string channelGroup;
+    std::string metric;
+    std::string path;
+    float exposure, offset, gamma;
+    std::string tonemap;
+};
+
+// Answers a query. On success, the message contains the result as JSON and otherwise
+// a description of the error.
+struct IpcPacketReply {
+    bool success;
+    std::string message;
+};
+
 class IpcPacket {
 public:
     enum Type : char {
@@ -57,6 +95,13 @@ public:
         UpdateImageV2 = 5, // Adds multi-channel support
         UpdateImageV3 = 6, // Adds custom striding/offset support
         OpenImageV2 = 7, // Explicit separation of image name and channel selector
+        // Queries, which are only answered by headless instances. Each is answered by exactly
+        // one Reply, and replies to the queries of a client arrive in the order of the queries.
+        QueryImages = 8,
+        ComputeStatistics = 9,
+        ExportImage = 10,
+        Reply = 11,
+        OpenImageData = 12,
     };
 
     IpcPacket() = default;
@@ -82,16 +127,25 @@ public:
     };
 
     void setOpenImage(const std::string& imagePath, const std::string& channelSelector, bool grabFocus);
+    void setOpenImageData(const std::string& imageName, const std::string& channelSelector, bool grabFocus, const char* data, size_t size);
     void setReloadImage(const std::string& imageName, bool grabFocus);
     void setCloseImage(const std::string& imageName);
-    void setUpdateImage(const std::string& imageName, bool grabFocus, const std::vector<ChannelDesc>& channelDescs, int32_t x, int32_t y, int32_t width, int32_t height, const std::vector<float>& stridedImageData);
+    void setUpdateImage(const std::string& imageName, bool grabFocus, const std::vector<ChannelDesc>& channelDescs, int32_t x, int32_t y, int32_t width, int32_t height, const PooledVector<float>& stridedImageData);
     void setCreateImage(const std::string& imageName, bool grabFocus, int32_t width, int32_t height, int32_t nChannels, const std::vector<std::string>& channelNames);
+    void setQueryImages();
+    void setComputeStatistics(const std::string& imageName, const std::string& referenceName, const std::string& channelGroup, const std::string& metric);
+    void setExportImage(const IpcPacketExportImage& info);
+    void setReply(bool success, const std::string& message);
 
     IpcPacketOpenImage interpretAsOpenImage() const;
+    IpcPacketOpenImageData interpretAsOpenImageData() const;
     IpcPacketReloadImage interpretAsReloadImage() const;
     IpcPacketCloseImage interpretAsCloseImage() const;
     IpcPacketUpdateImage interpretAsUpdateImage() const;
     IpcPacketCreateImage interpretAsCreateImage() const;
+    IpcPacketComputeStatistics interpretAsComputeStatistics() const;
+    IpcPacketExportImage interpretAsExportImage() const;
+    IpcPacketReply interpretAsReply() const;
 
 private:
     std::vector<char> mPayload;
@@ -129,8 +183,18 @@ private:
             return *this;
         }
 
-        template <typename T>
-        IStream& operator>>(std::vector<T>& var) {
+        IStream& read(char* data, size_t size) {
+            if (mData.size() < mIdx + size) {
+                throw std::runtime_error{"Trying to read bytes beyond the bounds of the IPC packet payload."};
+            }
+
+            std::copy_n(&mData[mIdx], size, data);
+            mIdx += size;
+            return *this;
+        }
+
+        template <typename T, typename Allocator>
+        IStream& operator>>(std::vector<T, Allocator>& var) {
             for (auto& elem : var) {
                 *this >> elem;
             }
@@ -160,8 +224,8 @@ private:
             *this << (uint32_t)0;
         }
 
-        template <typename T>
-        OStream& operator<<(const std::vector<T>& var) {
+        template <typename T, typename Allocator>
+        OStream& operator<<(const std::vector<T, Allocator>& var) {
             for (auto&& elem : var) {
                 *this << elem;
             }
@@ -176,6 +240,17 @@ private:
             return *this;
         }
 
+        OStream& write(const char* data, size_t size) {
+            if (mData.size() < mIdx + size) {
+                mData.resize(mIdx + size);
+            }
+
+            std::copy_n(data, size, &mData[mIdx]);
+            mIdx += size;
+            updateSize();
+            return *this;
+        }
+
         OStream& operator<<(bool var) {
             if (mData.size() < mIdx + 1) {
                 mData.resize(mIdx + 1);
@@ -224,7 +299,13 @@ public:
     }
 
     void sendToPrimaryInstance(const IpcPacket& message);
-    void receiveFromSecondaryInstance(std::function<void(const IpcPacket&)> callback);
+
+    // The callback additionally receives the ID of the sending client, such that replies
+    // can be sent back to it via `sendToSecondaryInstance`.
+    void receiveFromSecondaryInstance(std::function<void(const IpcPacket&, int)> callback);
+
+    // Replies to the client with the given ID. Does nothing if the client disconnected.
+    void sendToSecondaryInstance(int clientId, const IpcPacket& message);
 
 private:
     bool mIsPrimaryInstance;
@@ -239,16 +320,26 @@ private:
 
     class SocketConnection {
     public:
-        SocketConnection(Ipc::socket_t fd);
+        SocketConnection(Ipc::socket_t fd, int id);
 
-        void service(std::function<void(const IpcPacket&)> callback);
+        void service(std::function<void(const IpcPacket&, int)> callback);
+
+        // Queues the message and sends as much of the queue as the socket accepts without
+        // blocking. The remainder is sent by later calls to `flush`.
+        void send(const IpcPacket& message);
+        void flush();
 
         void close();
 
         bool isClosed() const;
 
+        int id() const {
+            return mId;
+        }
+
     private:
         Ipc::socket_t mSocketFd;
+        int mId;
 
         // Because TCP socket recv() calls return as much data as is available
         // (which may have the partial contents of a client-side send() call,
@@ -256,9 +347,14 @@ private:
         std::vector<char> mBuffer;
         // Offset into buffer where next recv() call should start writing.
         size_t mRecvOffset = 0;
+
+        // Replies that the client did not read yet. Bytes before `mSendOffset` were sent already.
+        std::vector<char> mSendBuffer;
+        size_t mSendOffset = 0;
     };
 
     std::list<SocketConnection> mSocketConnections;
+    int mNextClientId = 0;
 };
 
 TEV_NAMESPACE_END
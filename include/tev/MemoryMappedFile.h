@@ -0,0 +1,53 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the BSD 3-Clause License within the LICENSE file.
+
+#pragma once
+
+#include <tev/Common.h>
+
+#include <istream>
+#include <vector>
+
+TEV_NAMESPACE_BEGIN
+
+// Read-only view of all bytes of an image. If the stream refers to a file on disk,
+// the file is memory-mapped, such that loaders can decode straight out of the page
+// cache without first copying the whole file. The bytes of a MemoryStream are used in
+// place. Other streams (e.g. images arriving through the clipboard or IPC) are read into
+// an owned buffer instead.
+class MemoryMappedFile {
+public:
+    MemoryMappedFile(std::istream& iStream, const filesystem::path& path);
+    ~MemoryMappedFile();
+
+    MemoryMappedFile(const MemoryMappedFile&) = delete;
+    MemoryMappedFile& operator=(const MemoryMappedFile&) = delete;
+
+    const char* data() const {
+        return mData;
+    }
+
+    size_t size() const {
+        return mSize;
+    }
+
+    bool isMapped() const {
+        return mIsMapped;
+    }
+
+private:
+    bool tryMap(const filesystem::path& path);
+
+    const char* mData = nullptr;
+    size_t mSize = 0;
+    bool mIsMapped = false;
+
+#ifdef _WIN32
+    HANDLE mFileHandle = INVALID_HANDLE_VALUE;
+    HANDLE mMappingHandle = nullptr;
+#endif
+
+    std::vector<char> mBuffer;
+};
+
+TEV_NAMESPACE_END
@@ -0,0 +1,59 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the BSD 3-Clause License within the LICENSE file.
+
+#pragma once
+
+#include <tev/Common.h>
+
+#include <istream>
+#include <streambuf>
+#include <vector>
+
+TEV_NAMESPACE_BEGIN
+
+// Seekable input stream over bytes that already reside in memory, e.g. decompressed files.
+// Loaders that need all bytes at once (see MemoryMappedFile) read them straight from the
+// buffer rather than through the stream.
+class MemoryStream : public std::istream {
+public:
+    // Streams that hold only the beginning of a file, e.g. to read its header, are not complete.
+    MemoryStream(std::vector<char> data, bool isComplete = true) : std::istream{&mBuffer}, mBuffer{std::move(data)}, mIsComplete{isComplete} {}
+
+    const char* data() const {
+        return mBuffer.data();
+    }
+
+    size_t size() const {
+        return mBuffer.size();
+    }
+
+    bool isComplete() const {
+        return mIsComplete;
+    }
+
+private:
+    class Buffer : public std::streambuf {
+    public:
+        Buffer(std::vector<char> data);
+
+        const char* data() const {
+            return mData.data();
+        }
+
+        size_t size() const {
+            return mData.size();
+        }
+
+    protected:
+        pos_type seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode mode) override;
+        pos_type seekpos(pos_type position, std::ios_base::openmode mode) override;
+
+    private:
+        std::vector<char> mData;
+    };
+
+    Buffer mBuffer;
+    bool mIsComplete;
+};
+
+TEV_NAMESPACE_END
@@ -0,0 +1,97 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the BSD 3-Clause License within the LICENSE file.
+
+#pragma once
+
+#include <tev/Common.h>
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <string>
+
+TEV_NAMESPACE_BEGIN
+
+enum EMemoryCategory : int {
+    // Decoded channel data of images.
+    PixelMemory = 0,
+    // GPU textures including their mipmaps.
+    TextureMemory,
+    // Cached statistics and histograms.
+    StatisticsMemory,
+    // Temporary buffers, e.g. for flattening channels or staging texture uploads.
+    BufferMemory,
+
+    // This enum value should never be used directly.
+    // It facilitates looping over all members of this enum.
+    NumMemoryCategories,
+};
+
+std::string memoryCategoryName(EMemoryCategory category);
+
+// Formats a number of bytes in human-readable units, e.g. "1.5 GiB".
+std::string toMemoryString(size_t bytes);
+
+// Bytes in use per category along with their high-water marks. All counters are atomic,
+// such that memory can be accounted from any thread without locking.
+class MemoryUsage {
+public:
+    // Usage of the whole process, which includes the usage of all images.
+    static MemoryUsage& global();
+
+    void add(EMemoryCategory category, size_t bytes);
+    void remove(EMemoryCategory category, size_t bytes);
+
+    size_t bytes(EMemoryCategory category) const {
+        return mBytes[category];
+    }
+
+    size_t peakBytes(EMemoryCategory category) const {
+        return mPeakBytes[category];
+    }
+
+    size_t totalBytes() const {
+        return mTotalBytes;
+    }
+
+    size_t peakTotalBytes() const {
+        return mPeakTotalBytes;
+    }
+
+private:
+    std::array<std::atomic<size_t>, NumMemoryCategories> mBytes = {};
+    std::array<std::atomic<size_t>, NumMemoryCategories> mPeakBytes = {};
+    std::atomic<size_t> mTotalBytes{0};
+    std::atomic<size_t> mPeakTotalBytes{0};
+};
+
+// Accounts bytes to the usage of an image as well as to the global usage for as long as it
+// exists. It keeps the usage of the image alive, since e.g. textures may outlive their image.
+class MemoryAllocation {
+public:
+    MemoryAllocation() = default;
+    MemoryAllocation(std::shared_ptr<MemoryUsage> usage, EMemoryCategory category, size_t bytes);
+    ~MemoryAllocation();
+
+    MemoryAllocation(const MemoryAllocation&) = delete;
+    MemoryAllocation& operator=(const MemoryAllocation&) = delete;
+
+    MemoryAllocation(MemoryAllocation&& other) {
+        *this = std::move(other);
+    }
+
+    MemoryAllocation& operator=(MemoryAllocation&& other);
+
+    size_t bytes() const {
+        return mBytes;
+    }
+
+private:
+    void release();
+
+    std::shared_ptr<MemoryUsage> mUsage;
+    EMemoryCategory mCategory = PixelMemory;
+    size_t mBytes = 0;
+};
+
+TEV_NAMESPACE_END
@@ -0,0 +1,44 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the BSD 3-Clause License within the LICENSE file.
+
+#pragma once
+
+#include <tev/Common.h>
+#include <tev/Image.h>
+
+#include <nanogui/window.h>
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+TEV_NAMESPACE_BEGIN
+
+// Lists the memory held by each image per category alongside the totals of the process.
+// Clicking a column header sorts the images by that column.
+class MemoryWindow : public nanogui::Window {
+public:
+    MemoryWindow(nanogui::Widget* parent, std::function<void()> closeCallback);
+
+    bool keyboard_event(int key, int scancode, int action, int modifiers) override;
+
+    void update(const std::vector<std::shared_ptr<Image>>& images);
+
+private:
+    void sortBy(int column);
+    void rebuild();
+
+    std::function<void()> mCloseCallback;
+
+    nanogui::Widget* mTable;
+    nanogui::Widget* mTotals;
+
+    std::vector<std::weak_ptr<Image>> mImages;
+
+    // 0 sorts by name, 1 to NumMemoryCategories by the respective category, and the
+    // last column by the total.
+    int mSortColumn = NumMemoryCategories + 1;
+    bool mSortDescending = true;
+};
+
+TEV_NAMESPACE_END
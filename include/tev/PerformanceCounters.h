@@ -0,0 +1,44 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the BSD 3-Clause License within the LICENSE file.
+
+#pragma once
+
+#include <tev/Common.h>
+
+#include <atomic>
+
+TEV_NAMESPACE_BEGIN
+
+// Counters of the work flowing through tev, which are shown in the performance HUD. They are
+// updated with relaxed atomic operations and never lock, such that they can be updated from
+// any thread at negligible cost and remain enabled in release builds.
+struct PerformanceCounters {
+    static PerformanceCounters& global();
+
+    // Cumulative, such that readers can compute rates from the difference of two samples.
+    std::atomic<size_t> uploadedBytes{0};
+    std::atomic<size_t> ipcPackets{0};
+
+    std::atomic<int> inFlightLoads{0};
+    std::atomic<int> inFlightStatistics{0};
+};
+
+// Increments a counter for as long as it exists.
+class ScopedCount {
+public:
+    ScopedCount(std::atomic<int>& counter) : mCounter{counter} {
+        mCounter.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    ~ScopedCount() {
+        mCounter.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    ScopedCount(const ScopedCount&) = delete;
+    ScopedCount& operator=(const ScopedCount&) = delete;
+
+private:
+    std::atomic<int>& mCounter;
+};
+
+TEV_NAMESPACE_END
@@ -0,0 +1,22 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the BSD 3-Clause License within the LICENSE file.
+
+#pragma once
+
+#include <tev/Channel.h>
+#include <tev/Common.h>
+
+#include <Eigen/Dense>
+
+TEV_NAMESPACE_BEGIN
+
+// Resamples the channel such that its extent covers `size` pixels via a separable filter that
+// is widened when minifying to avoid aliasing. Pixels beyond the border repeat the edge.
+// `Centered` keeps the pixels as they are and crops or pads the channel with 0 around its center.
+Channel resample(const Channel& channel, const Eigen::Vector2i& size, EResampling resampling);
+
+// Convolves the channel with a Gaussian of standard deviation `sigma` pixels. Pixels beyond
+// the border repeat the edge.
+Channel blur(const Channel& channel, float sigma);
+
+TEV_NAMESPACE_END
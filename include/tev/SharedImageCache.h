@@ -0,0 +1,53 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the BSD 3-Clause License within the LICENSE file.
+
+#pragma once
+
+#include <tev/Common.h>
+#include <tev/Image.h>
+
+#include <string>
+
+TEV_NAMESPACE_BEGIN
+
+// Shares decoded images between tev instances on the same machine via POSIX shared memory,
+// such that an instance opening a file that another instance already decoded maps the
+// existing pixels rather than decoding the file once more. Each image lives in its own
+// shared memory object, which is removed once the last instance that displays it closes it.
+// Shared images hence outlive the instance that decoded them, which is why sharing is
+// disabled by default. Does nothing on platforms without POSIX shared memory.
+//
+// Instances that crash never release their references, such that the images they displayed
+// remain in memory until reboot. Images that a crashed instance was storing are removed once
+// another instance stores them. All others can be removed by deleting `/dev/shm/tev-*` on
+// Linux while no instance with `--shared-cache` runs.
+class SharedImageCache {
+public:
+    static bool isEnabled() {
+        return sIsEnabled;
+    }
+
+    static void setEnabled(bool enabled);
+
+    // Identifies the decoded contents of the file at `path` by the file's absolute path,
+    // modification time, and size, as well as by the channel selector. Returns an empty
+    // string if the image can not be shared, e.g. because sharing is disabled or the path
+    // does not refer to a regular file.
+    static std::string key(const filesystem::path& path, const std::string& channelSelector);
+
+    // Maps the channels that some instance stored under `key` into `data`. The channels are
+    // read-only (see Channel) and keep the shared memory alive. Returns false if no image
+    // is stored under `key`.
+    static bool load(const std::string& key, ImageData& data);
+
+    // Copies the channels of `data`, whose alpha must be premultiplied, into shared memory
+    // and replaces them by the shared copy, such that this instance does not hold the
+    // pixels twice. Does nothing if an image is already stored under `key` or shared
+    // memory is unavailable.
+    static void store(const std::string& key, ImageData& data);
+
+private:
+    static bool sIsEnabled;
+};
+
+TEV_NAMESPACE_END
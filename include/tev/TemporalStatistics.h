@@ -0,0 +1,61 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the BSD 3-Clause License within the LICENSE file.
+
+#pragma once
+
+#include <tev/BufferPool.h>
+#include <tev/Common.h>
+#include <tev/Image.h>
+
+#include <Eigen/Dense>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+TEV_NAMESPACE_BEGIN
+
+// Accumulates the per-pixel mean, variance, minimum, and maximum of many images of the same
+// resolution via Welford's algorithm. Images are added one at a time, such that only the
+// accumulators need to be held in memory rather than all images.
+class TemporalStatistics {
+public:
+    // The first image determines the resolution and channels. Throws invalid_argument if a
+    // later image differs in resolution or lacks one of the channels.
+    void add(const Image& image);
+
+    size_t numImages() const {
+        return mNumImages;
+    }
+
+    // Returns an image with the layers `mean`, `variance`, `stderr` (the standard error of
+    // the mean), `min`, and `max`, each containing all accumulated channels.
+    std::shared_ptr<Image> toImage(const std::string& name) const;
+
+private:
+    struct Accumulator {
+        PooledVector<float> mean;
+        PooledVector<float> m2;
+        PooledVector<float> minimum;
+        PooledVector<float> maximum;
+    };
+
+    Eigen::Vector2i mSize = Eigen::Vector2i::Zero();
+    std::vector<std::string> mChannelNames;
+    std::vector<Accumulator> mAccumulators;
+    size_t mNumImages = 0;
+};
+
+// Streams the images returned by `loadImage` for the indices 0 to `numImages`-1 through a
+// TemporalStatistics accumulator. A few images are decoded ahead of the one being accumulated
+// and each image is released once accumulated. Images that fail to load or do not match the
+// first one are skipped. Returns nullptr if no image could be accumulated. Must not be called
+// from gThreadPool.
+std::shared_ptr<Image> computeTemporalStatistics(
+    const std::string& name,
+    size_t numImages,
+    const std::function<std::shared_ptr<Image>(size_t)>& loadImage
+);
+
+TEV_NAMESPACE_END
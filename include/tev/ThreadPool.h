@@ -87,6 +87,10 @@ public:
         return futures;
     }
 
+    // Blocks until all iterations finished. Must not be called from a task of the same pool,
+    // since waiting for the nested iterations from within its workers could deadlock. Work
+    // that runs parallel loops on gThreadPool, such as decoding images, is hence scheduled on
+    // separate pools.
     template <typename Int, typename F>
     void parallelFor(Int start, Int end, F body) {
         waitAll(parallelForAsync(start, end, body));
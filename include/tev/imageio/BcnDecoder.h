@@ -0,0 +1,24 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the BSD 3-Clause License within the LICENSE file.
+
+#pragma once
+
+#include <tev/Common.h>
+
+#include <cstdint>
+
+TEV_NAMESPACE_BEGIN
+
+// Portable decoders for the block-compressed BCn texture formats. Each function decodes
+// a single compressed 4x4 block into 16 RGBA pixels in row-major order, i.e. the
+// component c of pixel (x, y) is written to `rgba[(y * 4 + x) * 4 + c]`. Components
+// that are not part of a format are set to 0 (color) or 1 (alpha).
+void decodeBc1(const uint8_t* block, float* rgba);
+void decodeBc2(const uint8_t* block, float* rgba);
+void decodeBc3(const uint8_t* block, float* rgba);
+void decodeBc4(const uint8_t* block, float* rgba, bool isSigned);
+void decodeBc5(const uint8_t* block, float* rgba, bool isSigned);
+void decodeBc6h(const uint8_t* block, float* rgba, bool isSigned);
+void decodeBc7(const uint8_t* block, float* rgba);
+
+TEV_NAMESPACE_END
@@ -12,7 +12,7 @@ TEV_NAMESPACE_BEGIN
 
 class ClipboardImageLoader : public ImageLoader {
 public:
-    bool canLoadFile(std::istream& iStream) const override;
+    std::vector<std::string> magicNumbers() const override;
     ImageData load(std::istream& iStream, const filesystem::path& path, const std::string& channelSelector, bool& hasPremultipliedAlpha) const override;
 
     std::string name() const override {
@@ -12,7 +12,8 @@ TEV_NAMESPACE_BEGIN
 
 class DdsImageLoader : public ImageLoader {
 public:
-    bool canLoadFile(std::istream& iStream) const override;
+    std::vector<std::string> magicNumbers() const override;
+    bool loadHeader(std::istream& iStream, const filesystem::path& path, const std::string& channelSelector, ImageHeader& header) const override;
     ImageData load(std::istream& iStream, const filesystem::path& path, const std::string& channelSelector, bool& hasPremultipliedAlpha) const override;
 
     std::string name() const override {
@@ -11,7 +11,7 @@ TEV_NAMESPACE_BEGIN
 
 class ExrImageSaver : public TypedImageSaver<float> {
 public:
-    void save(std::ostream& oStream, const filesystem::path& path, const std::vector<float>& data, const Eigen::Vector2i& imageSize, int nChannels) const override;
+    void save(std::ostream& oStream, const filesystem::path& path, const PooledVector<float>& data, const Eigen::Vector2i& imageSize, int nChannels) const override;
 
     bool hasPremultipliedAlpha() const override {
         return true;
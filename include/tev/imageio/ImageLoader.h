@@ -10,6 +10,8 @@
 
 #include <istream>
 #include <string>
+#include <utility>
+#include <vector>
 
 TEV_NAMESPACE_BEGIN
 
@@ -17,15 +19,65 @@ class ImageLoader {
 public:
     virtual ~ImageLoader() {}
 
-    virtual bool canLoadFile(std::istream& iStream) const = 0;
+    // Byte sequences that files of this format start with.
+    virtual std::vector<std::string> magicNumbers() const {
+        return {};
+    }
+
+    // Extensions (lower case and without the dot) of the files this loader is meant for. They
+    // decide between loaders sharing a magic number, and they recognize formats without one.
+    virtual std::vector<std::string> extensions() const {
+        return {};
+    }
+
+    // Formats without a magic number may also be recognized by other properties of their path,
+    // e.g. by an accompanying sidecar file.
+    virtual bool canLoadPath(const filesystem::path& path) const {
+        return false;
+    }
+
+    // Reads only the resolution and channels of the image without decoding its pixels,
+    // which allows opening many images at once and decoding them only when needed.
+    // Returns false if the format offers no cheaper way than a full load.
+    virtual bool loadHeader(std::istream& iStream, const filesystem::path& path, const std::string& channelSelector, ImageHeader& header) const {
+        return false;
+    }
+
     virtual ImageData load(std::istream& iStream, const filesystem::path& path, const std::string& channelSelector, bool& hasPremultipliedAlpha) const = 0;
 
     virtual std::string name() const = 0;
 
+    // Adds a loader to the built-in ones. Loaders with a higher priority are preferred when several
+    // recognize the same file; the built-in loaders have a priority of 0. Not thread-safe, so
+    // loaders must be registered before any image is loaded.
+    static void registerLoader(std::unique_ptr<ImageLoader> loader, int priority = 0);
+
+    // All loaders, ordered from the highest to the lowest priority.
     static const std::vector<std::unique_ptr<ImageLoader>>& getLoaders();
 
+    // Reads the first few bytes of the stream once, rewinds it, and matches them against the
+    // magic numbers of all loaders. Files whose contents are not recognized fall back to
+    // loaders that recognize their path. Throws invalid_argument if no loader recognizes the file.
+    static const ImageLoader& findLoader(std::istream& iStream, const filesystem::path& path);
+
+    // File extensions (without the dot) and descriptions of the formats that can be opened.
+    static const std::vector<std::pair<std::string, std::string>>& supportedFormats();
+
 protected:
+    static std::vector<std::string> makeNChannelNames(int numChannels);
     static std::vector<Channel> makeNChannels(int numChannels, Eigen::Vector2i size);
+
+    // Reads at most the first `maxBytes` of the stream and rewinds it, such that loadHeader()
+    // only touches the header of large files.
+    static std::vector<char> readHeaderBytes(std::istream& iStream, size_t maxBytes);
+
+    // The size of the whole stream, which is found by seeking. Throws invalid_argument if it is
+    // unknown, e.g. for streams that hold only the beginning of a compressed file.
+    static size_t streamSize(std::istream& iStream);
+
+    // Returns the matrix that converts linear RGB with the given primaries and white point,
+    // given as CIE xy coordinates, to the Rec.709 primaries and D65 white point of sRGB.
+    static Eigen::Matrix3f toRec709Matrix(Eigen::Vector2f red, Eigen::Vector2f green, Eigen::Vector2f blue, Eigen::Vector2f white);
 };
 
 TEV_NAMESPACE_END
@@ -3,6 +3,7 @@
 
 #pragma once
 
+#include <tev/BufferPool.h>
 #include <tev/Common.h>
 
 #include <Eigen/Dense>
@@ -33,7 +34,7 @@ public:
 template <typename T>
 class TypedImageSaver : public ImageSaver {
 public:
-    virtual void save(std::ostream& oStream, const ::filesystem::path& path, const std::vector<T>& data, const Eigen::Vector2i& imageSize, int nChannels) const = 0;
+    virtual void save(std::ostream& oStream, const ::filesystem::path& path, const PooledVector<T>& data, const Eigen::Vector2i& imageSize, int nChannels) const = 0;
 };
 
 TEV_NAMESPACE_END
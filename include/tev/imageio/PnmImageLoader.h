@@ -0,0 +1,25 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the BSD 3-Clause License within the LICENSE file.
+
+#pragma once
+
+#include <tev/Image.h>
+#include <tev/imageio/ImageLoader.h>
+
+#include <istream>
+
+TEV_NAMESPACE_BEGIN
+
+// Loads binary PGM (P5), PPM (P6), and PAM (P7) images with 8 or 16 bits per sample.
+class PnmImageLoader : public ImageLoader {
+public:
+    std::vector<std::string> magicNumbers() const override;
+    bool loadHeader(std::istream& iStream, const filesystem::path& path, const std::string& channelSelector, ImageHeader& header) const override;
+    ImageData load(std::istream& iStream, const filesystem::path& path, const std::string& channelSelector, bool& hasPremultipliedAlpha) const override;
+
+    std::string name() const override {
+        return "PNM";
+    }
+};
+
+TEV_NAMESPACE_END
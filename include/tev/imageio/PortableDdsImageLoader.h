@@ -0,0 +1,26 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the BSD 3-Clause License within the LICENSE file.
+
+#pragma once
+
+#include <tev/Image.h>
+#include <tev/imageio/ImageLoader.h>
+
+#include <istream>
+
+TEV_NAMESPACE_BEGIN
+
+// DDS loader that does not depend on DirectXTex and therefore works on all platforms.
+// Block-compressed formats are decoded by the portable BCn decoders in BcnDecoder.h.
+class PortableDdsImageLoader : public ImageLoader {
+public:
+    std::vector<std::string> magicNumbers() const override;
+    bool loadHeader(std::istream& iStream, const filesystem::path& path, const std::string& channelSelector, ImageHeader& header) const override;
+    ImageData load(std::istream& iStream, const filesystem::path& path, const std::string& channelSelector, bool& hasPremultipliedAlpha) const override;
+
+    std::string name() const override {
+        return "DDS";
+    }
+};
+
+TEV_NAMESPACE_END
@@ -0,0 +1,29 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the BSD 3-Clause License within the LICENSE file.
+
+#pragma once
+
+#include <tev/Image.h>
+#include <tev/imageio/ImageLoader.h>
+
+#include <istream>
+
+TEV_NAMESPACE_BEGIN
+
+// Loads headerless binary dumps of pixel data, e.g. framebuffers written by renderers.
+// Since such files carry no information about their contents, they are described by
+// a sidecar file (`<file>.json` or `<file>.desc`) and/or by their file name, e.g.
+// `beauty_1920x1080_4ch_f16_planar.raw`.
+class RawImageLoader : public ImageLoader {
+public:
+    std::vector<std::string> extensions() const override;
+    bool canLoadPath(const filesystem::path& path) const override;
+    bool loadHeader(std::istream& iStream, const filesystem::path& path, const std::string& channelSelector, ImageHeader& header) const override;
+    ImageData load(std::istream& iStream, const filesystem::path& path, const std::string& channelSelector, bool& hasPremultipliedAlpha) const override;
+
+    std::string name() const override {
+        return "RAW";
+    }
+};
+
+TEV_NAMESPACE_END
@@ -11,7 +11,7 @@ TEV_NAMESPACE_BEGIN
 
 class StbiLdrImageSaver : public TypedImageSaver<char> {
 public:
-    void save(std::ostream& oStream, const filesystem::path& path, const std::vector<char>& data, const Eigen::Vector2i& imageSize, int nChannels) const override;
+    void save(std::ostream& oStream, const filesystem::path& path, const PooledVector<char>& data, const Eigen::Vector2i& imageSize, int nChannels) const override;
 
     bool hasPremultipliedAlpha() const override {
         return false;
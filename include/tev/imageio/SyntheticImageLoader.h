@@ -0,0 +1,33 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the BSD 3-Clause License within the LICENSE file.
+
+#pragma once
+
+#include <tev/Image.h>
+#include <tev/imageio/ImageLoader.h>
+
+#include <istream>
+
+TEV_NAMESPACE_BEGIN
+
+// Generates images procedurally from a pseudo-path of the form
+// `synthetic:<width>x<height>[:<n>ch][:<n>layers][:gradient|noise|checkerboard][:nan][:seed<n>]`,
+// e.g. `synthetic:8192x8192:64ch`, such that loading, statistics, and comparisons can be
+// exercised without involving the disk. The channel count applies to each layer.
+class SyntheticImageLoader : public ImageLoader {
+public:
+    std::vector<std::string> magicNumbers() const override;
+
+    bool loadHeader(std::istream& iStream, const filesystem::path& path, const std::string& channelSelector, ImageHeader& header) const override;
+    ImageData load(std::istream& iStream, const filesystem::path& path, const std::string& channelSelector, bool& hasPremultipliedAlpha) const override;
+
+    std::string name() const override {
+        return "synthetic";
+    }
+
+    // Synthetic images do not exist on disk. Their path is instead handed to the loader as
+    // the contents of the stream.
+    static bool isSyntheticPath(const std::string& path);
+};
+
+TEV_NAMESPACE_END
@@ -0,0 +1,463 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the BSD 3-Clause License within the LICENSE file.
+
+#include <tev/Archive.h>
+#include <tev/MemoryStream.h>
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <mutex>
+#include <unordered_map>
+
+using namespace filesystem;
+using namespace std;
+
+TEV_NAMESPACE_BEGIN
+
+namespace {
+
+// Compressed bytes are read from disk in chunks of this size, such that decompression starts
+// right away and the compressed file never resides in memory as a whole.
+const size_t CHUNK_SIZE = 1024 * 1024;
+
+// Decompressed sizes stored in gzip and zip files merely serve as a hint for the size of the
+// output buffer, which grows as needed. Since they can not be trusted, hints are limited to
+// this multiple of the compressed size, which few images exceed.
+const uint64_t MAX_HINTED_COMPRESSION_RATIO = 32;
+
+struct ZipEntry {
+    string name;
+    uint16_t flags;
+    uint16_t method;
+    uint64_t compressedSize;
+    uint64_t uncompressedSize;
+    uint64_t localHeaderOffset;
+};
+
+uint64_t readLittleEndian(const char* data, size_t numBytes) {
+    uint64_t result = 0;
+    for (size_t i = 0; i < numBytes; ++i) {
+        result |= (uint64_t)(uint8_t)data[i] << (8 * i);
+    }
+
+    return result;
+}
+
+bool hasGzipMagic(const char* data, size_t size) {
+    return size >= 2 && (uint8_t)data[0] == 0x1f && (uint8_t)data[1] == 0x8b;
+}
+
+vector<char> readBytes(istream& iStream, uint64_t offset, size_t numBytes) {
+    vector<char> result(numBytes);
+    iStream.clear();
+    iStream.seekg((streamoff)offset);
+    iStream.read(result.data(), numBytes);
+    if ((size_t)iStream.gcount() != numBytes) {
+        throw runtime_error{"Unexpected end of file."};
+    }
+
+    return result;
+}
+
+// Limits a decompressed size read from the file to MAX_HINTED_COMPRESSION_RATIO.
+size_t limitSizeHint(uint64_t sizeHint, uint64_t numCompressedBytes) {
+    uint64_t limit = numCompressedBytes > numeric_limits<uint64_t>::max() / MAX_HINTED_COMPRESSION_RATIO ?
+        numeric_limits<uint64_t>::max() : numCompressedBytes * MAX_HINTED_COMPRESSION_RATIO;
+    return (size_t)min({sizeHint, limit, (uint64_t)numeric_limits<size_t>::max()});
+}
+
+// Inflates at most `numInputBytes` from the stream's current position. Gzip data (`isGzip`)
+// may consist of several members, which decompress to the concatenation of their contents.
+// Otherwise, the data is a single raw deflate stream as found in zip archives. Decompression
+// stops early once `maxNumBytes` were decompressed.
+vector<char> inflateStream(istream& iStream, uint64_t numInputBytes, bool isGzip, size_t sizeHint, size_t maxNumBytes) {
+    z_stream stream = {};
+    if (inflateInit2(&stream, isGzip ? 16 + MAX_WBITS : -MAX_WBITS) != Z_OK) {
+        throw runtime_error{"Failed to initialize decompression."};
+    }
+
+    ScopeGuard streamGuard{[&stream] { inflateEnd(&stream); }};
+
+    // Zip bombs legitimately decompress to more than fits into memory.
+    auto grow = [](vector<char>& buffer, size_t size) {
+        try {
+            buffer.resize(size);
+        } catch (const bad_alloc&) {
+            throw runtime_error{"Decompressed data does not fit into memory."};
+        } catch (const length_error&) {
+            throw runtime_error{"Decompressed data does not fit into memory."};
+        }
+    };
+
+    vector<char> input(CHUNK_SIZE);
+    vector<char> result;
+    grow(result, min(max(sizeHint, CHUNK_SIZE), maxNumBytes));
+    size_t numDecompressed = 0;
+
+    int status = Z_OK;
+    while (true) {
+        if (numDecompressed == maxNumBytes) {
+            return result;
+        }
+
+        if (stream.avail_in == 0) {
+            size_t numToRead = (size_t)min<uint64_t>(numInputBytes, input.size());
+            iStream.read(input.data(), numToRead);
+            numInputBytes -= (uint64_t)iStream.gcount();
+
+            stream.next_in = (Bytef*)input.data();
+            stream.avail_in = (uInt)iStream.gcount();
+            if (stream.avail_in == 0) {
+                break;
+            }
+        }
+
+        if (numDecompressed == result.size()) {
+            grow(result, min(result.size() * 2, maxNumBytes));
+        }
+
+        stream.next_out = (Bytef*)result.data() + numDecompressed;
+        stream.avail_out = (uInt)min<size_t>(result.size() - numDecompressed, INT_MAX);
+
+        status = inflate(&stream, Z_NO_FLUSH);
+        numDecompressed = (char*)stream.next_out - result.data();
+
+        if (status == Z_STREAM_END) {
+            if (!isGzip) {
+                break;
+            }
+
+            // Another gzip member may follow.
+            if (inflateReset(&stream) != Z_OK) {
+                throw runtime_error{"Failed to reset decompression."};
+            }
+        } else if (status != Z_OK && status != Z_BUF_ERROR) {
+            throw runtime_error{tfm::format("Failed to decompress: %s", stream.msg ? stream.msg : "invalid data")};
+        }
+    }
+
+    if (status != Z_STREAM_END) {
+        throw runtime_error{"Compressed data is truncated."};
+    }
+
+    result.resize(numDecompressed);
+    return result;
+}
+
+vector<char> gunzip(istream& iStream, size_t maxNumBytes) {
+    // The last four bytes hold the decompressed size (modulo 2^32) of the last member, which
+    // usually is the only one.
+    iStream.clear();
+    iStream.seekg(0, ios_base::end);
+    streamoff fileSize = iStream.tellg();
+
+    uint64_t numCompressedBytes = (uint64_t)max<streamoff>(fileSize, 0);
+    uint64_t sizeHint = 0;
+    if (fileSize >= 4) {
+        sizeHint = readLittleEndian(readBytes(iStream, (uint64_t)fileSize - 4, 4).data(), 4);
+    }
+
+    iStream.clear();
+    iStream.seekg(0);
+    return inflateStream(iStream, numeric_limits<uint64_t>::max(), true, limitSizeHint(max(sizeHint, numCompressedBytes), numCompressedBytes), maxNumBytes);
+}
+
+vector<ZipEntry> readZipDirectory(istream& iStream) {
+    iStream.clear();
+    iStream.seekg(0, ios_base::end);
+    uint64_t fileSize = (uint64_t)max<streamoff>(iStream.tellg(), 0);
+
+    // The end of central directory record is at least 22 bytes long and followed by a comment
+    // of at most 65535 bytes.
+    const size_t eocdSize = 22;
+    if (fileSize < eocdSize) {
+        throw runtime_error{"File is too small to be a zip archive."};
+    }
+
+    uint64_t tailSize = min<uint64_t>(fileSize, eocdSize + 65535);
+    auto tail = readBytes(iStream, fileSize - tailSize, (size_t)tailSize);
+
+    size_t eocd = string::npos;
+    for (size_t i = tail.size() - eocdSize + 1; i-- > 0;) {
+        if (memcmp(&tail[i], "PK\x05\x06", 4) == 0) {
+            eocd = i;
+            break;
+        }
+    }
+
+    if (eocd == string::npos) {
+        throw runtime_error{"Could not find the central directory of the zip archive."};
+    }
+
+    uint64_t numEntries = readLittleEndian(&tail[eocd + 10], 2);
+    uint64_t directorySize = readLittleEndian(&tail[eocd + 12], 4);
+    uint64_t directoryOffset = readLittleEndian(&tail[eocd + 16], 4);
+
+    // Archives beyond 4 GiB or 65535 entries store the actual values in a zip64 record, which
+    // is referenced by a locator right in front of the regular record.
+    if (numEntries == 0xffff || directorySize == 0xffffffff || directoryOffset == 0xffffffff) {
+        uint64_t eocdOffset = fileSize - tailSize + eocd;
+        if (eocdOffset < 20) {
+            throw runtime_error{"Missing zip64 locator."};
+        }
+
+        auto locator = readBytes(iStream, eocdOffset - 20, 20);
+        if (memcmp(locator.data(), "PK\x06\x07", 4) != 0) {
+            throw runtime_error{"Missing zip64 locator."};
+        }
+
+        auto record = readBytes(iStream, readLittleEndian(&locator[8], 8), 56);
+        if (memcmp(record.data(), "PK\x06\x06", 4) != 0) {
+            throw runtime_error{"Invalid zip64 end of central directory record."};
+        }
+
+        numEntries = readLittleEndian(&record[32], 8);
+        directorySize = readLittleEndian(&record[40], 8);
+        directoryOffset = readLittleEndian(&record[48], 8);
+    }
+
+    if (directoryOffset + directorySize > fileSize) {
+        throw runtime_error{"Central directory of the zip archive exceeds the file."};
+    }
+
+    auto directory = readBytes(iStream, directoryOffset, (size_t)directorySize);
+
+    vector<ZipEntry> result;
+    size_t position = 0;
+    for (uint64_t i = 0; i < numEntries; ++i) {
+        const size_t headerSize = 46;
+        if (position + headerSize > directory.size() || memcmp(&directory[position], "PK\x01\x02", 4) != 0) {
+            throw runtime_error{"Invalid central directory entry."};
+        }
+
+        const char* header = &directory[position];
+        size_t nameLength = (size_t)readLittleEndian(header + 28, 2);
+        size_t extraLength = (size_t)readLittleEndian(header + 30, 2);
+        size_t commentLength = (size_t)readLittleEndian(header + 32, 2);
+        if (position + headerSize + nameLength + extraLength + commentLength > directory.size()) {
+            throw runtime_error{"Invalid central directory entry."};
+        }
+
+        ZipEntry entry;
+        entry.flags = (uint16_t)readLittleEndian(header + 8, 2);
+        entry.method = (uint16_t)readLittleEndian(header + 10, 2);
+        entry.compressedSize = readLittleEndian(header + 20, 4);
+        entry.uncompressedSize = readLittleEndian(header + 24, 4);
+        entry.localHeaderOffset = readLittleEndian(header + 42, 4);
+        entry.name = string{header + headerSize, nameLength};
+
+        // Sizes and offsets that do not fit into 32 bits are stored, in this order, in the
+        // zip64 extra field.
+        const char* extra = header + headerSize + nameLength;
+        for (size_t j = 0; j + 4 <= extraLength;) {
+            uint16_t id = (uint16_t)readLittleEndian(extra + j, 2);
+            size_t size = (size_t)readLittleEndian(extra + j + 2, 2);
+            j += 4;
+
+            if (id == 0x0001) {
+                size_t k = j;
+                for (uint64_t* value : {&entry.uncompressedSize, &entry.compressedSize, &entry.localHeaderOffset}) {
+                    if (*value == 0xffffffff && k + 8 <= j + size && k + 8 <= extraLength) {
+                        *value = readLittleEndian(extra + k, 8);
+                        k += 8;
+                    }
+                }
+            }
+
+            j += size;
+        }
+
+        if (entry.localHeaderOffset > fileSize || entry.compressedSize > fileSize - entry.localHeaderOffset) {
+            throw runtime_error{tfm::format("Zip member %s exceeds the archive.", entry.name)};
+        }
+
+        position += headerSize + nameLength + extraLength + commentLength;
+
+        // Directories are listed as empty entries whose name ends in a slash.
+        if (!entry.name.empty() && entry.name.back() != '/') {
+            result.emplace_back(move(entry));
+        }
+    }
+
+    return result;
+}
+
+vector<char> extractZipEntry(istream& iStream, const ZipEntry& entry, size_t maxNumBytes) {
+    if (entry.flags & 0x1) {
+        throw runtime_error{tfm::format("Zip member %s is encrypted.", entry.name)};
+    }
+
+    auto localHeader = readBytes(iStream, entry.localHeaderOffset, 30);
+    if (memcmp(localHeader.data(), "PK\x03\x04", 4) != 0) {
+        throw runtime_error{tfm::format("Invalid local header of zip member %s.", entry.name)};
+    }
+
+    // Also guards against directories that were cached before the archive changed.
+    size_t nameLength = (size_t)readLittleEndian(&localHeader[26], 2);
+    if (nameLength != entry.name.size() || !equal(begin(entry.name), end(entry.name), begin(readBytes(iStream, entry.localHeaderOffset + 30, nameLength)))) {
+        throw runtime_error{tfm::format("Local header of zip member %s does not match the central directory.", entry.name)};
+    }
+
+    uint64_t dataOffset = entry.localHeaderOffset + 30 + nameLength + readLittleEndian(&localHeader[28], 2);
+
+    switch (entry.method) {
+        case 0: // Stored
+            return readBytes(iStream, dataOffset, (size_t)min<uint64_t>(entry.compressedSize, maxNumBytes));
+        case 8: // Deflated
+            iStream.clear();
+            iStream.seekg((streamoff)dataOffset);
+            return inflateStream(iStream, entry.compressedSize, false, limitSizeHint(entry.uncompressedSize, entry.compressedSize), maxNumBytes);
+        default:
+            throw runtime_error{tfm::format("Zip member %s uses the unsupported compression method %d.", entry.name, entry.method)};
+    }
+}
+
+// The central directories of the zip archives that were read, such that opening each of the N
+// members of an archive does not read and parse its directory N times. Directories are read
+// anew once the size of their archive changes or listZipMembers is called.
+struct ZipDirectory {
+    uint64_t archiveSize;
+    unordered_map<string, ZipEntry> entries;
+};
+
+mutex zipDirectoriesMutex;
+unordered_map<string, shared_ptr<const ZipDirectory>> zipDirectories;
+
+shared_ptr<const ZipDirectory> cacheZipDirectory(const path& archivePath, uint64_t archiveSize, const vector<ZipEntry>& entries) {
+    auto directory = make_shared<ZipDirectory>();
+    directory->archiveSize = archiveSize;
+    for (const auto& entry : entries) {
+        // Like extractors, use the first of several members of the same name.
+        directory->entries.emplace(entry.name, entry);
+    }
+
+    lock_guard<mutex> lock{zipDirectoriesMutex};
+    zipDirectories[archivePath.str()] = directory;
+    return directory;
+}
+
+shared_ptr<const ZipDirectory> zipDirectory(const path& archivePath, istream& archiveStream) {
+    uint64_t archiveSize = (uint64_t)archivePath.file_size();
+    {
+        lock_guard<mutex> lock{zipDirectoriesMutex};
+        auto it = zipDirectories.find(archivePath.str());
+        if (it != end(zipDirectories) && it->second->archiveSize == archiveSize) {
+            return it->second;
+        }
+    }
+
+    return cacheZipDirectory(archivePath, archiveSize, readZipDirectory(archiveStream));
+}
+
+// Splits paths of the form `<archive>.zip/<member>` into the archive and the member.
+bool splitZipMemberPath(const path& memberPath, path& archivePath, string& memberName) {
+    string str = memberPath.str();
+    for (size_t i = str.find_first_of("/\\"); i != string::npos; i = str.find_first_of("/\\", i + 1)) {
+        path candidate = str.substr(0, i);
+        if (isZipArchive(candidate)) {
+            archivePath = candidate;
+            memberName = str.substr(i + 1);
+            replace(begin(memberName), end(memberName), '\\', '/');
+            return true;
+        }
+    }
+
+    return false;
+}
+
+}
+
+bool isZipArchive(const path& path) {
+    return toLower(path.extension()) == "zip" && path.is_file();
+}
+
+vector<path> listZipMembers(const path& archivePath) {
+    ifstream archiveStream{nativeString(archivePath), ios_base::binary};
+    if (!archiveStream) {
+        throw runtime_error{tfm::format("Could not open %s.", archivePath)};
+    }
+
+    auto entries = readZipDirectory(archiveStream);
+    cacheZipDirectory(archivePath, (uint64_t)archivePath.file_size(), entries);
+
+    vector<path> result;
+    for (const auto& entry : entries) {
+        result.emplace_back(archivePath / entry.name);
+    }
+
+    return result;
+}
+
+namespace {
+
+unique_ptr<istream> openImageFile(const path& path, size_t maxNumBytes) {
+    class path archivePath;
+    string memberName;
+    if (!path.is_file() && splitZipMemberPath(path, archivePath, memberName)) {
+        ifstream archiveStream{nativeString(archivePath), ios_base::binary};
+        auto directory = zipDirectory(archivePath, archiveStream);
+        auto entry = directory->entries.find(memberName);
+        if (entry == end(directory->entries)) {
+            throw runtime_error{tfm::format("%s contains no member %s.", archivePath, memberName)};
+        }
+
+        auto data = extractZipEntry(archiveStream, entry->second, maxNumBytes);
+        if (data.size() < maxNumBytes) {
+            return openImageData(move(data));
+        }
+
+        return make_unique<MemoryStream>(move(data), false);
+    }
+
+    auto fileStream = make_unique<ifstream>(nativeString(path), ios_base::binary);
+
+    char magic[2];
+    fileStream->read(magic, sizeof(magic));
+    bool isGzip = hasGzipMagic(magic, (size_t)fileStream->gcount());
+
+    fileStream->clear();
+    fileStream->seekg(0);
+
+    if (!isGzip) {
+        return fileStream;
+    }
+
+    auto data = gunzip(*fileStream, maxNumBytes);
+    bool isComplete = data.size() < maxNumBytes;
+    return make_unique<MemoryStream>(move(data), isComplete);
+}
+
+}
+
+unique_ptr<istream> openImageFile(const path& path) {
+    return openImageFile(path, numeric_limits<size_t>::max());
+}
+
+unique_ptr<istream> openImageFileHead(const path& path, size_t maxNumBytes) {
+    return openImageFile(path, maxNumBytes);
+}
+
+unique_ptr<istream> openImageData(vector<char> data) {
+    if (hasGzipMagic(data.data(), data.size())) {
+        MemoryStream compressedStream{move(data)};
+        data = gunzip(compressedStream, numeric_limits<size_t>::max());
+    }
+
+    return make_unique<MemoryStream>(move(data));
+}
+
+path contentPath(const path& path) {
+    if (toLower(path.extension()) != "gz") {
+        return path;
+    }
+
+    string str = path.str();
+    return str.substr(0, str.size() - 3);
+}
+
+TEV_NAMESPACE_END
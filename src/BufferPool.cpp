@@ -0,0 +1,170 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the BSD 3-Clause License within the LICENSE file.
+
+#include <tev/BufferPool.h>
+
+#include <cstdlib>
+#include <new>
+
+#ifndef _WIN32
+#   include <sys/mman.h>
+#endif
+
+using namespace std;
+
+TEV_NAMESPACE_BEGIN
+
+namespace {
+
+// Blocks smaller than a huge page could not be backed by one anyway and are merely aligned
+// to cache lines.
+void* allocateAligned(size_t bytes) {
+    const bool isHuge = bytes >= BufferPool::HUGE_PAGE_BYTES;
+    const size_t alignment = isHuge ? BufferPool::HUGE_PAGE_BYTES : 64;
+#ifdef _WIN32
+    void* ptr = _aligned_malloc(bytes, alignment);
+    if (!ptr) {
+        throw bad_alloc{};
+    }
+#else
+    void* ptr;
+    if (posix_memalign(&ptr, alignment, bytes) != 0) {
+        throw bad_alloc{};
+    }
+#   ifdef MADV_HUGEPAGE
+    // Merely a hint, which fails harmlessly where transparent huge pages are disabled.
+    if (isHuge) {
+        madvise(ptr, bytes, MADV_HUGEPAGE);
+    }
+#   endif
+#endif
+    return ptr;
+}
+
+void freeAligned(void* ptr) {
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+void updatePeak(atomic<size_t>& peak, size_t value) {
+    size_t previous = peak;
+    while (previous < value && !peak.compare_exchange_weak(previous, value)) {}
+}
+
+}
+
+BufferPool& BufferPool::global() {
+    // Kept alive until exit, since buffers may be released by static destructors.
+    static BufferPool* pool = new BufferPool{(size_t)1024 * 1024 * 1024};
+    return *pool;
+}
+
+BufferPool::~BufferPool() {
+    trim();
+}
+
+size_t BufferPool::sizeClass(size_t bytes) {
+    if (bytes < MIN_POOLED_BYTES) {
+        return bytes;
+    }
+
+    // Four classes per power of two waste less than a fifth of each block. Rounding smaller
+    // blocks up to whole huge pages would waste far more, e.g. 2 MiB for a 300 KiB request.
+    size_t octave = MIN_POOLED_BYTES;
+    while (octave * 2 <= bytes) {
+        octave *= 2;
+    }
+
+    size_t step = octave / 4;
+    return (bytes + step - 1) / step * step;
+}
+
+void* BufferPool::allocate(size_t bytes) {
+    if (bytes < MIN_POOLED_BYTES) {
+        return ::operator new(bytes);
+    }
+
+    size_t blockBytes = sizeClass(bytes);
+    ++mNumAllocations;
+    updatePeak(mPeakBytes, mUsedBytes += blockBytes);
+
+    {
+        lock_guard<mutex> lock{mMutex};
+        auto iter = mFreeBlocks.find(blockBytes);
+        if (iter != end(mFreeBlocks) && !iter->second.empty()) {
+            void* ptr = iter->second.back();
+            iter->second.pop_back();
+            mFreeBytes -= blockBytes;
+            ++mNumReuses;
+            return ptr;
+        }
+    }
+
+    try {
+        return allocateAligned(blockBytes);
+    } catch (const bad_alloc&) {
+        // Memory held for reuse is better spent on this allocation.
+        trim();
+        try {
+            return allocateAligned(blockBytes);
+        } catch (const bad_alloc&) {
+            mUsedBytes -= blockBytes;
+            throw;
+        }
+    }
+}
+
+void BufferPool::deallocate(void* ptr, size_t bytes) {
+    if (!ptr) {
+        return;
+    }
+
+    if (bytes < MIN_POOLED_BYTES) {
+        ::operator delete(ptr);
+        return;
+    }
+
+    size_t blockBytes = sizeClass(bytes);
+    mUsedBytes -= blockBytes;
+
+    lock_guard<mutex> lock{mMutex};
+    if (blockBytes > mMaxFreeBytes) {
+        freeAligned(ptr);
+        return;
+    }
+
+    // The most recently freed block is the most likely to be needed again, so the blocks that
+    // are already held make room for it.
+    if (mFreeBytes + blockBytes > mMaxFreeBytes) {
+        releaseFreeBlocks(mMaxFreeBytes - blockBytes);
+    }
+
+    mFreeBlocks[blockBytes].emplace_back(ptr);
+    mFreeBytes += blockBytes;
+}
+
+void BufferPool::trim() {
+    lock_guard<mutex> lock{mMutex};
+    releaseFreeBlocks(0);
+}
+
+BufferPool::Statistics BufferPool::statistics() const {
+    return {mNumAllocations, mNumReuses, mUsedBytes, mFreeBytes, mPeakBytes};
+}
+
+void BufferPool::releaseFreeBlocks(size_t targetBytes) {
+    // Largest blocks first, such that as few blocks as possible are released.
+    for (auto iter = mFreeBlocks.rbegin(); iter != mFreeBlocks.rend() && mFreeBytes > targetBytes; ++iter) {
+        auto& blocks = iter->second;
+        while (!blocks.empty() && mFreeBytes > targetBytes) {
+            freeAligned(blocks.back());
+            blocks.pop_back();
+            mFreeBytes -= iter->first;
+        }
+    }
+}
+
+TEV_NAMESPACE_END
@@ -2,19 +2,64 @@
 // It is published under the BSD 3-Clause License within the LICENSE file.
 
 #include <tev/Channel.h>
+#include <tev/Compression.h>
 #include <tev/ThreadPool.h>
 
 #include <numeric>
 
 using namespace Eigen;
-using namespace nanogui;
 using namespace std;
 
 TEV_NAMESPACE_BEGIN
 
+namespace {
+
+// Tiles are compressed independently, such that large channels are compressed in parallel.
+const size_t COMPRESSION_TILE_SIZE = 64 * 1024;
+
+// The returned pointer keeps the pooled vector alive.
+shared_ptr<float> allocateData(size_t count) {
+    auto vector = make_shared<PooledVector<float>>(count);
+    return {vector, vector->data()};
+}
+
+shared_ptr<float> copyData(const float* data, size_t count) {
+    auto result = allocateData(count);
+    copy_n(data, count, result.get());
+    return result;
+}
+
+}
+
 Channel::Channel(const std::string& name, Eigen::Vector2i size)
-: mName{name} {
-    mData.resize(size.y(), size.x());
+: mName{name}, mSize{size}, mData{allocateData((size_t)size.x() * size.y())} {
+}
+
+Channel::Channel(const string& name, Vector2i size, shared_ptr<const float> data)
+: Channel{name, size, const_pointer_cast<float>(data), true} {
+}
+
+Channel::Channel(const string& name, Vector2i size, shared_ptr<float> data, bool isReadOnly)
+: mName{name}, mSize{size}, mData{data}, mIsReadOnly{isReadOnly} {
+}
+
+Channel::Channel(const Channel& other)
+: mName{other.mName}, mSize{other.mSize}, mIsCompressed{other.mIsCompressed}, mCompressedTiles{other.mCompressedTiles} {
+    if (other.mData) {
+        mData = copyData(other.mData.get(), (size_t)count());
+    }
+}
+
+Channel& Channel::operator=(const Channel& other) {
+    if (this != &other) {
+        *this = Channel{other};
+    }
+    return *this;
+}
+
+Channel Channel::snapshot() const {
+    TEV_ASSERT(!mIsCompressed, "Compressed channels can not be snapshotted.");
+    return {mName, mSize, mData, mIsReadOnly};
 }
 
 pair<string, string> Channel::split(const string& channel) {
@@ -38,21 +83,8 @@ bool Channel::isTopmost(const string& channel) {
     return tail(channel) == channel;
 }
 
-Color Channel::color(string channel) {
-    channel = toLower(tail(channel));
-
-    if (channel == "r") {
-        return Color(0.8f, 0.2f, 0.2f, 1.0f);
-    } else if (channel == "g") {
-        return Color(0.2f, 0.8f, 0.2f, 1.0f);
-    } else if (channel == "b") {
-        return Color(0.2f, 0.3f, 1.0f, 1.0f);
-    }
-
-    return Color(1.0f, 1.0f);
-}
-
 void Channel::divideByAsync(const Channel& other, vector<future<void>>& futures) {
+    makeWritable();
     gThreadPool->parallelForAsync<DenseIndex>(0, other.count(), [&](DenseIndex i) {
         if (other.at(i) != 0) {
             at(i) /= other.at(i);
@@ -63,17 +95,83 @@ void Channel::divideByAsync(const Channel& other, vector<future<void>>& futures)
 }
 
 void Channel::multiplyWithAsync(const Channel& other, vector<future<void>>& futures) {
+    makeWritable();
     gThreadPool->parallelForAsync<DenseIndex>(0, other.count(), [&](DenseIndex i) {
         at(i) *= other.at(i);
     }, futures);
 }
 
-void Channel::updateTile(int x, int y, int width, int height, const vector<float>& newData) {
+void Channel::setZero() {
+    if (mIsReadOnly || mData.use_count() > 1) {
+        mData = allocateData((size_t)count());
+        mIsReadOnly = false;
+    }
+
+    fill_n(mData.get(), count(), 0.0f);
+}
+
+void Channel::compress() {
+    if (mIsCompressed) {
+        return;
+    }
+
+    const float* data = mData.get();
+    size_t numValues = (size_t)count();
+    size_t numTiles = (numValues + COMPRESSION_TILE_SIZE - 1) / COMPRESSION_TILE_SIZE;
+    mCompressedTiles.resize(numTiles);
+    gThreadPool->parallelFor<size_t>(0, numTiles, [&](size_t i) {
+        size_t start = i * COMPRESSION_TILE_SIZE;
+        mCompressedTiles[i] = compressFloats(&data[start], min(COMPRESSION_TILE_SIZE, numValues - start));
+    });
+
+    // Snapshots keep their version of the data alive. Read-only data is decompressed into
+    // a copy that this channel owns.
+    mData.reset();
+    mIsReadOnly = false;
+    mIsCompressed = true;
+}
+
+void Channel::decompress() {
+    if (!mIsCompressed) {
+        return;
+    }
+
+    size_t numValues = (size_t)count();
+    auto data = allocateData(numValues);
+    gThreadPool->parallelFor<size_t>(0, mCompressedTiles.size(), [&](size_t i) {
+        size_t start = i * COMPRESSION_TILE_SIZE;
+        decompressFloats(mCompressedTiles[i], data.get() + start, min(COMPRESSION_TILE_SIZE, numValues - start));
+    });
+
+    mData = data;
+    mCompressedTiles.clear();
+    mIsCompressed = false;
+}
+
+void Channel::replaceData(Channel&& other) {
+    mSize = other.mSize;
+    mData = move(other.mData);
+    mIsReadOnly = other.mIsReadOnly;
+    mIsCompressed = other.mIsCompressed;
+    mCompressedTiles = move(other.mCompressedTiles);
+}
+
+size_t Channel::compressedBytes() const {
+    size_t result = 0;
+    for (const auto& tile : mCompressedTiles) {
+        result += tile.size();
+    }
+    return result;
+}
+
+void Channel::updateTile(int x, int y, int width, int height, const PooledVector<float>& newData) {
     if (x < 0 || y < 0 || x + width > size().x() || y + height > size().y()) {
         tlog::warning() << "Tile [" << x << "," << y << "," << width << "," << height << "] could not be updated because it does not fit into the channel's size " << size();
         return;
     }
 
+    makeWritable();
+
     for (int posY = 0; posY < height; ++posY) {
         for (int posX = 0; posX < width; ++posX) {
             at({x + posX, y + posY}) = newData[posX + posY * width];
@@ -81,4 +179,13 @@ void Channel::updateTile(int x, int y, int width, int height, const vector<float
     }
 }
 
+void Channel::makeWritable() {
+    // Publish a new version rather than modifying the one that snapshots still read. Callers
+    // prevent snapshots from being taken during updates, so the check can not race.
+    if (mIsReadOnly || mData.use_count() > 1) {
+        mData = copyData(mData.get(), (size_t)count());
+        mIsReadOnly = false;
+    }
+}
+
 TEV_NAMESPACE_END
@@ -3,8 +3,6 @@
 
 #include <tev/Common.h>
 
-#include <nanogui/opengl.h>
-
 #include <utf8.h>
 
 #include <algorithm>
@@ -16,12 +14,12 @@
 #   include <Shlobj.h>
 #else
 #   include <cstring>
+#   include <dirent.h>
 #   include <pwd.h>
 #   include <unistd.h>
 #endif
 
 using namespace filesystem;
-using namespace nanogui;
 using namespace std;
 
 TEV_NAMESPACE_BEGIN
@@ -120,15 +118,6 @@ bool matchesRegex(string text, string filter) {
     }
 }
 
-void drawTextWithShadow(NVGcontext* ctx, float x, float y, string text, float shadowAlpha) {
-    nvgSave(ctx);
-    nvgFontBlur(ctx, 2);
-    nvgFillColor(ctx, Color{0.0f, shadowAlpha});
-    nvgText(ctx, x + 1, y + 1, text.c_str(), NULL);
-    nvgRestore(ctx);
-    nvgText(ctx, x, y, text.c_str(), NULL);
-}
-
 ETonemap toTonemap(string name) {
     // Perform matching on uppercase strings
     name = toUpper(name);
@@ -163,6 +152,24 @@ EMetric toMetric(string name) {
     }
 }
 
+EResampling toResampling(string name) {
+    // Perform matching on uppercase strings
+    name = toUpper(name);
+    if (name == "CENTERED" || name == "NONE") {
+        return Centered;
+    } else if (name == "BOX") {
+        return Box;
+    } else if (name == "BILINEAR") {
+        return Bilinear;
+    } else if (name == "LANCZOS") {
+        return Lanczos;
+    } else {
+        // Unlike display settings, the resampling decides what comparisons measure, so typos
+        // must not silently change it.
+        throw invalid_argument{tfm::format("Unknown resampling '%s'. Must be one of centered (or none), box, bilinear, or lanczos.", name)};
+    }
+}
+
 int lastError() {
 #ifdef _WIN32
     return GetLastError();
@@ -209,6 +216,43 @@ path homeDirectory() {
 #endif
 }
 
+vector<string> listDirectory(const path& directory) {
+    vector<string> result;
+
+#ifdef _WIN32
+    WIN32_FIND_DATAW findData;
+    HANDLE handle = FindFirstFileW((directory / "*").wstr().c_str(), &findData);
+    if (handle == INVALID_HANDLE_VALUE) {
+        throw invalid_argument{tfm::format("Could not list directory %s: %s", directory, errorString(lastError()))};
+    }
+
+    do {
+        string name = utf16to8(findData.cFileName);
+        if (name != "." && name != "..") {
+            result.emplace_back(name);
+        }
+    } while (FindNextFileW(handle, &findData));
+
+    FindClose(handle);
+#else
+    DIR* dir = opendir(directory.str().c_str());
+    if (!dir) {
+        throw invalid_argument{tfm::format("Could not list directory %s: %s", directory, errorString(lastError()))};
+    }
+
+    while (dirent* entry = readdir(dir)) {
+        string name = entry->d_name;
+        if (name != "." && name != "..") {
+            result.emplace_back(name);
+        }
+    }
+
+    closedir(dir);
+#endif
+
+    return result;
+}
+
 void toggleConsole() {
 #ifdef _WIN32
     HWND console = GetConsoleWindow();
@@ -0,0 +1,52 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the BSD 3-Clause License within the LICENSE file.
+
+#include <tev/Compression.h>
+
+#include <zlib.h>
+
+using namespace std;
+
+TEV_NAMESPACE_BEGIN
+
+vector<char> compressFloats(const float* data, size_t count) {
+    size_t numBytes = count * sizeof(float);
+    vector<uint8_t> shuffled(numBytes);
+
+    const uint8_t* bytes = (const uint8_t*)data;
+    for (size_t i = 0; i < count; ++i) {
+        for (size_t b = 0; b < sizeof(float); ++b) {
+            shuffled[b * count + i] = bytes[i * sizeof(float) + b];
+        }
+    }
+
+    // The fastest level already captures most of the redundancy of shuffled floats.
+    uLongf compressedBytes = compressBound((uLong)numBytes);
+    vector<char> result(compressedBytes);
+    if (compress2((Bytef*)result.data(), &compressedBytes, shuffled.data(), (uLong)numBytes, 1) != Z_OK) {
+        throw runtime_error{"Failed to compress floats."};
+    }
+
+    result.resize(compressedBytes);
+    result.shrink_to_fit();
+    return result;
+}
+
+void decompressFloats(const vector<char>& compressed, float* data, size_t count) {
+    size_t numBytes = count * sizeof(float);
+    vector<uint8_t> shuffled(numBytes);
+
+    uLongf decompressedBytes = (uLongf)numBytes;
+    if (uncompress(shuffled.data(), &decompressedBytes, (const Bytef*)compressed.data(), (uLong)compressed.size()) != Z_OK || decompressedBytes != numBytes) {
+        throw runtime_error{"Failed to decompress floats."};
+    }
+
+    uint8_t* bytes = (uint8_t*)data;
+    for (size_t i = 0; i < count; ++i) {
+        for (size_t b = 0; b < sizeof(float); ++b) {
+            bytes[i * sizeof(float) + b] = shuffled[b * count + i];
+        }
+    }
+}
+
+TEV_NAMESPACE_END
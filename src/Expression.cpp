@@ -0,0 +1,338 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the BSD 3-Clause License within the LICENSE file.
+
+#include <tev/Expression.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+
+using namespace std;
+
+TEV_NAMESPACE_BEGIN
+
+namespace {
+
+using EOp = ChannelExpression::EOp;
+using Instruction = ChannelExpression::Instruction;
+
+// Large enough to amortize interpreting the instructions, yet small enough for the stack
+// of intermediate values to remain in the L1 cache.
+const size_t BLOCK_SIZE = 256;
+
+struct Function {
+    const char* name;
+    size_t numArguments;
+    EOp op;
+};
+
+const Function FUNCTIONS[] = {
+    {"abs", 1, EOp::Abs},
+    {"sqrt", 1, EOp::Sqrt},
+    {"exp", 1, EOp::Exp},
+    {"log", 1, EOp::Log},
+    {"min", 2, EOp::Minimum},
+    {"max", 2, EOp::Maximum},
+    {"pow", 2, EOp::Power},
+};
+
+bool isNameCharacter(char c) {
+    return isalnum((unsigned char)c) || c == '_' || c == '.';
+}
+
+// Recursive descent parser which emits instructions in postfix order. From lowest to highest
+// precedence, it parses comparisons, sums, products, unary minus, and powers.
+class Parser {
+public:
+    Parser(const string& text, vector<string>& inputs, vector<Instruction>& instructions)
+    : mText{text}, mInputs{inputs}, mInstructions{instructions} {}
+
+    string parseDefinition() {
+        string name = parseName();
+        expect('=');
+        parseComparison();
+
+        skipWhitespace();
+        if (mPosition < mText.size()) {
+            fail(tfm::format("Unexpected '%c'", mText[mPosition]));
+        }
+
+        return name;
+    }
+
+private:
+    [[noreturn]] void fail(const string& reason) {
+        throw invalid_argument{tfm::format("Invalid channel expression '%s'. %s at position %d.", mText, reason, mPosition)};
+    }
+
+    void skipWhitespace() {
+        while (mPosition < mText.size() && isspace((unsigned char)mText[mPosition])) {
+            ++mPosition;
+        }
+    }
+
+    bool accept(const string& token) {
+        skipWhitespace();
+        if (mText.compare(mPosition, token.size(), token) == 0) {
+            mPosition += token.size();
+            return true;
+        }
+        return false;
+    }
+
+    void expect(char c) {
+        if (!accept(string(1, c))) {
+            fail(tfm::format("Expected '%c'", c));
+        }
+    }
+
+    void emit(EOp op, float constant = 0, size_t input = 0) {
+        mInstructions.push_back({op, constant, input});
+    }
+
+    string parseName() {
+        skipWhitespace();
+
+        string name;
+        if (accept("'")) {
+            size_t end = mText.find('\'', mPosition);
+            if (end == string::npos) {
+                fail("Unterminated quote");
+            }
+
+            name = mText.substr(mPosition, end - mPosition);
+            mPosition = end + 1;
+        } else {
+            size_t start = mPosition;
+            while (mPosition < mText.size() && isNameCharacter(mText[mPosition])) {
+                ++mPosition;
+            }
+
+            name = mText.substr(start, mPosition - start);
+        }
+
+        if (name.empty()) {
+            fail("Expected a channel name");
+        }
+
+        return name;
+    }
+
+    void parseComparison() {
+        parseSum();
+
+        const pair<const char*, EOp> comparisons[] = {
+            {"<=", EOp::LessEqual},
+            {">=", EOp::GreaterEqual},
+            {"<", EOp::Less},
+            {">", EOp::Greater},
+        };
+
+        for (const auto& comparison : comparisons) {
+            if (accept(comparison.first)) {
+                parseSum();
+                emit(comparison.second);
+                return;
+            }
+        }
+    }
+
+    void parseSum() {
+        parseProduct();
+        while (true) {
+            if (accept("+")) {
+                parseProduct();
+                emit(EOp::Add);
+            } else if (accept("-")) {
+                parseProduct();
+                emit(EOp::Subtract);
+            } else {
+                return;
+            }
+        }
+    }
+
+    void parseProduct() {
+        parseUnary();
+        while (true) {
+            if (accept("*")) {
+                parseUnary();
+                emit(EOp::Multiply);
+            } else if (accept("/")) {
+                parseUnary();
+                emit(EOp::Divide);
+            } else {
+                return;
+            }
+        }
+    }
+
+    void parseUnary() {
+        if (accept("-")) {
+            parseUnary();
+            emit(EOp::Negate);
+        } else if (accept("+")) {
+            parseUnary();
+        } else {
+            parsePower();
+        }
+    }
+
+    void parsePower() {
+        parsePrimary();
+        // Right-associative and binding tighter than unary minus on its left, i.e. -a^-b
+        // equals -(a^(-b)).
+        if (accept("^")) {
+            parseUnary();
+            emit(EOp::Power);
+        }
+    }
+
+    void parsePrimary() {
+        skipWhitespace();
+        if (mPosition >= mText.size()) {
+            fail("Unexpected end");
+        }
+
+        char c = mText[mPosition];
+        if (isdigit((unsigned char)c) || (c == '.' && mPosition + 1 < mText.size() && isdigit((unsigned char)mText[mPosition + 1]))) {
+            const char* start = mText.c_str() + mPosition;
+            char* end;
+            float value = strtof(start, &end);
+            mPosition += end - start;
+            emit(EOp::Constant, value);
+            return;
+        }
+
+        if (accept("(")) {
+            parseComparison();
+            expect(')');
+            return;
+        }
+
+        bool isQuoted = c == '\'';
+        string name = parseName();
+
+        if (!isQuoted && accept("(")) {
+            auto function = find_if(begin(FUNCTIONS), end(FUNCTIONS), [&](const Function& f) { return name == f.name; });
+            if (function == end(FUNCTIONS)) {
+                fail(tfm::format("Unknown function '%s'", name));
+            }
+
+            for (size_t i = 0; i < function->numArguments; ++i) {
+                if (i > 0) {
+                    expect(',');
+                }
+                parseComparison();
+            }
+
+            expect(')');
+            emit(function->op);
+            return;
+        }
+
+        auto it = find(begin(mInputs), end(mInputs), name);
+        if (it == end(mInputs)) {
+            mInputs.emplace_back(name);
+            it = end(mInputs) - 1;
+        }
+
+        emit(EOp::Input, 0, (size_t)(it - begin(mInputs)));
+    }
+
+    const string& mText;
+    size_t mPosition = 0;
+
+    vector<string>& mInputs;
+    vector<Instruction>& mInstructions;
+};
+
+template <typename F>
+void applyUnary(float* a, size_t n, F f) {
+    for (size_t i = 0; i < n; ++i) {
+        a[i] = f(a[i]);
+    }
+}
+
+template <typename F>
+void applyBinary(float* a, const float* b, size_t n, F f) {
+    for (size_t i = 0; i < n; ++i) {
+        a[i] = f(a[i], b[i]);
+    }
+}
+
+}
+
+ChannelExpression::ChannelExpression(const string& definition) : mDefinition{definition} {
+    mName = Parser{mDefinition, mInputs, mInstructions}.parseDefinition();
+
+    if (find(begin(mInputs), end(mInputs), mName) != end(mInputs)) {
+        throw invalid_argument{tfm::format("Invalid channel expression '%s'. Channel '%s' can not depend on itself.", definition, mName)};
+    }
+
+    size_t stackSize = 0;
+    for (const auto& instruction : mInstructions) {
+        switch (instruction.op) {
+            case EOp::Constant:
+            case EOp::Input:
+                ++stackSize;
+                break;
+            case EOp::Negate:
+            case EOp::Abs:
+            case EOp::Sqrt:
+            case EOp::Exp:
+            case EOp::Log:
+                break;
+            default:
+                --stackSize;
+                break;
+        }
+
+        mStackSize = max(mStackSize, stackSize);
+    }
+
+    TEV_ASSERT(stackSize == 1, "Expressions must leave exactly one value on the stack.");
+}
+
+void ChannelExpression::evaluate(const vector<const float*>& inputs, float* result, size_t count) const {
+    TEV_ASSERT(inputs.size() == mInputs.size(), "Number of inputs (%d) must match the expression (%d).", inputs.size(), mInputs.size());
+
+    vector<float> stack(mStackSize * BLOCK_SIZE);
+    for (size_t start = 0; start < count; start += BLOCK_SIZE) {
+        size_t n = min(BLOCK_SIZE, count - start);
+
+        // Points one past the topmost block of the stack, whereas `a` is the topmost block
+        // and `b` the one below.
+        float* top = stack.data();
+        for (const auto& instruction : mInstructions) {
+            size_t depth = (size_t)(top - stack.data()) / BLOCK_SIZE;
+            float* a = depth >= 1 ? top - BLOCK_SIZE : nullptr;
+            float* b = depth >= 2 ? top - 2 * BLOCK_SIZE : nullptr;
+            switch (instruction.op) {
+                case EOp::Constant:     fill_n(top, n, instruction.constant); top += BLOCK_SIZE; break;
+                case EOp::Input:        copy_n(inputs[instruction.input] + start, n, top); top += BLOCK_SIZE; break;
+                case EOp::Negate:       applyUnary(a, n, [](float x) { return -x; }); break;
+                case EOp::Abs:          applyUnary(a, n, [](float x) { return abs(x); }); break;
+                case EOp::Sqrt:         applyUnary(a, n, [](float x) { return sqrt(x); }); break;
+                case EOp::Exp:          applyUnary(a, n, [](float x) { return exp(x); }); break;
+                case EOp::Log:          applyUnary(a, n, [](float x) { return log(x); }); break;
+                case EOp::Add:          applyBinary(b, a, n, [](float x, float y) { return x + y; }); top = a; break;
+                case EOp::Subtract:     applyBinary(b, a, n, [](float x, float y) { return x - y; }); top = a; break;
+                case EOp::Multiply:     applyBinary(b, a, n, [](float x, float y) { return x * y; }); top = a; break;
+                case EOp::Divide:       applyBinary(b, a, n, [](float x, float y) { return x / y; }); top = a; break;
+                case EOp::Power:        applyBinary(b, a, n, [](float x, float y) { return pow(x, y); }); top = a; break;
+                case EOp::Minimum:      applyBinary(b, a, n, [](float x, float y) { return min(x, y); }); top = a; break;
+                case EOp::Maximum:      applyBinary(b, a, n, [](float x, float y) { return max(x, y); }); top = a; break;
+                case EOp::Less:         applyBinary(b, a, n, [](float x, float y) { return x < y ? 1.0f : 0.0f; }); top = a; break;
+                case EOp::LessEqual:    applyBinary(b, a, n, [](float x, float y) { return x <= y ? 1.0f : 0.0f; }); top = a; break;
+                case EOp::Greater:      applyBinary(b, a, n, [](float x, float y) { return x > y ? 1.0f : 0.0f; }); top = a; break;
+                case EOp::GreaterEqual: applyBinary(b, a, n, [](float x, float y) { return x >= y ? 1.0f : 0.0f; }); top = a; break;
+            }
+        }
+
+        copy_n(stack.data(), n, result + start);
+    }
+}
+
+TEV_NAMESPACE_END
@@ -0,0 +1,22 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the BSD 3-Clause License within the LICENSE file.
+
+#include <tev/GuiCommon.h>
+
+#include <nanogui/opengl.h>
+
+using namespace nanogui;
+using namespace std;
+
+TEV_NAMESPACE_BEGIN
+
+void drawTextWithShadow(NVGcontext* ctx, float x, float y, string text, float shadowAlpha) {
+    nvgSave(ctx);
+    nvgFontBlur(ctx, 2);
+    nvgFillColor(ctx, Color{0.0f, shadowAlpha});
+    nvgText(ctx, x + 1, y + 1, text.c_str(), NULL);
+    nvgRestore(ctx);
+    nvgText(ctx, x, y, text.c_str(), NULL);
+}
+
+TEV_NAMESPACE_END
@@ -0,0 +1,1085 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the BSD 3-Clause License within the LICENSE file.
+
+#include <tev/BufferPool.h>
+#include <tev/Headless.h>
+#include <tev/Image.h>
+#include <tev/ImageProcessing.h>
+#include <tev/ThreadPool.h>
+#include <tev/imageio/ImageSaver.h>
+
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
+
+#ifndef _WIN32
+#   include <sys/stat.h>
+#endif
+
+using namespace Eigen;
+using namespace filesystem;
+using namespace std;
+
+TEV_NAMESPACE_BEGIN
+
+namespace {
+
+const int EXIT_THRESHOLD_EXCEEDED = 1;
+const int EXIT_LOADING_FAILED = 2;
+const int EXIT_SAVING_FAILED = 3;
+
+// Abbreviations as used by the GUI and the --metric flag.
+const char* metricName(EMetric metric) {
+    switch (metric) {
+        case Error:                 return "E";
+        case AbsoluteError:         return "AE";
+        case SquaredError:          return "SE";
+        case RelativeAbsoluteError: return "RAE";
+        case RelativeSquaredError:  return "RSE";
+        default:
+            throw runtime_error{"Invalid metric selected."};
+    }
+}
+
+// Loads every image only once, even if it is used by several comparisons (e.g. as the common
+// reference), and releases it as soon as the last comparison that uses it is done.
+class ImageCache {
+public:
+    ImageCache(const vector<ImageArgument>& uses) {
+        for (const auto& use : uses) {
+            ++mNumUses[key(use)];
+        }
+    }
+
+    shared_ptr<Image> acquire(const ImageArgument& argument) {
+        promise<shared_ptr<Image>> loadPromise;
+        shared_future<shared_ptr<Image>> image;
+        bool shallLoad = false;
+
+        {
+            lock_guard<mutex> lock{mMutex};
+            auto it = mImages.find(key(argument));
+            if (it == end(mImages)) {
+                image = loadPromise.get_future().share();
+                mImages[key(argument)] = image;
+                shallLoad = true;
+            } else {
+                image = it->second;
+            }
+        }
+
+        if (shallLoad) {
+            loadPromise.set_value(tryLoadImage(argument.path, argument.channelSelector));
+        }
+
+        return image.get();
+    }
+
+    void release(const ImageArgument& argument) {
+        lock_guard<mutex> lock{mMutex};
+        if (--mNumUses[key(argument)] == 0) {
+            mImages.erase(key(argument));
+        }
+    }
+
+private:
+    static string key(const ImageArgument& argument) {
+        return argument.path + ":" + argument.channelSelector;
+    }
+
+    mutex mMutex;
+    map<string, size_t> mNumUses;
+    map<string, shared_future<shared_ptr<Image>>> mImages;
+};
+
+struct GroupStatistics {
+    string group;
+    // Either a single entry for the statistics of an image or one entry per metric.
+    vector<pair<EMetric, shared_ptr<CanvasStatistics>>> statistics;
+};
+
+struct Report {
+    ImageArgument image;
+    ImageArgument reference;
+    bool hasLoaded = false;
+    bool hasPassed = true;
+    Eigen::Vector2i size = Eigen::Vector2i::Zero();
+    vector<GroupStatistics> groups;
+};
+
+// Decoding is parallelized internally via gThreadPool, so only a few images are processed at
+// once.
+template <typename F>
+void processConcurrently(size_t numTasks, F task) {
+    ThreadPool workers{4};
+    vector<future<void>> futures;
+    for (size_t i = 0; i < numTasks; ++i) {
+        futures.emplace_back(workers.enqueueTask([i, &task] { task(i); }));
+    }
+
+    for (auto& f : futures) {
+        f.get();
+    }
+}
+
+string displayName(const ImageArgument& argument) {
+    return argument.channelSelector.empty() ? argument.path : tfm::format("%s:%s", argument.path, argument.channelSelector);
+}
+
+string jsonString(const string& str) {
+    string result = "\"";
+    for (char c : str) {
+        switch (c) {
+            case '"':  result += "\\\""; break;
+            case '\\': result += "\\\\"; break;
+            case '\n': result += "\\n"; break;
+            case '\r': result += "\\r"; break;
+            case '\t': result += "\\t"; break;
+            default:
+                if ((unsigned char)c < 0x20) {
+                    result += tfm::format("\\u%04x", (int)c);
+                } else {
+                    result += c;
+                }
+        }
+    }
+    return result + "\"";
+}
+
+// Bytes per memory category, keyed by the lower-case category name.
+string memoryJson(const MemoryUsage& usage, bool peak) {
+    string result = "{";
+    for (int i = 0; i < NumMemoryCategories; ++i) {
+        EMemoryCategory category = (EMemoryCategory)i;
+        result += tfm::format("%s: %d, ", jsonString(toLower(memoryCategoryName(category))), peak ? usage.peakBytes(category) : usage.bytes(category));
+    }
+    return result + tfm::format("\"total\": %d}", peak ? usage.peakTotalBytes() : usage.totalBytes());
+}
+
+// JSON has no representation of NaN and infinity, which may well occur in the images.
+string jsonNumber(float value) {
+    return isfinite(value) ? tfm::format("%.9g", value) : "null";
+}
+
+string csvField(const string& str) {
+    if (str.find_first_of(",\"\n") == string::npos) {
+        return str;
+    }
+
+    string result = "\"";
+    for (char c : str) {
+        result += c == '"' ? string{"\"\""} : string{c};
+    }
+    return result + "\"";
+}
+
+void writeJson(ostream& out, const vector<Report>& reports, bool isComparison, const HeadlessSettings& settings) {
+    out << "{\n";
+    if (isComparison && settings.hasThreshold) {
+        out << "  \"metric\": " << jsonString(metricName(settings.metric)) << ",\n";
+        out << "  \"threshold\": " << jsonNumber(settings.threshold) << ",\n";
+    }
+
+    out << (isComparison ? "  \"comparisons\": [" : "  \"images\": [");
+    for (size_t i = 0; i < reports.size(); ++i) {
+        const auto& report = reports[i];
+        out << (i == 0 ? "\n" : ",\n") << "    {\n";
+        out << "      \"image\": " << jsonString(displayName(report.image)) << ",\n";
+        if (isComparison) {
+            out << "      \"reference\": " << jsonString(displayName(report.reference)) << ",\n";
+        }
+
+        if (!report.hasLoaded) {
+            out << "      \"error\": \"Could not be loaded.\"\n    }";
+            continue;
+        }
+
+        if (isComparison) {
+            out << "      \"passed\": " << (report.hasPassed ? "true" : "false") << ",\n";
+        }
+
+        out << "      \"width\": " << report.size.x() << ",\n";
+        out << "      \"height\": " << report.size.y() << ",\n";
+        out << "      \"groups\": [";
+        for (size_t j = 0; j < report.groups.size(); ++j) {
+            const auto& group = report.groups[j];
+            out << (j == 0 ? "\n" : ",\n") << "        {\"name\": " << jsonString(group.group);
+            for (const auto& statistics : group.statistics) {
+                const auto& s = *statistics.second;
+                string values = tfm::format("{\"mean\": %s, \"minimum\": %s, \"maximum\": %s}", jsonNumber(s.mean), jsonNumber(s.minimum), jsonNumber(s.maximum));
+                if (isComparison) {
+                    out << ", " << jsonString(metricName(statistics.first)) << ": " << values;
+                } else {
+                    out << ", \"statistics\": " << values;
+                }
+            }
+            out << "}";
+        }
+        out << "\n      ]\n    }";
+    }
+
+    out << "\n  ]\n}\n";
+}
+
+void writeCsv(ostream& out, const vector<Report>& reports, bool isComparison) {
+    out << (isComparison ? "image,reference,group,metric,mean,minimum,maximum\n" : "image,group,mean,minimum,maximum\n");
+    for (const auto& report : reports) {
+        string prefix = csvField(displayName(report.image)) + ",";
+        if (isComparison) {
+            prefix += csvField(displayName(report.reference)) + ",";
+        }
+
+        // Images that failed to load appear with empty values, such that they are not silently missing.
+        if (!report.hasLoaded) {
+            out << prefix << (isComparison ? ",,,,\n" : ",,,\n");
+            continue;
+        }
+
+        for (const auto& group : report.groups) {
+            for (const auto& statistics : group.statistics) {
+                const auto& s = *statistics.second;
+                out << prefix << csvField(group.group) << ",";
+                if (isComparison) {
+                    out << metricName(statistics.first) << ",";
+                }
+                out << tfm::format("%.9g,%.9g,%.9g\n", s.mean, s.minimum, s.maximum);
+            }
+        }
+    }
+}
+
+int writeReports(const vector<Report>& reports, bool isComparison, const HeadlessSettings& settings) {
+    auto write = [&](ostream& out) {
+        if (settings.format == EReportFormat::Csv) {
+            writeCsv(out, reports, isComparison);
+        } else {
+            writeJson(out, reports, isComparison, settings);
+        }
+    };
+
+    if (settings.outputPath.empty()) {
+        write(cout);
+    } else {
+        ofstream outputStream{nativeString(settings.outputPath)};
+        write(outputStream);
+        if (!outputStream) {
+            throw runtime_error{tfm::format("Could not write to %s.", settings.outputPath)};
+        }
+    }
+
+    size_t numFailedToLoad = count_if(begin(reports), end(reports), [](const Report& r) { return !r.hasLoaded; });
+    size_t numFailed = count_if(begin(reports), end(reports), [](const Report& r) { return !r.hasPassed; });
+
+    if (numFailedToLoad > 0) {
+        tlog::error() << tfm::format("%d of %d images could not be loaded.", numFailedToLoad, reports.size());
+        return EXIT_LOADING_FAILED;
+    }
+
+    if (numFailed > 0) {
+        tlog::error() << tfm::format("%d of %d comparisons exceed the %s threshold of %f.", numFailed, reports.size(), metricName(settings.metric), settings.threshold);
+        return EXIT_THRESHOLD_EXCEEDED;
+    }
+
+    return 0;
+}
+
+
+// Bounds the number of images that are in flight between being decoded and being saved.
+class ImageSlots {
+public:
+    ImageSlots(size_t numSlots) : mNumFreeSlots{numSlots} {}
+
+    void acquire() {
+        unique_lock<mutex> lock{mMutex};
+        mSlotFreed.wait(lock, [this] { return mNumFreeSlots > 0; });
+        --mNumFreeSlots;
+    }
+
+    void release() {
+        {
+            lock_guard<mutex> lock{mMutex};
+            ++mNumFreeSlots;
+        }
+        mSlotFreed.notify_one();
+    }
+
+private:
+    mutex mMutex;
+    condition_variable mSlotFreed;
+    size_t mNumFreeSlots;
+};
+
+string replaceAll(string str, const string& placeholder, const string& value) {
+    for (size_t pos = str.find(placeholder); pos != string::npos; pos = str.find(placeholder, pos + value.size())) {
+        str.replace(pos, placeholder.size(), value);
+    }
+    return str;
+}
+
+path exportPath(const string& pattern, const path& imagePath, size_t index) {
+    string name = imagePath.filename();
+    size_t dot = name.find_last_of('.');
+    if (dot != string::npos && dot > 0) {
+        name = name.substr(0, dot);
+    }
+
+    string directory = imagePath.parent_path().str();
+    if (directory.empty()) {
+        directory = ".";
+    }
+
+    string result = replaceAll(pattern, "{name}", name);
+    result = replaceAll(result, "{dir}", directory);
+    return replaceAll(result, "{index}", to_string(index));
+}
+
+const ImageSaver* findSaver(const path& path) {
+    for (const auto& saver : ImageSaver::getSavers()) {
+        if (saver->canSaveFile(path)) {
+            return saver.get();
+        }
+    }
+
+    return nullptr;
+}
+
+template <typename T>
+void saveImageData(const TypedImageSaver<T>& saver, const path& path, const PooledVector<T>& data, const Vector2i& size) {
+    ofstream f{nativeString(path), ios_base::binary};
+    if (!f) {
+        throw invalid_argument{tfm::format("Could not open file %s", path)};
+    }
+
+    saver.save(f, path, data, size, 4);
+}
+
+string findChannelGroup(const Image& image, const string& requestedGroup) {
+    for (const auto& group : image.channelGroups()) {
+        if (matchesFuzzy(group.name, requestedGroup)) {
+            return group.name;
+        }
+    }
+
+    throw invalid_argument{tfm::format("No channel group matches '%s'.", requestedGroup)};
+}
+
+IpcPacket makeReply(bool success, const string& message) {
+    IpcPacket reply;
+    reply.setReply(success, message);
+    return reply;
+}
+
+// Whether `path` remains within `directory` once symlinks are resolved, which lexical checks
+// can not tell, since symlinks within the directory may point anywhere. The parent of `path`
+// must exist, and `path` itself must not be a symlink, which writing would follow.
+bool isWithinDirectory(const path& path, const class path& directory) {
+#ifndef _WIN32
+    struct stat info;
+    if (lstat(path.str().c_str(), &info) == 0 && S_ISLNK(info.st_mode)) {
+        return false;
+    }
+#endif
+
+    string resolvedDirectory, resolvedParent;
+    try {
+        resolvedDirectory = directory.make_absolute().str();
+        resolvedParent = path.parent_path().make_absolute().str();
+    } catch (const runtime_error&) {
+        return false;
+    }
+
+#ifdef _WIN32
+    const char separator = '\\';
+#else
+    const char separator = '/';
+#endif
+
+    if (resolvedDirectory.empty() || resolvedDirectory.back() != separator) {
+        resolvedDirectory += separator;
+    }
+
+    return (resolvedParent + separator).compare(0, resolvedDirectory.size(), resolvedDirectory) == 0;
+}
+}
+
+int computeStatisticsHeadless(const HeadlessSettings& settings) {
+    if (settings.images.empty()) {
+        throw invalid_argument{"No images were given."};
+    }
+
+    vector<Report> reports(settings.images.size());
+    ImageCache cache{settings.images};
+
+    processConcurrently(settings.images.size(), [&](size_t i) {
+        auto& report = reports[i];
+        report.image = settings.images[i];
+
+        auto image = cache.acquire(report.image);
+        if (image) {
+            report.hasLoaded = true;
+            report.size = image->size();
+
+            for (const auto& group : image->channelGroups()) {
+                report.groups.push_back({group.name, {{Error, computeCanvasStatistics(image, nullptr, group.name, Error, settings.comparisonFilter, false)}}});
+            }
+        }
+
+        cache.release(report.image);
+    });
+
+    return writeReports(reports, false, settings);
+}
+
+int compareImagesHeadless(const HeadlessSettings& settings) {
+    vector<pair<ImageArgument, ImageArgument>> pairs;
+    if (settings.hasReference) {
+        for (const auto& image : settings.images) {
+            pairs.emplace_back(image, settings.reference);
+        }
+    } else {
+        if (settings.images.size() % 2 != 0) {
+            throw invalid_argument{"Images must be given in pairs of image and reference if no reference is specified."};
+        }
+
+        for (size_t i = 0; i < settings.images.size(); i += 2) {
+            pairs.emplace_back(settings.images[i], settings.images[i + 1]);
+        }
+    }
+
+    if (pairs.empty()) {
+        throw invalid_argument{"No images were given."};
+    }
+
+    vector<ImageArgument> uses;
+    for (const auto& pair : pairs) {
+        uses.emplace_back(pair.first);
+        uses.emplace_back(pair.second);
+    }
+
+    vector<Report> reports(pairs.size());
+    ImageCache cache{uses};
+
+    processConcurrently(pairs.size(), [&](size_t i) {
+        auto& report = reports[i];
+        report.image = pairs[i].first;
+        report.reference = pairs[i].second;
+
+        auto image = cache.acquire(report.image);
+        auto reference = cache.acquire(report.reference);
+        if (image && reference) {
+            report.hasLoaded = true;
+            report.size = image->size();
+
+            for (const auto& group : image->channelGroups()) {
+                GroupStatistics groupStatistics{group.name, {}};
+                auto metricStatistics = computeMetricStatistics(image, reference, group.name, settings.comparisonFilter);
+                for (int m = 0; m < NumMetrics; ++m) {
+                    EMetric metric = (EMetric)m;
+                    const auto& statistics = metricStatistics[m];
+                    groupStatistics.statistics.emplace_back(metric, statistics);
+
+                    // Written such that NaN errors fail as well.
+                    if (settings.hasThreshold && metric == settings.metric && !(abs(statistics->mean) <= settings.threshold)) {
+                        report.hasPassed = false;
+                    }
+                }
+
+                report.groups.emplace_back(groupStatistics);
+            }
+        }
+
+        cache.release(report.image);
+        cache.release(report.reference);
+    });
+
+    return writeReports(reports, true, settings);
+}
+
+int exportImagesHeadless(const HeadlessSettings& settings) {
+    vector<ImageArgument> images;
+    for (const auto& argument : settings.images) {
+        for (const auto& imagePath : resolveImagePaths(argument.path)) {
+            images.push_back({imagePath.str(), argument.channelSelector});
+        }
+    }
+
+    if (images.empty()) {
+        throw invalid_argument{"No images were given."};
+    }
+
+    const ImageSaver* saver = findSaver(settings.exportPattern);
+    if (!saver) {
+        throw invalid_argument{tfm::format("No save routine for image type '%s' found.", path{settings.exportPattern}.extension())};
+    }
+
+    const auto* hdrSaver = dynamic_cast<const TypedImageSaver<float>*>(saver);
+    const auto* ldrSaver = dynamic_cast<const TypedImageSaver<char>*>(saver);
+    TEV_ASSERT(hdrSaver || ldrSaver, "Each image saver must either be a HDR or an LDR saver.");
+
+    // Catch patterns that would silently overwrite exported images before any work is done.
+    vector<path> outputPaths;
+    set<string> uniqueOutputPaths;
+    for (size_t i = 0; i < images.size(); ++i) {
+        outputPaths.emplace_back(exportPath(settings.exportPattern, images[i].path, i));
+        if (!uniqueOutputPaths.insert(outputPaths.back().str()).second) {
+            throw invalid_argument{tfm::format(
+                "Several images would be exported to '%s'. Use {name}, {dir}, or {index} in the export pattern to distinguish them.",
+                outputPaths.back()
+            )};
+        }
+    }
+
+    shared_ptr<Image> reference;
+    if (settings.hasReference) {
+        reference = tryLoadImage(settings.reference.path, settings.reference.channelSelector);
+        if (!reference) {
+            tlog::error() << tfm::format("Reference %s could not be loaded.", displayName(settings.reference));
+            return EXIT_LOADING_FAILED;
+        }
+    }
+
+    // Decoding and tonemapping are parallelized internally via gThreadPool, whereas encoding
+    // mostly runs on a single thread per image. Encoding an image therefore overlaps with
+    // decoding the next ones, but the number of images in flight is bounded to keep memory
+    // usage independent of the number of exported images.
+    const size_t numDecoders = 2;
+    const size_t numEncoders = 4;
+    ImageSlots slots{numDecoders + numEncoders + 2};
+
+    ThreadPool decoders{numDecoders};
+    ThreadPool encoders{numEncoders};
+
+    atomic<size_t> numFailedToLoad{0};
+    atomic<size_t> numFailedToSave{0};
+
+    auto encode = [&](const auto& typedSaver, auto data, const Vector2i& size, const path& outputPath) {
+        encoders.enqueueTask([&, typedSaver = &typedSaver, data = move(data), size, outputPath] {
+            try {
+                saveImageData(*typedSaver, outputPath, data, size);
+                tlog::success() << tfm::format("Exported '%s'.", outputPath);
+            } catch (const exception& e) {
+                tlog::error() << tfm::format("Could not export '%s': %s", outputPath, e.what());
+                ++numFailedToSave;
+            }
+
+            slots.release();
+        });
+    };
+
+    for (size_t i = 0; i < images.size(); ++i) {
+        slots.acquire();
+        decoders.enqueueTask([&, i] {
+            const auto& argument = images[i];
+            const auto& outputPath = outputPaths[i];
+
+            auto image = tryLoadImage(argument.path, argument.channelSelector);
+            if (!image) {
+                ++numFailedToLoad;
+                slots.release();
+                return;
+            }
+
+            try {
+                string group = findChannelGroup(*image, settings.channelGroup);
+                bool divideAlpha = !saver->hasPremultipliedAlpha();
+                Vector2i size = image->size();
+
+                // The decoded channels are released as soon as the interleaved data exists,
+                // such that only the latter waits for an encoder.
+                if (hdrSaver) {
+                    auto data = getHdrImageData(image, reference, group, settings.metric, settings.comparisonFilter, divideAlpha);
+                    image = nullptr;
+                    encode(*hdrSaver, move(data), size, outputPath);
+                } else {
+                    auto data = getLdrImageData(image, reference, group, settings.metric, settings.comparisonFilter, divideAlpha, settings.displaySettings);
+                    image = nullptr;
+                    encode(*ldrSaver, move(data), size, outputPath);
+                }
+            } catch (const exception& e) {
+                tlog::error() << tfm::format("Could not export %s: %s", displayName(argument), e.what());
+                ++numFailedToSave;
+                slots.release();
+            }
+        });
+    }
+
+    decoders.waitUntilFinished();
+    encoders.waitUntilFinished();
+
+    if (numFailedToLoad > 0) {
+        tlog::error() << tfm::format("%d of %d images could not be loaded.", numFailedToLoad.load(), images.size());
+        return EXIT_LOADING_FAILED;
+    }
+
+    if (numFailedToSave > 0) {
+        tlog::error() << tfm::format("%d of %d images could not be exported.", numFailedToSave.load(), images.size());
+        return EXIT_SAVING_FAILED;
+    }
+
+    return 0;
+}
+
+EReportFormat toReportFormat(string name) {
+    name = toUpper(name);
+    if (name == "CSV") {
+        return EReportFormat::Csv;
+    } else {
+        return EReportFormat::Json;
+    }
+}
+
+HeadlessServer::HeadlessServer(shared_ptr<Ipc> ipc, size_t memoryBudget) : mIpc{ipc}, mMemoryBudget{memoryBudget} {
+    if (!mIpc->isPrimaryInstance()) {
+        throw runtime_error{"Another instance of tev is already listening for IPC clients."};
+    }
+}
+
+void HeadlessServer::open(const string& path, const string& channelSelector) {
+    // Images from the command line are opened in the order given, just like a client would.
+    schedule(-1, [this, path, channelSelector] {
+        openImages(path, channelSelector);
+    });
+}
+
+void HeadlessServer::run(const atomic<bool>& shallShutdown) {
+    // Clients commonly stream an image as many small tiles, which are applied in batches of
+    // all the tiles that arrived at once. Other packets still run in the order they arrived.
+    map<int, vector<IpcPacket>> updates;
+    auto scheduleUpdates = [&](int clientId) {
+        auto it = updates.find(clientId);
+        if (it == end(updates)) {
+            return;
+        }
+
+        schedule(clientId, [this, packets = move(it->second)] {
+            updateImages(packets);
+        });
+        updates.erase(it);
+    };
+
+    while (!shallShutdown) {
+        mIpc->receiveFromSecondaryInstance([&](const IpcPacket& packet, int clientId) {
+            auto type = packet.type();
+            if (type == IpcPacket::UpdateImage || type == IpcPacket::UpdateImageV2 || type == IpcPacket::UpdateImageV3) {
+                updates[clientId].emplace_back(packet);
+                return;
+            }
+
+            scheduleUpdates(clientId);
+            schedule(clientId, [this, packet, clientId] {
+                handlePacket(packet, clientId);
+            });
+        });
+
+        while (!updates.empty()) {
+            scheduleUpdates(begin(updates)->first);
+        }
+
+        try {
+            while (true) {
+                auto reply = mReplies.tryPop();
+                mIpc->sendToSecondaryInstance(reply.first, reply.second);
+            }
+        } catch (const runtime_error&) {
+        }
+
+        // Shorter than in the GUI, since clients commonly wait for replies.
+        this_thread::sleep_for(chrono::milliseconds{1});
+    }
+}
+
+void HeadlessServer::schedule(int clientId, function<void()> task) {
+    lock_guard<mutex> lock{mClientTasksMutex};
+    auto& tasks = mClientTasks[clientId];
+    tasks.emplace_back(move(task));
+
+    // Tasks are only popped once they are done, so a single task means that no worker
+    // is currently running the tasks of this client.
+    if (tasks.size() == 1) {
+        mWorkers.enqueueTask([this, clientId] { runClientTasks(clientId); });
+    }
+}
+
+void HeadlessServer::runClientTasks(int clientId) {
+    while (true) {
+        function<void()> task;
+        {
+            lock_guard<mutex> lock{mClientTasksMutex};
+            task = mClientTasks[clientId].front();
+        }
+
+        task();
+
+        lock_guard<mutex> lock{mClientTasksMutex};
+        auto& tasks = mClientTasks[clientId];
+        tasks.pop_front();
+        if (tasks.empty()) {
+            mClientTasks.erase(clientId);
+            return;
+        }
+    }
+}
+
+void HeadlessServer::handlePacket(const IpcPacket& packet, int clientId) {
+    try {
+        switch (packet.type()) {
+            case IpcPacket::OpenImage:
+            case IpcPacket::OpenImageV2: {
+                auto info = packet.interpretAsOpenImage();
+                openImages(ensureUtf8(info.imagePath), ensureUtf8(info.channelSelector));
+                break;
+            }
+
+            case IpcPacket::OpenImageData: {
+                auto info = packet.interpretAsOpenImageData();
+                auto image = tryLoadImage(ensureUtf8(info.imageName), move(info.imageData), ensureUtf8(info.channelSelector));
+                if (image) {
+                    addImage(image, false);
+                }
+                break;
+            }
+
+            case IpcPacket::ReloadImage: {
+                // Reloading amounts to evicting the image, such that its next use loads it anew.
+                auto info = packet.interpretAsReloadImage();
+                lock_guard<mutex> lock{mEntriesMutex};
+                for (auto& entry : mEntries) {
+                    if (entry.name == ensureUtf8(info.imageName) && entry.canReload) {
+                        entry.image = nullptr;
+                    }
+                }
+                break;
+            }
+
+            case IpcPacket::CloseImage: {
+                closeImage(ensureUtf8(packet.interpretAsCloseImage().imageName));
+                break;
+            }
+
+            case IpcPacket::UpdateImage:
+            case IpcPacket::UpdateImageV2:
+            case IpcPacket::UpdateImageV3: {
+                updateImages({packet});
+                break;
+            }
+
+            case IpcPacket::CreateImage: {
+                auto info = packet.interpretAsCreateImage();
+                stringstream imageStream;
+                imageStream << "empty " << info.width << " " << info.height << " " << info.nChannels << " ";
+                for (const auto& channelName : info.channelNames) {
+                    imageStream << channelName.length() << channelName;
+                }
+
+                auto image = tryLoadImage(ensureUtf8(info.imageName), imageStream, "");
+                if (image) {
+                    addImage(image, false);
+                }
+                break;
+            }
+
+            case IpcPacket::QueryImages: {
+                mReplies.push({clientId, makeReply(true, queryImages())});
+                break;
+            }
+
+            case IpcPacket::ComputeStatistics: {
+                mReplies.push({clientId, makeReply(true, computeStatistics(packet.interpretAsComputeStatistics()))});
+                break;
+            }
+
+            case IpcPacket::ExportImage: {
+                mReplies.push({clientId, makeReply(true, exportImage(packet.interpretAsExportImage()))});
+                break;
+            }
+
+            default: {
+                throw runtime_error{tfm::format("Invalid IPC packet type %d", (int)packet.type())};
+            }
+        }
+    } catch (const exception& e) {
+        // Queries must be answered in any case, since their clients wait for a reply.
+        bool isQuery = packet.type() == IpcPacket::QueryImages || packet.type() == IpcPacket::ComputeStatistics || packet.type() == IpcPacket::ExportImage;
+        if (isQuery) {
+            mReplies.push({clientId, makeReply(false, e.what())});
+        } else {
+            tlog::warning() << "Could not handle IPC packet: " << e.what();
+        }
+    }
+}
+
+void HeadlessServer::openImages(const string& path, const string& channelSelector) {
+    auto paths = resolveImagePaths(path);
+    if (paths.empty()) {
+        tlog::warning() << tfm::format("No images found in '%s'.", path);
+    }
+
+    // Only headers are read, such that opening many images is cheap and memory is only
+    // spent on images that are actually queried.
+    for (const auto& imagePath : paths) {
+        auto image = tryLoadImageHeader(imagePath, channelSelector);
+        if (!image) {
+            image = tryLoadImage(imagePath, channelSelector);
+        }
+
+        if (image) {
+            addImage(image, true);
+        }
+    }
+}
+
+void HeadlessServer::addImage(const shared_ptr<Image>& image, bool canReload) {
+    lock_guard<mutex> lock{mEntriesMutex};
+
+    // Opening or creating an image of an existing name replaces it.
+    Entry entry{image->name(), image, image->path(), image->channelSelector(), canReload, mNumUses++, image->size(), image->channelGroups()};
+    auto it = find_if(begin(mEntries), end(mEntries), [&](const Entry& e) { return e.name == entry.name; });
+    if (it != end(mEntries)) {
+        *it = move(entry);
+    } else {
+        mEntries.emplace_back(move(entry));
+    }
+
+    tlog::info() << tfm::format("Opened '%s'.", image->name());
+    evictToBudget();
+}
+
+void HeadlessServer::closeImage(const string& name) {
+    lock_guard<mutex> lock{mEntriesMutex};
+    auto it = find_if(begin(mEntries), end(mEntries), [&](const Entry& e) { return e.name == name; });
+    if (it != end(mEntries)) {
+        mEntries.erase(it);
+    }
+}
+
+void HeadlessServer::updateImages(const vector<IpcPacket>& packets) {
+    vector<IpcPacketUpdateImage> infos;
+    for (const auto& packet : packets) {
+        infos.emplace_back(packet.interpretAsUpdateImage());
+    }
+
+    // Consecutive updates of the same image form one batch.
+    for (size_t first = 0; first < infos.size();) {
+        size_t last = first + 1;
+        while (last < infos.size() && infos[last].imageName == infos[first].imageName) {
+            ++last;
+        }
+
+        try {
+            auto image = acquire(ensureUtf8(infos[first].imageName));
+
+            vector<ChannelUpdate> updates;
+            for (size_t i = first; i < last; ++i) {
+                const auto& info = infos[i];
+                for (int c = 0; c < info.nChannels; ++c) {
+                    updates.push_back({info.channelNames[c], info.x, info.y, info.width, info.height, &info.imageData[c]});
+                }
+            }
+
+            // Queries read snapshots of the channels and therefore need not wait for the update.
+            image->updateChannels(updates);
+
+            // The image now differs from the file it was loaded from and must no longer be evicted.
+            lock_guard<mutex> lock{mEntriesMutex};
+            for (auto& entry : mEntries) {
+                if (entry.image == image) {
+                    entry.canReload = false;
+                }
+            }
+        } catch (const exception& e) {
+            tlog::warning() << "Could not handle IPC packet: " << e.what();
+        }
+
+        first = last;
+    }
+}
+
+shared_ptr<Image> HeadlessServer::acquire(const string& name) {
+    shared_ptr<Image> image;
+    class path path;
+    string channelSelector;
+    {
+        lock_guard<mutex> lock{mEntriesMutex};
+        auto it = find_if(begin(mEntries), end(mEntries), [&](const Entry& e) { return e.name == name; });
+        if (it == end(mEntries)) {
+            throw invalid_argument{tfm::format("Image '%s' does not exist.", name)};
+        }
+
+        it->lastUse = mNumUses++;
+        if (it->image && !it->image->isDeferred()) {
+            return it->image;
+        }
+
+        image = it->image;
+        path = it->path;
+        channelSelector = it->channelSelector;
+    }
+
+    // Decode without holding the lock, such that other clients are not blocked in the meantime.
+    auto decodedImage = image ? image->decode() : tryLoadImage(path, channelSelector);
+    if (!decodedImage) {
+        throw invalid_argument{tfm::format("Image '%s' could not be loaded.", name)};
+    }
+
+    lock_guard<mutex> lock{mEntriesMutex};
+    auto it = find_if(begin(mEntries), end(mEntries), [&](const Entry& e) { return e.name == name; });
+    if (it != end(mEntries) && it->image == image) {
+        it->image = decodedImage;
+        evictToBudget();
+    }
+
+    return decodedImage;
+}
+
+void HeadlessServer::evictToBudget() {
+    if (mMemoryBudget == 0) {
+        return;
+    }
+
+    auto bytes = [](const Entry& entry) {
+        bool isResident = entry.image && !entry.image->isDeferred();
+        return isResident ? entry.image->numChannels() * (size_t)entry.image->count() * sizeof(float) : 0;
+    };
+
+    size_t totalBytes = 0;
+    for (const auto& entry : mEntries) {
+        totalBytes += bytes(entry);
+    }
+
+    while (totalBytes > mMemoryBudget) {
+        Entry* leastRecentlyUsed = nullptr;
+        for (auto& entry : mEntries) {
+            if (entry.canReload && bytes(entry) > 0 && (!leastRecentlyUsed || entry.lastUse < leastRecentlyUsed->lastUse)) {
+                leastRecentlyUsed = &entry;
+            }
+        }
+
+        if (!leastRecentlyUsed) {
+            tlog::warning() << tfm::format("Images that can not be evicted exceed the memory budget by %d bytes.", totalBytes - mMemoryBudget);
+            return;
+        }
+
+        // Queries that still use the image keep it alive until they are done.
+        totalBytes -= bytes(*leastRecentlyUsed);
+        leastRecentlyUsed->image = nullptr;
+        tlog::info() << tfm::format("Evicted '%s' to stay within the memory budget.", leastRecentlyUsed->name);
+    }
+}
+
+string HeadlessServer::queryImages() {
+    lock_guard<mutex> lock{mEntriesMutex};
+
+    // Evicted images hold no memory.
+    static const MemoryUsage noMemory;
+
+    string result = "{\"images\": [";
+    for (size_t i = 0; i < mEntries.size(); ++i) {
+        const auto& entry = mEntries[i];
+        result += tfm::format(
+            "%s{\"name\": %s, \"width\": %d, \"height\": %d, \"resident\": %s, \"memory\": %s, \"groups\": [",
+            i == 0 ? "" : ", ", jsonString(entry.name), entry.size.x(), entry.size.y(),
+            entry.image && !entry.image->isDeferred() ? "true" : "false",
+            memoryJson(entry.image ? *entry.image->memoryUsage() : noMemory, false)
+        );
+
+        for (size_t j = 0; j < entry.channelGroups.size(); ++j) {
+            result += (j == 0 ? "" : ", ") + jsonString(entry.channelGroups[j].name);
+        }
+        result += "]}";
+    }
+
+    const auto& global = MemoryUsage::global();
+    auto pool = BufferPool::global().statistics();
+    return result + tfm::format(
+        "], \"memory\": %s, \"peakMemory\": %s, \"bufferPool\": {\"allocations\": %d, \"reuses\": %d, \"used\": %d, \"free\": %d, \"peak\": %d}}",
+        memoryJson(global, false), memoryJson(global, true),
+        pool.numAllocations, pool.numReuses, pool.usedBytes, pool.freeBytes, pool.peakBytes
+    );
+}
+
+string HeadlessServer::computeStatistics(const IpcPacketComputeStatistics& info) {
+    auto image = acquire(ensureUtf8(info.imageName));
+    auto reference = info.referenceName.empty() ? nullptr : acquire(ensureUtf8(info.referenceName));
+    EMetric metric = toMetric(info.metric);
+
+    vector<string> groups;
+    if (info.channelGroup.empty()) {
+        for (const auto& group : image->channelGroups()) {
+            groups.emplace_back(group.name);
+        }
+    } else {
+        groups.emplace_back(findChannelGroup(*image, info.channelGroup));
+    }
+
+    string result = tfm::format("{\"image\": %s, ", jsonString(image->name()));
+    if (reference) {
+        result += tfm::format("\"reference\": %s, \"metric\": %s, ", jsonString(reference->name()), jsonString(metricName(metric)));
+    }
+
+    result += "\"groups\": [";
+    for (size_t i = 0; i < groups.size(); ++i) {
+        auto statistics = computeCanvasStatistics(image, reference, groups[i], metric, mComparisonFilter, false);
+        result += tfm::format(
+            "%s{\"name\": %s, \"mean\": %s, \"minimum\": %s, \"maximum\": %s}",
+            i == 0 ? "" : ", ", jsonString(groups[i]), jsonNumber(statistics->mean), jsonNumber(statistics->minimum), jsonNumber(statistics->maximum)
+        );
+    }
+
+    return result + "]}";
+}
+
+string HeadlessServer::exportImage(const IpcPacketExportImage& info) {
+    // Any local process can connect, so exports must not reach files outside the directory.
+    // This is checked before acquiring the images, such that rejected exports load nothing.
+    if (mExportDirectory.empty()) {
+        throw invalid_argument{"Exports are disabled. Start tev with --export-dir to enable them."};
+    }
+
+    string relativePath = ensureUtf8(info.path);
+    auto components = split(relativePath, "/\\");
+    bool isAbsolute = relativePath.empty() || relativePath.front() == '/' || relativePath.front() == '\\' || relativePath.find(':') != string::npos;
+    if (isAbsolute || find(begin(components), end(components), "..") != end(components)) {
+        throw invalid_argument{tfm::format("Export path '%s' must be relative to the export directory and must not contain '..'.", relativePath)};
+    }
+
+    class path path = mExportDirectory / relativePath;
+    if (!isWithinDirectory(path, mExportDirectory)) {
+        throw invalid_argument{tfm::format("Export path '%s' must name a file in an existing directory within the export directory.", relativePath)};
+    }
+
+    if (!mAllowOverwrite && path.exists()) {
+        throw invalid_argument{tfm::format("%s already exists. Start tev with --overwrite to replace existing files.", path)};
+    }
+
+    const ImageSaver* saver = findSaver(path);
+    if (!saver) {
+        throw invalid_argument{tfm::format("No save routine for image type '%s' found.", path.extension())};
+    }
+
+    EMetric metric = toMetric(info.metric);
+
+    auto image = acquire(ensureUtf8(info.imageName));
+    auto reference = info.referenceName.empty() ? nullptr : acquire(ensureUtf8(info.referenceName));
+
+    string group = findChannelGroup(*image, info.channelGroup);
+    bool divideAlpha = !saver->hasPremultipliedAlpha();
+    DisplaySettings displaySettings{info.exposure, info.offset, info.gamma, toTonemap(info.tonemap)};
+
+    if (const auto* hdrSaver = dynamic_cast<const TypedImageSaver<float>*>(saver)) {
+        auto data = getHdrImageData(image, reference, group, metric, mComparisonFilter, divideAlpha);
+        saveImageData(*hdrSaver, path, data, image->size());
+    } else if (const auto* ldrSaver = dynamic_cast<const TypedImageSaver<char>*>(saver)) {
+        auto data = getLdrImageData(image, reference, group, metric, mComparisonFilter, divideAlpha, displaySettings);
+        saveImageData(*ldrSaver, path, data, image->size());
+    }
+
+    return tfm::format("{\"path\": %s}", jsonString(path.str()));
+}
+
+TEV_NAMESPACE_END
@@ -73,12 +73,15 @@ HelpWindow::HelpWindow(Widget *parent, bool supportsHdr, function<void()> closeC
         addRow(imageSelection, "Left Click",          "Select Hovered Image");
         addRow(imageSelection, "1…9",                 "Select N-th Image");
         addRow(imageSelection, "Down or S / Up or W", "Select Next / Previous Image");
+        addRow(imageSelection, "Period / Comma",      "Select Next / Previous Frame of Sequence");
 
         addRow(imageSelection, "Click & Drag (+Shift/" + COMMAND + ")", "Translate Image");
         addRow(imageSelection, "Plus / Minus / Scroll (+Shift/" + COMMAND + ")", "Zoom In / Out of Image");
 
         addRow(imageSelection, "F", "Fit Image to Screen");
         addRow(imageSelection, "N", "Normalize Image to [0, 1]");
+        addRow(imageSelection, "C", "Toggle Conversion from the File's Color Primaries");
+        addRow(imageSelection, "T", "Compute Per-Pixel Statistics of the Sequence or Visible Images");
         addRow(imageSelection, "R", "Reset Image Parameters");
         if (supportsHdr) {
             addRow(imageSelection, "L", "Display the image as if on an LDR screen");
@@ -102,6 +105,8 @@ HelpWindow::HelpWindow(Widget *parent, bool supportsHdr, function<void()> closeC
 
         addRow(referenceSelection, "Ctrl (hold)",                                "View selected Image if Reference is selected");
         addRow(referenceSelection, "Ctrl+Right or Ctrl+D / Ctrl+Left or Ctrl+A", "Select Next / Previous Error Metric");
+        addRow(referenceSelection, "K / Shift+K",                                "Double / Halve Blur before Comparing");
+        addRow(referenceSelection, "J / Shift+J",                                "Double / Halve Downsampling before Comparing");
 
         new Label{shortcuts, "Channel Group Options", "sans-bold", 18};
         auto groupSelection = new Widget{shortcuts};
@@ -118,6 +123,8 @@ HelpWindow::HelpWindow(Widget *parent, bool supportsHdr, function<void()> closeC
         addRow(ui, ALT + "+Enter", "Maximize");
         addRow(ui, COMMAND + "+B", "Toggle GUI");
         addRow(ui, "H",            "Show Help (this Window)");
+        addRow(ui, "M",            "Show Memory Usage");
+        addRow(ui, "I",            "Toggle Performance Overlay");
         addRow(ui, COMMAND + "+P", "Find Image or Channel Group");
         addRow(ui, "Q or Esc",     "Quit");
     }
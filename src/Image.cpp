@@ -1,17 +1,26 @@
 // This file was developed by Thomas Müller <thomas94@gmx.net>.
 // It is published under the BSD 3-Clause License within the LICENSE file.
 
+#include <tev/Archive.h>
 #include <tev/Image.h>
+#include <tev/ImageSequence.h>
 #include <tev/imageio/ImageLoader.h>
+#include <tev/imageio/SyntheticImageLoader.h>
+#include <tev/PerformanceCounters.h>
+#include <tev/Resampling.h>
+#include <tev/SharedImageCache.h>
+#include <tev/TemporalStatistics.h>
 #include <tev/ThreadPool.h>
 
 #include <Iex.h>
 
-#include <GLFW/glfw3.h>
-
+#include <algorithm>
+#include <array>
 #include <chrono>
 #include <fstream>
 #include <istream>
+#include <set>
+#include <sstream>
 
 using namespace Eigen;
 using namespace filesystem;
@@ -19,9 +28,259 @@ using namespace std;
 
 TEV_NAMESPACE_BEGIN
 
+namespace {
+
+// Headers of all supported formats fit into this many bytes, unless they embed large metadata,
+// in which case the image is decoded right away instead of being deferred.
+const size_t MAX_HEADER_PROBE_BYTES = 1024 * 1024;
+
+bool isGlob(const string& str) {
+    return str.find_first_of("*?[") != string::npos;
+}
+
+// Matches a single character against the glob character or character class at `pattern[i]`
+// and advances `i` past it.
+bool matchesGlobCharacter(const string& pattern, size_t& i, char c) {
+    if (pattern[i] == '?') {
+        ++i;
+        return true;
+    }
+
+    if (pattern[i] == '[') {
+        size_t j = i + 1;
+        bool negate = j < pattern.size() && pattern[j] == '!';
+        if (negate) {
+            ++j;
+        }
+
+        // A closing bracket directly after the opening one is part of the class.
+        size_t end = pattern.find(']', j + 1);
+        if (end != string::npos) {
+            bool matches = false;
+            for (; j < end; ++j) {
+                if (j + 2 < end && pattern[j + 1] == '-') {
+                    matches |= c >= pattern[j] && c <= pattern[j + 2];
+                    j += 2;
+                } else {
+                    matches |= c == pattern[j];
+                }
+            }
+
+            i = end + 1;
+            return matches != negate;
+        }
+
+        // Unterminated classes are treated literally.
+    }
+
+    return pattern[i++] == c;
+}
+
+bool matchesGlob(const string& pattern, const string& str) {
+    size_t p = 0, s = 0;
+    size_t starP = string::npos, starS = 0;
+
+    while (s < str.size()) {
+        if (p < pattern.size() && pattern[p] == '*') {
+            starP = p++;
+            starS = s;
+            continue;
+        }
+
+        size_t next = p;
+        if (p < pattern.size() && matchesGlobCharacter(pattern, next, str[s])) {
+            p = next;
+            ++s;
+            continue;
+        }
+
+        // Let the most recent star consume one more character.
+        if (starP == string::npos) {
+            return false;
+        }
+
+        p = starP + 1;
+        s = ++starS;
+    }
+
+    while (p < pattern.size() && pattern[p] == '*') {
+        ++p;
+    }
+
+    return p == pattern.size();
+}
+
+bool isSupportedImageFile(const path& path) {
+    // Archives are not images themselves, but are expanded into their members instead.
+    string extension = toLower(contentPath(path).extension());
+    if (extension == "zip" || extension == "gz") {
+        return false;
+    }
+
+    for (const auto& format : ImageLoader::supportedFormats()) {
+        if (format.first == extension) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Lists the entries of all given directories in parallel. Hidden entries are skipped
+// unless the pattern explicitly asks for them.
+vector<path> listMatchingEntries(const vector<path>& directories, const string& pattern, bool directoriesOnly) {
+    bool includeHidden = !pattern.empty() && pattern[0] == '.';
+
+    vector<vector<path>> entries(directories.size());
+    gThreadPool->parallelFor<size_t>(0, directories.size(), [&](size_t i) {
+        vector<string> names;
+        try {
+            names = listDirectory(directories[i]);
+        } catch (const invalid_argument& e) {
+            tlog::warning() << e.what();
+            return;
+        }
+
+        for (const auto& name : names) {
+            if ((name[0] == '.' && !includeHidden) || !matchesGlob(pattern, name)) {
+                continue;
+            }
+
+            path entry = directories[i] / name;
+            if (directoriesOnly ? entry.is_directory() : entry.is_file()) {
+                entries[i].emplace_back(entry);
+            }
+        }
+    });
+
+    vector<path> result;
+    for (auto& directoryEntries : entries) {
+        move(begin(directoryEntries), end(directoryEntries), back_inserter(result));
+    }
+
+    return result;
+}
+
+// Returns all files matching the glob pattern, where `**` matches zero or more directories.
+vector<path> expandGlob(const string& pattern) {
+    size_t separator = pattern.find_last_of("/\\", pattern.find_first_of("*?["));
+    path base = separator == string::npos ? path::getcwd() : path{pattern.substr(0, max(separator, (size_t)1))};
+
+    vector<string> components;
+    for (auto& component : split(pattern.substr(separator == string::npos ? 0 : separator + 1), "/\\")) {
+        if (!component.empty()) {
+            components.emplace_back(move(component));
+        }
+    }
+
+    // A trailing `**` stands for all files below the directory.
+    if (!components.empty() && components.back() == "**") {
+        components.emplace_back("*");
+    }
+
+    vector<path> current = {base};
+    for (size_t i = 0; i < components.size() && !current.empty(); ++i) {
+        const auto& component = components[i];
+        bool isLast = i == components.size() - 1;
+
+        if (component == "**") {
+            // Descend level by level such that the directories of each level are listed in
+            // parallel. Symlinked directories are only visited once to not get stuck in cycles.
+            set<string> visited;
+            vector<path> level = current;
+            current.clear();
+
+            while (!level.empty()) {
+                vector<path> unvisited;
+                for (auto& directory : level) {
+                    string key = directory.str();
+                    try {
+                        key = directory.make_absolute().str();
+                    } catch (const runtime_error&) {}
+
+                    if (visited.insert(key).second) {
+                        unvisited.emplace_back(move(directory));
+                    }
+                }
+
+                current.insert(end(current), begin(unvisited), end(unvisited));
+                level = listMatchingEntries(unvisited, "*", true);
+            }
+        } else if (!isGlob(component)) {
+            vector<path> next;
+            for (const auto& directory : current) {
+                path entry = directory / component;
+                if (isLast ? entry.is_file() : entry.is_directory()) {
+                    next.emplace_back(entry);
+                }
+            }
+
+            current = move(next);
+        } else {
+            current = listMatchingEntries(current, component, !isLast);
+        }
+    }
+
+    sort(begin(current), end(current), [](const path& a, const path& b) { return a.str() < b.str(); });
+    return current;
+}
+
+// Returns the images within the zip archive. Like in directories, members of unknown formats
+// are skipped, since archives commonly bundle images with other files.
+vector<path> listZipImageFiles(const path& archivePath) {
+    vector<path> result;
+    try {
+        for (auto& member : listZipMembers(archivePath)) {
+            if (isSupportedImageFile(member)) {
+                result.emplace_back(move(member));
+            }
+        }
+    } catch (const runtime_error& e) {
+        tlog::error() << tfm::format("Could not list '%s'. %s", archivePath, e.what());
+    }
+
+    return result;
+}
+
+// Replaces zip archives among the paths by the images they contain.
+vector<path> expandZipArchives(const vector<path>& paths) {
+    vector<path> result;
+    for (const auto& path : paths) {
+        if (isZipArchive(path)) {
+            auto members = listZipImageFiles(path);
+            result.insert(end(result), begin(members), end(members));
+        } else {
+            result.emplace_back(path);
+        }
+    }
+
+    return result;
+}
+
+// Returns the images directly within the directory, including those within zip archives.
+// Unlike with globs, files of unknown formats are skipped, since directories commonly
+// contain non-image files.
+vector<path> listImageFiles(const path& directory) {
+    vector<path> result;
+    for (auto& entry : listMatchingEntries({directory}, "*", false)) {
+        if (isZipArchive(entry)) {
+            auto members = listZipImageFiles(entry);
+            result.insert(end(result), begin(members), end(members));
+        } else if (isSupportedImageFile(entry)) {
+            result.emplace_back(move(entry));
+        }
+    }
+
+    sort(begin(result), end(result), [](const path& a, const path& b) { return a.str() < b.str(); });
+    return result;
+}
+
+}
+
 atomic<int> Image::sId(0);
+vector<ChannelExpression> Image::sChannelExpressions;
 
-Image::Image(const class path& path, istream& iStream, const string& channelSelector)
+Image::Image(const class path& path, istream& iStream, const string& channelSelector, const string& sharedCacheKey)
 : mPath{path}, mChannelSelector{channelSelector}, mId{sId++} {
     mName = channelSelector.empty() ? path.str() : tfm::format("%s:%s", path, channelSelector);
 
@@ -31,126 +290,116 @@ Image::Image(const class path& path, istream& iStream, const string& channelSele
         throw invalid_argument{tfm::format("Image %s could not be opened.", mName)};
     }
 
-    std::string loadMethod;
-    for (const auto& imageLoader : ImageLoader::getLoaders()) {
-        // If we arrived at the last loader, then we want to at least try loading the image,
-        // even if it is likely to fail.
-        bool useLoader = imageLoader == ImageLoader::getLoaders().back() || imageLoader->canLoadFile(iStream);
-
-        // Reset file cursor in case file load check changed it.
-        iStream.clear();
-        iStream.seekg(0);
+    // Compressed files are decompressed before they reach the loader, which hence sees
+    // the path of the decompressed contents.
+    class path loaderPath = contentPath(mPath);
+    const auto& imageLoader = ImageLoader::findLoader(iStream, loaderPath);
+    std::string loadMethod = imageLoader.name();
 
-        if (useLoader) {
-            loadMethod = imageLoader->name();
-            bool hasPremultipliedAlpha = false;
-            mData = imageLoader->load(iStream, mPath, mChannelSelector, hasPremultipliedAlpha);
-            ensureValid();
+    bool hasPremultipliedAlpha = false;
+    mData = imageLoader.load(iStream, loaderPath, mChannelSelector, hasPremultipliedAlpha);
+    mSize = mData.channels.empty() ? Vector2i::Zero() : mData.channels.front().size();
+    ensureValid();
 
-            // We assume an internal pre-multiplied-alpha representation
-            if (!hasPremultipliedAlpha) {
-                multiplyAlpha();
-            }
-            break;
-        }
+    // We assume an internal pre-multiplied-alpha representation
+    if (!hasPremultipliedAlpha) {
+        multiplyAlpha();
     }
 
-    for (const auto& layer : mData.layers) {
-        auto groups = getGroupedChannels(layer);
-        mChannelGroups.insert(end(mChannelGroups), begin(groups), end(groups));
+    // Derived channels depend on the expressions of each instance and are hence not shared.
+    if (!sharedCacheKey.empty()) {
+        SharedImageCache::store(sharedCacheKey, mData);
     }
 
+    initializeChannels();
+
     auto end = chrono::system_clock::now();
     chrono::duration<double> elapsedSeconds = end - start;
 
-    ensureValid();
-
     tlog::success() << tfm::format("Loaded '%s' via %s after %.3f seconds.", mName, loadMethod, elapsedSeconds.count());
 }
 
-Image::~Image() {
-    // Move the texture pointers to the main thread such that their reference count
-    // hits zero there. This is required, because OpenGL calls must always happen
-    // on the main thread.
-    scheduleToMainThread([textures = std::move(mTextures)] {});
+Image::Image(const class path& path, ImageData data, const string& channelSelector)
+: mPath{path}, mChannelSelector{channelSelector}, mData{move(data)}, mId{sId++} {
+    mName = channelSelector.empty() ? path.str() : tfm::format("%s:%s", path, channelSelector);
+    mSize = mData.channels.empty() ? Vector2i::Zero() : mData.channels.front().size();
+    ensureValid();
+
+    initializeChannels();
+
+    tlog::success() << tfm::format("Loaded '%s' from shared memory.", mName);
 }
 
-string Image::shortName() const {
-    string result = mName;
+Image::Image(const class path& path, const ImageHeader& header, const string& channelSelector)
+: mPath{path}, mChannelSelector{channelSelector}, mSize{header.size}, mId{sId++}, mIsDeferred{true} {
+    mName = channelSelector.empty() ? path.str() : tfm::format("%s:%s", path, channelSelector);
 
-    size_t slashPosition = result.find_last_of("/\\");
-    if (slashPosition != string::npos) {
-        result = result.substr(slashPosition + 1);
+    if ((DenseIndex)mSize.x() * mSize.y() == 0) {
+        throw invalid_argument{"Image has zero pixels."};
     }
 
-    size_t colonPosition = result.find_last_of(":");
-    if (colonPosition != string::npos) {
-        result = result.substr(0, colonPosition);
+    // Select channels the same way as the loaders do, such that the decoded image ends up
+    // with the same channels as its deferred counterpart.
+    vector<pair<size_t, size_t>> matches;
+    for (size_t i = 0; i < header.channels.size(); ++i) {
+        size_t matchId;
+        if (matchesFuzzy(header.channels[i], channelSelector, &matchId)) {
+            matches.emplace_back(matchId, i);
+        }
     }
 
-    return result;
-}
+    if (!channelSelector.empty()) {
+        sort(begin(matches), end(matches));
+    }
+
+    // The channels of a deferred image are empty placeholders that only carry their name.
+    set<string> layerNames;
+    for (const auto& match : matches) {
+        const auto& name = header.channels[match.second];
+        mData.channels.emplace_back(name, Vector2i::Zero());
+        layerNames.insert(Channel::head(name));
+    }
+
+    if (mData.channels.empty()) {
+        throw invalid_argument{"No channels match the given channel selector."};
+    }
+
+    mData.layers.assign(begin(layerNames), end(layerNames));
 
-nanogui::Texture* Image::texture(const string& channelGroupName) {
-    return texture(channelsInGroup(channelGroupName));
+    addDerivedChannels();
+
+    for (const auto& layer : mData.layers) {
+        auto groups = getGroupedChannels(layer);
+        mChannelGroups.insert(end(mChannelGroups), begin(groups), end(groups));
+    }
 }
 
-nanogui::Texture* Image::texture(const vector<string>& channelNames) {
-    string lookup = join(channelNames, ",");
-    auto iter = mTextures.find(lookup);
-    if (iter != end(mTextures)) {
-        auto& texture = iter->second;
-        if (texture.mipmapDirty) {
-            texture.nanoguiTexture->generate_mipmap();
-            texture.mipmapDirty = false;
-        }
-        return texture.nanoguiTexture.get();
+shared_ptr<Image> Image::decode() {
+    TEV_ASSERT(mIsDeferred, "Only deferred images can be decoded.");
+
+    lock_guard<mutex> lock{mDecodeMutex};
+    if (!mWasDecoded) {
+        mDecoded = tryLoadImage(mPath, mChannelSelector);
+        mWasDecoded = true;
     }
 
-    mTextures.emplace(lookup, ImageTexture{
-        new nanogui::Texture{
-            nanogui::Texture::PixelFormat::RGBA,
-            nanogui::Texture::ComponentFormat::Float32,
-            {size().x(), size().y()},
-            nanogui::Texture::InterpolationMode::Trilinear,
-            nanogui::Texture::InterpolationMode::Nearest,
-            nanogui::Texture::WrapMode::ClampToEdge,
-            1, nanogui::Texture::TextureFlags::ShaderRead,
-            true,
-        },
-        channelNames,
-        false,
-    });
-    auto& texture = mTextures.at(lookup).nanoguiTexture;
+    return mDecoded;
+}
 
-    auto numPixels = count();
-    vector<float> data(numPixels * 4);
+string Image::shortName() const {
+    string result = mName;
 
-    vector<future<void>> futures;
-    for (size_t i = 0; i < 4; ++i) {
-        if (i < channelNames.size()) {
-            const auto& channelName = channelNames[i];
-            const auto* chan = channel(channelName);
-            if (!chan) {
-                throw invalid_argument{tfm::format("Cannot obtain texture of %s:%s, because the channel does not exist.", path(), channelName)};
-            }
+    size_t slashPosition = result.find_last_of("/\\");
+    if (slashPosition != string::npos) {
+        result = result.substr(slashPosition + 1);
+    }
 
-            const auto& channelData = chan->data();
-            gThreadPool->parallelForAsync<DenseIndex>(0, numPixels, [&channelData, &data, i](DenseIndex j) {
-                data[j * 4 + i] = channelData(j);
-            }, futures);
-        } else {
-            float val = i == 3 ? 1 : 0;
-            gThreadPool->parallelForAsync<DenseIndex>(0, numPixels, [&data, val, i](DenseIndex j) {
-                data[j * 4 + i] = val;
-            }, futures);
-        }
+    size_t colonPosition = result.find_last_of(":");
+    if (colonPosition != string::npos) {
+        result = result.substr(0, colonPosition);
     }
-    waitAll(futures);
 
-    texture->upload((uint8_t*)data.data());
-    texture->generate_mipmap();
-    return texture.get();
+    return result;
 }
 
 vector<string> Image::channelsInLayer(string layerName) const {
@@ -306,53 +555,509 @@ vector<string> Image::getSortedChannels(const string& layerName) const {
     return result;
 }
 
-void Image::updateChannel(const string& channelName, int x, int y, int width, int height, const vector<float>& data) {
+vector<string> Image::updateChannel(const string& channelName, int x, int y, int width, int height, const PooledVector<float>& data) {
+    lock_guard<mutex> lock{mDataMutex};
+    return updateChannelLocked(channelName, x, y, width, height, data);
+}
+
+vector<string> Image::updateChannels(const vector<ChannelUpdate>& updates) {
+    lock_guard<mutex> lock{mDataMutex};
+
+    vector<string> result;
+    for (const auto& update : updates) {
+        for (auto& derivedChannel : updateChannelLocked(update.channelName, update.x, update.y, update.width, update.height, *update.data)) {
+            if (find(begin(result), end(result), derivedChannel) == end(result)) {
+                result.emplace_back(move(derivedChannel));
+            }
+        }
+    }
+
+    return result;
+}
+
+vector<string> Image::updateChannelLocked(const string& channelName, int x, int y, int width, int height, const PooledVector<float>& data) {
+    decompress();
+
     Channel* chan = mutableChannel(channelName);
     if (!chan) {
         tlog::warning() << "Channel " << channelName << " could not be updated, because it does not exist.";
-        return;
+        return {};
     }
 
+    // Warns if the tile does not fit.
     chan->updateTile(x, y, width, height, data);
+    mResampledChannels.clear();
+    ++mDataVersion;
+    if (x < 0 || y < 0 || x + width > mSize.x() || y + height > mSize.y()) {
+        return {};
+    }
 
-    // Update textures that are cached for this channel
-    for (auto& kv : mTextures) {
-        auto& imageTexture = kv.second;
-        if (find(begin(imageTexture.channels), end(imageTexture.channels), channelName) == end(imageTexture.channels)) {
+    updateHiddenColors(channelName, x, y, width, height);
+    return updateDerivedChannels({channelName}, x, y, width, height);
+}
+
+vector<string> Image::updateDerivedChannels(vector<string> updatedChannels, int x, int y, int width, int height) {
+    // Derived channels only depend on the same pixel of their inputs, so only the updated
+    // tile has to be evaluated again. Channels that were never evaluated are left alone,
+    // since they are evaluated from scratch once needed.
+    vector<string> result;
+    for (const auto& derived : mDerivedChannels) {
+        const auto& inputs = derived.expression.inputs();
+        bool isAffected = any_of(begin(inputs), end(inputs), [&](const string& input) {
+            return find(begin(updatedChannels), end(updatedChannels), input) != end(updatedChannels);
+        });
+
+        if (!derived.isEvaluated || !isAffected) {
             continue;
         }
 
-        auto numPixels = width * height;
-        vector<float> textureData(numPixels * 4);
+        PooledVector<float> values((size_t)width * height);
+        evaluateExpression(derived.expression, x, y, width, height, values.data());
+        mutableChannel(derived.expression.name())->updateTile(x, y, width, height, values);
 
-        // Populate data for sub-region of the texture to be updated
-        for (size_t i = 0; i < 4; ++i) {
-            if (i < imageTexture.channels.size()) {
-                const auto& localChannelName = imageTexture.channels[i];
-                const auto* localChan = channel(localChannelName);
-                TEV_ASSERT(localChan, "Channel to be updated must exist");
+        updatedChannels.emplace_back(derived.expression.name());
+        result.emplace_back(derived.expression.name());
+    }
 
-                for (int posY = 0; posY < height; ++posY) {
-                    for (int posX = 0; posX < width; ++posX) {
-                        int tileIdx = posX + posY * width;
-                        textureData[tileIdx * 4 + i] = localChan->at({x + posX, y + posY});
-                    }
+    return result;
+}
+
+void Image::updateHiddenColors(const string& channelName, int x, int y, int width, int height) {
+    // Only the converted colors are kept while the raw ones are shown.
+    auto it = find_if(begin(mConvertedChannels), end(mConvertedChannels), [&](const Channel& c) { return c.name() == channelName; });
+    if (it == end(mConvertedChannels)) {
+        return;
+    }
+
+    // Hidden channels come in triples of R, G, and B, all of which depend on each shown one.
+    size_t first = (size_t)(it - begin(mConvertedChannels)) / 3 * 3;
+    array<const Channel*, 3> shown;
+    for (size_t i = 0; i < 3; ++i) {
+        shown[i] = mutableChannel(mConvertedChannels[first + i].name());
+        if (!shown[i]) {
+            return;
+        }
+    }
+
+    vector<PooledVector<float>> values(3, PooledVector<float>((size_t)width * height));
+    for (int posY = 0; posY < height; ++posY) {
+        for (int posX = 0; posX < width; ++posX) {
+            Vector2i pos = {x + posX, y + posY};
+            Vector3f rgb = mData.toRec709 * Vector3f{shown[0]->at(pos), shown[1]->at(pos), shown[2]->at(pos)};
+            for (size_t i = 0; i < 3; ++i) {
+                values[i][posX + posY * (size_t)width] = rgb[i];
+            }
+        }
+    }
+
+    for (size_t i = 0; i < 3; ++i) {
+        mConvertedChannels[first + i].updateTile(x, y, width, height, values[i]);
+    }
+}
+
+vector<string> Image::setShowsRawColors(bool value) {
+    if (value == mShowsRawColors || mData.convertedChannels.empty() || mIsDeferred) {
+        return {};
+    }
+
+    lock_guard<mutex> lock{mDataMutex};
+    decompress();
+
+    // Only the conversion is stored, and raw colors are computed through its inverse once they
+    // are shown. The converted channels are kept meanwhile and swapped back in, such that
+    // toggling does not accumulate rounding errors. Updates keep them in sync.
+    const auto& names = mData.convertedChannels;
+    if (any_of(begin(names), end(names), [&](const string& name) { return !mutableChannel(name); })) {
+        tlog::warning() << "Cannot show raw colors, since converted channels are missing.";
+        return {};
+    }
+
+    if (value) {
+        Matrix3f toRaw = mData.toRec709.inverse();
+        for (size_t first = 0; first + 3 <= names.size(); first += 3) {
+            array<Channel*, 3> shown;
+            for (size_t i = 0; i < 3; ++i) {
+                shown[i] = mutableChannel(names[first + i]);
+                mConvertedChannels.emplace_back(shown[i]->snapshot());
+            }
+
+            array<Channel, 3> raw = {Channel{names[first], mSize}, Channel{names[first + 1], mSize}, Channel{names[first + 2], mSize}};
+            gThreadPool->parallelFor<DenseIndex>(0, count(), [&](DenseIndex j) {
+                Vector3f rgb = toRaw * Vector3f{shown[0]->at(j), shown[1]->at(j), shown[2]->at(j)};
+                for (size_t i = 0; i < 3; ++i) {
+                    raw[i].at(j) = rgb[i];
+                }
+            });
+
+            for (size_t i = 0; i < 3; ++i) {
+                shown[i]->replaceData(move(raw[i]));
+            }
+        }
+    } else {
+        for (auto& channel : mConvertedChannels) {
+            mutableChannel(channel.name())->replaceData(move(channel));
+        }
+
+        mConvertedChannels.clear();
+    }
+
+    mShowsRawColors = value;
+    mResampledChannels.clear();
+    ++mDataVersion;
+
+    size_t pixelBytes = 0;
+    for (const auto* channel : compressibleChannels()) {
+        pixelBytes += (size_t)channel->count() * sizeof(float);
+    }
+    mPixelMemory = {mMemoryUsage, PixelMemory, pixelBytes};
+
+    // The shown channels are replaced as a whole, so derived ones are evaluated again.
+    vector<string> result = names;
+    for (auto& derivedChannel : updateDerivedChannels(names, 0, 0, mSize.x(), mSize.y())) {
+        result.emplace_back(move(derivedChannel));
+    }
+
+    return result;
+}
+
+void Image::initializeChannels() {
+    addDerivedChannels();
+
+    for (const auto& layer : mData.layers) {
+        auto groups = getGroupedChannels(layer);
+        mChannelGroups.insert(end(mChannelGroups), begin(groups), end(groups));
+    }
+
+    size_t pixelBytes = 0;
+    for (const auto* channel : compressibleChannels()) {
+        pixelBytes += (size_t)channel->count() * sizeof(float);
+    }
+    mPixelMemory = {mMemoryUsage, PixelMemory, pixelBytes};
+
+    ensureValid();
+}
+
+void Image::addDerivedChannels() {
+    for (const auto& expression : sChannelExpressions) {
+        const auto& inputs = expression.inputs();
+        if (hasChannel(expression.name()) || !all_of(begin(inputs), end(inputs), [this](const string& input) { return hasChannel(input); })) {
+            continue;
+        }
+
+        // Derived channels are empty placeholders until pin() evaluates them, such that they
+        // take no memory unless they are viewed.
+        mData.channels.emplace_back(expression.name(), Vector2i::Zero());
+        mDerivedChannels.push_back({expression, false});
+
+        string layer = Channel::head(expression.name());
+        if (find(begin(mData.layers), end(mData.layers), layer) == end(mData.layers)) {
+            mData.layers.emplace_back(layer);
+        }
+    }
+}
+
+vector<Channel*> Image::compressibleChannels() const {
+    vector<Channel*> result;
+    for (auto& channel : mData.channels) {
+        result.emplace_back(&channel);
+    }
+
+    for (auto& channel : mConvertedChannels) {
+        result.emplace_back(&channel);
+    }
+
+    return result;
+}
+
+void Image::decompress() const {
+    if (!mIsCompressed) {
+        return;
+    }
+
+    auto start = chrono::steady_clock::now();
+
+    size_t pixelBytes = 0;
+    for (auto* channel : compressibleChannels()) {
+        channel->decompress();
+        pixelBytes += (size_t)channel->count() * sizeof(float);
+    }
+
+    mPixelMemory = {mMemoryUsage, PixelMemory, pixelBytes};
+    mIsCompressed = false;
+
+    chrono::duration<double> elapsedSeconds = chrono::steady_clock::now() - start;
+    tlog::debug() << tfm::format("Decompressed '%s' after %.3f seconds.", mName, elapsedSeconds.count());
+}
+
+void Image::evaluateDerivedChannels() const {
+    if (mIsDeferred) {
+        return;
+    }
+
+    for (auto& derived : mDerivedChannels) {
+        if (derived.isEvaluated) {
+            continue;
+        }
+
+        // Evaluated into a new channel, since compression may still read the placeholder.
+        Channel* chan = mutableChannel(derived.expression.name());
+        Channel evaluated{chan->name(), mSize};
+        evaluateExpression(derived.expression, 0, 0, mSize.x(), mSize.y(), &evaluated.at(0));
+        chan->replaceData(move(evaluated));
+        derived.isEvaluated = true;
+        mPixelMemory = {mMemoryUsage, PixelMemory, mPixelMemory.bytes() + (size_t)chan->count() * sizeof(float)};
+    }
+}
+
+void Image::evaluateExpression(const ChannelExpression& expression, int x, int y, int width, int height, float* result) const {
+    vector<const float*> inputs;
+    for (const auto& input : expression.inputs()) {
+        inputs.emplace_back(channel(input)->data().data());
+    }
+
+    evaluateExpression(expression, inputs, x, y, width, height, result);
+}
+
+void Image::evaluateExpression(const ChannelExpression& expression, const vector<const float*>& inputs, int x, int y, int width, int height, float* result) const {
+    gThreadPool->parallelFor(y, y + height, [&](int row) {
+        DenseIndex offset = x + row * (DenseIndex)mSize.x();
+
+        vector<const float*> inputRows;
+        for (const float* input : inputs) {
+            inputRows.emplace_back(input + offset);
+        }
+
+        expression.evaluate(inputRows, result + (row - y) * (DenseIndex)width, width);
+    });
+}
+
+Image::Pin Image::pin() const {
+    bool hasEvaluationFailed = false;
+    while (true) {
+        vector<Channel> channels;
+        size_t version;
+        size_t derivedIndex = 0;
+        unique_ptr<ChannelExpression> expression;
+        {
+            lock_guard<mutex> lock{mDataMutex};
+            if (!mIsCompressed) {
+                derivedIndex = mDerivedChannels.size();
+                if (!mIsDeferred) {
+                    auto it = find_if(begin(mDerivedChannels), end(mDerivedChannels), [](const DerivedChannel& d) { return !d.isEvaluated; });
+                    derivedIndex = (size_t)(it - begin(mDerivedChannels));
+                }
+
+                // Streaming updates could keep invalidating evaluations that happen without
+                // the lock, in which case the remaining ones happen while holding it.
+                if (hasEvaluationFailed) {
+                    evaluateDerivedChannels();
+                    derivedIndex = mDerivedChannels.size();
+                }
+
+                if (derivedIndex == mDerivedChannels.size()) {
+                    ++mNumPins;
+                    mLastPinned = chrono::steady_clock::now();
+                    return Pin{this};
+                }
+
+                // Inputs precede the channel in dependency order and are hence evaluated.
+                expression = make_unique<ChannelExpression>(mDerivedChannels[derivedIndex].expression);
+                for (const auto& input : expression->inputs()) {
+                    channels.emplace_back(channel(input)->snapshot());
                 }
             } else {
-                float val = i == 3 ? 1 : 0;
-                for (DenseIndex j = 0; j < numPixels; ++j) {
-                    textureData[j * 4 + i] = val;
+                for (const auto* channel : compressibleChannels()) {
+                    channels.emplace_back(*channel);
                 }
             }
+
+            version = mDataVersion;
+        }
+
+        // Like decompression below, derived channels are evaluated without holding the lock,
+        // such that snapshots and updates of the image do not wait for it.
+        if (expression) {
+            vector<const float*> inputs;
+            for (const auto& input : channels) {
+                inputs.emplace_back(input.data().data());
+            }
+
+            Channel evaluated{expression->name(), mSize};
+            evaluateExpression(*expression, inputs, 0, 0, mSize.x(), mSize.y(), &evaluated.at(0));
+
+            lock_guard<mutex> lock{mDataMutex};
+            auto& derived = mDerivedChannels[derivedIndex];
+            if (!mIsCompressed && !derived.isEvaluated && version == mDataVersion) {
+                size_t evaluatedBytes = (size_t)evaluated.count() * sizeof(float);
+                mutableChannel(expression->name())->replaceData(move(evaluated));
+                derived.isEvaluated = true;
+                mPixelMemory = {mMemoryUsage, PixelMemory, mPixelMemory.bytes() + evaluatedBytes};
+                // Invalidates concurrent compression, which may still hold the placeholder.
+                ++mDataVersion;
+            } else if (!derived.isEvaluated) {
+                hasEvaluationFailed = true;
+            }
+
+            continue;
+        }
+
+        // Decompressing happens without holding the lock, such that compressing or updating
+        // other images does not wait for it. Channels are swapped in only if no other
+        // thread decompressed or updated them meanwhile.
+        auto start = chrono::steady_clock::now();
+        size_t pixelBytes = 0;
+        for (auto& channel : channels) {
+            channel.decompress();
+            pixelBytes += (size_t)channel.count() * sizeof(float);
+        }
+
+        lock_guard<mutex> lock{mDataMutex};
+        if (mIsCompressed && version == mDataVersion) {
+            auto targets = compressibleChannels();
+            for (size_t i = 0; i < channels.size(); ++i) {
+                targets[i]->replaceData(move(channels[i]));
+            }
+            mPixelMemory = {mMemoryUsage, PixelMemory, pixelBytes};
+            mIsCompressed = false;
+
+            chrono::duration<double> elapsedSeconds = chrono::steady_clock::now() - start;
+            tlog::debug() << tfm::format("Decompressed '%s' after %.3f seconds.", mName, elapsedSeconds.count());
+        }
+    }
+}
+
+vector<Channel> Image::snapshot(const vector<string>& channelNames) const {
+    auto pinned = pin();
+    lock_guard<mutex> lock{mDataMutex};
+
+    vector<Channel> result;
+    for (const auto& channelName : channelNames) {
+        const auto* chan = channel(channelName);
+        if (!chan) {
+            throw invalid_argument{tfm::format("Cannot snapshot %s:%s, because the channel does not exist.", mName, channelName)};
+        }
+
+        result.emplace_back(chan->snapshot());
+    }
+
+    return result;
+}
+
+vector<Channel> Image::resampledSnapshot(const vector<string>& channelNames, const Vector2i& size, EResampling resampling, float blurSigma) const {
+    if (size == mSize && blurSigma <= 0) {
+        return snapshot(channelNames);
+    }
+
+    vector<Channel> result;
+    for (const auto& channelName : channelNames) {
+        string key = tfm::format("%s@%dx%d:%d:%g", channelName, size.x(), size.y(), (int)resampling, blurSigma);
+
+        size_t version;
+        {
+            lock_guard<mutex> lock{mDataMutex};
+            auto it = mResampledChannels.find(key);
+            if (it != end(mResampledChannels)) {
+                result.emplace_back(it->second.channel.snapshot());
+                continue;
+            }
+
+            version = mDataVersion;
+        }
+
+        // Filtering happens without holding the lock, such that the image can be viewed and
+        // updated meanwhile.
+        auto resampled = move(snapshot({channelName}).front());
+        if (size != mSize) {
+            resampled = resample(resampled, size, resampling);
+        }
+
+        if (blurSigma > 0) {
+            resampled = blur(resampled, blurSigma);
+        }
+
+        {
+            lock_guard<mutex> lock{mDataMutex};
+            if (version == mDataVersion) {
+                mResampledChannels.emplace(key, ResampledChannel{
+                    resampled.snapshot(),
+                    {mMemoryUsage, PixelMemory, (size_t)resampled.count() * sizeof(float)},
+                });
+            }
+        }
+
+        result.emplace_back(move(resampled));
+    }
+
+    return result;
+}
+
+void Image::unpin() const {
+    lock_guard<mutex> lock{mDataMutex};
+    --mNumPins;
+    mLastPinned = chrono::steady_clock::now();
+}
+
+bool Image::compress(chrono::steady_clock::duration minIdleTime) {
+    vector<Channel> channels;
+    size_t version;
+    chrono::steady_clock::time_point lastPinned;
+    {
+        lock_guard<mutex> lock{mDataMutex};
+        if (mIsCompressed || mIsDeferred || mNumPins > 0 || chrono::steady_clock::now() - mLastPinned < minIdleTime) {
+            return false;
         }
 
-        imageTexture.nanoguiTexture->upload_sub_region((uint8_t*)textureData.data(), {x, y}, {width, height});
-        imageTexture.mipmapDirty = true;
+        for (const auto* channel : compressibleChannels()) {
+            channels.emplace_back(channel->snapshot());
+        }
+
+        version = mDataVersion;
+        lastPinned = mLastPinned;
+    }
+
+    // Snapshots are compressed without holding the lock, such that the image can be pinned
+    // meanwhile. The result is discarded if the image was pinned or updated in the meantime.
+    auto start = chrono::steady_clock::now();
+
+    size_t compressedBytes = 0;
+    for (auto& channel : channels) {
+        channel.compress();
+        compressedBytes += channel.compressedBytes();
+    }
+
+    lock_guard<mutex> lock{mDataMutex};
+    if (mIsCompressed || mNumPins > 0 || version != mDataVersion || lastPinned != mLastPinned) {
+        return false;
     }
+
+    size_t pixelBytes = mPixelMemory.bytes();
+    auto targets = compressibleChannels();
+    for (size_t i = 0; i < channels.size(); ++i) {
+        targets[i]->replaceData(move(channels[i]));
+    }
+    mPixelMemory = {mMemoryUsage, PixelMemory, compressedBytes};
+    mIsCompressed = true;
+    ++mDataVersion;
+
+    // Resampled channels are quickly computed again once needed.
+    mResampledChannels.clear();
+
+    chrono::duration<double> elapsedSeconds = chrono::steady_clock::now() - start;
+    tlog::debug() << tfm::format(
+        "Compressed '%s' from %s to %s after %.3f seconds.",
+        mName, toMemoryString(pixelBytes), toMemoryString(compressedBytes), elapsedSeconds.count()
+    );
+
+    return true;
 }
 
 string Image::toString() const {
-    string result = tfm::format("Path: %s\n\nResolution: (%d, %d)\n\nChannels:\n", mName, size().x(), size().y());
+    string result = tfm::format("Path: %s\n\nResolution: (%d, %d)\n\n", mName, size().x(), size().y());
+    if (hasColorConversion()) {
+        result += mShowsRawColors ? "Colors: raw values of the file\n\n" : "Colors: converted to sRGB primaries\n\n";
+    }
+
+    result += "Channels:\n";
 
     auto localLayers = mData.layers;
     transform(begin(localLayers), end(localLayers), begin(localLayers), [this](string layer) {
@@ -366,7 +1071,15 @@ string Image::toString() const {
         return layer + ": " + join(channels, ",");
     });
 
-    return result + join(localLayers, "\n");
+    result += join(localLayers, "\n");
+
+    result += "\n\nMemory:\n";
+    for (int i = 0; i < NumMemoryCategories; ++i) {
+        EMemoryCategory category = (EMemoryCategory)i;
+        result += tfm::format("%s: %s\n", memoryCategoryName(category), toMemoryString(mMemoryUsage->bytes(category)));
+    }
+
+    return result + tfm::format("Total: %s (peak %s)", toMemoryString(mMemoryUsage->totalBytes()), toMemoryString(mMemoryUsage->peakTotalBytes()));
 }
 
 void Image::alphaOperation(const function<void(Channel&, const Channel&)>& func) {
@@ -422,7 +1135,7 @@ void Image::ensureValid() {
     }
 }
 
-shared_ptr<Image> tryLoadImage(path path, istream& iStream, string channelSelector) {
+shared_ptr<Image> tryLoadImage(path path, istream& iStream, string channelSelector, string sharedCacheKey) {
     auto handleException = [&](const exception& e) {
         if (channelSelector.empty()) {
             tlog::error() << tfm::format("Could not load '%s'. %s", path, e.what());
@@ -431,8 +1144,10 @@ shared_ptr<Image> tryLoadImage(path path, istream& iStream, string channelSelect
         }
     };
 
+    ScopedCount inFlight{PerformanceCounters::global().inFlightLoads};
+
     try {
-        return make_shared<Image>(path, iStream, channelSelector);
+        return make_shared<Image>(path, iStream, channelSelector, sharedCacheKey);
     } catch (const invalid_argument& e) {
         handleException(e);
     } catch (const runtime_error& e) {
@@ -445,6 +1160,57 @@ shared_ptr<Image> tryLoadImage(path path, istream& iStream, string channelSelect
 }
 
 shared_ptr<Image> tryLoadImage(path path, string channelSelector) {
+    // Synthetic images are fully described by their path and are hence not read from disk.
+    if (SyntheticImageLoader::isSyntheticPath(path.str())) {
+        istringstream descriptorStream{path.str()};
+        return tryLoadImage(path, descriptorStream, channelSelector);
+    }
+
+    try {
+        path = path.make_absolute();
+    } catch (const runtime_error& e) {
+        // If for some strange reason we can not obtain an absolute path, let's still
+        // try to open the image at the given path just to make sure.
+    }
+
+    // Another instance may have decoded the same file already.
+    string sharedCacheKey = SharedImageCache::key(path, channelSelector);
+    if (!sharedCacheKey.empty()) {
+        ImageData data;
+        if (SharedImageCache::load(sharedCacheKey, data)) {
+            ScopedCount inFlight{PerformanceCounters::global().inFlightLoads};
+            try {
+                return make_shared<Image>(path, move(data), channelSelector);
+            } catch (const runtime_error& e) {
+                tlog::error() << tfm::format("Could not load '%s' from shared memory. %s", path, e.what());
+            }
+        }
+    }
+
+    unique_ptr<istream> fileStream;
+    try {
+        fileStream = openImageFile(path);
+    } catch (const runtime_error& e) {
+        tlog::error() << tfm::format("Could not load '%s'. %s", path, e.what());
+        return nullptr;
+    }
+
+    return tryLoadImage(path, *fileStream, channelSelector, sharedCacheKey);
+}
+
+shared_ptr<Image> tryLoadImage(path path, vector<char> data, string channelSelector) {
+    unique_ptr<istream> dataStream;
+    try {
+        dataStream = openImageData(move(data));
+    } catch (const runtime_error& e) {
+        tlog::error() << tfm::format("Could not load '%s'. %s", path, e.what());
+        return nullptr;
+    }
+
+    return tryLoadImage(path, *dataStream, channelSelector);
+}
+
+shared_ptr<Image> tryLoadImageHeader(path path, string channelSelector) {
     try {
         path = path.make_absolute();
     } catch (const runtime_error& e) {
@@ -452,19 +1218,134 @@ shared_ptr<Image> tryLoadImage(path path, string channelSelector) {
         // try to open the image at the given path just to make sure.
     }
 
-    ifstream fileStream{nativeString(path), ios_base::binary};
-    return tryLoadImage(path, fileStream, channelSelector);
+    // Errors are not reported here, because callers fall back to a full load,
+    // which reports them in more detail.
+    try {
+        // Only the beginning of compressed files is decompressed, since the header is all
+        // that is needed and many files may be probed in parallel.
+        auto fileStream = openImageFileHead(path, MAX_HEADER_PROBE_BYTES);
+        if (!*fileStream) {
+            return nullptr;
+        }
+
+        class path loaderPath = contentPath(path);
+        ImageHeader header;
+        if (!ImageLoader::findLoader(*fileStream, loaderPath).loadHeader(*fileStream, loaderPath, channelSelector, header)) {
+            return nullptr;
+        }
+
+        return make_shared<Image>(path, header, channelSelector);
+    } catch (const invalid_argument&) {
+    } catch (const runtime_error&) {
+    } catch (const Iex::BaseExc&) {
+    }
+
+    return nullptr;
+}
+
+vector<path> resolveImagePaths(const string& pathOrPattern) {
+    path path = pathOrPattern;
+    if (path.is_directory()) {
+        return listImageFiles(path);
+    } else if (isZipArchive(path)) {
+        return listZipImageFiles(path);
+    } else if (!path.exists() && isGlob(pathOrPattern)) {
+        return expandZipArchives(expandGlob(pathOrPattern));
+    }
+
+    return {path};
 }
 
 void BackgroundImagesLoader::enqueue(const path& path, const string& channelSelector, bool shallSelect) {
     mWorkers.enqueueTask([path, channelSelector, shallSelect, this] {
-        auto image = tryLoadImage(path, channelSelector);
+        // Paths that do not exist as-is may describe a sequence of frames, e.g. `render.####.exr`.
+        if (!path.is_file() && ImageSequence::isPattern(path.str())) {
+            auto sequence = tryLoadImageSequence(path.str(), channelSelector);
+            if (sequence) {
+                auto image = sequence->waitForFrame(0, Forward);
+                if (image) {
+                    mLoadedImages.push({ shallSelect, image, sequence, nullptr });
+                }
+            }
+        } else if (path.is_directory() || isZipArchive(path) || (!path.exists() && isGlob(path.str()))) {
+            loadDeferred(resolveImagePaths(path.str()), path, channelSelector, shallSelect);
+        } else {
+            auto image = tryLoadImage(path, channelSelector);
+            if (image) {
+                mLoadedImages.push({ shallSelect, image, nullptr, nullptr });
+            }
+        }
+
+        notifyImagesLoaded();
+    });
+}
+
+void BackgroundImagesLoader::enqueueDecode(const shared_ptr<Image>& deferredImage) {
+    mWorkers.enqueueTask([deferredImage, this] {
+        // Failures are reported as well, such that the deferred image can be closed.
+        auto image = deferredImage->decode();
+        mLoadedImages.push({ false, image, nullptr, deferredImage });
+
+        notifyImagesLoaded();
+    });
+}
+
+void BackgroundImagesLoader::enqueueData(const string& name, vector<char> data, const string& channelSelector, bool shallSelect) {
+    mWorkers.enqueueTask([name, data = move(data), channelSelector, shallSelect, this]() mutable {
+        auto image = tryLoadImage(name, move(data), channelSelector);
         if (image) {
-            mLoadedImages.push({ shallSelect, image });
+            mLoadedImages.push({ shallSelect, image, nullptr, nullptr });
         }
 
-        glfwPostEmptyEvent();
+        notifyImagesLoaded();
     });
 }
 
+void BackgroundImagesLoader::enqueueTemporalStatistics(const string& name, size_t numImages, function<shared_ptr<Image>(size_t)> loadImage) {
+    // Accumulating many images takes long, so it happens on its own worker rather than
+    // holding up other loads. Only adding the result is queued behind them.
+    mStatisticsWorkers.enqueueTask([name, numImages, loadImage, this] {
+        auto image = computeTemporalStatistics(name, numImages, loadImage);
+        mWorkers.enqueueTask([image, this] {
+            if (image) {
+                mLoadedImages.push({ true, image, nullptr, nullptr });
+            }
+
+            notifyImagesLoaded();
+        });
+    });
+}
+
+void BackgroundImagesLoader::loadDeferred(const vector<path>& paths, const path& origin, const string& channelSelector, bool shallSelect) {
+    if (paths.empty()) {
+        tlog::warning() << tfm::format("No images found in '%s'.", origin);
+        return;
+    }
+
+    auto start = chrono::system_clock::now();
+
+    // Only headers are read at this point, which is dominated by file system latency rather
+    // than computation, so all files are probed at once.
+    vector<shared_ptr<Image>> images(paths.size());
+    gThreadPool->parallelFor<size_t>(0, paths.size(), [&](size_t i) {
+        images[i] = tryLoadImageHeader(paths[i], channelSelector);
+    });
+
+    chrono::duration<double> elapsedSeconds = chrono::system_clock::now() - start;
+
+    size_t numDeferred = count_if(begin(images), end(images), [](const shared_ptr<Image>& image) { return !!image; });
+    tlog::success() << tfm::format("Read %d of %d headers in '%s' after %.3f seconds.", numDeferred, paths.size(), origin, elapsedSeconds.count());
+
+    for (size_t i = 0; i < paths.size(); ++i) {
+        // Formats whose headers can not be read on their own are decoded right away.
+        auto image = images[i] ? images[i] : tryLoadImage(paths[i], channelSelector);
+        if (image) {
+            mLoadedImages.push({ shallSelect, image, nullptr, nullptr });
+            shallSelect = false;
+
+            notifyImagesLoaded();
+        }
+    }
+}
+
 TEV_NAMESPACE_END
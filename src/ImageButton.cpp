@@ -179,6 +179,16 @@ void ImageButton::draw(NVGcontext *ctx) {
     nvgText(ctx, m_pos.x() + 5, textPos.y(), idString.c_str(), nullptr);
 }
 
+void ImageButton::setCaption(const string& caption) {
+    mCaption = caption;
+
+    // The cutoff and highlight range refer to the previous caption and need to be recomputed.
+    mCutoff = 0;
+    mSizeForWhichCutoffWasComputed = {0};
+    mHighlightBegin = 0;
+    mHighlightEnd = 0;
+}
+
 void ImageButton::setHighlightRange(size_t begin, size_t end) {
     size_t beginIndex = begin;
     if (end > mCaption.size()) {
@@ -1,8 +1,11 @@
 // This file was developed by Thomas Müller <thomas94@gmx.net>.
 // It is published under the BSD 3-Clause License within the LICENSE file.
 
+#include <tev/BufferPool.h>
 #include <tev/FalseColor.h>
+#include <tev/GuiCommon.h>
 #include <tev/ImageCanvas.h>
+#include <tev/PerformanceCounters.h>
 #include <tev/ThreadPool.h>
 
 #include <tev/imageio/ImageSaver.h>
@@ -12,6 +15,7 @@
 #include <nanogui/theme.h>
 #include <nanogui/vector.h>
 
+#include <algorithm>
 #include <fstream>
 #include <numeric>
 #include <set>
@@ -48,8 +52,10 @@ bool ImageCanvas::scroll_event(const nanogui::Vector2i& p, const nanogui::Vector
 }
 
 void ImageCanvas::draw_contents() {
+    pruneTextures();
+
     auto* glfwWindow = screen()->glfw_window();
-    Image* image = (mReference && glfwGetKey(glfwWindow, GLFW_KEY_LEFT_SHIFT)) ? mReference.get() : mImage.get();
+    const auto& image = (mReference && glfwGetKey(glfwWindow, GLFW_KEY_LEFT_SHIFT)) ? mReference : mImage;
 
     if (!image) {
         mShader->draw(
@@ -59,14 +65,14 @@ void ImageCanvas::draw_contents() {
         return;
     }
 
-    if (!mReference || glfwGetKey(glfwWindow, GLFW_KEY_LEFT_CONTROL) || image == mReference.get()) {
+    if (!mReference || glfwGetKey(glfwWindow, GLFW_KEY_LEFT_CONTROL) || image == mReference) {
         mShader->draw(
             2.0f * Vector2f{m_size.x(), m_size.y()}.cwiseInverse() / mPixelRatio,
             Vector2f::Constant(20),
-            image->texture(mRequestedChannelGroup),
+            texture(image, mRequestedChannelGroup),
             // The uber shader operates in [-1, 1] coordinates and requires the _inserve_
             // image transform to obtain texture coordinates in [0, 1]-space.
-            toNanogui(transform(image).inverse().matrix()),
+            toNanogui(transform(image.get()).inverse().matrix()),
             mExposure,
             mOffset,
             mGamma,
@@ -76,15 +82,18 @@ void ImageCanvas::draw_contents() {
         return;
     }
 
+    // Filtered textures of both images cover the extent of the image, even if they were
+    // downsampled.
+    bool isFiltered = isComparisonFiltered();
     mShader->draw(
         2.0f * Vector2f{m_size.x(), m_size.y()}.cwiseInverse() / mPixelRatio,
         Vector2f::Constant(20),
-        mImage->texture(mRequestedChannelGroup),
+        isFiltered ? filteredTexture(mImage, mImage->channelsInGroup(mRequestedChannelGroup)) : texture(mImage, mRequestedChannelGroup),
         // The uber shader operates in [-1, 1] coordinates and requires the _inserve_
         // image transform to obtain texture coordinates in [0, 1]-space.
         toNanogui(transform(mImage.get()).inverse().matrix()),
-        mReference->texture(mRequestedChannelGroup),
-        toNanogui(transform(mReference.get()).inverse().matrix()),
+        isFiltered ? filteredTexture(mReference, mReference->channelsInGroup(mRequestedChannelGroup)) : texture(mReference, mRequestedChannelGroup),
+        toNanogui(transform(isFiltered ? mImage.get() : mReference.get()).inverse().matrix()),
         mExposure,
         mOffset,
         mGamma,
@@ -95,7 +104,9 @@ void ImageCanvas::draw_contents() {
 }
 
 void ImageCanvas::draw(NVGcontext *ctx) {
+    auto drawStart = chrono::steady_clock::now();
     nanogui::Canvas::draw(ctx);
+    recordFrame(chrono::duration<float>{chrono::steady_clock::now() - drawStart}.count());
 
     if (mImage) {
         auto texToNano = textureToNanogui(mImage.get());
@@ -123,7 +134,7 @@ void ImageCanvas::draw(NVGcontext *ctx) {
 
             vector<nanogui::Color> colors;
             for (const auto& channel : channels) {
-                colors.emplace_back(Channel::color(channel));
+                colors.emplace_back(channelColor(channel));
             }
 
             float fontSize = pixelSize.x() / 6;
@@ -197,6 +208,19 @@ void ImageCanvas::draw(NVGcontext *ctx) {
         nvgFill(ctx);
         nvgRestore(ctx);
     }
+
+    if (mHudVisible) {
+        drawHud(ctx);
+    }
+}
+
+void ImageCanvas::setHudVisible(bool value) {
+    mHudVisible = value;
+
+    // Frames that were drawn while the HUD was hidden are only drawn on demand and would
+    // skew the frame times.
+    mNumFrames = 0;
+    mLastFrame = {};
 }
 
 void ImageCanvas::translate(const Vector2f& amount) {
@@ -217,7 +241,7 @@ void ImageCanvas::scale(float amount, const Vector2f& origin) {
 }
 
 float ImageCanvas::applyExposureAndOffset(float value) const {
-    return pow(2.0f, mExposure) * value + mOffset;
+    return tev::applyExposureAndOffset(value, mExposure, mOffset);
 }
 
 Vector2i ImageCanvas::getImageCoords(const Image& image, Vector2i mousePos) {
@@ -234,7 +258,31 @@ void ImageCanvas::getValuesAtNanoPos(Vector2i nanoPos, vector<float>& result, co
         return;
     }
 
+    auto imagePin = mImage->pin();
+    auto referencePin = Image::pin(mReference.get());
+
     Vector2i imageCoords = getImageCoords(*mImage, nanoPos);
+
+    // Shows the values that are compared, which is why filtered comparisons read the filtered
+    // channels of both images at the pixel covering the same location.
+    if (isComparisonFiltered()) {
+        Vector2i size = mComparisonFilter.comparisonSize(mImage->size());
+        bool isInside = (imageCoords.array() >= 0).all() && (imageCoords.array() < mImage->size().array()).all();
+        Vector2i coords = isInside ? Vector2i{imageCoords.cwiseProduct(size).cwiseQuotient(mImage->size())} : Vector2i::Constant(-1);
+
+        for (const auto& channel : filteredChannels(*mImage, channels, mImage->size(), mComparisonFilter)) {
+            result.push_back(channel.eval(coords));
+        }
+
+        auto referenceChannels = filteredChannels(*mReference, mReference->channelsInGroup(mRequestedChannelGroup), mImage->size(), mComparisonFilter);
+        for (size_t i = 0; i < result.size(); ++i) {
+            float reference = i < referenceChannels.size() ? referenceChannels[i].eval(coords) : 0.0f;
+            result[i] = applyMetric(result[i], reference);
+        }
+
+        return;
+    }
+
     for (const auto& channel : channels) {
         const Channel* c = mImage->channel(channel);
         TEV_ASSERT(c, "Requested channel must exist.");
@@ -255,55 +303,6 @@ void ImageCanvas::getValuesAtNanoPos(Vector2i nanoPos, vector<float>& result, co
     }
 }
 
-Vector3f ImageCanvas::applyTonemap(const Vector3f& value, float gamma, ETonemap tonemap) {
-    Vector3f result;
-    switch (tonemap) {
-        case ETonemap::SRGB:
-            {
-                result = {toSRGB(value.x()), toSRGB(value.y()), toSRGB(value.z())};
-                break;
-            }
-        case ETonemap::Gamma:
-            {
-                result = {pow(value.x(), 1 / gamma), pow(value.y(), 1 / gamma), pow(value.z(), 1 / gamma)};
-                break;
-            }
-        case ETonemap::FalseColor:
-            {
-                static const auto falseColor = [](float linear) {
-                    static const auto& fcd = colormap::turbo();
-                    int start = 4 * clamp((int)(linear * (fcd.size() / 4)), 0, (int)fcd.size() / 4 - 1);
-                    return Vector3f{fcd[start], fcd[start + 1], fcd[start + 2]};
-                };
-
-                result = falseColor(log2(value.mean() + 0.03125f) / 10 + 0.5f);
-                break;
-            }
-        case ETonemap::PositiveNegative:
-            {
-                result = {-2.0f * value.cwiseMin(Vector3f::Zero()).mean(), 2.0f * value.cwiseMax(Vector3f::Zero()).mean(), 0.0f};
-                break;
-            }
-        default:
-            throw runtime_error{"Invalid tonemap selected."};
-    }
-
-    return result.cwiseMax(Vector3f::Zero()).cwiseMin(Vector3f::Ones());
-}
-
-float ImageCanvas::applyMetric(float image, float reference, EMetric metric) {
-    float diff = image - reference;
-    switch (metric) {
-        case EMetric::Error:                 return diff;
-        case EMetric::AbsoluteError:         return abs(diff);
-        case EMetric::SquaredError:          return diff * diff;
-        case EMetric::RelativeAbsoluteError: return abs(diff) / (reference + 0.01f);
-        case EMetric::RelativeSquaredError:  return diff * diff / (reference * reference + 0.01f);
-        default:
-            throw runtime_error{"Invalid metric selected."};
-    }
-}
-
 void ImageCanvas::fitImageToScreen(const Image& image) {
     Vector2f nanoguiImageSize = image.size().cast<float>() / mPixelRatio;
     mTransform = Scaling(Vector2f{m_size.x(), m_size.y()}.cwiseQuotient(nanoguiImageSize).minCoeff());
@@ -313,87 +312,6 @@ void ImageCanvas::resetTransform() {
     mTransform = Affine2f::Identity();
 }
 
-std::vector<float> ImageCanvas::getHdrImageData(bool divideAlpha) const {
-    std::vector<float> result;
-
-    if (!mImage) {
-        return result;
-    }
-
-    const auto& channels = channelsFromImages(mImage, mReference, mRequestedChannelGroup, mMetric);
-    auto numPixels = mImage->count();
-
-    if (channels.empty()) {
-        return result;
-    }
-
-    int nChannelsToSave = std::min((int)channels.size(), 4);
-
-    // Flatten image into vector
-    result.resize(4 * numPixels, 0);
-
-    gThreadPool->parallelFor(0, nChannelsToSave, [&channels, &result](int i) {
-        const auto& channelData = channels[i].data();
-        for (DenseIndex j = 0; j < channelData.size(); ++j) {
-            result[j * 4 + i] = channelData(j);
-        }
-    });
-
-    // Manually set alpha channel to 1 if the image does not have one.
-    if (nChannelsToSave < 4) {
-        for (DenseIndex i = 0; i < numPixels; ++i) {
-            result[i * 4 + 3] = 1;
-        }
-    }
-
-    // Divide alpha out if needed (for storing in non-premultiplied formats)
-    if (divideAlpha) {
-        gThreadPool->parallelFor(0, min(nChannelsToSave, 3), [&result,numPixels](int i) {
-            for (DenseIndex j = 0; j < numPixels; ++j) {
-                float alpha = result[j * 4 + 3];
-                if (alpha == 0) {
-                    result[j * 4 + i] = 0;
-                } else {
-                    result[j * 4 + i] /= alpha;
-                }
-            }
-        });
-    }
-
-    return result;
-}
-
-std::vector<char> ImageCanvas::getLdrImageData(bool divideAlpha) const {
-    std::vector<char> result;
-
-    if (!mImage) {
-        return result;
-    }
-
-    auto numPixels = mImage->count();
-    auto floatData = getHdrImageData(divideAlpha);
-
-    // Store as LDR image.
-    result.resize(floatData.size());
-
-    gThreadPool->parallelFor<DenseIndex>(0, numPixels, [&](DenseIndex i) {
-        size_t start = 4 * i;
-        Vector3f value = applyTonemap({
-            applyExposureAndOffset(floatData[start]),
-            applyExposureAndOffset(floatData[start + 1]),
-            applyExposureAndOffset(floatData[start + 2]),
-        });
-        for (int j = 0; j < 3; ++j) {
-            floatData[start + j] = value[j];
-        }
-        for (int j = 0; j < 4; ++j) {
-            result[start + j] = (char)(floatData[start + j] * 255 + 0.5f);
-        }
-    });
-
-    return result;
-}
-
 void ImageCanvas::saveImage(const path& path) const {
     if (!mImage) {
         return;
@@ -442,7 +360,11 @@ shared_ptr<Lazy<shared_ptr<CanvasStatistics>>> ImageCanvas::canvasStatistics() {
 
     string channels = join(mImage->channelsInGroup(mRequestedChannelGroup), ",");
     string key = mReference ?
-        tfm::format("%d-%s-%d-%d", mImage->id(), channels, mReference->id(), mMetric) :
+        tfm::format(
+            "%d-%s-%d-%d-%d-%g-%d",
+            mImage->id(), channels, mReference->id(), mMetric,
+            mComparisonFilter.resampling, mComparisonFilter.blurSigma, mComparisonFilter.downsampling
+        ) :
         tfm::format("%d-%s", mImage->id(), channels);
 
     auto iter = mMeanValues.find(key);
@@ -453,8 +375,9 @@ shared_ptr<Lazy<shared_ptr<CanvasStatistics>>> ImageCanvas::canvasStatistics() {
     auto image = mImage, reference = mReference;
     auto requestedChannelGroup = mRequestedChannelGroup;
     auto metric = mMetric;
-    mMeanValues.insert(make_pair(key, make_shared<Lazy<shared_ptr<CanvasStatistics>>>([image, reference, requestedChannelGroup, metric]() {
-        return computeCanvasStatistics(image, reference, requestedChannelGroup, metric);
+    auto filter = mComparisonFilter;
+    mMeanValues.insert(make_pair(key, make_shared<Lazy<shared_ptr<CanvasStatistics>>>([image, reference, requestedChannelGroup, metric, filter]() {
+        return computeCanvasStatistics(image, reference, requestedChannelGroup, metric, filter);
     }, &mMeanValueThreadPool)));
 
     auto val = mMeanValues.at(key);
@@ -462,187 +385,295 @@ shared_ptr<Lazy<shared_ptr<CanvasStatistics>>> ImageCanvas::canvasStatistics() {
     return val;
 }
 
-vector<Channel> ImageCanvas::channelsFromImages(
-    shared_ptr<Image> image,
-    shared_ptr<Image> reference,
-    const string& requestedChannelGroup,
-    EMetric metric
-) {
-    if (!image) {
-        return {};
+void ImageCanvas::updateTextures(const Image& image, const string& channelName, int x, int y, int width, int height) {
+    auto iter = mTextures.find(&image);
+    if (iter == end(mTextures)) {
+        return;
     }
 
-    vector<Channel> result;
-    auto channelNames = image->channelsInGroup(requestedChannelGroup);
-    for (size_t i = 0; i < channelNames.size(); ++i) {
-        result.emplace_back(toUpper(Channel::tail(channelNames[i])), image->size());
+    auto imagePin = image.pin();
+
+    // Tiles of the image do not map onto filtered textures, so these are filtered anew once
+    // drawn.
+    auto& textures = iter->second.textures;
+    for (auto it = begin(textures); it != end(textures); ) {
+        const auto& channels = it->second.channels;
+        if (it->second.isFiltered && find(begin(channels), end(channels), channelName) != end(channels)) {
+            it = textures.erase(it);
+        } else {
+            ++it;
+        }
     }
 
-    bool onlyAlpha = all_of(begin(result), end(result), [](const Channel& c) { return c.name() == "A"; });
+    // Update textures that are cached for this channel
+    for (auto& kv : textures) {
+        auto& imageTexture = kv.second;
+        if (find(begin(imageTexture.channels), end(imageTexture.channels), channelName) == end(imageTexture.channels)) {
+            continue;
+        }
 
-    if (!reference) {
-        gThreadPool->parallelFor(0, (int)channelNames.size(), [&](int i) {
-            const auto* chan = image->channel(channelNames[i]);
-            for (DenseIndex j = 0; j < chan->count(); ++j) {
-                result[i].at(j) = chan->eval(j);
-            }
-        });
-    } else {
-        Vector2i size = image->size();
-        Vector2i offset = (reference->size() - size) / 2;
-        auto referenceChannels = reference->channelsInGroup(requestedChannelGroup);
-
-        gThreadPool->parallelFor<size_t>(0, channelNames.size(), [&](size_t i) {
-            const auto* chan = image->channel(channelNames[i]);
-            bool isAlpha = !onlyAlpha && result[i].name() == "A";
-
-            if (i < referenceChannels.size()) {
-                const Channel* referenceChan = reference->channel(referenceChannels[i]);
-                if (isAlpha) {
-                    for (int y = 0; y < size.y(); ++y) {
-                        for (int x = 0; x < size.x(); ++x) {
-                            result[i].at({x, y}) = 0.5f * (
-                                chan->eval({x, y}) +
-                                referenceChan->eval({x + offset.x(), y + offset.y()})
-                            );
-                        }
-                    }
-                } else {
-                    for (int y = 0; y < size.y(); ++y) {
-                        for (int x = 0; x < size.x(); ++x) {
-                            result[i].at({x, y}) = ImageCanvas::applyMetric(
-                                chan->eval({x, y}),
-                                referenceChan->eval({x + offset.x(), y + offset.y()}),
-                                metric
-                            );
-                        }
+        auto numPixels = width * height;
+        PooledVector<float> textureData(numPixels * 4);
+        MemoryAllocation textureDataMemory{image.memoryUsage(), BufferMemory, textureData.size() * sizeof(float)};
+
+        // Populate data for sub-region of the texture to be updated
+        for (size_t i = 0; i < 4; ++i) {
+            if (i < imageTexture.channels.size()) {
+                const auto& localChannelName = imageTexture.channels[i];
+                const auto* localChan = image.channel(localChannelName);
+                TEV_ASSERT(localChan, "Channel to be updated must exist");
+
+                for (int posY = 0; posY < height; ++posY) {
+                    for (int posX = 0; posX < width; ++posX) {
+                        int tileIdx = posX + posY * width;
+                        textureData[tileIdx * 4 + i] = localChan->at({x + posX, y + posY});
                     }
                 }
             } else {
-                if (isAlpha) {
-                    for (int y = 0; y < size.y(); ++y) {
-                        for (int x = 0; x < size.x(); ++x) {
-                            result[i].at({x, y}) = chan->eval({x, y});
-                        }
-                    }
-                } else {
-                    for (int y = 0; y < size.y(); ++y) {
-                        for (int x = 0; x < size.x(); ++x) {
-                            result[i].at({x, y}) = ImageCanvas::applyMetric(chan->eval({x, y}), 0, metric);
-                        }
-                    }
+                float val = i == 3 ? 1 : 0;
+                for (DenseIndex j = 0; j < numPixels; ++j) {
+                    textureData[j * 4 + i] = val;
                 }
             }
-        });
+        }
+
+        imageTexture.nanoguiTexture->upload_sub_region((uint8_t*)textureData.data(), {x, y}, {width, height});
+        PerformanceCounters::global().uploadedBytes.fetch_add(textureData.size() * sizeof(float), memory_order_relaxed);
+        imageTexture.mipmapDirty = true;
+    }
+}
+
+nanogui::Color ImageCanvas::channelColor(string channel) {
+    channel = toLower(Channel::tail(channel));
+
+    if (channel == "r") {
+        return nanogui::Color(0.8f, 0.2f, 0.2f, 1.0f);
+    } else if (channel == "g") {
+        return nanogui::Color(0.2f, 0.8f, 0.2f, 1.0f);
+    } else if (channel == "b") {
+        return nanogui::Color(0.2f, 0.3f, 1.0f, 1.0f);
     }
 
-    return result;
+    return nanogui::Color(1.0f, 1.0f);
 }
 
-shared_ptr<CanvasStatistics> ImageCanvas::computeCanvasStatistics(
-    std::shared_ptr<Image> image,
-    std::shared_ptr<Image> reference,
-    const string& requestedChannelGroup,
-    EMetric metric
-) {
-    auto flattened = channelsFromImages(image, reference, requestedChannelGroup, metric);
-
-    float mean = 0;
-    float maximum = -numeric_limits<float>::infinity();
-    float minimum = numeric_limits<float>::infinity();
-
-    const Channel* alphaChannel = nullptr;
-    // Only treat the alpha channel specially if it is not the only channel of the image.
-    if (!all_of(begin(flattened), end(flattened), [](const Channel& c) { return c.name() == "A"; })) {
-        for (auto& channel : flattened) {
-            if (channel.name() == "A") {
-                alphaChannel = &channel;
-                // The following code expects the alpha channel to be the last, so let's make sure it is.
-                if (alphaChannel != &flattened.back()) {
-                    swap(channel, flattened.back());
-                }
-                break;
-            }
+nanogui::Texture* ImageCanvas::texture(const shared_ptr<Image>& image, const string& channelGroupName) {
+    return texture(image, image->channelsInGroup(channelGroupName));
+}
+
+nanogui::Texture* ImageCanvas::texture(const shared_ptr<Image>& image, const vector<string>& channelNames) {
+    // A new image may have been allocated where a previous one was released.
+    auto& imageTextures = mTextures[image.get()];
+    if (imageTextures.image.lock() != image) {
+        imageTextures = {image, {}};
+    }
+
+    auto& textures = imageTextures.textures;
+
+    string lookup = join(channelNames, ",");
+    auto iter = textures.find(lookup);
+    if (iter != end(textures)) {
+        auto& texture = iter->second;
+        if (texture.mipmapDirty) {
+            texture.nanoguiTexture->generate_mipmap();
+            texture.mipmapDirty = false;
         }
+        return texture.nanoguiTexture.get();
     }
 
-    int nChannels = alphaChannel ? (int)flattened.size() - 1 : (int)flattened.size();
+    textures.emplace(lookup, ImageTexture{
+        new nanogui::Texture{
+            nanogui::Texture::PixelFormat::RGBA,
+            nanogui::Texture::ComponentFormat::Float32,
+            {image->size().x(), image->size().y()},
+            nanogui::Texture::InterpolationMode::Trilinear,
+            nanogui::Texture::InterpolationMode::Nearest,
+            nanogui::Texture::WrapMode::ClampToEdge,
+            1, nanogui::Texture::TextureFlags::ShaderRead,
+            true,
+        },
+        channelNames,
+        false,
+        // RGBA floats plus a third for the mipmap chain.
+        {image->memoryUsage(), TextureMemory, (size_t)image->count() * 4 * sizeof(float) * 4 / 3},
+        false,
+    });
+    auto& texture = textures.at(lookup).nanoguiTexture;
+
+    auto data = getTextureData(*image, channelNames);
+    MemoryAllocation dataMemory{image->memoryUsage(), BufferMemory, data.size() * sizeof(float)};
+    texture->upload((uint8_t*)data.data());
+    PerformanceCounters::global().uploadedBytes.fetch_add(data.size() * sizeof(float), memory_order_relaxed);
+    texture->generate_mipmap();
+    return texture.get();
+}
 
-    for (int i = 0; i < nChannels; ++i) {
-        const auto& channel = flattened[i];
-        mean += channel.data().mean();
-        maximum = max(maximum, channel.data().maxCoeff());
-        minimum = min(minimum, channel.data().minCoeff());
+bool ImageCanvas::isComparisonFiltered() const {
+    if (!mImage || !mReference) {
+        return false;
     }
 
-    auto result = make_shared<CanvasStatistics>();
+    return mComparisonFilter.isActive() || (mComparisonFilter.resampling != Centered && mReference->size() != mImage->size());
+}
+
+nanogui::Texture* ImageCanvas::filteredTexture(const shared_ptr<Image>& image, const vector<string>& channelNames) {
+    auto& imageTextures = mTextures[image.get()];
+    if (imageTextures.image.lock() != image) {
+        imageTextures = {image, {}};
+    }
 
-    result->mean = nChannels > 0 ? (mean / nChannels) : 0;
-    result->maximum = maximum;
-    result->minimum = minimum;
+    auto& textures = imageTextures.textures;
 
-    // Now that we know the maximum and minimum value we can define our histogram bin size.
-    static const int NUM_BINS = 400;
-    result->histogram = MatrixXf::Zero(NUM_BINS, nChannels);
+    // Keyed by everything the filtered channels depend on, such that they coexist with the
+    // texture of the image itself.
+    Vector2i imageSize = mImage->size();
+    Vector2i size = mComparisonFilter.comparisonSize(imageSize);
+    string lookup = tfm::format(
+        "%s@%dx%d:%d:%g:%d", join(channelNames, ","), imageSize.x(), imageSize.y(),
+        mComparisonFilter.resampling, mComparisonFilter.blurSigma, mComparisonFilter.downsampling
+    );
+    auto iter = textures.find(lookup);
+    if (iter != end(textures)) {
+        return iter->second.nanoguiTexture.get();
+    }
 
-    // We're going to draw our histogram in log space.
-    static const float addition = 0.001f;
-    static const float smallest = log(addition);
-    auto symmetricLog = [](float val) {
-        return val > 0 ? (log(val + addition) - smallest) : -(log(-val + addition) - smallest);
-    };
-    auto symmetricLogInverse = [](float val) {
-        return val > 0 ? (exp(val + smallest) - addition) : -(exp(-val + smallest) - addition);
-    };
+    textures.emplace(lookup, ImageTexture{
+        new nanogui::Texture{
+            nanogui::Texture::PixelFormat::RGBA,
+            nanogui::Texture::ComponentFormat::Float32,
+            {size.x(), size.y()},
+            nanogui::Texture::InterpolationMode::Trilinear,
+            nanogui::Texture::InterpolationMode::Nearest,
+            nanogui::Texture::WrapMode::ClampToEdge,
+            1, nanogui::Texture::TextureFlags::ShaderRead,
+            true,
+        },
+        channelNames,
+        false,
+        {image->memoryUsage(), TextureMemory, (size_t)size.x() * size.y() * 4 * sizeof(float) * 4 / 3},
+        true,
+    });
+    auto& texture = textures.at(lookup).nanoguiTexture;
+
+    auto data = getTextureData(filteredChannels(*image, channelNames, imageSize, mComparisonFilter), size);
+    MemoryAllocation dataMemory{image->memoryUsage(), BufferMemory, data.size() * sizeof(float)};
+    texture->upload((uint8_t*)data.data());
+    PerformanceCounters::global().uploadedBytes.fetch_add(data.size() * sizeof(float), memory_order_relaxed);
+    texture->generate_mipmap();
+    return texture.get();
+}
 
-    float minLog = symmetricLog(minimum);
-    float diffLog = symmetricLog(maximum) - minLog;
+void ImageCanvas::pruneTextures() {
+    for (auto it = begin(mTextures); it != end(mTextures); ) {
+        if (it->second.image.expired()) {
+            it = mTextures.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
 
-    auto valToBin = [&](float val) {
-        return clamp((int)(NUM_BINS * (symmetricLog(val) - minLog) / diffLog), 0, NUM_BINS - 1);
-    };
+void ImageCanvas::recordFrame(float drawSeconds) {
+    auto& counters = PerformanceCounters::global();
+    auto now = chrono::steady_clock::now();
 
-    result->histogramZero = valToBin(0);
+    size_t uploadedBytes = counters.uploadedBytes.load(memory_order_relaxed);
+    size_t ipcPackets = counters.ipcPackets.load(memory_order_relaxed);
 
-    auto binToVal = [&](float val) {
-        return symmetricLogInverse((diffLog * val / NUM_BINS) + minLog);
-    };
+    if (mFrameSeconds.empty()) {
+        mFrameSeconds.resize(NUM_HUD_FRAMES);
+        mDrawSeconds.resize(NUM_HUD_FRAMES);
+        mFrameUploadedBytes.resize(NUM_HUD_FRAMES);
+        mLastUploadedBytes = uploadedBytes;
+        mLastIpcPackets = ipcPackets;
+        mLastIpcSample = now;
+    }
 
-    // In the strange case that we have 0 channels, early return, because the histogram makes no sense.
-    if (nChannels == 0) {
-        return result;
+    if (mLastFrame != chrono::steady_clock::time_point{}) {
+        size_t idx = mNumFrames++ % NUM_HUD_FRAMES;
+        mFrameSeconds[idx] = chrono::duration<float>{now - mLastFrame}.count();
+        mDrawSeconds[idx] = drawSeconds;
+        mFrameUploadedBytes[idx] = uploadedBytes - mLastUploadedBytes;
     }
 
-    auto numElements = image->count();
-    Eigen::MatrixXi indices(numElements, nChannels);
+    mLastFrame = now;
+    mLastUploadedBytes = uploadedBytes;
 
-    vector<future<void>> futures;
-    for (int i = 0; i < nChannels; ++i) {
-        const auto& channel = flattened[i];
-        gThreadPool->parallelForAsync<DenseIndex>(0, numElements, [&, i](DenseIndex j) {
-            indices(j, i) = valToBin(channel.eval(j));
-        }, futures);
+    chrono::duration<float> sinceIpcSample = now - mLastIpcSample;
+    if (sinceIpcSample > chrono::seconds{1}) {
+        mIpcPacketsPerSecond = (ipcPackets - mLastIpcPackets) / sinceIpcSample.count();
+        mLastIpcPackets = ipcPackets;
+        mLastIpcSample = now;
     }
-    waitAll(futures);
+}
+
+void ImageCanvas::drawHud(NVGcontext* ctx) {
+    const auto& counters = PerformanceCounters::global();
+    size_t numFrames = min(mNumFrames, NUM_HUD_FRAMES);
 
-    gThreadPool->parallelFor(0, nChannels, [&](int i) {
-        for (DenseIndex j = 0; j < numElements; ++j) {
-            result->histogram(indices(j, i), i) += alphaChannel ? alphaChannel->eval(j) : 1;
+    auto percentile = [&](const vector<float>& values, float p) {
+        if (numFrames == 0) {
+            return 0.0f;
         }
-    });
 
-    for (int i = 0; i < NUM_BINS; ++i) {
-        result->histogram.row(i) /= binToVal(i + 1) - binToVal(i);
-    }
+        vector<float> sorted(begin(values), begin(values) + numFrames);
+        auto nth = begin(sorted) + min((size_t)(p * numFrames), numFrames - 1);
+        nth_element(begin(sorted), nth, end(sorted));
+        return *nth;
+    };
 
-    // Normalize the histogram according to the 10th-largest
-    // element to avoid a couple spikes ruining the entire graph.
-    MatrixXf temp = result->histogram;
-    DenseIndex idx = temp.size() - 10;
-    nth_element(temp.data(), temp.data() + idx, temp.data() + temp.size());
-    result->histogram /= max(temp(idx), 0.1f) * 1.3f;
+    size_t lastIdx = (mNumFrames + NUM_HUD_FRAMES - 1) % NUM_HUD_FRAMES;
+    auto pool = BufferPool::global().statistics();
+    size_t maxUploadedBytes = numFrames == 0 ? 0 : *max_element(begin(mFrameUploadedBytes), begin(mFrameUploadedBytes) + numFrames);
+
+    vector<string> lines = {
+        tfm::format("Frame: %.1f ms (p50 %.1f, p95 %.1f, p99 %.1f, max %.1f)",
+            numFrames == 0 ? 0.0f : mFrameSeconds[lastIdx] * 1000,
+            percentile(mFrameSeconds, 0.5f) * 1000,
+            percentile(mFrameSeconds, 0.95f) * 1000,
+            percentile(mFrameSeconds, 0.99f) * 1000,
+            percentile(mFrameSeconds, 1.0f) * 1000
+        ),
+        tfm::format("Canvas draw: %.1f ms (p95 %.1f)",
+            numFrames == 0 ? 0.0f : mDrawSeconds[lastIdx] * 1000,
+            percentile(mDrawSeconds, 0.95f) * 1000
+        ),
+        tfm::format("UI tasks: %.1f ms, %d queued", mHudInfo.taskSeconds * 1000, mHudInfo.numQueuedTasks),
+        tfm::format("Uploaded: %s (max %s)",
+            toMemoryString(numFrames == 0 ? 0 : mFrameUploadedBytes[lastIdx]),
+            toMemoryString(maxUploadedBytes)
+        ),
+        tfm::format("Loaded images queued: %d", mHudInfo.numQueuedImages),
+        tfm::format("In flight: %d loads, %d statistics",
+            counters.inFlightLoads.load(memory_order_relaxed),
+            counters.inFlightStatistics.load(memory_order_relaxed)
+        ),
+        tfm::format("IPC: %.0f packets/s", mIpcPacketsPerSecond),
+        tfm::format("Buffer pool: %s used, %s free, %d%% reused",
+            toMemoryString(pool.usedBytes),
+            toMemoryString(pool.freeBytes),
+            pool.numAllocations == 0 ? 0 : (int)(100 * pool.numReuses / pool.numAllocations)
+        ),
+    };
 
-    return result;
+    const float fontSize = 15, lineHeight = 18, padding = 8;
+    Vector2f origin = {m_pos.x() + 10.0f, m_pos.y() + 10.0f};
+    Vector2f size = {390.0f, lines.size() * lineHeight + 2 * padding};
+
+    nvgSave(ctx);
+    nvgBeginPath(ctx);
+    nvgRoundedRect(ctx, origin.x(), origin.y(), size.x(), size.y(), 3);
+    nvgFillColor(ctx, nanogui::Color(0.0f, 0.6f));
+    nvgFill(ctx);
+
+    nvgFontSize(ctx, fontSize);
+    nvgFontFace(ctx, "sans");
+    nvgTextAlign(ctx, NVG_ALIGN_LEFT | NVG_ALIGN_TOP);
+    nvgFillColor(ctx, nanogui::Color(1.0f, 1.0f));
+    for (size_t i = 0; i < lines.size(); ++i) {
+        drawTextWithShadow(ctx, origin.x() + padding, origin.y() + padding + i * lineHeight, lines[i]);
+    }
+    nvgRestore(ctx);
 }
 
 Vector2f ImageCanvas::pixelOffset(const Vector2i& size) const {
@@ -0,0 +1,528 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the BSD 3-Clause License within the LICENSE file.
+
+#include <tev/FalseColor.h>
+#include <tev/ImageProcessing.h>
+#include <tev/PerformanceCounters.h>
+#include <tev/Resampling.h>
+#include <tev/ThreadPool.h>
+
+#include <limits>
+
+using namespace Eigen;
+using namespace std;
+
+TEV_NAMESPACE_BEGIN
+
+float applyExposureAndOffset(float value, float exposure, float offset) {
+    return pow(2.0f, exposure) * value + offset;
+}
+
+Vector3f applyTonemap(const Vector3f& value, float gamma, ETonemap tonemap) {
+    Vector3f result;
+    switch (tonemap) {
+        case ETonemap::SRGB:
+            {
+                result = {toSRGB(value.x()), toSRGB(value.y()), toSRGB(value.z())};
+                break;
+            }
+        case ETonemap::Gamma:
+            {
+                result = {pow(value.x(), 1 / gamma), pow(value.y(), 1 / gamma), pow(value.z(), 1 / gamma)};
+                break;
+            }
+        case ETonemap::FalseColor:
+            {
+                static const auto falseColor = [](float linear) {
+                    static const auto& fcd = colormap::turbo();
+                    int start = 4 * clamp((int)(linear * (fcd.size() / 4)), 0, (int)fcd.size() / 4 - 1);
+                    return Vector3f{fcd[start], fcd[start + 1], fcd[start + 2]};
+                };
+
+                result = falseColor(log2(value.mean() + 0.03125f) / 10 + 0.5f);
+                break;
+            }
+        case ETonemap::PositiveNegative:
+            {
+                result = {-2.0f * value.cwiseMin(Vector3f::Zero()).mean(), 2.0f * value.cwiseMax(Vector3f::Zero()).mean(), 0.0f};
+                break;
+            }
+        default:
+            throw runtime_error{"Invalid tonemap selected."};
+    }
+
+    return result.cwiseMax(Vector3f::Zero()).cwiseMin(Vector3f::Ones());
+}
+
+float applyMetric(float image, float reference, EMetric metric) {
+    float diff = image - reference;
+    switch (metric) {
+        case EMetric::Error:                 return diff;
+        case EMetric::AbsoluteError:         return abs(diff);
+        case EMetric::SquaredError:          return diff * diff;
+        case EMetric::RelativeAbsoluteError: return abs(diff) / (reference + 0.01f);
+        case EMetric::RelativeSquaredError:  return diff * diff / (reference * reference + 0.01f);
+        default:
+            throw runtime_error{"Invalid metric selected."};
+    }
+}
+
+namespace {
+
+size_t channelBytes(const vector<Channel>& channels) {
+    size_t result = 0;
+    for (const auto& channel : channels) {
+        result += (size_t)channel.count() * sizeof(float);
+    }
+    return result;
+}
+
+shared_ptr<MemoryUsage> memoryUsageOf(const shared_ptr<Image>& image) {
+    return image ? image->memoryUsage() : nullptr;
+}
+
+// The channels of an image and its reference as they enter a comparison. They are obtained
+// once, such that errors of several metrics can be computed from them.
+struct ComparisonInputs {
+    // Upper-case names of the flattened channels.
+    vector<string> names;
+    vector<Channel> channels;
+    vector<Channel> referenceChannels;
+    Vector2i size;
+    // Where the image lies within a centered reference of a different size.
+    Vector2i offset = Vector2i::Zero();
+    bool hasReference = false;
+};
+
+ComparisonInputs comparisonInputs(
+    const shared_ptr<Image>& image,
+    const shared_ptr<Image>& reference,
+    const string& requestedChannelGroup,
+    const ComparisonFilter& filter
+) {
+    ComparisonInputs result;
+    auto channelNames = image->channelsInGroup(requestedChannelGroup);
+
+    // Filtering only applies when comparing, since it is meant to suppress the noise of the
+    // error rather than of the image itself.
+    bool isFiltered = reference && filter.isActive();
+    result.size = isFiltered ? filter.comparisonSize(image->size()) : image->size();
+
+    // Reading snapshots yields consistent results even if the images are updated meanwhile.
+    result.channels = isFiltered ?
+        filteredChannels(*image, channelNames, image->size(), filter) :
+        image->snapshot(channelNames);
+
+    for (const auto& channelName : channelNames) {
+        result.names.emplace_back(toUpper(Channel::tail(channelName)));
+    }
+
+    if (reference) {
+        result.hasReference = true;
+        auto referenceChannelNames = reference->channelsInGroup(requestedChannelGroup);
+        if (filter.resampling == Centered && !isFiltered) {
+            result.offset = (reference->size() - result.size) / 2;
+            result.referenceChannels = reference->snapshot(referenceChannelNames);
+        } else {
+            result.referenceChannels = filteredChannels(*reference, referenceChannelNames, image->size(), filter);
+        }
+    }
+
+    return result;
+}
+
+vector<Channel> channelsFromInputs(const ComparisonInputs& inputs, EMetric metric) {
+    const Vector2i& size = inputs.size;
+    const Vector2i& offset = inputs.offset;
+
+    vector<Channel> result;
+    for (const auto& name : inputs.names) {
+        result.emplace_back(name, size);
+    }
+
+    bool onlyAlpha = all_of(begin(result), end(result), [](const Channel& c) { return c.name() == "A"; });
+
+    if (!inputs.hasReference) {
+        gThreadPool->parallelFor(0, (int)inputs.channels.size(), [&](int i) {
+            const auto* chan = &inputs.channels[i];
+            for (DenseIndex j = 0; j < chan->count(); ++j) {
+                result[i].at(j) = chan->eval(j);
+            }
+        });
+    } else {
+        gThreadPool->parallelFor<size_t>(0, inputs.channels.size(), [&](size_t i) {
+            const auto* chan = &inputs.channels[i];
+            bool isAlpha = !onlyAlpha && result[i].name() == "A";
+
+            if (i < inputs.referenceChannels.size()) {
+                const Channel* referenceChan = &inputs.referenceChannels[i];
+                if (isAlpha) {
+                    for (int y = 0; y < size.y(); ++y) {
+                        for (int x = 0; x < size.x(); ++x) {
+                            result[i].at({x, y}) = 0.5f * (
+                                chan->eval({x, y}) +
+                                referenceChan->eval({x + offset.x(), y + offset.y()})
+                            );
+                        }
+                    }
+                } else {
+                    for (int y = 0; y < size.y(); ++y) {
+                        for (int x = 0; x < size.x(); ++x) {
+                            result[i].at({x, y}) = applyMetric(
+                                chan->eval({x, y}),
+                                referenceChan->eval({x + offset.x(), y + offset.y()}),
+                                metric
+                            );
+                        }
+                    }
+                }
+            } else {
+                if (isAlpha) {
+                    for (int y = 0; y < size.y(); ++y) {
+                        for (int x = 0; x < size.x(); ++x) {
+                            result[i].at({x, y}) = chan->eval({x, y});
+                        }
+                    }
+                } else {
+                    for (int y = 0; y < size.y(); ++y) {
+                        for (int x = 0; x < size.x(); ++x) {
+                            result[i].at({x, y}) = applyMetric(chan->eval({x, y}), 0, metric);
+                        }
+                    }
+                }
+            }
+        });
+    }
+
+    return result;
+}
+
+// Reduces the flattened channels (see channelsFromImages) to their statistics.
+shared_ptr<CanvasStatistics> computeStatistics(vector<Channel> flattened, const shared_ptr<Image>& image, bool computeHistogram) {
+    MemoryAllocation flattenedMemory{memoryUsageOf(image), BufferMemory, channelBytes(flattened)};
+
+    float mean = 0;
+    float maximum = -numeric_limits<float>::infinity();
+    float minimum = numeric_limits<float>::infinity();
+
+    const Channel* alphaChannel = nullptr;
+    // Only treat the alpha channel specially if it is not the only channel of the image.
+    if (!all_of(begin(flattened), end(flattened), [](const Channel& c) { return c.name() == "A"; })) {
+        for (auto& channel : flattened) {
+            if (channel.name() == "A") {
+                alphaChannel = &channel;
+                // The following code expects the alpha channel to be the last, so let's make sure it is.
+                if (alphaChannel != &flattened.back()) {
+                    swap(channel, flattened.back());
+                }
+                break;
+            }
+        }
+    }
+
+    int nChannels = alphaChannel ? (int)flattened.size() - 1 : (int)flattened.size();
+
+    for (int i = 0; i < nChannels; ++i) {
+        const auto& channel = flattened[i];
+        mean += channel.data().mean();
+        maximum = max(maximum, channel.data().maxCoeff());
+        minimum = min(minimum, channel.data().minCoeff());
+    }
+
+    auto result = make_shared<CanvasStatistics>();
+
+    result->mean = nChannels > 0 ? (mean / nChannels) : 0;
+    result->maximum = maximum;
+    result->minimum = minimum;
+
+    if (!computeHistogram) {
+        result->histogramZero = 0;
+        result->memory = {memoryUsageOf(image), StatisticsMemory, sizeof(CanvasStatistics)};
+        return result;
+    }
+
+    // Now that we know the maximum and minimum value we can define our histogram bin size.
+    static const int NUM_BINS = 400;
+    result->histogram = MatrixXf::Zero(NUM_BINS, nChannels);
+
+    // We're going to draw our histogram in log space.
+    static const float addition = 0.001f;
+    static const float smallest = log(addition);
+    auto symmetricLog = [](float val) {
+        return val > 0 ? (log(val + addition) - smallest) : -(log(-val + addition) - smallest);
+    };
+    auto symmetricLogInverse = [](float val) {
+        return val > 0 ? (exp(val + smallest) - addition) : -(exp(-val + smallest) - addition);
+    };
+
+    float minLog = symmetricLog(minimum);
+    float diffLog = symmetricLog(maximum) - minLog;
+
+    auto valToBin = [&](float val) {
+        return clamp((int)(NUM_BINS * (symmetricLog(val) - minLog) / diffLog), 0, NUM_BINS - 1);
+    };
+
+    result->histogramZero = valToBin(0);
+
+    auto binToVal = [&](float val) {
+        return symmetricLogInverse((diffLog * val / NUM_BINS) + minLog);
+    };
+
+    // In the strange case that we have 0 channels, early return, because the histogram makes no sense.
+    if (nChannels == 0) {
+        result->memory = {memoryUsageOf(image), StatisticsMemory, sizeof(CanvasStatistics) + result->histogram.size() * sizeof(float)};
+        return result;
+    }
+
+    // Filtered comparisons may have fewer elements than the image.
+    auto numElements = flattened.front().count();
+    PooledVector<int> indices((size_t)numElements * nChannels);
+
+    vector<future<void>> futures;
+    for (int i = 0; i < nChannels; ++i) {
+        const auto& channel = flattened[i];
+        gThreadPool->parallelForAsync<DenseIndex>(0, numElements, [&, i](DenseIndex j) {
+            indices[j + i * numElements] = valToBin(channel.eval(j));
+        }, futures);
+    }
+    waitAll(futures);
+
+    gThreadPool->parallelFor(0, nChannels, [&](int i) {
+        for (DenseIndex j = 0; j < numElements; ++j) {
+            result->histogram(indices[j + i * numElements], i) += alphaChannel ? alphaChannel->eval(j) : 1;
+        }
+    });
+
+    for (int i = 0; i < NUM_BINS; ++i) {
+        result->histogram.row(i) /= binToVal(i + 1) - binToVal(i);
+    }
+
+    // Normalize the histogram according to the 10th-largest
+    // element to avoid a couple spikes ruining the entire graph.
+    MatrixXf temp = result->histogram;
+    DenseIndex idx = temp.size() - 10;
+    nth_element(temp.data(), temp.data() + idx, temp.data() + temp.size());
+    result->histogram /= max(temp(idx), 0.1f) * 1.3f;
+
+    result->memory = {memoryUsageOf(image), StatisticsMemory, sizeof(CanvasStatistics) + result->histogram.size() * sizeof(float)};
+    return result;
+}
+
+}
+
+vector<Channel> channelsFromImages(
+    shared_ptr<Image> image,
+    shared_ptr<Image> reference,
+    const string& requestedChannelGroup,
+    EMetric metric,
+    const ComparisonFilter& filter
+) {
+    if (!image) {
+        return {};
+    }
+
+    return channelsFromInputs(comparisonInputs(image, reference, requestedChannelGroup, filter), metric);
+}
+
+vector<Channel> filteredChannels(
+    const Image& image,
+    const vector<string>& channelNames,
+    const Vector2i& imageSize,
+    const ComparisonFilter& filter
+) {
+    // Images of the compared size are downsampled with a box filter. Centered pixels can not
+    // be downsampled consistently, so a reference of a different size is then stretched, too.
+    bool isBoxFiltered = image.size() == imageSize || filter.resampling == Centered;
+    return image.resampledSnapshot(
+        channelNames,
+        filter.comparisonSize(imageSize),
+        isBoxFiltered ? Box : filter.resampling,
+        filter.blurSigma / max(filter.downsampling, 1)
+    );
+}
+
+shared_ptr<CanvasStatistics> computeCanvasStatistics(
+    shared_ptr<Image> image,
+    shared_ptr<Image> reference,
+    const string& requestedChannelGroup,
+    EMetric metric,
+    const ComparisonFilter& filter,
+    bool computeHistogram
+) {
+    ScopedCount inFlight{PerformanceCounters::global().inFlightStatistics};
+    return computeStatistics(channelsFromImages(image, reference, requestedChannelGroup, metric, filter), image, computeHistogram);
+}
+
+vector<shared_ptr<CanvasStatistics>> computeMetricStatistics(
+    shared_ptr<Image> image,
+    shared_ptr<Image> reference,
+    const string& requestedChannelGroup,
+    const ComparisonFilter& filter
+) {
+    ScopedCount inFlight{PerformanceCounters::global().inFlightStatistics};
+
+    // The snapshots and filtered channels are shared by all metrics.
+    auto inputs = comparisonInputs(image, reference, requestedChannelGroup, filter);
+    vector<shared_ptr<CanvasStatistics>> result;
+    for (int m = 0; m < NumMetrics; ++m) {
+        result.emplace_back(computeStatistics(channelsFromInputs(inputs, (EMetric)m), image, false));
+    }
+
+    return result;
+}
+
+PooledVector<float> getTextureData(const Image& image, const vector<string>& channelNames) {
+    auto imagePin = image.pin();
+
+    auto numPixels = image.count();
+    PooledVector<float> data(numPixels * 4);
+
+    vector<future<void>> futures;
+    for (size_t i = 0; i < 4; ++i) {
+        if (i < channelNames.size()) {
+            const auto& channelName = channelNames[i];
+            const auto* chan = image.channel(channelName);
+            if (!chan) {
+                throw invalid_argument{tfm::format("Cannot obtain texture of %s:%s, because the channel does not exist.", image.path(), channelName)};
+            }
+
+            // The map is captured by value, since it only lives within this scope.
+            auto channelData = chan->data();
+            gThreadPool->parallelForAsync<DenseIndex>(0, numPixels, [channelData, &data, i](DenseIndex j) {
+                data[j * 4 + i] = channelData(j);
+            }, futures);
+        } else {
+            float val = i == 3 ? 1 : 0;
+            gThreadPool->parallelForAsync<DenseIndex>(0, numPixels, [&data, val, i](DenseIndex j) {
+                data[j * 4 + i] = val;
+            }, futures);
+        }
+    }
+    waitAll(futures);
+
+    return data;
+}
+
+PooledVector<float> getTextureData(const vector<Channel>& channels, const Vector2i& size) {
+    auto numPixels = (DenseIndex)size.x() * size.y();
+    PooledVector<float> data(numPixels * 4);
+
+    gThreadPool->parallelFor<DenseIndex>(0, numPixels, [&](DenseIndex j) {
+        for (size_t i = 0; i < 4; ++i) {
+            data[j * 4 + i] = i < channels.size() ? channels[i].at(j) : (i == 3 ? 1.0f : 0.0f);
+        }
+    });
+
+    return data;
+}
+
+PooledVector<float> getHdrImageData(
+    shared_ptr<Image> image,
+    shared_ptr<Image> reference,
+    const string& requestedChannelGroup,
+    EMetric metric,
+    const ComparisonFilter& filter,
+    bool divideAlpha
+) {
+    PooledVector<float> result;
+
+    if (!image) {
+        return result;
+    }
+
+    auto channels = channelsFromImages(image, reference, requestedChannelGroup, metric, filter);
+    for (auto& channel : channels) {
+        if (channel.size() != image->size()) {
+            // Box filtering magnifies by repeating pixels, which keeps the error of each
+            // downsampled block intact.
+            channel = resample(channel, image->size(), Box);
+        }
+    }
+
+    MemoryAllocation channelsMemory{image->memoryUsage(), BufferMemory, channelBytes(channels)};
+    auto numPixels = image->count();
+
+    if (channels.empty()) {
+        return result;
+    }
+
+    int nChannelsToSave = std::min((int)channels.size(), 4);
+
+    // Flatten image into vector
+    result.resize(4 * numPixels, 0);
+
+    gThreadPool->parallelFor(0, nChannelsToSave, [&channels, &result](int i) {
+        const auto& channelData = channels[i].data();
+        for (DenseIndex j = 0; j < channelData.size(); ++j) {
+            result[j * 4 + i] = channelData(j);
+        }
+    });
+
+    // Manually set alpha channel to 1 if the image does not have one.
+    if (nChannelsToSave < 4) {
+        for (DenseIndex i = 0; i < numPixels; ++i) {
+            result[i * 4 + 3] = 1;
+        }
+    }
+
+    // Divide alpha out if needed (for storing in non-premultiplied formats)
+    if (divideAlpha) {
+        gThreadPool->parallelFor(0, min(nChannelsToSave, 3), [&result,numPixels](int i) {
+            for (DenseIndex j = 0; j < numPixels; ++j) {
+                float alpha = result[j * 4 + 3];
+                if (alpha == 0) {
+                    result[j * 4 + i] = 0;
+                } else {
+                    result[j * 4 + i] /= alpha;
+                }
+            }
+        });
+    }
+
+    return result;
+}
+
+PooledVector<char> getLdrImageData(
+    shared_ptr<Image> image,
+    shared_ptr<Image> reference,
+    const string& requestedChannelGroup,
+    EMetric metric,
+    const ComparisonFilter& filter,
+    bool divideAlpha,
+    const DisplaySettings& displaySettings
+) {
+    PooledVector<char> result;
+
+    if (!image) {
+        return result;
+    }
+
+    auto numPixels = image->count();
+    auto floatData = getHdrImageData(image, reference, requestedChannelGroup, metric, filter, divideAlpha);
+    MemoryAllocation floatDataMemory{image->memoryUsage(), BufferMemory, floatData.size() * sizeof(float)};
+
+    const float exposure = displaySettings.exposure;
+    const float offset = displaySettings.offset;
+
+    // Store as LDR image.
+    result.resize(floatData.size());
+
+    gThreadPool->parallelFor<DenseIndex>(0, numPixels, [&](DenseIndex i) {
+        size_t start = 4 * i;
+        Vector3f value = applyTonemap({
+            applyExposureAndOffset(floatData[start], exposure, offset),
+            applyExposureAndOffset(floatData[start + 1], exposure, offset),
+            applyExposureAndOffset(floatData[start + 2], exposure, offset),
+        }, displaySettings.gamma, displaySettings.tonemap);
+        for (int j = 0; j < 3; ++j) {
+            floatData[start + j] = value[j];
+        }
+        for (int j = 0; j < 4; ++j) {
+            result[start + j] = (char)(floatData[start + j] * 255 + 0.5f);
+        }
+    });
+
+    return result;
+}
+
+TEV_NAMESPACE_END
@@ -0,0 +1,390 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the BSD 3-Clause License within the LICENSE file.
+
+#include <tev/ImageSequence.h>
+
+#include <algorithm>
+#include <cctype>
+#include <regex>
+
+using namespace filesystem;
+using namespace std;
+
+TEV_NAMESPACE_BEGIN
+
+namespace {
+
+struct FramePattern {
+    string directory;
+    string filename;
+    string range;
+
+    // Parts of the filename before and after the frame number.
+    string prefix;
+    string suffix;
+
+    // Number of digits of zero-padded frame numbers. 0 permits an arbitrary number of digits.
+    size_t padding;
+
+    bool hasRange = false;
+    long first = 0;
+    long last = 0;
+    long step = 1;
+};
+
+bool parsePattern(const string& str, FramePattern& result) {
+    static const regex frameToken{"#+|%(0\\d{1,2})?d"};
+    static const regex frameRange{"@(\\d{1,9})-(\\d{1,9})(?:x(\\d{1,9}))?$"};
+
+    string pattern = str;
+    smatch rangeMatch;
+    if (regex_search(pattern, rangeMatch, frameRange)) {
+        result.hasRange = true;
+        result.first = stol(rangeMatch[1]);
+        result.last = stol(rangeMatch[2]);
+        result.step = rangeMatch[3].matched ? stol(rangeMatch[3]) : 1;
+        result.range = rangeMatch[0];
+        pattern = rangeMatch.prefix();
+    }
+
+    size_t separator = pattern.find_last_of("/\\");
+    size_t filenameStart = separator == string::npos ? 0 : separator + 1;
+    result.directory = pattern.substr(0, filenameStart);
+    result.filename = pattern.substr(filenameStart);
+
+    smatch tokenMatch;
+    if (!regex_search(result.filename, tokenMatch, frameToken)) {
+        return false;
+    }
+
+    result.prefix = tokenMatch.prefix();
+    result.suffix = tokenMatch.suffix();
+
+    string token = tokenMatch[0];
+    if (token[0] == '#') {
+        result.padding = token.size();
+    } else {
+        result.padding = tokenMatch[1].matched ? stoul(tokenMatch[1]) : 0;
+    }
+
+    return true;
+}
+
+path absoluteDirectory(const FramePattern& pattern) {
+    return pattern.directory.empty() ? path::getcwd() : path{pattern.directory}.make_absolute();
+}
+
+string frameNumber(long frame, size_t padding) {
+    string result = to_string(frame);
+    if (result.size() < padding) {
+        result.insert(0, padding - result.size(), '0');
+    }
+    return result;
+}
+
+}
+
+ImageSequence::ImageSequence(const string& pattern, const vector<path>& framePaths, const string& channelSelector)
+: mPattern{pattern}, mFramePaths{framePaths}, mChannelSelector{channelSelector} {
+    if (mFramePaths.empty()) {
+        throw invalid_argument{"Image sequence must contain at least one frame."};
+    }
+}
+
+ImageSequence::~ImageSequence() {
+    mWorkers.flushQueue();
+    mWorkers.waitUntilFinished();
+}
+
+bool ImageSequence::isPattern(const string& str) {
+    FramePattern pattern;
+    return parsePattern(str, pattern);
+}
+
+vector<path> ImageSequence::expandPattern(const string& str) {
+    FramePattern pattern;
+    if (!parsePattern(str, pattern)) {
+        throw invalid_argument{tfm::format("'%s' is not a frame pattern.", str)};
+    }
+
+    path directory = absoluteDirectory(pattern);
+    vector<pair<long, path>> frames;
+
+    if (pattern.hasRange) {
+        if (pattern.step <= 0 || pattern.last < pattern.first) {
+            throw invalid_argument{tfm::format("Invalid frame range %s.", pattern.range)};
+        }
+
+        size_t numMissing = 0;
+        for (long frame = pattern.first; frame <= pattern.last; frame += pattern.step) {
+            path framePath = directory / (pattern.prefix + frameNumber(frame, pattern.padding) + pattern.suffix);
+            if (framePath.is_file()) {
+                frames.emplace_back(frame, framePath);
+            } else {
+                ++numMissing;
+            }
+        }
+
+        if (numMissing > 0) {
+            tlog::warning() << tfm::format("%d frames of '%s' do not exist.", numMissing, str);
+        }
+    } else {
+        const auto& prefix = pattern.prefix;
+        const auto& suffix = pattern.suffix;
+
+        for (const auto& name : listDirectory(directory)) {
+            if (name.size() <= prefix.size() + suffix.size() ||
+                name.compare(0, prefix.size(), prefix) != 0 ||
+                name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0) {
+                continue;
+            }
+
+            string digits = name.substr(prefix.size(), name.size() - prefix.size() - suffix.size());
+            if (digits.size() > 9 || !all_of(begin(digits), end(digits), [](char c) { return isdigit((unsigned char)c); })) {
+                continue;
+            }
+
+            // Frame numbers exceeding the padding are written with more digits, but never with
+            // more leading zeroes.
+            if (pattern.padding > 0 && (digits.size() < pattern.padding || (digits.size() > pattern.padding && digits[0] == '0'))) {
+                continue;
+            }
+
+            frames.emplace_back(stol(digits), directory / name);
+        }
+
+        sort(begin(frames), end(frames), [](const pair<long, path>& a, const pair<long, path>& b) {
+            return a.first < b.first;
+        });
+    }
+
+    vector<path> result;
+    for (auto& frame : frames) {
+        result.emplace_back(move(frame.second));
+    }
+
+    return result;
+}
+
+int ImageSequence::frameIndex(const shared_ptr<Image>& frame) const {
+    if (!frame) {
+        return -1;
+    }
+
+    lock_guard<mutex> lock{mMutex};
+    auto it = mIndicesByPath.find(frame->path().str());
+    return it == end(mIndicesByPath) ? -1 : (int)it->second;
+}
+
+size_t ImageSequence::nextFrame(size_t index, EDirection direction) const {
+    size_t n = numFrames();
+    return direction == Forward ? (index + 1) % n : (index + n - 1) % n;
+}
+
+bool ImageSequence::hasFailed(size_t index) const {
+    lock_guard<mutex> lock{mMutex};
+    return mFailed.count(index) > 0;
+}
+
+shared_ptr<Image> ImageSequence::frame(size_t index, EDirection direction) {
+    lock_guard<mutex> lock{mMutex};
+    movePlayhead(index, direction);
+
+    auto it = mFrames.find(index);
+    return it == end(mFrames) ? nullptr : it->second;
+}
+
+shared_ptr<Image> ImageSequence::waitForFrame(size_t index, EDirection direction) {
+    unique_lock<mutex> lock{mMutex};
+    movePlayhead(index, direction);
+
+    while (true) {
+        auto it = mFrames.find(index);
+        if (it != end(mFrames)) {
+            return it->second;
+        }
+
+        if (mFailed.count(index) > 0) {
+            return nullptr;
+        }
+
+        // The decode task may have skipped the frame if the playhead was moved
+        // elsewhere in the meantime. In that case, schedule it once more.
+        if (mPending.count(index) == 0) {
+            enqueueDecode(index);
+        }
+
+        mFrameDecoded.wait(lock);
+    }
+}
+
+void ImageSequence::clear() {
+    lock_guard<mutex> lock{mMutex};
+
+    // Frames that are currently being decoded are discarded once they are
+    // done by virtue of the incremented generation.
+    mWorkers.flushQueue();
+    ++mGeneration;
+
+    mFrames.clear();
+    mPending.clear();
+    mFailed.clear();
+
+    mFrameDecoded.notify_all();
+}
+
+void ImageSequence::setFrameDecodedCallback(function<void()> callback) {
+    lock_guard<mutex> lock{mMutex};
+    mFrameDecodedCallback = callback;
+}
+
+void ImageSequence::setMemoryBudget(size_t bytes) {
+    lock_guard<mutex> lock{mMutex};
+    mMemoryBudget = bytes;
+    movePlayhead(mPlayhead, mDirection);
+}
+
+void ImageSequence::windowExtent(size_t& ahead, size_t& behind) const {
+    size_t windowSize = numFrames();
+    if (mBytesPerFrame > 0) {
+        windowSize = min(windowSize, max(mMemoryBudget / mBytesPerFrame, (size_t)2));
+    }
+
+    // The playhead itself is part of the window. Three quarters of the remainder are
+    // spent on frames in playback direction, the rest is kept for stepping backwards.
+    behind = (windowSize - 1) / 4;
+    ahead = windowSize - 1 - behind;
+}
+
+bool ImageSequence::isInWindow(size_t index) const {
+    size_t ahead, behind;
+    windowExtent(ahead, behind);
+
+    size_t n = numFrames();
+    size_t forwardDistance = (index + n - mPlayhead) % n;
+    size_t backwardDistance = (mPlayhead + n - index) % n;
+
+    if (mDirection == Forward) {
+        return forwardDistance <= ahead || backwardDistance <= behind;
+    } else {
+        return backwardDistance <= ahead || forwardDistance <= behind;
+    }
+}
+
+void ImageSequence::movePlayhead(size_t index, EDirection direction) {
+    if (index >= numFrames()) {
+        throw invalid_argument{tfm::format("Frame %d is out of range [0, %d).", index, numFrames())};
+    }
+
+    mPlayhead = index;
+    mDirection = direction;
+
+    // Frames outside of the window are released. Those that are still being displayed
+    // remain alive through the viewer until it moves on to another frame.
+    for (auto it = begin(mFrames); it != end(mFrames); ) {
+        if (isInWindow(it->first)) {
+            ++it;
+        } else {
+            it = mFrames.erase(it);
+        }
+    }
+
+    enqueueDecode(index);
+
+    // The size of the window is only known once the first frame was decoded.
+    if (mBytesPerFrame == 0) {
+        return;
+    }
+
+    size_t ahead, behind;
+    windowExtent(ahead, behind);
+
+    for (size_t i = 0, frame = index; i < ahead; ++i) {
+        frame = nextFrame(frame, direction);
+        enqueueDecode(frame);
+    }
+}
+
+void ImageSequence::enqueueDecode(size_t index) {
+    if (mFrames.count(index) > 0 || mPending.count(index) > 0 || mFailed.count(index) > 0) {
+        return;
+    }
+
+    mPending.insert(index);
+
+    // The frame at the playhead jumps the queue of prefetched frames, since it is
+    // the one that is waited for.
+    bool isPlayhead = index == mPlayhead;
+    mWorkers.enqueueTask([this, index, generation = mGeneration] {
+        {
+            lock_guard<mutex> lock{mMutex};
+            if (generation != mGeneration) {
+                return;
+            }
+
+            // The playhead may have moved on since the frame was scheduled.
+            if (!isInWindow(index)) {
+                mPending.erase(index);
+                mFrameDecoded.notify_all();
+                return;
+            }
+        }
+
+        auto image = tryLoadImage(mFramePaths[index], mChannelSelector);
+
+        function<void()> callback;
+        {
+            lock_guard<mutex> lock{mMutex};
+            if (generation != mGeneration) {
+                return;
+            }
+
+            mPending.erase(index);
+
+            if (!image) {
+                mFailed.insert(index);
+            } else {
+                mIndicesByPath[image->path().str()] = index;
+                if (isInWindow(index)) {
+                    mFrames[index] = image;
+                }
+
+                if (mBytesPerFrame == 0) {
+                    mBytesPerFrame = (size_t)image->count() * image->numChannels() * sizeof(float);
+                    movePlayhead(mPlayhead, mDirection);
+                }
+            }
+
+            callback = mFrameDecodedCallback;
+        }
+
+        mFrameDecoded.notify_all();
+        if (callback) {
+            callback();
+        }
+    }, isPlayhead);
+}
+
+shared_ptr<ImageSequence> tryLoadImageSequence(const string& pattern, const string& channelSelector) {
+    auto handleException = [&](const exception& e) {
+        tlog::error() << tfm::format("Could not load sequence '%s'. %s", pattern, e.what());
+    };
+
+    try {
+        auto framePaths = ImageSequence::expandPattern(pattern);
+        if (framePaths.empty()) {
+            throw invalid_argument{"No frames match the pattern."};
+        }
+
+        tlog::success() << tfm::format("Found %d frames matching '%s'.", framePaths.size(), pattern);
+        return make_shared<ImageSequence>(pattern, framePaths, channelSelector);
+    } catch (const invalid_argument& e) {
+        handleException(e);
+    } catch (const runtime_error& e) {
+        handleException(e);
+    }
+
+    return nullptr;
+}
+
+TEV_NAMESPACE_END
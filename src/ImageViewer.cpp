@@ -2,6 +2,7 @@
 // It is published under the BSD 3-Clause License within the LICENSE file.
 
 #include <tev/ImageViewer.h>
+#include <tev/imageio/ImageLoader.h>
 
 #include <clip.h>
 
@@ -362,14 +363,31 @@ ImageViewer::ImageViewer(const shared_ptr<BackgroundImagesLoader>& imagesLoader,
             // mFpsTextBox->set_fixed_text_width(42);
 
             mPlaybackThread = thread{[&]() {
+                // Frames are advanced at fixed deadlines rather than after fixed sleeps, such that
+                // the time spent waking up and advancing frames does not accumulate into drift.
+                auto deadline = chrono::steady_clock::now();
                 while (mShallRunPlaybackThread) {
                     auto fps = clamp(mFpsTextBox->value(), 1, 1000);
-                    auto sleepDuration = chrono::duration<float>{1.0f / fps};
-                    this_thread::sleep_for(sleepDuration);
+                    auto frameDuration = chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>{1.0 / fps});
+
+                    deadline += frameDuration;
+
+                    // If we fell behind by more than a frame, e.g. because playback was paused or the
+                    // frame rate was changed, re-synchronize rather than rushing through frames.
+                    auto now = chrono::steady_clock::now();
+                    if (deadline < now) {
+                        deadline = now + frameDuration;
+                    }
+
+                    this_thread::sleep_until(deadline);
 
                     if (mPlayButton->pushed() && mTaskQueue.empty()) {
                         mTaskQueue.push([&]() {
-                            selectImage(nextImage(mCurrentImage, Forward), false);
+                            // Sequences play their frames. If the next frame was not decoded yet,
+                            // the current one is held rather than skipped.
+                            if (!stepSequence(Forward, true)) {
+                                selectImage(nextImage(mCurrentImage, Forward), false);
+                            }
                         });
                         redraw();
                     }
@@ -463,6 +481,10 @@ ImageViewer::~ImageViewer() {
     if (mPlaybackThread.joinable()) {
         mPlaybackThread.join();
     }
+
+    for (const auto& sequence : mImageSequences) {
+        sequence.second->setFrameDecodedCallback({});
+    }
 }
 
 bool ImageViewer::mouse_button_event(const nanogui::Vector2i &p, int button, bool down, int modifiers) {
@@ -644,6 +666,12 @@ bool ImageViewer::keyboard_event(int key, int scancode, int action, int modifier
         } else if (key == GLFW_KEY_N) {
             normalizeExposureAndOffset();
             return true;
+        } else if (key == GLFW_KEY_C && !(modifiers & SYSTEM_COMMAND_MOD)) {
+            toggleRawColors();
+            return true;
+        } else if (key == GLFW_KEY_T) {
+            computeTemporalStatistics();
+            return true;
         } else if (key == GLFW_KEY_R) {
             if (modifiers & SYSTEM_COMMAND_MOD) {
                 if (modifiers & GLFW_MOD_SHIFT) {
@@ -674,6 +702,13 @@ bool ImageViewer::keyboard_event(int key, int scancode, int action, int modifier
         } else if (key == GLFW_KEY_H) {
             toggleHelpWindow();
             return true;
+        } else if (key == GLFW_KEY_I) {
+            mImageCanvas->setHudVisible(!mImageCanvas->isHudVisible());
+            redraw();
+            return true;
+        } else if (key == GLFW_KEY_M) {
+            toggleMemoryWindow();
+            return true;
         } else if (key == GLFW_KEY_ENTER && modifiers & GLFW_MOD_ALT) {
             toggleMaximized();
             return true;
@@ -809,6 +844,18 @@ bool ImageViewer::keyboard_event(int key, int scancode, int action, int modifier
             }
         }
 
+        if (key == GLFW_KEY_K || key == GLFW_KEY_J) {
+            auto filter = comparisonFilter();
+            bool shallIncrease = !(modifiers & GLFW_MOD_SHIFT);
+            if (key == GLFW_KEY_K) {
+                filter.blurSigma = shallIncrease ? min(max(filter.blurSigma * 2, 1.0f), 64.0f) : (filter.blurSigma > 1 ? filter.blurSigma / 2 : 0.0f);
+            } else {
+                filter.downsampling = shallIncrease ? min(filter.downsampling * 2, 64) : max(filter.downsampling / 2, 1);
+            }
+
+            setComparisonFilter(filter);
+        }
+
         if (mGammaSlider->enabled()) {
             if (key == GLFW_KEY_G) {
                 if (modifiers & GLFW_MOD_SHIFT) {
@@ -837,6 +884,9 @@ bool ImageViewer::keyboard_event(int key, int scancode, int action, int modifier
             } else {
                 selectImage(nextImage(mCurrentImage, Forward));
             }
+        } else if (key == GLFW_KEY_PERIOD || key == GLFW_KEY_COMMA) {
+            mPlayButton->set_pushed(false);
+            stepSequence(key == GLFW_KEY_PERIOD ? Forward : Backward, false);
         }
 
         if (key == GLFW_KEY_RIGHT || key == GLFW_KEY_D) {
@@ -880,6 +930,14 @@ void ImageViewer::draw_contents() {
 
     clear();
 
+    // Queue depths are sampled before the queues are drained below. Doing so takes their
+    // locks, so only when the HUD is shown.
+    HudInfo hudInfo;
+    if (mImageCanvas->isHudVisible()) {
+        hudInfo.numQueuedTasks = mTaskQueue.size();
+        hudInfo.numQueuedImages = mImagesLoader->numQueuedImages();
+    }
+
     // In case any images got loaded in the background, they sit around in mImagesLoader. Here is the
     // place where we actually add them to the GUI. Focus the application in case one of the
     // new images is meant to override the current selection.
@@ -887,7 +945,41 @@ void ImageViewer::draw_contents() {
     try {
         while (true) {
             auto addition = mImagesLoader->tryPop();
+            if (addition.deferredImage) {
+                // The deferred image may have been closed or decoded on the main thread already,
+                // in which case this is a no-op.
+                const auto& deferredImage = addition.deferredImage;
+                if (addition.image) {
+                    replaceImage(deferredImage, addition.image);
+                } else {
+                    removeImage(deferredImage);
+                }
+
+                bool isDecoded = addition.image && imageId(addition.image) != -1;
+                if (mPendingImage == deferredImage) {
+                    mPendingImage = nullptr;
+                    if (isDecoded) {
+                        selectImage(addition.image, false);
+                    }
+                }
+
+                if (mPendingReference == deferredImage) {
+                    mPendingReference = nullptr;
+                    if (isDecoded) {
+                        selectReference(addition.image);
+                    }
+                }
+                continue;
+            }
+
             newFocus |= addition.shallSelect;
+            if (addition.sequence) {
+                mImageSequences[addition.image] = addition.sequence;
+                addition.sequence->setFrameDecodedCallback([this]() {
+                    mTaskQueue.push([this]() { updateRequestedFrames(); });
+                    redraw();
+                });
+            }
             addImage(addition.image, addition.shallSelect);
         }
     } catch (const runtime_error&) {
@@ -899,6 +991,7 @@ void ImageViewer::draw_contents() {
 
     // mTaskQueue contains jobs that should be executed on the main thread. It is useful for handling
     // callbacks from background threads
+    auto tasksStart = chrono::steady_clock::now();
     try {
         while (true) {
             mTaskQueue.tryPop()();
@@ -906,6 +999,13 @@ void ImageViewer::draw_contents() {
     } catch (const runtime_error&) {
     }
 
+    if (mImageCanvas->isHudVisible()) {
+        hudInfo.taskSeconds = chrono::duration<float>{chrono::steady_clock::now() - tasksStart}.count();
+        mImageCanvas->setHudInfo(hudInfo);
+        // Keep drawing, such that the HUD measures and shows live frame times.
+        redraw();
+    }
+
     for (auto it = begin(mToBump); it != end(mToBump); ) {
         auto& image = *it;
         bool isShown = image == mCurrentImage || image == mCurrentReference;
@@ -926,6 +1026,36 @@ void ImageViewer::draw_contents() {
         mRequiresFilterUpdate = false;
     }
 
+    // Memory usage changes as images load and textures or statistics are cached, so the
+    // memory window is refreshed periodically rather than on every change.
+    if (mMemoryWindow && chrono::steady_clock::now() - mLastMemoryWindowUpdate > chrono::milliseconds{500}) {
+        mMemoryWindow->update(mImages);
+        mLastMemoryWindowUpdate = chrono::steady_clock::now();
+        requestLayoutUpdate();
+    }
+
+    if (mIdleCompressionDelay > 0 && chrono::steady_clock::now() - mLastIdleCompression > chrono::seconds{1} && mCompressionWorker.numTasksInSystem() == 0) {
+        vector<weak_ptr<Image>> idleImages;
+        for (const auto& image : mImages) {
+            if (image != mCurrentImage && image != mCurrentReference && !image->isCompressed()) {
+                idleImages.emplace_back(image);
+            }
+        }
+
+        if (!idleImages.empty()) {
+            auto minIdleTime = chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<float>{mIdleCompressionDelay});
+            mCompressionWorker.enqueueTask([idleImages, minIdleTime]() {
+                for (const auto& weakImage : idleImages) {
+                    if (auto image = weakImage.lock()) {
+                        image->compress(minIdleTime);
+                    }
+                }
+            });
+        }
+
+        mLastIdleCompression = chrono::steady_clock::now();
+    }
+
     if (mRequiresLayoutUpdate) {
         nanogui::Vector2i oldDraggedImageButtonPos{0, 0};
         auto& buttons = mImageButtonContainer->children();
@@ -1086,6 +1216,12 @@ void ImageViewer::removeImage(shared_ptr<Image> image) {
 
     mImages.erase(begin(mImages) + id);
     mImageButtonContainer->remove_child_at(id);
+    if (auto sequence = imageSequence(image)) {
+        sequence->setFrameDecodedCallback({});
+        mRequestedFrames.erase(sequence);
+    }
+    mImageSequences.erase(image);
+    mPendingUpdates.erase(image);
 
     if (mImages.empty()) {
         selectImage(nullptr);
@@ -1119,6 +1255,12 @@ void ImageViewer::removeAllImages() {
         mImageButtonContainer->remove_child_at((int)(i - 1));
     }
     mImages.clear();
+    for (const auto& sequence : mImageSequences) {
+        sequence.second->setFrameDecodedCallback({});
+    }
+    mImageSequences.clear();
+    mRequestedFrames.clear();
+    mPendingUpdates.clear();
 
     // No images left to select
     selectImage(nullptr);
@@ -1141,7 +1283,30 @@ void ImageViewer::reloadImage(shared_ptr<Image> image, bool shallSelect) {
 
     int referenceId = imageId(mCurrentReference);
 
-    auto newImage = tryLoadImage(image->path(), image->channelSelector());
+    // Frames of sequences are reloaded through their sequence such that its cache of decoded
+    // frames does not hold on to stale data. The stale frame is shown until the new one arrives.
+    auto sequence = imageSequence(image);
+    if (sequence) {
+        int frame = sequence->frameIndex(image);
+        sequence->clear();
+        requestFrame(sequence, (size_t)max(frame, 0), Forward);
+        if (shallSelect) {
+            selectImage(image);
+        }
+        return;
+    }
+
+    shared_ptr<Image> newImage;
+    if (image->isDeferred()) {
+        // Deferred images remain deferred, but pick up changes to their metadata.
+        newImage = tryLoadImageHeader(image->path(), image->channelSelector());
+        if (!newImage) {
+            newImage = tryLoadImage(image->path(), image->channelSelector());
+        }
+    } else {
+        newImage = tryLoadImage(image->path(), image->channelSelector());
+    }
+
     if (newImage) {
         removeImage(image);
         insertImage(newImage, id, shallSelect);
@@ -1169,7 +1334,7 @@ void ImageViewer::updateImage(
     const string& channel,
     int x, int y,
     int width, int height,
-    const vector<float>& imageData
+    const PooledVector<float>& imageData
 ) {
     auto image = imageByName(imageName);
     if (!image) {
@@ -1177,7 +1342,33 @@ void ImageViewer::updateImage(
         return;
     }
 
-    image->updateChannel(channel, x, y, width, height, imageData);
+    // Like selecting them, updating deferred images must not decode them on the main thread.
+    if (image->isDeferred()) {
+        auto& updates = mPendingUpdates[image];
+        if (updates.empty()) {
+            mImagesLoader->enqueueDecode(image);
+        }
+
+        updates.push_back({shallSelect, channel, x, y, width, height, imageData});
+        return;
+    }
+
+    updateImage(image, shallSelect, channel, x, y, width, height, imageData);
+}
+
+void ImageViewer::updateImage(
+    const shared_ptr<Image>& image,
+    bool shallSelect,
+    const string& channel,
+    int x, int y,
+    int width, int height,
+    const PooledVector<float>& imageData
+) {
+    auto derivedChannels = image->updateChannel(channel, x, y, width, height, imageData);
+    mImageCanvas->updateTextures(*image, channel, x, y, width, height);
+    for (const auto& derivedChannel : derivedChannels) {
+        mImageCanvas->updateTextures(*image, derivedChannel, x, y, width, height);
+    }
     if (shallSelect) {
         selectImage(image);
     }
@@ -1203,6 +1394,8 @@ void ImageViewer::selectImage(const shared_ptr<Image>& image, bool stopPlayback)
     }
 
     if (!image) {
+        mPendingImage = nullptr;
+
         auto& buttons = mImageButtonContainer->children();
         for (size_t i = 0; i < buttons.size(); ++i) {
             dynamic_cast<ImageButton*>(buttons[i])->setIsSelected(false);
@@ -1227,6 +1420,17 @@ void ImageViewer::selectImage(const shared_ptr<Image>& image, bool stopPlayback)
         return;
     }
 
+    // Images opened from directories or globs are only decoded once they are needed. They
+    // are decoded in the background, such that the interface remains responsive, and
+    // selected once they arrive unless another image was selected in the meantime.
+    if (image->isDeferred()) {
+        mPendingImage = image;
+        mImagesLoader->enqueueDecode(image);
+        return;
+    }
+
+    mPendingImage = nullptr;
+
     auto& buttons = mImageButtonContainer->children();
     for (size_t i = 0; i < buttons.size(); ++i) {
         dynamic_cast<ImageButton*>(buttons[i])->setIsSelected(i == id);
@@ -1235,6 +1439,14 @@ void ImageViewer::selectImage(const shared_ptr<Image>& image, bool stopPlayback)
     mCurrentImage = image;
     mImageCanvas->setImage(mCurrentImage);
 
+    // Decode deferred neighbors in the background such that stepping through them does not stall.
+    for (auto direction : {Forward, Backward}) {
+        auto neighbor = nextImage(mCurrentImage, direction);
+        if (neighbor && neighbor->isDeferred()) {
+            mImagesLoader->enqueueDecode(neighbor);
+        }
+    }
+
     // Clear group buttons
     while (mGroupButtonContainer->child_count() > 0) {
         mGroupButtonContainer->remove_child_at(mGroupButtonContainer->child_count() - 1);
@@ -1317,6 +1529,8 @@ void ImageViewer::selectGroup(string group) {
 
 void ImageViewer::selectReference(const shared_ptr<Image>& image) {
     if (!image) {
+        mPendingReference = nullptr;
+
         auto& buttons = mImageButtonContainer->children();
         for (size_t i = 0; i < buttons.size(); ++i) {
             dynamic_cast<ImageButton*>(buttons[i])->setIsReference(false);
@@ -1332,6 +1546,14 @@ void ImageViewer::selectReference(const shared_ptr<Image>& image) {
         return;
     }
 
+    if (image->isDeferred()) {
+        mPendingReference = image;
+        mImagesLoader->enqueueDecode(image);
+        return;
+    }
+
+    mPendingReference = nullptr;
+
     size_t id = (size_t)max(0, imageId(image));
 
     auto& buttons = mImageButtonContainer->children();
@@ -1392,11 +1614,58 @@ void ImageViewer::setGamma(float value) {
     mImageCanvas->setGamma(value);
 }
 
+void ImageViewer::toggleRawColors() {
+    if (!mCurrentImage || !mCurrentImage->hasColorConversion()) {
+        return;
+    }
+
+    auto image = mCurrentImage;
+    for (const auto& channel : image->setShowsRawColors(!image->showsRawColors())) {
+        mImageCanvas->updateTextures(*image, channel, 0, 0, image->size().x(), image->size().y());
+    }
+
+    mToBump.insert(image);
+    tlog::info() << tfm::format("Showing %s of '%s'.", image->showsRawColors() ? "raw colors" : "colors converted to sRGB primaries", image->name());
+}
+
+void ImageViewer::computeTemporalStatistics() {
+    if (!mCurrentImage) {
+        return;
+    }
+
+    // Frames and deferred images are decoded anew rather than through their sequence or
+    // decode(), which would keep all of them in memory.
+    auto sequence = imageSequence(mCurrentImage);
+    if (sequence) {
+        mImagesLoader->enqueueTemporalStatistics(
+            tfm::format("statistics of %s", sequence->pattern()),
+            sequence->numFrames(),
+            [sequence](size_t i) { return tryLoadImage(sequence->framePath(i), sequence->channelSelector()); }
+        );
+    } else {
+        vector<shared_ptr<Image>> images;
+        for (size_t i = 0; i < mImages.size(); ++i) {
+            if (mImageButtonContainer->children()[i]->visible()) {
+                images.emplace_back(mImages[i]);
+            }
+        }
+
+        mImagesLoader->enqueueTemporalStatistics(
+            tfm::format("statistics of %d images", images.size()),
+            images.size(),
+            [images](size_t i) { return images[i]->isDeferred() ? tryLoadImage(images[i]->path(), images[i]->channelSelector()) : images[i]; }
+        );
+    }
+
+    tlog::info() << "Computing per-pixel statistics in the background.";
+}
+
 void ImageViewer::normalizeExposureAndOffset() {
     if (!mCurrentImage) {
         return;
     }
 
+    auto imagePin = mCurrentImage->pin();
     auto channels = mCurrentImage->channelsInGroup(mCurrentGroup);
 
     float minimum = numeric_limits<float>::max();
@@ -1445,6 +1714,11 @@ void ImageViewer::setMetric(EMetric metric) {
     }
 }
 
+void ImageViewer::setComparisonFilter(const ComparisonFilter& filter) {
+    mImageCanvas->setComparisonFilter(filter);
+    tlog::info() << tfm::format("Comparing with a blur of %g pixels and %dx downsampling.", filter.blurSigma, filter.downsampling);
+}
+
 nanogui::Vector2i ImageViewer::sizeToFitImage(const shared_ptr<Image>& image) {
     if (!image) {
         return m_size;
@@ -1542,26 +1816,23 @@ void ImageViewer::toggleHelpWindow() {
     requestLayoutUpdate();
 }
 
+void ImageViewer::toggleMemoryWindow() {
+    if (mMemoryWindow) {
+        mMemoryWindow->dispose();
+        mMemoryWindow = nullptr;
+    } else {
+        mMemoryWindow = new MemoryWindow{this, [this] { toggleMemoryWindow(); }};
+        mMemoryWindow->update(mImages);
+        mLastMemoryWindowUpdate = chrono::steady_clock::now();
+        mMemoryWindow->center();
+        mMemoryWindow->request_focus();
+    }
+
+    requestLayoutUpdate();
+}
+
 void ImageViewer::openImageDialog() {
-    vector<string> paths = file_dialog(
-    {
-        // HDR formats
-        {"exr",  "OpenEXR image"},
-        {"hdr",  "HDR image"},
-        {"pfm",  "Portable Float Map image"},
-        // LDR formats
-        {"bmp",  "Bitmap Image File"},
-        {"gif",  "Graphics Interchange Format image"},
-        {"jpg",  "JPEG image"},
-        {"jpeg", "JPEG image"},
-        {"pic",  "PIC image"},
-        {"pgm",  "Portable GrayMap image"},
-        {"png",  "Portable Network Graphics image"},
-        {"pnm",  "Portable AnyMap image"},
-        {"ppm",  "Portable PixMap image"},
-        {"psd",  "PSD image"},
-        {"tga",  "Truevision TGA image"},
-    }, false, true);
+    vector<string> paths = file_dialog(ImageLoader::supportedFormats(), false, true);
 
     for (size_t i = 0; i < paths.size(); ++i) {
         path imageFile = ensureUtf8(paths[i]);
@@ -1887,6 +2158,122 @@ shared_ptr<Image> ImageViewer::nextImage(const shared_ptr<Image>& image, EDirect
     return mImages[id];
 }
 
+shared_ptr<ImageSequence> ImageViewer::imageSequence(const shared_ptr<Image>& image) const {
+    auto it = mImageSequences.find(image);
+    return it == end(mImageSequences) ? nullptr : it->second;
+}
+
+void ImageViewer::replaceImage(shared_ptr<Image> image, shared_ptr<Image> newImage) {
+    int id = imageId(image);
+    if (id == -1 || !newImage || image == newImage) {
+        return;
+    }
+
+    mImages[id] = newImage;
+
+    auto sequence = mImageSequences.find(image);
+    if (sequence != end(mImageSequences)) {
+        mImageSequences[newImage] = sequence->second;
+        mImageSequences.erase(sequence);
+    }
+
+    auto button = dynamic_cast<ImageButton*>(mImageButtonContainer->child_at(id));
+    button->setCaption(newImage->name());
+    button->set_tooltip(newImage->toString());
+
+    button->setSelectedCallback([this, newImage]() {
+        selectImage(newImage);
+    });
+
+    button->setReferenceCallback([this, newImage](bool isReference) {
+        if (!isReference) {
+            selectReference(nullptr);
+        } else {
+            selectReference(newImage);
+        }
+    });
+
+    if (mCurrentReference == image) {
+        selectReference(newImage);
+    }
+
+    if (mCurrentImage == image) {
+        selectImage(newImage, false);
+    }
+
+    // Highlighted parts of the image names need to be recomputed for the new caption.
+    mRequiresFilterUpdate = true;
+
+    auto updates = mPendingUpdates.find(image);
+    if (updates != end(mPendingUpdates)) {
+        auto pendingUpdates = move(updates->second);
+        mPendingUpdates.erase(updates);
+        for (const auto& update : pendingUpdates) {
+            updateImage(newImage->name(), update.shallSelect, update.channel, update.x, update.y, update.width, update.height, update.data);
+        }
+    }
+}
+
+bool ImageViewer::stepSequence(EDirection direction, bool isPlayback) {
+    auto sequence = imageSequence(mCurrentImage);
+    if (!sequence) {
+        return false;
+    }
+
+    size_t current = (size_t)max(sequence->frameIndex(mCurrentImage), 0);
+    auto requested = mRequestedFrames.find(sequence);
+    if (requested != end(mRequestedFrames)) {
+        if (isPlayback) {
+            return true;
+        }
+
+        current = requested->second.index;
+    }
+
+    size_t frame = sequence->nextFrame(current, direction);
+
+    // Frames that failed to load are skipped so that playback does not get stuck on them.
+    for (size_t i = 0; i < sequence->numFrames() && sequence->hasFailed(frame); ++i) {
+        frame = sequence->nextFrame(frame, direction);
+    }
+
+    requestFrame(sequence, frame, direction);
+    return true;
+}
+
+void ImageViewer::requestFrame(const shared_ptr<ImageSequence>& sequence, size_t index, EDirection direction) {
+    mRequestedFrames[sequence] = {index, direction};
+    updateRequestedFrames();
+}
+
+void ImageViewer::updateRequestedFrames() {
+    for (auto it = begin(mRequestedFrames); it != end(mRequestedFrames);) {
+        const auto& sequence = it->first;
+        auto shown = find_if(begin(mImageSequences), end(mImageSequences), [&](const auto& entry) {
+            return entry.second == sequence;
+        });
+
+        if (shown == end(mImageSequences)) {
+            it = mRequestedFrames.erase(it);
+            continue;
+        }
+
+        // Moves the playhead, which also schedules the frame again if the playhead had moved
+        // elsewhere while it was being decoded.
+        auto image = sequence->frame(it->second.index, it->second.direction);
+        if (!image && !sequence->hasFailed(it->second.index)) {
+            ++it;
+            continue;
+        }
+
+        auto shownImage = shown->first;
+        it = mRequestedFrames.erase(it);
+        if (image) {
+            replaceImage(shownImage, image);
+        }
+    }
+}
+
 shared_ptr<Image> ImageViewer::nthVisibleImage(size_t n) {
     shared_ptr<Image> lastVisible = nullptr;
     for (size_t i = 0; i < mImages.size(); ++i) {
@@ -10,10 +10,13 @@
 
 #include <tev/Common.h>
 #include <tev/Ipc.h>
+#include <tev/PerformanceCounters.h>
 #include <tev/ThreadPool.h>
 
 #include <Eigen/Dense>
 
+#include <limits>
+
 #ifdef _WIN32
 using socklen_t = int;
 #else
@@ -49,6 +52,10 @@ enum SocketError : int {
 #endif
 };
 
+// Clients that let more replies than this pile up without reading them are disconnected,
+// such that they can neither stall the primary instance nor exhaust its memory.
+const size_t MAX_SEND_BACKLOG = 64 * 1024 * 1024;
+
 IpcPacket::IpcPacket(const char* data, size_t length) {
     if (length <= 0) {
         throw runtime_error{"Cannot construct an IPC packet from no data."};
@@ -64,6 +71,21 @@ void IpcPacket::setOpenImage(const string& imagePath, const string& channelSelec
     payload << channelSelector;
 }
 
+void IpcPacket::setOpenImageData(const string& imageName, const string& channelSelector, bool grabFocus, const char* data, size_t size) {
+    // The first 4 bytes encode the size of the entire packet.
+    if (size + imageName.size() + channelSelector.size() + 32 > numeric_limits<uint32_t>::max()) {
+        throw runtime_error{"OpenImageData IPC packet must be smaller than 4 GiB."};
+    }
+
+    OStream payload{mPayload};
+    payload << Type::OpenImageData;
+    payload << grabFocus;
+    payload << imageName;
+    payload << channelSelector;
+    payload << (uint64_t)size;
+    payload.write(data, size);
+}
+
 void IpcPacket::setReloadImage(const string& imageName, bool grabFocus) {
     OStream payload{mPayload};
     payload << Type::ReloadImage;
@@ -77,7 +99,7 @@ void IpcPacket::setCloseImage(const string& imageName) {
     payload << imageName;
 }
 
-void IpcPacket::setUpdateImage(const string& imageName, bool grabFocus, const std::vector<IpcPacket::ChannelDesc>& channelDescs, int32_t x, int32_t y, int32_t width, int32_t height, const vector<float>& stridedImageData) {
+void IpcPacket::setUpdateImage(const string& imageName, bool grabFocus, const std::vector<IpcPacket::ChannelDesc>& channelDescs, int32_t x, int32_t y, int32_t width, int32_t height, const PooledVector<float>& stridedImageData) {
     if (channelDescs.empty()) {
         throw runtime_error{"UpdateImage IPC packet must have a non-zero channel count."};
     }
@@ -131,6 +153,39 @@ void IpcPacket::setCreateImage(const std::string& imageName, bool grabFocus, int
     payload << channelNames;
 }
 
+void IpcPacket::setQueryImages() {
+    OStream payload{mPayload};
+    payload << Type::QueryImages;
+}
+
+void IpcPacket::setComputeStatistics(const string& imageName, const string& referenceName, const string& channelGroup, const string& metric) {
+    OStream payload{mPayload};
+    payload << Type::ComputeStatistics;
+    payload << imageName;
+    payload << referenceName;
+    payload << channelGroup;
+    payload << metric;
+}
+
+void IpcPacket::setExportImage(const IpcPacketExportImage& info) {
+    OStream payload{mPayload};
+    payload << Type::ExportImage;
+    payload << info.imageName;
+    payload << info.referenceName;
+    payload << info.channelGroup;
+    payload << info.metric;
+    payload << info.path;
+    payload << info.exposure << info.offset << info.gamma;
+    payload << info.tonemap;
+}
+
+void IpcPacket::setReply(bool success, const string& message) {
+    OStream payload{mPayload};
+    payload << Type::Reply;
+    payload << success;
+    payload << message;
+}
+
 IpcPacketOpenImage IpcPacket::interpretAsOpenImage() const {
     IpcPacketOpenImage result;
     IStream payload{mPayload};
@@ -168,6 +223,31 @@ IpcPacketOpenImage IpcPacket::interpretAsOpenImage() const {
     return result;
 }
 
+IpcPacketOpenImageData IpcPacket::interpretAsOpenImageData() const {
+    IpcPacketOpenImageData result;
+    IStream payload{mPayload};
+
+    Type type;
+    payload >> type;
+    if (type != Type::OpenImageData) {
+        throw runtime_error{"Cannot interpret IPC packet as OpenImageData."};
+    }
+
+    payload >> result.grabFocus;
+    payload >> result.imageName;
+    payload >> result.channelSelector;
+
+    uint64_t size;
+    payload >> size;
+    if (size > mPayload.size()) {
+        throw runtime_error{"Trying to read image data beyond the bounds of the IPC packet payload."};
+    }
+
+    result.imageData.resize((size_t)size);
+    payload.read(result.imageData.data(), result.imageData.size());
+    return result;
+}
+
 IpcPacketReloadImage IpcPacket::interpretAsReloadImage() const {
     IpcPacketReloadImage result;
     IStream payload{mPayload};
@@ -246,7 +326,7 @@ IpcPacketUpdateImage IpcPacket::interpretAsUpdateImage() const {
         stridedImageDataSize = std::max(stridedImageDataSize, (DenseIndex)(result.channelOffsets[c] + (nPixels-1) * result.channelStrides[c] + 1));
     }
 
-    vector<float> stridedImageData(stridedImageDataSize);
+    PooledVector<float> stridedImageData(stridedImageDataSize);
     payload >> stridedImageData;
 
     gThreadPool->parallelFor<DenseIndex>(0, nPixels, [&](DenseIndex px) {
@@ -279,6 +359,58 @@ IpcPacketCreateImage IpcPacket::interpretAsCreateImage() const {
     return result;
 }
 
+IpcPacketComputeStatistics IpcPacket::interpretAsComputeStatistics() const {
+    IpcPacketComputeStatistics result;
+    IStream payload{mPayload};
+
+    Type type;
+    payload >> type;
+    if (type != Type::ComputeStatistics) {
+        throw runtime_error{"Cannot interpret IPC packet as ComputeStatistics."};
+    }
+
+    payload >> result.imageName;
+    payload >> result.referenceName;
+    payload >> result.channelGroup;
+    payload >> result.metric;
+    return result;
+}
+
+IpcPacketExportImage IpcPacket::interpretAsExportImage() const {
+    IpcPacketExportImage result;
+    IStream payload{mPayload};
+
+    Type type;
+    payload >> type;
+    if (type != Type::ExportImage) {
+        throw runtime_error{"Cannot interpret IPC packet as ExportImage."};
+    }
+
+    payload >> result.imageName;
+    payload >> result.referenceName;
+    payload >> result.channelGroup;
+    payload >> result.metric;
+    payload >> result.path;
+    payload >> result.exposure >> result.offset >> result.gamma;
+    payload >> result.tonemap;
+    return result;
+}
+
+IpcPacketReply IpcPacket::interpretAsReply() const {
+    IpcPacketReply result;
+    IStream payload{mPayload};
+
+    Type type;
+    payload >> type;
+    if (type != Type::Reply) {
+        throw runtime_error{"Cannot interpret IPC packet as Reply."};
+    }
+
+    payload >> result.success;
+    payload >> result.message;
+    return result;
+}
+
 
 static void makeSocketNonBlocking(Ipc::socket_t socketFd) {
 #ifdef _WIN32
@@ -474,7 +606,7 @@ void Ipc::sendToPrimaryInstance(const IpcPacket& message) {
     }
 }
 
-void Ipc::receiveFromSecondaryInstance(function<void(const IpcPacket&)> callback) {
+void Ipc::receiveFromSecondaryInstance(function<void(const IpcPacket&, int)> callback) {
     if (!mIsPrimaryInstance) {
         throw runtime_error{"Must be the primary instance to receive from a secondary instance."};
     }
@@ -494,7 +626,7 @@ void Ipc::receiveFromSecondaryInstance(function<void(const IpcPacket&)> callback
         uint32_t ip = ntohl(client.sin_addr.s_addr);
         uint16_t port = ntohs(client.sin_port);
         tlog::info() << tfm::format("Accepted IPC client connection into socket fd %d (host: %d.%d.%d.%d:%d)", fd, ip >> 24, (ip >> 16) & 0xff, (ip >> 8) & 0xff, ip & 0xff, port);
-        mSocketConnections.push_back(SocketConnection(fd));
+        mSocketConnections.push_back(SocketConnection(fd, mNextClientId++));
     }
 
     // Service existing connections.
@@ -509,7 +641,20 @@ void Ipc::receiveFromSecondaryInstance(function<void(const IpcPacket&)> callback
     }
 }
 
-Ipc::SocketConnection::SocketConnection(Ipc::socket_t fd) : mSocketFd(fd) {
+void Ipc::sendToSecondaryInstance(int clientId, const IpcPacket& message) {
+    if (!mIsPrimaryInstance) {
+        throw runtime_error{"Must be the primary instance to send to a secondary instance."};
+    }
+
+    for (auto& connection : mSocketConnections) {
+        if (connection.id() == clientId) {
+            connection.send(message);
+            return;
+        }
+    }
+}
+
+Ipc::SocketConnection::SocketConnection(Ipc::socket_t fd, int id) : mSocketFd(fd), mId(id) {
     TEV_ASSERT(mSocketFd != INVALID_SOCKET, "SocketConnection must receive a valid socket.");
 
     makeSocketNonBlocking(mSocketFd);
@@ -518,12 +663,14 @@ Ipc::SocketConnection::SocketConnection(Ipc::socket_t fd) : mSocketFd(fd) {
     mBuffer.resize(1024 * 1024);
 }
 
-void Ipc::SocketConnection::service(function<void(const IpcPacket&)> callback) {
+void Ipc::SocketConnection::service(function<void(const IpcPacket&, int)> callback) {
     if (isClosed()) {
         // Client disconnected, so don't bother.
         return;
     }
 
+    flush();
+
     while (true) {
         // Receive as much data as we can, up to the capacity of 'mBuffer'.
         size_t maxBytes = mBuffer.size() - mRecvOffset;
@@ -566,7 +713,8 @@ void Ipc::SocketConnection::service(function<void(const IpcPacket&)> callback) {
 
             if (processedOffset + messageLength <= mRecvOffset) {
                 // We have a full message.
-                callback(IpcPacket{messagePtr, messageLength});
+                PerformanceCounters::global().ipcPackets.fetch_add(1, memory_order_relaxed);
+                callback(IpcPacket{messagePtr, messageLength}, mId);
                 processedOffset += messageLength;
             } else {
                 // It's a partial message; we'll need to recv() more.
@@ -586,6 +734,44 @@ void Ipc::SocketConnection::service(function<void(const IpcPacket&)> callback) {
     }
 }
 
+void Ipc::SocketConnection::send(const IpcPacket& message) {
+    if (isClosed()) {
+        return;
+    }
+
+    if (mSendBuffer.size() - mSendOffset + message.size() > MAX_SEND_BACKLOG) {
+        tlog::warning() << "Client on socket fd " << mSocketFd << " does not read its replies. Connection terminated.";
+        close();
+        return;
+    }
+
+    mSendBuffer.insert(mSendBuffer.end(), message.data(), message.data() + message.size());
+    flush();
+}
+
+void Ipc::SocketConnection::flush() {
+    // The socket is non-blocking, so large replies may have to be sent in several parts.
+    while (!isClosed() && mSendOffset < mSendBuffer.size()) {
+        int result = ::send(mSocketFd, mSendBuffer.data() + mSendOffset, (int)(mSendBuffer.size() - mSendOffset), 0 /* flags */);
+        if (result == SOCKET_ERROR) {
+            int errorId = lastSocketError();
+            if (errorId == SocketError::Again || errorId == SocketError::WouldBlock) {
+                // The client is not reading right now; try again during the next service pass.
+                return;
+            }
+
+            tlog::warning() << "Error while writing to socket. " << errorString(errorId) << " Connection terminated.";
+            close();
+            return;
+        }
+
+        mSendOffset += (size_t)result;
+    }
+
+    mSendBuffer.clear();
+    mSendOffset = 0;
+}
+
 void Ipc::SocketConnection::close() {
     if (!isClosed()) {
         closeSocket(mSocketFd);
@@ -0,0 +1,133 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the BSD 3-Clause License within the LICENSE file.
+
+#include <tev/MemoryMappedFile.h>
+#include <tev/MemoryStream.h>
+
+#include <fstream>
+#include <iterator>
+
+#ifndef _WIN32
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#endif
+
+using namespace filesystem;
+using namespace std;
+
+TEV_NAMESPACE_BEGIN
+
+MemoryMappedFile::MemoryMappedFile(istream& iStream, const path& path) {
+    // Only streams that were opened from the file at `path` can be substituted by
+    // a mapping of that file. Everything else has to go through the stream.
+    if (dynamic_cast<ifstream*>(&iStream) && tryMap(path)) {
+        return;
+    }
+
+    // Decompressed files already reside in memory and are used in place.
+    if (auto memoryStream = dynamic_cast<MemoryStream*>(&iStream)) {
+        if (!memoryStream->isComplete()) {
+            throw invalid_argument{"Cannot load an image from the beginning of its file only."};
+        }
+
+        mData = memoryStream->data();
+        mSize = memoryStream->size();
+        return;
+    }
+
+    iStream.clear();
+    iStream.seekg(0, ios_base::end);
+    auto end = iStream.tellg();
+    iStream.seekg(0);
+
+    if (end > 0) {
+        mBuffer.resize((size_t)end);
+        iStream.read(mBuffer.data(), end);
+        mBuffer.resize((size_t)iStream.gcount());
+    } else {
+        // The stream can not tell its size (e.g. a pipe), so we read until it runs dry.
+        iStream.clear();
+        mBuffer.assign(istreambuf_iterator<char>{iStream}, istreambuf_iterator<char>{});
+    }
+
+    iStream.clear();
+    iStream.seekg(0);
+
+    mData = mBuffer.data();
+    mSize = mBuffer.size();
+}
+
+MemoryMappedFile::~MemoryMappedFile() {
+    if (!mIsMapped) {
+        return;
+    }
+
+#ifdef _WIN32
+    UnmapViewOfFile(mData);
+    CloseHandle(mMappingHandle);
+    CloseHandle(mFileHandle);
+#else
+    munmap(const_cast<char*>(mData), mSize);
+#endif
+}
+
+bool MemoryMappedFile::tryMap(const path& path) {
+#ifdef _WIN32
+    mFileHandle = CreateFileW(nativeString(path).c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (mFileHandle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(mFileHandle, &fileSize) || fileSize.QuadPart == 0) {
+        CloseHandle(mFileHandle);
+        return false;
+    }
+
+    mMappingHandle = CreateFileMappingW(mFileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mMappingHandle) {
+        CloseHandle(mFileHandle);
+        return false;
+    }
+
+    mData = reinterpret_cast<const char*>(MapViewOfFile(mMappingHandle, FILE_MAP_READ, 0, 0, 0));
+    if (!mData) {
+        CloseHandle(mMappingHandle);
+        CloseHandle(mFileHandle);
+        return false;
+    }
+
+    mSize = (size_t)fileSize.QuadPart;
+#else
+    int fd = open(nativeString(path).c_str(), O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+
+    ScopeGuard fdGuard{[fd] { close(fd); }};
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0) {
+        return false;
+    }
+
+    void* data = mmap(nullptr, (size_t)fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+
+    // Loaders touch the entire file, usually from several threads at once,
+    // so we ask the kernel to start paging everything in right away.
+    madvise(data, (size_t)fileStat.st_size, MADV_WILLNEED);
+
+    mData = reinterpret_cast<const char*>(data);
+    mSize = (size_t)fileStat.st_size;
+#endif
+
+    mIsMapped = true;
+    return true;
+}
+
+TEV_NAMESPACE_END
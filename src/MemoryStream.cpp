@@ -0,0 +1,34 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the BSD 3-Clause License within the LICENSE file.
+
+#include <tev/MemoryStream.h>
+
+using namespace std;
+
+TEV_NAMESPACE_BEGIN
+
+MemoryStream::Buffer::Buffer(vector<char> data) : mData{std::move(data)} {
+    setg(mData.data(), mData.data(), mData.data() + mData.size());
+}
+
+MemoryStream::Buffer::pos_type MemoryStream::Buffer::seekoff(off_type offset, ios_base::seekdir direction, ios_base::openmode mode) {
+    off_type base = 0;
+    if (direction == ios_base::cur) {
+        base = gptr() - eback();
+    } else if (direction == ios_base::end) {
+        base = (off_type)mData.size();
+    }
+
+    return seekpos(base + offset, mode);
+}
+
+MemoryStream::Buffer::pos_type MemoryStream::Buffer::seekpos(pos_type position, ios_base::openmode) {
+    if (position < 0 || position > (off_type)mData.size()) {
+        return pos_type(off_type(-1));
+    }
+
+    setg(eback(), eback() + (off_type)position, egptr());
+    return position;
+}
+
+TEV_NAMESPACE_END
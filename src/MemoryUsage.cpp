@@ -0,0 +1,93 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the BSD 3-Clause License within the LICENSE file.
+
+#include <tev/MemoryUsage.h>
+
+using namespace std;
+
+TEV_NAMESPACE_BEGIN
+
+namespace {
+
+void updatePeak(atomic<size_t>& peak, size_t value) {
+    size_t previous = peak;
+    while (previous < value && !peak.compare_exchange_weak(previous, value)) {}
+}
+
+}
+
+string memoryCategoryName(EMemoryCategory category) {
+    switch (category) {
+        case PixelMemory:      return "Pixels";
+        case TextureMemory:    return "Textures";
+        case StatisticsMemory: return "Statistics";
+        case BufferMemory:     return "Buffers";
+        default:
+            throw runtime_error{"Invalid memory category."};
+    }
+}
+
+string toMemoryString(size_t bytes) {
+    static const char* units[] = {"B", "KiB", "MiB", "GiB", "TiB"};
+
+    double value = (double)bytes;
+    size_t unit = 0;
+    while (value >= 1024 && unit < sizeof(units) / sizeof(units[0]) - 1) {
+        value /= 1024;
+        ++unit;
+    }
+
+    return unit == 0 ? tfm::format("%d B", bytes) : tfm::format("%.1f %s", value, units[unit]);
+}
+
+MemoryUsage& MemoryUsage::global() {
+    static MemoryUsage usage;
+    return usage;
+}
+
+void MemoryUsage::add(EMemoryCategory category, size_t bytes) {
+    updatePeak(mPeakBytes[category], mBytes[category] += bytes);
+    updatePeak(mPeakTotalBytes, mTotalBytes += bytes);
+}
+
+void MemoryUsage::remove(EMemoryCategory category, size_t bytes) {
+    mBytes[category] -= bytes;
+    mTotalBytes -= bytes;
+}
+
+MemoryAllocation::MemoryAllocation(shared_ptr<MemoryUsage> usage, EMemoryCategory category, size_t bytes)
+: mUsage{usage}, mCategory{category}, mBytes{bytes} {
+    if (mUsage) {
+        mUsage->add(mCategory, mBytes);
+    }
+    MemoryUsage::global().add(mCategory, mBytes);
+}
+
+MemoryAllocation::~MemoryAllocation() {
+    release();
+}
+
+MemoryAllocation& MemoryAllocation::operator=(MemoryAllocation&& other) {
+    if (this != &other) {
+        release();
+        mUsage = move(other.mUsage);
+        mCategory = other.mCategory;
+        mBytes = other.mBytes;
+        other.mBytes = 0;
+    }
+    return *this;
+}
+
+void MemoryAllocation::release() {
+    if (mBytes == 0) {
+        return;
+    }
+
+    if (mUsage) {
+        mUsage->remove(mCategory, mBytes);
+    }
+    MemoryUsage::global().remove(mCategory, mBytes);
+    mBytes = 0;
+}
+
+TEV_NAMESPACE_END
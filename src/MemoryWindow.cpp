@@ -0,0 +1,151 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the BSD 3-Clause License within the LICENSE file.
+
+#include <tev/MemoryWindow.h>
+
+#include <nanogui/button.h>
+#include <nanogui/icons.h>
+#include <nanogui/label.h>
+#include <nanogui/layout.h>
+#include <nanogui/opengl.h>
+#include <nanogui/screen.h>
+
+#include <algorithm>
+
+using namespace nanogui;
+using namespace std;
+
+TEV_NAMESPACE_BEGIN
+
+namespace {
+
+const int NAME_WIDTH = 220;
+const int COLUMN_WIDTH = 85;
+
+size_t columnBytes(const MemoryUsage& usage, int column) {
+    return column <= NumMemoryCategories ? usage.bytes((EMemoryCategory)(column - 1)) : usage.totalBytes();
+}
+
+}
+
+MemoryWindow::MemoryWindow(Widget* parent, function<void()> closeCallback)
+    : Window{parent, "Memory Usage"}, mCloseCallback{closeCallback} {
+
+    auto closeButton = new Button{button_panel(), "", FA_TIMES};
+    closeButton->set_callback(mCloseCallback);
+
+    set_layout(new GroupLayout{});
+
+    new Label{this, "Images", "sans-bold", 18};
+    mTable = new Widget{this};
+    mTable->set_layout(new GridLayout{Orientation::Horizontal, NumMemoryCategories + 2, Alignment::Fill, 0, 2});
+
+    new Label{this, "Process", "sans-bold", 18};
+    mTotals = new Widget{this};
+    mTotals->set_layout(new GridLayout{Orientation::Horizontal, NumMemoryCategories + 2, Alignment::Fill, 0, 2});
+
+    rebuild();
+}
+
+bool MemoryWindow::keyboard_event(int key, int scancode, int action, int modifiers) {
+    if (Window::keyboard_event(key, scancode, action, modifiers)) {
+        return true;
+    }
+
+    if (key == GLFW_KEY_ESCAPE) {
+        mCloseCallback();
+        return true;
+    }
+
+    return false;
+}
+
+void MemoryWindow::update(const vector<shared_ptr<Image>>& images) {
+    mImages.assign(begin(images), end(images));
+    rebuild();
+}
+
+void MemoryWindow::sortBy(int column) {
+    if (mSortColumn == column) {
+        mSortDescending = !mSortDescending;
+    } else {
+        mSortColumn = column;
+        // Names read best in ascending order and sizes in descending order.
+        mSortDescending = column != 0;
+    }
+
+    rebuild();
+    screen()->perform_layout();
+}
+
+void MemoryWindow::rebuild() {
+    vector<shared_ptr<Image>> images;
+    for (const auto& weakImage : mImages) {
+        if (auto image = weakImage.lock()) {
+            images.emplace_back(image);
+        }
+    }
+
+    stable_sort(begin(images), end(images), [this](const shared_ptr<Image>& a, const shared_ptr<Image>& b) {
+        bool less = mSortColumn == 0 ?
+            a->name() < b->name() :
+            columnBytes(*a->memoryUsage(), mSortColumn) < columnBytes(*b->memoryUsage(), mSortColumn);
+        bool greater = mSortColumn == 0 ?
+            b->name() < a->name() :
+            columnBytes(*b->memoryUsage(), mSortColumn) < columnBytes(*a->memoryUsage(), mSortColumn);
+        return mSortDescending ? greater : less;
+    });
+
+    while (mTable->child_count() > 0) {
+        mTable->remove_child_at(mTable->child_count() - 1);
+    }
+
+    while (mTotals->child_count() > 0) {
+        mTotals->remove_child_at(mTotals->child_count() - 1);
+    }
+
+    auto addCell = [](Widget* parent, const string& text, int width, const string& font = "sans") {
+        auto label = new Label{parent, text, font};
+        label->set_fixed_width(width);
+        return label;
+    };
+
+    for (int i = 0; i < NumMemoryCategories + 2; ++i) {
+        string name = i == 0 ? "Name" : (i <= NumMemoryCategories ? memoryCategoryName((EMemoryCategory)(i - 1)) : "Total");
+        auto button = new Button{mTable, name};
+        if (i == mSortColumn) {
+            button->set_icon(mSortDescending ? FA_SORT_DOWN : FA_SORT_UP);
+            button->set_icon_position(Button::IconPosition::Right);
+        }
+        button->set_fixed_width(i == 0 ? NAME_WIDTH : COLUMN_WIDTH);
+        button->set_callback([this, i]() { sortBy(i); });
+    }
+
+    for (const auto& image : images) {
+        const auto& usage = *image->memoryUsage();
+        addCell(mTable, image->shortName(), NAME_WIDTH)->set_tooltip(image->name());
+        for (int i = 1; i < NumMemoryCategories + 2; ++i) {
+            addCell(mTable, toMemoryString(columnBytes(usage, i)), COLUMN_WIDTH);
+        }
+    }
+
+    const auto& global = MemoryUsage::global();
+    addCell(mTotals, "", NAME_WIDTH);
+    for (int i = 1; i < NumMemoryCategories + 2; ++i) {
+        string name = i <= NumMemoryCategories ? memoryCategoryName((EMemoryCategory)(i - 1)) : "Total";
+        addCell(mTotals, name, COLUMN_WIDTH, "sans-bold");
+    }
+
+    addCell(mTotals, "Current", NAME_WIDTH, "sans-bold");
+    for (int i = 1; i < NumMemoryCategories + 2; ++i) {
+        addCell(mTotals, toMemoryString(columnBytes(global, i)), COLUMN_WIDTH);
+    }
+
+    addCell(mTotals, "Peak", NAME_WIDTH, "sans-bold");
+    for (int i = 1; i < NumMemoryCategories + 2; ++i) {
+        size_t peak = i <= NumMemoryCategories ? global.peakBytes((EMemoryCategory)(i - 1)) : global.peakTotalBytes();
+        addCell(mTotals, toMemoryString(peak), COLUMN_WIDTH);
+    }
+}
+
+TEV_NAMESPACE_END
@@ -3,6 +3,7 @@
 // by Mikko Mononen. Modifications were developed by Thomas Müller <thomas94@gmx.net>.
 // This file is published under the BSD 3-Clause License within the LICENSE file.
 
+#include <tev/GuiCommon.h>
 #include <tev/MultiGraph.h>
 
 #include <nanogui/theme.h>
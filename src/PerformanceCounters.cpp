@@ -0,0 +1,13 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the BSD 3-Clause License within the LICENSE file.
+
+#include <tev/PerformanceCounters.h>
+
+TEV_NAMESPACE_BEGIN
+
+PerformanceCounters& PerformanceCounters::global() {
+    static PerformanceCounters counters;
+    return counters;
+}
+
+TEV_NAMESPACE_END
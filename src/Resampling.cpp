@@ -0,0 +1,219 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the BSD 3-Clause License within the LICENSE file.
+
+#include <tev/Resampling.h>
+#include <tev/ThreadPool.h>
+
+#include <cmath>
+
+using namespace Eigen;
+using namespace std;
+
+TEV_NAMESPACE_BEGIN
+
+namespace {
+
+float filterRadius(EResampling resampling) {
+    switch (resampling) {
+        case Box:      return 0.5f;
+        case Bilinear: return 1.0f;
+        case Lanczos:  return 3.0f;
+        default:
+            throw runtime_error{"Invalid resampling selected."};
+    }
+}
+
+float filterWeight(float x, EResampling resampling) {
+    x = abs(x);
+    switch (resampling) {
+        case Box:      return x < 0.5f ? 1.0f : 0.0f;
+        case Bilinear: return max(1.0f - x, 0.0f);
+        case Lanczos:
+            {
+                if (x < 1e-5f) {
+                    return 1.0f;
+                } else if (x >= 3.0f) {
+                    return 0.0f;
+                }
+
+                static const float pi = 3.14159265358979f;
+                return 3.0f * sin(pi * x) * sin(pi * x / 3.0f) / (pi * pi * x * x);
+            }
+        default:
+            throw runtime_error{"Invalid resampling selected."};
+    }
+}
+
+// Every output pixel has the same number of taps, such that the taps of all pixels fit into
+// flat arrays. Taps beyond the edge are clamped to it and unused taps have a weight of 0.
+struct Taps {
+    int count;
+    vector<int> indices;
+    vector<float> weights;
+};
+
+Taps computeTaps(int sourceSize, int targetSize, EResampling resampling) {
+    float scale = (float)sourceSize / targetSize;
+    float filterScale = max(scale, 1.0f);
+    float support = filterRadius(resampling) * filterScale;
+
+    Taps taps;
+    taps.count = (int)ceil(2 * support) + 1;
+    taps.indices.resize((size_t)targetSize * taps.count);
+    taps.weights.resize((size_t)targetSize * taps.count);
+
+    for (int i = 0; i < targetSize; ++i) {
+        float center = (i + 0.5f) * scale;
+        int first = (int)floor(center - support);
+
+        int* indices = &taps.indices[(size_t)i * taps.count];
+        float* weights = &taps.weights[(size_t)i * taps.count];
+
+        float total = 0;
+        for (int t = 0; t < taps.count; ++t) {
+            int j = first + t;
+            indices[t] = clamp(j, 0, sourceSize - 1);
+            weights[t] = filterWeight((j + 0.5f - center) / filterScale, resampling);
+            total += weights[t];
+        }
+
+        if (total == 0) {
+            // Can only happen for box filtering exactly between two pixels, in which case
+            // the nearest pixel is picked.
+            indices[0] = clamp((int)center, 0, sourceSize - 1);
+            weights[0] = total = 1;
+        }
+
+        for (int t = 0; t < taps.count; ++t) {
+            weights[t] /= total;
+        }
+    }
+
+    return taps;
+}
+
+// Columns of the vertical blur pass are processed in blocks of this many values, such that
+// the rows of a block that are weighted into one output row stay in the L1 cache.
+const int BLUR_BLOCK_SIZE = 1024;
+
+}
+
+Channel resample(const Channel& channel, const Vector2i& size, EResampling resampling) {
+    Vector2i sourceSize = channel.size();
+    Channel result{channel.name(), size};
+
+    if (resampling == Centered || sourceSize == size) {
+        Vector2i offset = (sourceSize - size) / 2;
+        gThreadPool->parallelFor(0, size.y(), [&](int y) {
+            for (int x = 0; x < size.x(); ++x) {
+                result.at({x, y}) = channel.eval({x + offset.x(), y + offset.y()});
+            }
+        });
+        return result;
+    }
+
+    Taps horizontal = computeTaps(sourceSize.x(), size.x(), resampling);
+    Taps vertical = computeTaps(sourceSize.y(), size.y(), resampling);
+
+    // First filter all rows horizontally, then combine the filtered rows vertically. The
+    // vertical pass processes contiguous rows with a single weight each, which compiles to
+    // SIMD instructions.
+    PooledVector<float> rows((size_t)sourceSize.y() * size.x());
+    gThreadPool->parallelFor(0, sourceSize.y(), [&](int y) {
+        const float* source = channel.data().data() + (size_t)y * sourceSize.x();
+        float* target = &rows[(size_t)y * size.x()];
+        for (int x = 0; x < size.x(); ++x) {
+            const int* indices = &horizontal.indices[(size_t)x * horizontal.count];
+            const float* weights = &horizontal.weights[(size_t)x * horizontal.count];
+
+            // Unused taps are skipped rather than weighted by 0, such that NaNs next to them
+            // do not spread.
+            float value = 0;
+            for (int t = 0; t < horizontal.count; ++t) {
+                if (weights[t] != 0) {
+                    value += weights[t] * source[indices[t]];
+                }
+            }
+            target[x] = value;
+        }
+    });
+
+    gThreadPool->parallelFor(0, size.y(), [&](int y) {
+        float* target = &result.at({0, y});
+        fill_n(target, size.x(), 0.0f);
+
+        for (int t = 0; t < vertical.count; ++t) {
+            float weight = vertical.weights[(size_t)y * vertical.count + t];
+            if (weight == 0) {
+                continue;
+            }
+
+            const float* source = &rows[(size_t)vertical.indices[(size_t)y * vertical.count + t] * size.x()];
+            for (int x = 0; x < size.x(); ++x) {
+                target[x] += weight * source[x];
+            }
+        }
+    });
+
+    return result;
+}
+
+Channel blur(const Channel& channel, float sigma) {
+    Vector2i size = channel.size();
+    Channel result{channel.name(), size};
+
+    int radius = max((int)ceil(3 * sigma), 0);
+    vector<float> kernel(2 * radius + 1);
+    float total = 0;
+    for (int i = -radius; i <= radius; ++i) {
+        kernel[i + radius] = exp(-0.5f * i * i / max(sigma * sigma, 1e-12f));
+        total += kernel[i + radius];
+    }
+
+    for (auto& weight : kernel) {
+        weight /= total;
+    }
+
+    // Each row is padded by repeating its edges, such that the horizontal pass consists of
+    // branch-free loops over contiguous values, just like the vertical pass.
+    PooledVector<float> rows((size_t)size.x() * size.y());
+    gThreadPool->parallelFor(0, size.y(), [&](int y) {
+        const float* source = channel.data().data() + (size_t)y * size.x();
+        float* target = &rows[(size_t)y * size.x()];
+
+        vector<float> padded(size.x() + 2 * radius);
+        for (int x = 0; x < (int)padded.size(); ++x) {
+            padded[x] = source[clamp(x - radius, 0, size.x() - 1)];
+        }
+
+        fill_n(target, size.x(), 0.0f);
+        for (int t = 0; t <= 2 * radius; ++t) {
+            float weight = kernel[t];
+            const float* shifted = padded.data() + t;
+            for (int x = 0; x < size.x(); ++x) {
+                target[x] += weight * shifted[x];
+            }
+        }
+    });
+
+    int numBlocks = (size.x() + BLUR_BLOCK_SIZE - 1) / BLUR_BLOCK_SIZE;
+    gThreadPool->parallelFor(0, size.y() * numBlocks, [&](int i) {
+        int y = i / numBlocks;
+        int start = (i % numBlocks) * BLUR_BLOCK_SIZE;
+        int end = min(start + BLUR_BLOCK_SIZE, size.x());
+
+        float* target = &result.at({0, y});
+        fill(target + start, target + end, 0.0f);
+        for (int t = 0; t <= 2 * radius; ++t) {
+            float weight = kernel[t];
+            const float* source = &rows[(size_t)clamp(y + t - radius, 0, size.y() - 1) * size.x()];
+            for (int x = start; x < end; ++x) {
+                target[x] += weight * source[x];
+            }
+        }
+    });
+
+    return result;
+}
+
+TEV_NAMESPACE_END
@@ -0,0 +1,459 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the BSD 3-Clause License within the LICENSE file.
+
+#include <tev/SharedImageCache.h>
+#include <tev/ThreadPool.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+
+#if !defined(_WIN32) && !defined(EMSCRIPTEN)
+#   define TEV_HAS_SHARED_MEMORY
+#   include <fcntl.h>
+#   include <signal.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#endif
+
+using namespace Eigen;
+using namespace filesystem;
+using namespace std;
+
+TEV_NAMESPACE_BEGIN
+
+bool SharedImageCache::sIsEnabled = false;
+
+#ifdef TEV_HAS_SHARED_MEMORY
+
+namespace {
+
+const uint64_t SEGMENT_MAGIC = 0x6568636163766574; // "tevcache"
+const uint32_t SEGMENT_VERSION = 4;
+
+// Storing an image takes far less time, even for huge images. Objects that are not ready
+// after this long belong to a crashed instance, even if its pid has been reused since.
+const time_t STORE_TIMEOUT_SECONDS = 10 * 60;
+
+// Each shared memory object begins with this header, followed by the key, the size, the
+// channel and layer names, the color conversion, and the names of the channels it was applied
+// to. The pixels of all channels follow at `dataOffset`, which is aligned to pages, such that
+// they can be mapped read-only.
+struct SegmentHeader {
+    uint64_t magic;
+    uint32_t version;
+    // Set once the pixels were written. Objects that are not ready yet are ignored by other
+    // instances, which then decode the image themselves.
+    atomic<uint32_t> isReady;
+    // Instances that display the image. The object is removed once the count drops to 0
+    // and can not be acquired anymore from then on.
+    atomic<uint32_t> numReferences;
+    uint32_t metadataBytes;
+    uint64_t dataOffset;
+    uint64_t dataBytes;
+    // The instance that creates the object and when it did so, which are written before
+    // anything else, such that objects of crashed instances can be removed (see isStale).
+    int64_t creatorPid;
+    int64_t creationTime;
+};
+
+static_assert(atomic<uint32_t>::is_always_lock_free, "Shared memory requires lock-free atomics.");
+
+// Short enough for the 31 characters to which macOS limits the names of shared memory objects.
+string segmentName(const string& key) {
+    // 64-bit FNV-1a, which unlike std::hash is the same for all builds of tev.
+    uint64_t hash = 0xcbf29ce484222325;
+    for (char c : key) {
+        hash = (hash ^ (uint8_t)c) * 0x100000001b3;
+    }
+    return tfm::format("/tev-%016x", hash);
+}
+
+size_t pageSize() {
+    return (size_t)sysconf(_SC_PAGESIZE);
+}
+
+template <typename T>
+void writeValue(vector<char>& metadata, T value) {
+    const char* bytes = reinterpret_cast<const char*>(&value);
+    metadata.insert(end(metadata), bytes, bytes + sizeof(value));
+}
+
+void writeString(vector<char>& metadata, const string& value) {
+    writeValue(metadata, (uint32_t)value.size());
+    metadata.insert(end(metadata), begin(value), end(value));
+}
+
+// Reads the metadata of a shared memory object, which other processes may have written, and
+// hence checks all sizes against the available bytes.
+class MetadataReader {
+public:
+    MetadataReader(const char* data, size_t size) : mData{data}, mSize{size} {}
+
+    template <typename T = uint32_t>
+    T readValue() {
+        T value;
+        if (mSize - mOffset < sizeof(value)) {
+            throw runtime_error{"Truncated metadata."};
+        }
+        memcpy(&value, mData + mOffset, sizeof(value));
+        mOffset += sizeof(value);
+        return value;
+    }
+
+    // Reads the number of entries of a list, each of which takes at least 4 bytes.
+    uint32_t readCount() {
+        uint32_t count = readValue();
+        if (count > (mSize - mOffset) / sizeof(uint32_t)) {
+            throw runtime_error{"Truncated metadata."};
+        }
+        return count;
+    }
+
+    string readString() {
+        uint32_t length = readValue();
+        if (mSize - mOffset < length) {
+            throw runtime_error{"Truncated metadata."};
+        }
+        string value{mData + mOffset, length};
+        mOffset += length;
+        return value;
+    }
+
+private:
+    const char* mData;
+    size_t mSize;
+    size_t mOffset = 0;
+};
+
+// A mapping of a shared memory object, which holds one reference to it for as long as it
+// exists. Channels keep the segment alive via their data.
+class Segment {
+public:
+    Segment(const string& name, char* mapping, size_t size) : mName{name}, mMapping{mapping}, mSize{size} {}
+
+    ~Segment() {
+        if (header().numReferences.fetch_sub(1) == 1) {
+            shm_unlink(mName.c_str());
+        }
+        munmap(mMapping, mSize);
+    }
+
+    SegmentHeader& header() {
+        return *reinterpret_cast<SegmentHeader*>(mMapping);
+    }
+
+    const char* metadata() {
+        return mMapping + sizeof(SegmentHeader);
+    }
+
+    const float* pixels() {
+        return reinterpret_cast<const float*>(mMapping + header().dataOffset);
+    }
+
+    // Protects the pixels from accidental writes, which would be visible to other instances.
+    void protectPixels() {
+        mprotect(mMapping + header().dataOffset, mSize - header().dataOffset, PROT_READ);
+    }
+
+private:
+    string mName;
+    char* mMapping;
+    size_t mSize;
+};
+
+char* mapSegment(int fd, size_t size) {
+    void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    return mapping == MAP_FAILED ? nullptr : (char*)mapping;
+}
+
+// Whether the object is an unfinished leftover of an instance that crashed while storing it,
+// which would otherwise block its key for good, or belongs to another version of tev.
+bool isStale(const string& name) {
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd == -1) {
+        return false;
+    }
+
+    bool result = false;
+    struct stat status;
+    if (fstat(fd, &status) == 0) {
+        time_t now = time(nullptr);
+        if ((size_t)status.st_size < sizeof(SegmentHeader)) {
+            // The creator did not even get to sizing the object.
+            result = now - status.st_ctime > STORE_TIMEOUT_SECONDS;
+        } else if (char* mapping = mapSegment(fd, sizeof(SegmentHeader))) {
+            auto& header = *reinterpret_cast<SegmentHeader*>(mapping);
+            if (header.creatorPid == 0) {
+                result = now - status.st_ctime > STORE_TIMEOUT_SECONDS;
+            } else if (header.magic != 0 && (header.magic != SEGMENT_MAGIC || header.version != SEGMENT_VERSION)) {
+                // Can never be loaded by this version. Instances that mapped it are unaffected.
+                result = true;
+            } else if (!header.isReady.load(memory_order_acquire)) {
+                bool isCreatorGone = kill((pid_t)header.creatorPid, 0) == -1 && errno == ESRCH;
+                result = isCreatorGone || now - header.creationTime > STORE_TIMEOUT_SECONDS;
+            }
+
+            munmap(mapping, sizeof(SegmentHeader));
+        }
+    }
+
+    close(fd);
+    return result;
+}
+
+// Increments the count of references unless the object is already being removed.
+bool acquire(SegmentHeader& header) {
+    uint32_t numReferences = header.numReferences.load();
+    while (numReferences > 0) {
+        if (header.numReferences.compare_exchange_weak(numReferences, numReferences + 1)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void assignChannels(const shared_ptr<Segment>& segment, const Vector2i& size, const vector<string>& channelNames, ImageData& data) {
+    size_t numPixels = (size_t)size.x() * size.y();
+    const float* pixels = segment->pixels();
+
+    data.channels.clear();
+    for (const auto& name : channelNames) {
+        // Shares ownership of the segment, such that it is unmapped along with the last channel.
+        shared_ptr<const float> channelData{segment, pixels};
+        data.channels.emplace_back(name, size, channelData);
+        pixels += numPixels;
+    }
+}
+
+}
+
+void SharedImageCache::setEnabled(bool enabled) {
+    sIsEnabled = enabled;
+}
+
+string SharedImageCache::key(const path& path, const string& channelSelector) {
+    if (!sIsEnabled) {
+        return "";
+    }
+
+    struct stat status;
+    if (stat(path.str().c_str(), &status) != 0 || !S_ISREG(status.st_mode)) {
+        return "";
+    }
+
+#ifdef __APPLE__
+    const auto& modificationTime = status.st_mtimespec;
+#else
+    const auto& modificationTime = status.st_mtim;
+#endif
+
+    return tfm::format(
+        "%s\n%d.%09d\n%d\n%d\n%s",
+        path.str(), (int64_t)modificationTime.tv_sec, (int64_t)modificationTime.tv_nsec,
+        (int64_t)status.st_size, (uint64_t)status.st_ino, channelSelector
+    );
+}
+
+bool SharedImageCache::load(const string& key, ImageData& data) {
+    string name = segmentName(key);
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd == -1) {
+        return false;
+    }
+
+    struct stat status;
+    char* mapping = nullptr;
+    size_t size = 0;
+    if (fstat(fd, &status) == 0 && (size_t)status.st_size >= sizeof(SegmentHeader)) {
+        size = (size_t)status.st_size;
+        mapping = mapSegment(fd, size);
+    }
+
+    close(fd);
+    if (!mapping) {
+        return false;
+    }
+
+    auto& header = *reinterpret_cast<SegmentHeader*>(mapping);
+    if (header.magic != SEGMENT_MAGIC || header.version != SEGMENT_VERSION || !header.isReady.load(memory_order_acquire) || !acquire(header)) {
+        munmap(mapping, size);
+        return false;
+    }
+
+    // From here on, the segment releases its reference when it is destroyed.
+    auto segment = make_shared<Segment>(name, mapping, size);
+
+    try {
+        if (header.dataOffset % pageSize() != 0 || header.dataOffset < sizeof(SegmentHeader) || header.dataOffset > size || header.dataBytes > size - header.dataOffset ||
+            header.metadataBytes > header.dataOffset - sizeof(SegmentHeader)) {
+            throw runtime_error{"Invalid layout."};
+        }
+
+        MetadataReader reader{segment->metadata(), header.metadataBytes};
+
+        // Different keys can map to the same name, in which case the image is decoded as usual.
+        if (reader.readString() != key) {
+            return false;
+        }
+
+        Vector2i imageSize;
+        imageSize.x() = (int)reader.readValue();
+        imageSize.y() = (int)reader.readValue();
+
+        vector<string> channelNames(reader.readCount());
+        for (auto& channelName : channelNames) {
+            channelName = reader.readString();
+        }
+
+        vector<string> layers(reader.readCount());
+        for (auto& layer : layers) {
+            layer = reader.readString();
+        }
+
+        Matrix3f toRec709;
+        for (DenseIndex i = 0; i < toRec709.size(); ++i) {
+            toRec709(i) = reader.readValue<float>();
+        }
+
+        vector<string> convertedChannels(reader.readCount());
+        for (auto& channelName : convertedChannels) {
+            channelName = reader.readString();
+        }
+
+        size_t numChannels = channelNames.size();
+        if (imageSize.minCoeff() < 0 || header.dataBytes != (uint64_t)imageSize.x() * imageSize.y() * numChannels * sizeof(float)) {
+            throw runtime_error{"Invalid size."};
+        }
+
+        segment->protectPixels();
+        assignChannels(segment, imageSize, channelNames, data);
+        data.layers = layers;
+        data.toRec709 = toRec709;
+        data.convertedChannels = convertedChannels;
+    } catch (const runtime_error& e) {
+        tlog::warning() << tfm::format("Ignoring invalid shared image %s: %s", name, e.what());
+        return false;
+    }
+
+    return true;
+}
+
+void SharedImageCache::store(const string& key, ImageData& data) {
+    if (data.channels.empty()) {
+        return;
+    }
+
+    Vector2i imageSize = data.channels.front().size();
+    size_t numPixels = (size_t)imageSize.x() * imageSize.y();
+
+    vector<char> metadata;
+    writeString(metadata, key);
+    writeValue(metadata, (uint32_t)imageSize.x());
+    writeValue(metadata, (uint32_t)imageSize.y());
+
+    vector<string> channelNames;
+    writeValue(metadata, (uint32_t)data.channels.size());
+    for (const auto& channel : data.channels) {
+        writeString(metadata, channel.name());
+        channelNames.emplace_back(channel.name());
+    }
+
+    writeValue(metadata, (uint32_t)data.layers.size());
+    for (const auto& layer : data.layers) {
+        writeString(metadata, layer);
+    }
+
+    for (DenseIndex i = 0; i < data.toRec709.size(); ++i) {
+        writeValue(metadata, data.toRec709(i));
+    }
+
+    writeValue(metadata, (uint32_t)data.convertedChannels.size());
+    for (const auto& channelName : data.convertedChannels) {
+        writeString(metadata, channelName);
+    }
+
+    vector<const Channel*> channels;
+    for (const auto& channel : data.channels) {
+        channels.emplace_back(&channel);
+    }
+
+    size_t dataOffset = (sizeof(SegmentHeader) + metadata.size() + pageSize() - 1) / pageSize() * pageSize();
+    size_t dataBytes = numPixels * channels.size() * sizeof(float);
+    size_t size = dataOffset + dataBytes;
+
+    // Only one instance creates the object. All others either map it once it is ready or
+    // decode the image themselves in the meantime.
+    string name = segmentName(key);
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd == -1 && errno == EEXIST && isStale(name)) {
+        tlog::warning() << tfm::format("Removing stale shared image %s.", name);
+        shm_unlink(name.c_str());
+        fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    }
+
+    if (fd == -1) {
+        return;
+    }
+
+    char* mapping = nullptr;
+    if (ftruncate(fd, (off_t)size) == 0) {
+        mapping = mapSegment(fd, size);
+    }
+
+    close(fd);
+    if (!mapping) {
+        tlog::warning() << tfm::format("Could not share '%s' with other instances: %s", name, strerror(errno));
+        shm_unlink(name.c_str());
+        return;
+    }
+
+    // The object is zero-initialized, so it is not ready until all of it was written.
+    auto& header = *reinterpret_cast<SegmentHeader*>(mapping);
+    header.creationTime = (int64_t)time(nullptr);
+    header.creatorPid = (int64_t)getpid();
+    header.magic = SEGMENT_MAGIC;
+    header.version = SEGMENT_VERSION;
+    header.numReferences.store(1);
+    header.metadataBytes = (uint32_t)metadata.size();
+    header.dataOffset = dataOffset;
+    header.dataBytes = dataBytes;
+
+    memcpy(mapping + sizeof(SegmentHeader), metadata.data(), metadata.size());
+
+    float* pixels = reinterpret_cast<float*>(mapping + dataOffset);
+    gThreadPool->parallelFor<size_t>(0, channels.size(), [&](size_t i) {
+        copy_n(channels[i]->data().data(), numPixels, pixels + i * numPixels);
+    });
+
+    header.isReady.store(1, memory_order_release);
+
+    auto segment = make_shared<Segment>(name, mapping, size);
+    segment->protectPixels();
+    assignChannels(segment, imageSize, channelNames, data);
+}
+
+#else
+
+void SharedImageCache::setEnabled(bool enabled) {
+    if (enabled) {
+        tlog::warning() << "Sharing images between instances is not supported on this platform.";
+    }
+}
+
+string SharedImageCache::key(const path&, const string&) {
+    return "";
+}
+
+bool SharedImageCache::load(const string&, ImageData&) {
+    return false;
+}
+
+void SharedImageCache::store(const string&, ImageData&) {
+}
+
+#endif
+
+TEV_NAMESPACE_END
@@ -0,0 +1,158 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the BSD 3-Clause License within the LICENSE file.
+
+#include <tev/TemporalStatistics.h>
+#include <tev/ThreadPool.h>
+
+#include <deque>
+#include <future>
+#include <limits>
+#include <sstream>
+
+using namespace Eigen;
+using namespace std;
+
+TEV_NAMESPACE_BEGIN
+
+namespace {
+
+// Enough to keep decoding busy while an image is accumulated, yet few enough to bound memory.
+const size_t NUM_IMAGES_AHEAD = 2;
+
+const char* const STATISTICS_LAYERS[] = {"mean", "variance", "stderr", "min", "max"};
+
+}
+
+void TemporalStatistics::add(const Image& image) {
+    if (mNumImages == 0) {
+        mSize = image.size();
+        mChannelNames = image.channelNames();
+
+        size_t numPixels = (size_t)image.count();
+        for (size_t i = 0; i < mChannelNames.size(); ++i) {
+            mAccumulators.push_back({
+                PooledVector<float>(numPixels, 0.0f),
+                PooledVector<float>(numPixels, 0.0f),
+                PooledVector<float>(numPixels, numeric_limits<float>::infinity()),
+                PooledVector<float>(numPixels, -numeric_limits<float>::infinity()),
+            });
+        }
+    } else if (image.size() != mSize) {
+        throw invalid_argument{tfm::format(
+            "Resolution %dx%d differs from %dx%d of the first image.",
+            image.size().x(), image.size().y(), mSize.x(), mSize.y()
+        )};
+    }
+
+    for (const auto& channelName : mChannelNames) {
+        if (!image.hasChannel(channelName)) {
+            throw invalid_argument{tfm::format("Channel %s of the first image is missing.", channelName)};
+        }
+    }
+
+    auto channels = image.snapshot(mChannelNames);
+    const float n = (float)(mNumImages + 1);
+
+    // Rows of all channels are accumulated in one go, which keeps all threads busy even for
+    // images with few, but large channels.
+    gThreadPool->parallelFor<DenseIndex>(0, (DenseIndex)channels.size() * mSize.y(), [&](DenseIndex i) {
+        const auto& channel = channels[i / mSize.y()];
+        auto& accumulator = mAccumulators[i / mSize.y()];
+        const DenseIndex rowStart = (i % mSize.y()) * (DenseIndex)mSize.x();
+
+        for (DenseIndex j = rowStart; j < rowStart + mSize.x(); ++j) {
+            float value = channel.at(j);
+            float delta = value - accumulator.mean[j];
+            accumulator.mean[j] += delta / n;
+            accumulator.m2[j] += delta * (value - accumulator.mean[j]);
+            accumulator.minimum[j] = min(accumulator.minimum[j], value);
+            accumulator.maximum[j] = max(accumulator.maximum[j], value);
+        }
+    });
+
+    ++mNumImages;
+}
+
+shared_ptr<Image> TemporalStatistics::toImage(const string& name) const {
+    if (mNumImages == 0) {
+        return nullptr;
+    }
+
+    // Images are created like over IPC: as an empty image whose channels are then updated.
+    vector<string> channelNames;
+    for (const char* layer : STATISTICS_LAYERS) {
+        for (const auto& channelName : mChannelNames) {
+            channelNames.emplace_back(tfm::format("%s.%s", layer, channelName));
+        }
+    }
+
+    stringstream imageStream;
+    imageStream << "empty " << mSize.x() << " " << mSize.y() << " " << channelNames.size() << " ";
+    for (const auto& channelName : channelNames) {
+        imageStream << channelName.length() << channelName;
+    }
+
+    auto image = tryLoadImage(name, imageStream, "");
+    if (!image) {
+        return nullptr;
+    }
+
+    // The sample variance is undefined for a single image and reported as 0 instead.
+    const float n = (float)mNumImages;
+    const float varianceScale = mNumImages > 1 ? 1.0f / (n - 1) : 0.0f;
+
+    size_t numPixels = (size_t)mSize.x() * mSize.y();
+    for (size_t c = 0; c < mChannelNames.size(); ++c) {
+        const auto& accumulator = mAccumulators[c];
+
+        PooledVector<float> variance(numPixels);
+        PooledVector<float> standardError(numPixels);
+        gThreadPool->parallelFor<size_t>(0, numPixels, [&](size_t i) {
+            variance[i] = accumulator.m2[i] * varianceScale;
+            standardError[i] = sqrt(variance[i] / n);
+        });
+
+        const PooledVector<float>* layers[] = {&accumulator.mean, &variance, &standardError, &accumulator.minimum, &accumulator.maximum};
+        for (size_t l = 0; l < sizeof(layers) / sizeof(layers[0]); ++l) {
+            image->updateChannel(tfm::format("%s.%s", STATISTICS_LAYERS[l], mChannelNames[c]), 0, 0, mSize.x(), mSize.y(), *layers[l]);
+        }
+    }
+
+    return image;
+}
+
+shared_ptr<Image> computeTemporalStatistics(const string& name, size_t numImages, const function<shared_ptr<Image>(size_t)>& loadImage) {
+    auto start = chrono::system_clock::now();
+
+    ThreadPool loaders{NUM_IMAGES_AHEAD};
+    deque<future<shared_ptr<Image>>> pendingImages;
+    size_t numEnqueued = 0;
+
+    TemporalStatistics statistics;
+    for (size_t i = 0; i < numImages; ++i) {
+        while (numEnqueued < numImages && numEnqueued <= i + NUM_IMAGES_AHEAD) {
+            pendingImages.emplace_back(loaders.enqueueTask([numEnqueued, &loadImage] { return loadImage(numEnqueued); }));
+            ++numEnqueued;
+        }
+
+        auto image = pendingImages.front().get();
+        pendingImages.pop_front();
+
+        if (!image) {
+            continue;
+        }
+
+        try {
+            statistics.add(*image);
+        } catch (const invalid_argument& e) {
+            tlog::warning() << tfm::format("Skipping '%s' in statistics. %s", image->name(), e.what());
+        }
+    }
+
+    chrono::duration<double> elapsedSeconds = chrono::system_clock::now() - start;
+    tlog::success() << tfm::format("Accumulated %d of %d images after %.3f seconds.", statistics.numImages(), numImages, elapsedSeconds.count());
+
+    return statistics.toImage(name);
+}
+
+TEV_NAMESPACE_END
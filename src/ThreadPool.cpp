@@ -9,6 +9,8 @@ using namespace std;
 
 TEV_NAMESPACE_BEGIN
 
+ThreadPool* gThreadPool = new ThreadPool{};
+
 ThreadPool::ThreadPool()
 : ThreadPool{thread::hardware_concurrency()} {
 }
@@ -0,0 +1,624 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the BSD 3-Clause License within the LICENSE file.
+
+#include <tev/Image.h>
+#include <tev/ImageProcessing.h>
+#include <tev/Ipc.h>
+#include <tev/Resampling.h>
+#include <tev/ThreadPool.h>
+#include <tev/imageio/ExrImageSaver.h>
+#include <tev/imageio/ImageLoader.h>
+#include <tev/imageio/StbiHdrImageSaver.h>
+#include <tev/imageio/StbiLdrImageSaver.h>
+
+#include <args.hxx>
+#include <ImfThreading.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <thread>
+
+using namespace args;
+using namespace Eigen;
+using namespace filesystem;
+using namespace std;
+
+TEV_NAMESPACE_BEGIN
+
+namespace {
+
+struct BenchmarkSettings {
+    double minSeconds;
+    size_t minIterations;
+    string filter;
+};
+
+struct BenchmarkResult {
+    string name;
+    size_t iterations;
+    double minSeconds;
+    double medianSeconds;
+    double meanSeconds;
+
+    // Amount of work done by a single iteration. Zero if not applicable.
+    double bytes;
+    double pixels;
+
+    double megabytesPerSecond() const {
+        return bytes / medianSeconds / (1024 * 1024);
+    }
+
+    double pixelsPerSecond() const {
+        return pixels / medianSeconds;
+    }
+};
+
+class BenchmarkRunner {
+public:
+    BenchmarkRunner(const BenchmarkSettings& settings) : mSettings{settings} {}
+
+    bool isEnabled(const string& name) const {
+        return mSettings.filter.empty() || name.find(mSettings.filter) != string::npos;
+    }
+
+    // Runs `func` repeatedly until both the minimum number of iterations and the minimum
+    // duration are reached. The first call is a warm-up whose timing is discarded.
+    void run(const string& name, double bytes, double pixels, const function<void()>& func) {
+        if (!isEnabled(name)) {
+            return;
+        }
+
+        func();
+
+        vector<double> times;
+        double totalSeconds = 0;
+        while (times.size() < mSettings.minIterations || totalSeconds < mSettings.minSeconds) {
+            auto start = chrono::steady_clock::now();
+            func();
+            double seconds = chrono::duration<double>{chrono::steady_clock::now() - start}.count();
+
+            times.emplace_back(seconds);
+            totalSeconds += seconds;
+        }
+
+        sort(begin(times), end(times));
+
+        BenchmarkResult result;
+        result.name = name;
+        result.iterations = times.size();
+        result.minSeconds = times.front();
+        result.medianSeconds = times[times.size() / 2];
+        result.meanSeconds = totalSeconds / times.size();
+        result.bytes = bytes;
+        result.pixels = pixels;
+
+        string throughput;
+        if (bytes > 0) {
+            throughput += tfm::format("  %10.1f MB/s", result.megabytesPerSecond());
+        }
+        if (pixels > 0) {
+            throughput += tfm::format("  %8.1f Mpixels/s", result.pixelsPerSecond() / 1000000);
+        }
+
+        tlog::info() << tfm::format("%-48s %10.3f ms%s", name, result.medianSeconds * 1000, throughput);
+        mResults.emplace_back(result);
+    }
+
+    const vector<BenchmarkResult>& results() const {
+        return mResults;
+    }
+
+private:
+    BenchmarkSettings mSettings;
+    vector<BenchmarkResult> mResults;
+};
+
+// Produces deterministic HDR content: smooth gradients, which compress well, overlaid
+// with noise, which does not, such that compressed formats are not unrealistically fast.
+PooledVector<float> makeSyntheticData(const Vector2i& size, int numChannels, unsigned seed) {
+    PooledVector<float> result((size_t)size.x() * size.y() * numChannels);
+
+    mt19937 rng{seed};
+    uniform_real_distribution<float> noise{-0.05f, 0.05f};
+
+    for (int y = 0; y < size.y(); ++y) {
+        for (int x = 0; x < size.x(); ++x) {
+            size_t i = ((size_t)y * size.x() + x) * numChannels;
+            for (int c = 0; c < numChannels; ++c) {
+                if (c == 3) {
+                    result[i + c] = 1;
+                    continue;
+                }
+
+                float u = (float)x / size.x(), v = (float)y / size.y();
+                float value = 0.5f + 0.5f * sin(6.2831853f * (u * (c + 1) + v * (2 - c)));
+                result[i + c] = max(value * 1.5f + noise(rng), 0.0f);
+            }
+        }
+    }
+
+    return result;
+}
+
+vector<string> channelNames(int numChannels) {
+    static const vector<string> names = {"R", "G", "B", "A"};
+    return numChannels == 1 ? vector<string>{"L"} : vector<string>{begin(names), begin(names) + numChannels};
+}
+
+// Creates an image entirely in memory through the same path as images created over IPC.
+shared_ptr<Image> makeSyntheticImage(const Vector2i& size, int numChannels, unsigned seed) {
+    auto names = channelNames(numChannels);
+
+    stringstream imageStream;
+    imageStream << "empty " << size.x() << " " << size.y() << " " << numChannels << " ";
+    for (const auto& name : names) {
+        imageStream << name.length() << name;
+    }
+
+    auto image = tryLoadImage(tfm::format("synthetic%d", seed), imageStream, "");
+    if (!image) {
+        throw runtime_error{"Could not create synthetic image."};
+    }
+
+    auto data = makeSyntheticData(size, numChannels, seed);
+    PooledVector<float> channelData((size_t)size.x() * size.y());
+    for (int c = 0; c < numChannels; ++c) {
+        for (size_t i = 0; i < channelData.size(); ++i) {
+            channelData[i] = data[i * numChannels + c];
+        }
+
+        image->updateChannel(names[c], 0, 0, size.x(), size.y(), channelData);
+    }
+
+    return image;
+}
+
+void writeBytes(ostream& oStream, const void* data, size_t numBytes) {
+    oStream.write(reinterpret_cast<const char*>(data), numBytes);
+}
+
+void writeUInt32(ostream& oStream, uint32_t value) {
+    uint8_t bytes[4] = {(uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24)};
+    writeBytes(oStream, bytes, sizeof(bytes));
+}
+
+PooledVector<char> toLdr(const PooledVector<float>& data) {
+    PooledVector<char> result(data.size());
+    for (size_t i = 0; i < data.size(); ++i) {
+        result[i] = (char)(min(max(toSRGB(data[i]), 0.0f), 1.0f) * 255 + 0.5f);
+    }
+    return result;
+}
+
+void writePfm(ostream& oStream, const PooledVector<float>& data, const Vector2i& size, int numChannels) {
+    // Negative scale denotes little endian data. Rows are stored bottom to top.
+    oStream << (numChannels == 1 ? "Pf" : "PF") << "\n" << size.x() << " " << size.y() << "\n" << (isSystemLittleEndian() ? "-1.0" : "1.0") << "\n";
+    size_t rowFloats = (size_t)size.x() * numChannels;
+    for (int y = size.y() - 1; y >= 0; --y) {
+        writeBytes(oStream, &data[y * rowFloats], rowFloats * sizeof(float));
+    }
+}
+
+void writePnm(ostream& oStream, const PooledVector<float>& data, const Vector2i& size, int numChannels, int maxValue) {
+    if (numChannels == 1 || numChannels == 3) {
+        oStream << (numChannels == 1 ? "P5" : "P6") << "\n" << size.x() << " " << size.y() << "\n" << maxValue << "\n";
+    } else {
+        oStream << "P7\nWIDTH " << size.x() << "\nHEIGHT " << size.y() << "\nDEPTH " << numChannels << "\nMAXVAL " << maxValue << "\nTUPLTYPE RGB_ALPHA\nENDHDR\n";
+    }
+
+    vector<uint8_t> raster;
+    raster.reserve(data.size() * (maxValue > 255 ? 2 : 1));
+    for (float value : data) {
+        int v = (int)(min(max(toSRGB(value), 0.0f), 1.0f) * maxValue + 0.5f);
+        if (maxValue > 255) {
+            raster.emplace_back((uint8_t)(v >> 8));
+        }
+        raster.emplace_back((uint8_t)v);
+    }
+
+    writeBytes(oStream, raster.data(), raster.size());
+}
+
+// Writes a DDS file with a DX10 header. `data` is written verbatim, such that block-compressed
+// formats can be filled with arbitrary (but deterministic) blocks.
+void writeDds(ostream& oStream, uint32_t dxgiFormat, const Vector2i& size, const void* data, size_t numBytes) {
+    const uint32_t DDSD_CAPS = 0x1, DDSD_HEIGHT = 0x2, DDSD_WIDTH = 0x4, DDSD_PIXELFORMAT = 0x1000;
+    const uint32_t DDPF_FOURCC = 0x4;
+    const uint32_t DDSCAPS_TEXTURE = 0x1000;
+
+    oStream << "DDS ";
+    writeUInt32(oStream, 124);
+    writeUInt32(oStream, DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT);
+    writeUInt32(oStream, size.y());
+    writeUInt32(oStream, size.x());
+    writeUInt32(oStream, 0); // Pitch or linear size
+    writeUInt32(oStream, 0); // Depth
+    writeUInt32(oStream, 1); // Mip map count
+    for (int i = 0; i < 11; ++i) {
+        writeUInt32(oStream, 0);
+    }
+
+    // DDS_PIXELFORMAT
+    writeUInt32(oStream, 32);
+    writeUInt32(oStream, DDPF_FOURCC);
+    oStream << "DX10";
+    for (int i = 0; i < 5; ++i) {
+        writeUInt32(oStream, 0);
+    }
+
+    writeUInt32(oStream, DDSCAPS_TEXTURE);
+    for (int i = 0; i < 4; ++i) {
+        writeUInt32(oStream, 0);
+    }
+
+    // DDS_HEADER_DXT10
+    writeUInt32(oStream, dxgiFormat);
+    writeUInt32(oStream, 3); // Texture 2D
+    writeUInt32(oStream, 0);
+    writeUInt32(oStream, 1); // Array size
+    writeUInt32(oStream, 0);
+
+    writeBytes(oStream, data, numBytes);
+}
+
+struct SyntheticFile {
+    string filename;
+    Vector2i size;
+    int numChannels;
+    function<void(ostream&, const path&)> write;
+};
+
+// Describes one file per supported format, resolution, and channel count. The files are only
+// written right before they are benchmarked, such that large ones do not pile up on disk.
+vector<SyntheticFile> syntheticFiles(const vector<Vector2i>& sizes) {
+    vector<SyntheticFile> result;
+
+    for (const auto& size : sizes) {
+        for (int numChannels : {1, 3, 4}) {
+            string base = tfm::format("bench_%dx%d_%dch", size.x(), size.y(), numChannels);
+            auto data = [size, numChannels]() { return makeSyntheticData(size, numChannels, 1337); };
+            auto add = [&](const string& filename, function<void(ostream&, const path&)> write) {
+                result.push_back({filename, size, numChannels, write});
+            };
+
+            add(base + ".exr", [=](ostream& f, const path& p) { ExrImageSaver{}.save(f, p, data(), size, numChannels); });
+            add(base + ".png", [=](ostream& f, const path& p) { StbiLdrImageSaver{}.save(f, p, toLdr(data()), size, numChannels); });
+            add(base + ".jpg", [=](ostream& f, const path& p) { StbiLdrImageSaver{}.save(f, p, toLdr(data()), size, numChannels); });
+            add(base + ".pnm", [=](ostream& f, const path&) { writePnm(f, data(), size, numChannels, 255); });
+            add(base + "_16bit.pnm", [=](ostream& f, const path&) { writePnm(f, data(), size, numChannels, 65535); });
+            add(base + "_f32_le_interleaved.raw", [=](ostream& f, const path&) {
+                auto values = data();
+                writeBytes(f, values.data(), values.size() * sizeof(float));
+            });
+
+            // PFM can not hold 4 channels.
+            if (numChannels != 4) {
+                add(base + ".pfm", [=](ostream& f, const path&) { writePfm(f, data(), size, numChannels); });
+            }
+
+            if (numChannels == 3) {
+                add(base + ".hdr", [=](ostream& f, const path& p) { StbiHdrImageSaver{}.save(f, p, data(), size, numChannels); });
+            }
+
+            if (numChannels == 4) {
+                add(base + "_f32.dds", [=](ostream& f, const path&) {
+                    auto values = data();
+                    writeDds(f, 2 /* DXGI_FORMAT_R32G32B32A32_FLOAT */, size, values.data(), values.size() * sizeof(float));
+                });
+
+                // Block-compressed formats store 8 (BC1) or 16 (BC7) bytes per 4x4 block.
+                auto blocks = [size](size_t bytesPerBlock) {
+                    vector<uint8_t> result((size_t)((size.x() + 3) / 4) * ((size.y() + 3) / 4) * bytesPerBlock);
+                    mt19937 rng{42};
+                    generate(begin(result), end(result), [&rng]() { return (uint8_t)rng(); });
+                    return result;
+                };
+
+                add(base + "_bc1.dds", [=](ostream& f, const path&) {
+                    auto bytes = blocks(8);
+                    writeDds(f, 71 /* DXGI_FORMAT_BC1_UNORM */, size, bytes.data(), bytes.size());
+                });
+                add(base + "_bc7.dds", [=](ostream& f, const path&) {
+                    auto bytes = blocks(16);
+                    writeDds(f, 98 /* DXGI_FORMAT_BC7_UNORM */, size, bytes.data(), bytes.size());
+                });
+            }
+        }
+    }
+
+    return result;
+}
+
+void benchmarkLoaders(BenchmarkRunner& runner, const path& directory, const vector<Vector2i>& sizes) {
+    for (const auto& file : syntheticFiles(sizes)) {
+        path filePath = directory / file.filename;
+
+        {
+            ofstream fileStream{nativeString(filePath), ios_base::binary};
+            file.write(fileStream, filePath);
+            if (!fileStream) {
+                throw runtime_error{tfm::format("Could not write %s.", filePath)};
+            }
+        }
+
+        ifstream probeStream{nativeString(filePath), ios_base::binary};
+        const ImageLoader* loader = nullptr;
+        try {
+            loader = &ImageLoader::findLoader(probeStream, filePath);
+        } catch (const invalid_argument& e) {
+            tlog::warning() << tfm::format("No loader for %s. %s", filePath, e.what());
+        }
+
+        if (loader) {
+            // Files are read from the page cache after the warm-up, so this measures decoding
+            // rather than the speed of the disk.
+            double numPixels = (double)file.size.x() * file.size.y();
+            runner.run(tfm::format("load/%s/%s", loader->name(), file.filename), (double)filePath.file_size(), numPixels, [&]() {
+                ifstream fileStream{nativeString(filePath), ios_base::binary};
+                bool hasPremultipliedAlpha;
+                auto data = loader->load(fileStream, filePath, "", hasPremultipliedAlpha);
+                if (data.channels.empty()) {
+                    throw runtime_error{tfm::format("Loading %s produced no channels.", filePath)};
+                }
+            });
+        }
+
+        filePath.remove_file();
+    }
+}
+
+void benchmarkImageProcessing(BenchmarkRunner& runner, const vector<Vector2i>& sizes) {
+    for (const auto& size : sizes) {
+        auto image = makeSyntheticImage(size, 4, 1);
+        auto reference = makeSyntheticImage(size, 4, 2);
+
+        const double numPixels = (double)image->count();
+        const double channelBytes = numPixels * 4 * sizeof(float);
+        const string group = image->channelGroups().front().name;
+        const string suffix = tfm::format("%dx%d", size.x(), size.y());
+        const auto channels = image->channelsInGroup(group);
+
+        runner.run("texture-staging/" + suffix, channelBytes, numPixels, [&]() {
+            getTextureData(*image, channels);
+        });
+
+        runner.run("statistics/" + suffix, channelBytes, numPixels, [&]() {
+            computeCanvasStatistics(image, nullptr, group, EMetric::Error, {});
+        });
+
+        runner.run("statistics-reference/" + suffix, 2 * channelBytes, numPixels, [&]() {
+            computeCanvasStatistics(image, reference, group, EMetric::RelativeSquaredError, {});
+        });
+
+        // Like comparing a half-resolution preview against the final render.
+        auto source = image->snapshot({channels.front()}).front();
+        for (EResampling resampling : {Box, Bilinear, Lanczos}) {
+            const char* names[] = {"centered", "box", "bilinear", "lanczos"};
+            runner.run(tfm::format("resample/%s/%s", names[resampling], suffix), channelBytes / 4, numPixels, [&]() {
+                resample(source, size / 2, resampling);
+            });
+        }
+
+        runner.run("blur/" + suffix, channelBytes / 4, numPixels, [&]() {
+            blur(source, 4.0f);
+        });
+
+        for (ETonemap tonemap : {ETonemap::SRGB, ETonemap::FalseColor}) {
+            DisplaySettings displaySettings;
+            displaySettings.tonemap = tonemap;
+
+            runner.run(tfm::format("ldr/%s/%s", tonemap == ETonemap::SRGB ? "srgb" : "false-color", suffix), channelBytes, numPixels, [&]() {
+                getLdrImageData(image, nullptr, group, EMetric::Error, {}, false, displaySettings);
+            });
+        }
+    }
+}
+
+void benchmarkIpc(BenchmarkRunner& runner, const vector<Vector2i>& sizes) {
+    for (const auto& size : sizes) {
+        const int numChannels = 4;
+        const auto data = makeSyntheticData(size, numChannels, 3);
+
+        vector<IpcPacket::ChannelDesc> channelDescs;
+        const auto names = channelNames(numChannels);
+        for (int c = 0; c < numChannels; ++c) {
+            channelDescs.push_back({names[c], c, numChannels});
+        }
+
+        const double numPixels = (double)size.x() * size.y();
+        const double numBytes = (double)data.size() * sizeof(float);
+        const string suffix = tfm::format("%dx%d", size.x(), size.y());
+
+        runner.run("ipc-encode/" + suffix, numBytes, numPixels, [&]() {
+            IpcPacket packet;
+            packet.setUpdateImage("benchmark", false, channelDescs, 0, 0, size.x(), size.y(), data);
+        });
+
+        IpcPacket packet;
+        packet.setUpdateImage("benchmark", false, channelDescs, 0, 0, size.x(), size.y(), data);
+        runner.run("ipc-decode/" + suffix, (double)packet.size(), numPixels, [&]() {
+            packet.interpretAsUpdateImage();
+        });
+    }
+}
+
+void benchmarkThreadPool(BenchmarkRunner& runner) {
+    // An (almost) empty body measures the fixed cost of distributing work to the
+    // threads and waiting for them, which dominates small images and tiles.
+    runner.run("parallel-for/empty", 0, 0, []() {
+        gThreadPool->parallelFor<int>(0, 1, [](int) {});
+    });
+
+    for (int numItems : {1024, 1024 * 1024, 16 * 1024 * 1024}) {
+        vector<float> data(numItems, 1.0f);
+        runner.run(tfm::format("parallel-for/%d", numItems), (double)numItems * sizeof(float), numItems, [&]() {
+            gThreadPool->parallelFor<int>(0, numItems, [&data](int i) {
+                data[i] = data[i] * 0.5f + 1.0f;
+            });
+        });
+    }
+}
+
+string toJson(const vector<BenchmarkResult>& results) {
+    string json = "{\n";
+    json += tfm::format("  \"version\": \"%s\",\n", TEV_VERSION);
+    json += tfm::format("  \"threads\": %d,\n", thread::hardware_concurrency());
+    json += "  \"results\": [\n";
+
+    for (size_t i = 0; i < results.size(); ++i) {
+        const auto& r = results[i];
+        json += tfm::format(
+            "    {\"name\": \"%s\", \"iterations\": %d, \"min_seconds\": %.9f, \"median_seconds\": %.9f, \"mean_seconds\": %.9f, "
+            "\"bytes\": %.0f, \"pixels\": %.0f, \"megabytes_per_second\": %.3f, \"pixels_per_second\": %.1f}%s\n",
+            r.name, r.iterations, r.minSeconds, r.medianSeconds, r.meanSeconds,
+            r.bytes, r.pixels, r.megabytesPerSecond(), r.pixelsPerSecond(),
+            i + 1 < results.size() ? "," : ""
+        );
+    }
+
+    json += "  ]\n}\n";
+    return json;
+}
+
+}
+
+int mainFunc(const vector<string>& arguments) {
+    ArgumentParser parser{
+        "tev-benchmark — benchmarks of tev's loaders and image processing\n"
+        "version " TEV_VERSION,
+        "All inputs are generated deterministically, such that runs on the same machine can be compared.",
+    };
+
+    HelpFlag helpFlag{
+        parser,
+        "HELP",
+        "Display this help menu.",
+        {'h', "help"},
+    };
+
+    ValueFlag<string> dataFlag{
+        parser,
+        "DIRECTORY",
+        "Directory into which the synthetic image files are written. Default is 'tev-benchmark-data'.",
+        {'d', "data"},
+    };
+
+    ValueFlag<string> filterFlag{
+        parser,
+        "FILTER",
+        "Only run benchmarks whose name contains the given string, e.g. 'load/' or 'statistics'.",
+        {'f', "filter"},
+    };
+
+    ValueFlag<double> minTimeFlag{
+        parser,
+        "SECONDS",
+        "Minimum duration of each benchmark. Default is 0.5.",
+        {'t', "min-time"},
+    };
+
+    ValueFlag<size_t> minIterationsFlag{
+        parser,
+        "ITERATIONS",
+        "Minimum number of iterations of each benchmark. Default is 5.",
+        {'n', "min-iterations"},
+    };
+
+    ValueFlag<string> outputFlag{
+        parser,
+        "FILE",
+        "Writes the results as JSON to the given file.",
+        {'o', "output"},
+    };
+
+    Flag quickFlag{
+        parser,
+        "QUICK",
+        "Only benchmark small images, e.g. to check that all benchmarks work.",
+        {'q', "quick"},
+    };
+
+    try {
+        TEV_ASSERT(arguments.size() > 0, "Number of arguments must be bigger than 0.");
+
+        parser.Prog(arguments.front());
+        parser.ParseArgs(begin(arguments) + 1, end(arguments));
+    } catch (const Help&) {
+        cout << parser;
+        return 0;
+    } catch (const ParseError& e) {
+        cerr << e.what() << endl;
+        cerr << parser;
+        return -1;
+    } catch (const ValidationError& e) {
+        cerr << e.what() << endl;
+        cerr << parser;
+        return -2;
+    }
+
+    Imf::setGlobalThreadCount(thread::hardware_concurrency());
+
+    BenchmarkSettings settings;
+    settings.minSeconds = minTimeFlag ? get(minTimeFlag) : 0.5;
+    settings.minIterations = minIterationsFlag ? get(minIterationsFlag) : 5;
+    settings.filter = filterFlag ? get(filterFlag) : "";
+
+    vector<Vector2i> sizes = {{256, 256}, {1024, 1024}, {2048, 2048}};
+    if (quickFlag) {
+        sizes = {{256, 256}};
+    }
+
+    BenchmarkRunner runner{settings};
+
+    path dataDirectory = dataFlag ? get(dataFlag) : "tev-benchmark-data";
+    if (!dataDirectory.is_directory() && !create_directory(dataDirectory)) {
+        throw runtime_error{tfm::format("Could not create %s.", dataDirectory)};
+    }
+
+    benchmarkLoaders(runner, dataDirectory, sizes);
+    benchmarkImageProcessing(runner, sizes);
+    benchmarkIpc(runner, sizes);
+    benchmarkThreadPool(runner);
+
+    if (outputFlag) {
+        ofstream outputStream{nativeString(get(outputFlag))};
+        outputStream << toJson(runner.results());
+        if (!outputStream) {
+            throw runtime_error{tfm::format("Could not write results to %s.", get(outputFlag))};
+        }
+
+        tlog::success() << tfm::format("Wrote %d results to %s.", runner.results().size(), get(outputFlag));
+    }
+
+    return 0;
+}
+
+TEV_NAMESPACE_END
+
+#ifdef _WIN32
+int wmain(int argc, wchar_t* argv[]) {
+#else
+int main(int argc, char* argv[]) {
+#endif
+    try {
+        vector<string> arguments;
+        for (int i = 0; i < argc; ++i) {
+#ifdef _WIN32
+            arguments.emplace_back(tev::utf16to8(argv[i]));
+#else
+            arguments.emplace_back(tev::ensureUtf8(argv[i]));
+#endif
+        }
+
+        return tev::mainFunc(arguments);
+    } catch (const exception& e) {
+        tlog::error() << tfm::format("Uncaught exception: %s", e.what());
+        return 1;
+    }
+}
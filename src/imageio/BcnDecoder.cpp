@@ -0,0 +1,690 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the BSD 3-Clause License within the LICENSE file.
+
+#include <tev/imageio/BcnDecoder.h>
+
+#include <half.h>
+
+#include <algorithm>
+
+using namespace std;
+
+TEV_NAMESPACE_BEGIN
+
+namespace {
+
+// Reads little-endian bit fields of a 128-bit block, starting at the least significant bit.
+class BlockBits {
+public:
+    BlockBits(const uint8_t* block) {
+        for (int i = 7; i >= 0; --i) {
+            mLow = (mLow << 8) | block[i];
+            mHigh = (mHigh << 8) | block[i + 8];
+        }
+    }
+
+    uint32_t read(int numBits) {
+        if (numBits == 0) {
+            return 0;
+        }
+
+        uint64_t result;
+        if (mPosition >= 64) {
+            result = mHigh >> (mPosition - 64);
+        } else if (mPosition + numBits <= 64) {
+            result = mLow >> mPosition;
+        } else {
+            result = (mLow >> mPosition) | (mHigh << (64 - mPosition));
+        }
+
+        mPosition += numBits;
+        return (uint32_t)(result & ((1ull << numBits) - 1));
+    }
+
+    // Reads a field whose bits are stored from most to least significant.
+    uint32_t readReversed(int numBits) {
+        uint32_t result = 0;
+        for (int i = 0; i < numBits; ++i) {
+            result = (result << 1) | read(1);
+        }
+        return result;
+    }
+
+private:
+    uint64_t mLow = 0;
+    uint64_t mHigh = 0;
+    int mPosition = 0;
+};
+
+// Subset assignment of the 2-subset partitions. Bit i is set if pixel i belongs to subset 1.
+const uint16_t partitions2[64] = {
+    0xcccc, 0x8888, 0xeeee, 0xecc8, 0xc880, 0xfeec, 0xfec8, 0xec80,
+    0xc800, 0xffec, 0xfe80, 0xe800, 0xffe8, 0xff00, 0xfff0, 0xf000,
+    0xf710, 0x008e, 0x7100, 0x08ce, 0x008c, 0x7310, 0x3100, 0x8cce,
+    0x088c, 0x3110, 0x6666, 0x366c, 0x17e8, 0x0ff0, 0x718e, 0x399c,
+    0xaaaa, 0xf0f0, 0x5a5a, 0x33cc, 0x3c3c, 0x55aa, 0x9696, 0xa55a,
+    0x73ce, 0x13c8, 0x324c, 0x3bdc, 0x6996, 0xc33c, 0x9966, 0x0660,
+    0x0272, 0x04e4, 0x4e40, 0x2720, 0xc936, 0x936c, 0x39c6, 0x639c,
+    0x9336, 0x9cc6, 0x817e, 0xe718, 0xccf0, 0x0fcc, 0x7744, 0xee22,
+};
+
+// Subset of every pixel of the 3-subset partitions.
+const uint8_t partitions3[64][16] = {
+    {0, 0, 1, 1, 0, 0, 1, 1, 0, 2, 2, 1, 2, 2, 2, 2},
+    {0, 0, 0, 1, 0, 0, 1, 1, 2, 2, 1, 1, 2, 2, 2, 1},
+    {0, 0, 0, 0, 2, 0, 0, 1, 2, 2, 1, 1, 2, 2, 1, 1},
+    {0, 2, 2, 2, 0, 0, 2, 2, 0, 0, 1, 1, 0, 1, 1, 1},
+    {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 2, 2, 1, 1, 2, 2},
+    {0, 0, 1, 1, 0, 0, 1, 1, 0, 0, 2, 2, 0, 0, 2, 2},
+    {0, 0, 2, 2, 0, 0, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1},
+    {0, 0, 1, 1, 0, 0, 1, 1, 2, 2, 1, 1, 2, 2, 1, 1},
+    {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2},
+    {0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2},
+    {0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2},
+    {0, 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2},
+    {0, 1, 1, 2, 0, 1, 1, 2, 0, 1, 1, 2, 0, 1, 1, 2},
+    {0, 1, 2, 2, 0, 1, 2, 2, 0, 1, 2, 2, 0, 1, 2, 2},
+    {0, 0, 1, 1, 0, 1, 1, 2, 1, 1, 2, 2, 1, 2, 2, 2},
+    {0, 0, 1, 1, 2, 0, 0, 1, 2, 2, 0, 0, 2, 2, 2, 0},
+    {0, 0, 0, 1, 0, 0, 1, 1, 0, 1, 1, 2, 1, 1, 2, 2},
+    {0, 1, 1, 1, 0, 0, 1, 1, 2, 0, 0, 1, 2, 2, 0, 0},
+    {0, 0, 0, 0, 1, 1, 2, 2, 1, 1, 2, 2, 1, 1, 2, 2},
+    {0, 0, 2, 2, 0, 0, 2, 2, 0, 0, 2, 2, 1, 1, 1, 1},
+    {0, 1, 1, 1, 0, 1, 1, 1, 0, 2, 2, 2, 0, 2, 2, 2},
+    {0, 0, 0, 1, 0, 0, 0, 1, 2, 2, 2, 1, 2, 2, 2, 1},
+    {0, 0, 0, 0, 0, 0, 1, 1, 0, 1, 2, 2, 0, 1, 2, 2},
+    {0, 0, 0, 0, 1, 1, 0, 0, 2, 2, 1, 0, 2, 2, 1, 0},
+    {0, 1, 2, 2, 0, 1, 2, 2, 0, 0, 1, 1, 0, 0, 0, 0},
+    {0, 0, 1, 2, 0, 0, 1, 2, 1, 1, 2, 2, 2, 2, 2, 2},
+    {0, 1, 1, 0, 1, 2, 2, 1, 1, 2, 2, 1, 0, 1, 1, 0},
+    {0, 0, 0, 0, 0, 1, 1, 0, 1, 2, 2, 1, 1, 2, 2, 1},
+    {0, 0, 2, 2, 1, 1, 0, 2, 1, 1, 0, 2, 0, 0, 2, 2},
+    {0, 1, 1, 0, 0, 1, 1, 0, 2, 0, 0, 2, 2, 2, 2, 2},
+    {0, 0, 1, 1, 0, 1, 2, 2, 0, 1, 2, 2, 0, 0, 1, 1},
+    {0, 0, 0, 0, 2, 0, 0, 0, 2, 2, 1, 1, 2, 2, 2, 1},
+    {0, 0, 0, 0, 0, 0, 0, 2, 1, 1, 2, 2, 1, 2, 2, 2},
+    {0, 2, 2, 2, 0, 0, 2, 2, 0, 0, 1, 2, 0, 0, 1, 1},
+    {0, 0, 1, 1, 0, 0, 1, 2, 0, 0, 2, 2, 0, 2, 2, 2},
+    {0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2, 0},
+    {0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 0, 0, 0, 0},
+    {0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0},
+    {0, 1, 2, 0, 2, 0, 1, 2, 1, 2, 0, 1, 0, 1, 2, 0},
+    {0, 0, 1, 1, 2, 2, 0, 0, 1, 1, 2, 2, 0, 0, 1, 1},
+    {0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 0, 0, 0, 0, 1, 1},
+    {0, 1, 0, 1, 0, 1, 0, 1, 2, 2, 2, 2, 2, 2, 2, 2},
+    {0, 0, 0, 0, 0, 0, 0, 0, 2, 1, 2, 1, 2, 1, 2, 1},
+    {0, 0, 2, 2, 1, 1, 2, 2, 0, 0, 2, 2, 1, 1, 2, 2},
+    {0, 0, 2, 2, 0, 0, 1, 1, 0, 0, 2, 2, 0, 0, 1, 1},
+    {0, 2, 2, 0, 1, 2, 2, 1, 0, 2, 2, 0, 1, 2, 2, 1},
+    {0, 1, 0, 1, 2, 2, 2, 2, 2, 2, 2, 2, 0, 1, 0, 1},
+    {0, 0, 0, 0, 2, 1, 2, 1, 2, 1, 2, 1, 2, 1, 2, 1},
+    {0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 2, 2, 2, 2},
+    {0, 2, 2, 2, 0, 1, 1, 1, 0, 2, 2, 2, 0, 1, 1, 1},
+    {0, 0, 0, 2, 1, 1, 1, 2, 0, 0, 0, 2, 1, 1, 1, 2},
+    {0, 0, 0, 0, 2, 1, 1, 2, 2, 1, 1, 2, 2, 1, 1, 2},
+    {0, 2, 2, 2, 0, 1, 1, 1, 0, 1, 1, 1, 0, 2, 2, 2},
+    {0, 0, 0, 2, 1, 1, 1, 2, 1, 1, 1, 2, 0, 0, 0, 2},
+    {0, 1, 1, 0, 0, 1, 1, 0, 0, 1, 1, 0, 2, 2, 2, 2},
+    {0, 0, 0, 0, 0, 0, 0, 0, 2, 1, 1, 2, 2, 1, 1, 2},
+    {0, 1, 1, 0, 0, 1, 1, 0, 2, 2, 2, 2, 2, 2, 2, 2},
+    {0, 0, 2, 2, 0, 0, 1, 1, 0, 0, 1, 1, 0, 0, 2, 2},
+    {0, 0, 2, 2, 1, 1, 2, 2, 1, 1, 2, 2, 0, 0, 2, 2},
+    {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 1, 1, 2},
+    {0, 0, 0, 2, 0, 0, 0, 1, 0, 0, 0, 2, 0, 0, 0, 1},
+    {0, 2, 2, 2, 1, 2, 2, 2, 0, 2, 2, 2, 1, 2, 2, 2},
+    {0, 1, 0, 1, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2},
+    {0, 1, 1, 1, 2, 0, 1, 1, 2, 2, 0, 1, 2, 2, 2, 0},
+};
+
+// Anchor index of the second subset of 2-subset partitions.
+const uint8_t anchors2[64] = {
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+    15,  2,  8,  2,  2,  8,  8, 15,  2,  8,  2,  2,  8,  8,  2,  2,
+    15, 15,  6,  8,  2,  8, 15, 15,  2,  8,  2,  2,  2, 15, 15,  6,
+     6,  2,  6,  8, 15, 15,  2,  2, 15, 15, 15, 15, 15,  2,  2, 15,
+};
+
+// Anchor indices of the second and third subsets of 3-subset partitions.
+const uint8_t anchors3Second[64] = {
+     3,  3, 15, 15,  8,  3, 15, 15,  8,  8,  6,  6,  6,  5,  3,  3,
+     3,  3,  8, 15,  3,  3,  6, 10,  5,  8,  8,  6,  8,  5, 15, 15,
+     8, 15,  3,  5,  6, 10,  8, 15, 15,  3, 15,  5, 15, 15, 15, 15,
+     3, 15,  5,  5,  5,  8,  5, 10,  5, 10,  8, 13, 15, 12,  3,  3,
+};
+
+const uint8_t anchors3Third[64] = {
+    15,  8,  8,  3, 15, 15,  3,  8, 15, 15, 15, 15, 15, 15, 15,  8,
+    15,  8, 15,  3, 15,  8, 15,  8,  3, 15,  6, 10, 15, 15, 10,  8,
+    15,  3, 15, 10, 10,  8,  9, 10,  6, 15,  8, 15,  3,  6,  6,  8,
+    15,  3, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,  3, 15, 15,  8,
+};
+
+const int weights2[4] = {0, 21, 43, 64};
+const int weights3[8] = {0, 9, 18, 27, 37, 46, 55, 64};
+const int weights4[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+const int* weightsForBits(int numBits) {
+    return numBits == 2 ? weights2 : (numBits == 3 ? weights3 : weights4);
+}
+
+inline int interpolate(int e0, int e1, int weight) {
+    return ((64 - weight) * e0 + weight * e1 + 32) >> 6;
+}
+
+void unpack565(uint16_t color, float* rgb) {
+    int r = (color >> 11) & 0x1f;
+    int g = (color >> 5) & 0x3f;
+    int b = color & 0x1f;
+    rgb[0] = ((r << 3) | (r >> 2)) / 255.0f;
+    rgb[1] = ((g << 2) | (g >> 4)) / 255.0f;
+    rgb[2] = ((b << 3) | (b >> 2)) / 255.0f;
+}
+
+// Color part shared by BC1-BC3. Only BC1 supports the 3-color mode with transparent black.
+void decodeColorBlock(const uint8_t* block, float* rgba, bool allowTransparency) {
+    uint16_t c0 = (uint16_t)(block[0] | (block[1] << 8));
+    uint16_t c1 = (uint16_t)(block[2] | (block[3] << 8));
+
+    float palette[4][4];
+    unpack565(c0, palette[0]);
+    unpack565(c1, palette[1]);
+    palette[0][3] = palette[1][3] = 1.0f;
+
+    if (c0 > c1 || !allowTransparency) {
+        for (int c = 0; c < 4; ++c) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+    } else {
+        for (int c = 0; c < 4; ++c) {
+            palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+            palette[3][c] = 0.0f;
+        }
+    }
+
+    uint32_t indices = block[4] | (block[5] << 8) | (block[6] << 16) | ((uint32_t)block[7] << 24);
+    for (int i = 0; i < 16; ++i) {
+        const float* color = palette[(indices >> (2 * i)) & 3];
+        for (int c = 0; c < 4; ++c) {
+            rgba[i * 4 + c] = color[c];
+        }
+    }
+}
+
+// Single-channel block of BC3 (alpha), BC4 and BC5. Writes to every `stride`-th float.
+void decodeChannelBlock(const uint8_t* block, float* out, int stride, bool isSigned) {
+    float palette[8];
+    if (isSigned) {
+        int e0 = max((int)(int8_t)block[0], -127);
+        int e1 = max((int)(int8_t)block[1], -127);
+        palette[0] = e0 / 127.0f;
+        palette[1] = e1 / 127.0f;
+        if (e0 > e1) {
+            for (int i = 2; i < 8; ++i) {
+                palette[i] = ((8 - i) * e0 + (i - 1) * e1) / (7 * 127.0f);
+            }
+        } else {
+            for (int i = 2; i < 6; ++i) {
+                palette[i] = ((6 - i) * e0 + (i - 1) * e1) / (5 * 127.0f);
+            }
+            palette[6] = -1.0f;
+            palette[7] = 1.0f;
+        }
+    } else {
+        int e0 = block[0];
+        int e1 = block[1];
+        palette[0] = e0 / 255.0f;
+        palette[1] = e1 / 255.0f;
+        if (e0 > e1) {
+            for (int i = 2; i < 8; ++i) {
+                palette[i] = ((8 - i) * e0 + (i - 1) * e1) / (7 * 255.0f);
+            }
+        } else {
+            for (int i = 2; i < 6; ++i) {
+                palette[i] = ((6 - i) * e0 + (i - 1) * e1) / (5 * 255.0f);
+            }
+            palette[6] = 0.0f;
+            palette[7] = 1.0f;
+        }
+    }
+
+    uint64_t indices = 0;
+    for (int i = 7; i >= 2; --i) {
+        indices = (indices << 8) | block[i];
+    }
+
+    for (int i = 0; i < 16; ++i) {
+        out[i * stride] = palette[(indices >> (3 * i)) & 7];
+    }
+}
+
+void fill(float* rgba, float r, float g, float b, float a) {
+    for (int i = 0; i < 16; ++i) {
+        rgba[i * 4 + 0] = r;
+        rgba[i * 4 + 1] = g;
+        rgba[i * 4 + 2] = b;
+        rgba[i * 4 + 3] = a;
+    }
+}
+
+struct Bc7Mode {
+    int numSubsets;
+    int partitionBits;
+    int rotationBits;
+    int indexSelectionBits;
+    int colorBits;
+    int alphaBits;
+    int endpointPBits;
+    int sharedPBits;
+    int indexBits;
+    int secondaryIndexBits;
+};
+
+const Bc7Mode bc7Modes[8] = {
+    {3, 4, 0, 0, 4, 0, 1, 0, 3, 0},
+    {2, 6, 0, 0, 6, 0, 0, 1, 3, 0},
+    {3, 6, 0, 0, 5, 0, 0, 0, 2, 0},
+    {2, 6, 0, 0, 7, 0, 1, 0, 2, 0},
+    {1, 0, 2, 1, 5, 6, 0, 0, 2, 3},
+    {1, 0, 2, 0, 7, 8, 0, 0, 2, 2},
+    {1, 0, 0, 0, 7, 7, 1, 0, 4, 0},
+    {2, 6, 0, 0, 5, 5, 1, 0, 2, 0},
+};
+
+int subsetOf(int numSubsets, int partition, int pixel) {
+    if (numSubsets == 2) {
+        return (partitions2[partition] >> pixel) & 1;
+    } else if (numSubsets == 3) {
+        return partitions3[partition][pixel];
+    }
+    return 0;
+}
+
+bool isAnchor(int numSubsets, int partition, int pixel) {
+    if (pixel == 0) {
+        return true;
+    } else if (numSubsets == 2) {
+        return pixel == anchors2[partition];
+    } else if (numSubsets == 3) {
+        return pixel == anchors3Second[partition] || pixel == anchors3Third[partition];
+    }
+    return false;
+}
+
+// BC6H endpoints are reconstructed at full 16-bit precision before interpolation.
+int unquantizeBc6h(int value, int numBits, bool isSigned) {
+    if (!isSigned) {
+        if (numBits >= 15 || value == 0) {
+            return value;
+        } else if (value == (1 << numBits) - 1) {
+            return 0xffff;
+        }
+        return ((value << 16) + 0x8000) >> numBits;
+    }
+
+    if (numBits >= 16) {
+        return value;
+    }
+
+    bool isNegative = value < 0;
+    int magnitude = isNegative ? -value : value;
+    int result;
+    if (magnitude == 0) {
+        result = 0;
+    } else if (magnitude >= (1 << (numBits - 1)) - 1) {
+        result = 0x7fff;
+    } else {
+        result = ((magnitude << 15) + 0x4000) >> (numBits - 1);
+    }
+
+    return isNegative ? -result : result;
+}
+
+float finishUnquantizeBc6h(int value, bool isSigned) {
+    uint16_t bits;
+    if (isSigned) {
+        bits = value < 0 ? (uint16_t)(0x8000 | ((-value * 31) >> 5)) : (uint16_t)((value * 31) >> 5);
+    } else {
+        bits = (uint16_t)((value * 31) >> 6);
+    }
+
+    ::half result;
+    result.setBits(bits);
+    return result;
+}
+
+int signExtend(int value, int numBits) {
+    int shift = 32 - numBits;
+    return (int)((uint32_t)value << shift) >> shift;
+}
+
+}
+
+void decodeBc1(const uint8_t* block, float* rgba) {
+    decodeColorBlock(block, rgba, true);
+}
+
+void decodeBc2(const uint8_t* block, float* rgba) {
+    decodeColorBlock(block + 8, rgba, false);
+    for (int i = 0; i < 16; ++i) {
+        rgba[i * 4 + 3] = ((block[i / 2] >> (4 * (i & 1))) & 0xf) / 15.0f;
+    }
+}
+
+void decodeBc3(const uint8_t* block, float* rgba) {
+    decodeColorBlock(block + 8, rgba, false);
+    decodeChannelBlock(block, rgba + 3, 4, false);
+}
+
+void decodeBc4(const uint8_t* block, float* rgba, bool isSigned) {
+    fill(rgba, 0.0f, 0.0f, 0.0f, 1.0f);
+    decodeChannelBlock(block, rgba, 4, isSigned);
+}
+
+void decodeBc5(const uint8_t* block, float* rgba, bool isSigned) {
+    fill(rgba, 0.0f, 0.0f, 0.0f, 1.0f);
+    decodeChannelBlock(block, rgba, 4, isSigned);
+    decodeChannelBlock(block + 8, rgba + 1, 4, isSigned);
+}
+
+void decodeBc6h(const uint8_t* block, float* rgba, bool isSigned) {
+    BlockBits bits{block};
+
+    int mode = (int)bits.read(2);
+    if (mode > 1) {
+        mode |= bits.read(3) << 2;
+    }
+
+    // Endpoints w and x of region 0 and y and z of region 1, in this order.
+    int r[4] = {}, g[4] = {}, b[4] = {};
+    int endpointBits, deltaBits[3];
+    bool isTransformed = true;
+    bool isSingleRegion = false;
+
+    auto get = [&](int& target, int firstBit, int numBits) {
+        target |= (int)bits.read(numBits) << firstBit;
+    };
+
+    switch (mode) {
+        case 0x00:
+            get(g[2], 4, 1); get(b[2], 4, 1); get(b[3], 4, 1);
+            get(r[0], 0, 10); get(g[0], 0, 10); get(b[0], 0, 10);
+            get(r[1], 0, 5); get(g[3], 4, 1); get(g[2], 0, 4);
+            get(g[1], 0, 5); get(b[3], 0, 1); get(g[3], 0, 4);
+            get(b[1], 0, 5); get(b[3], 1, 1); get(b[2], 0, 4);
+            get(r[2], 0, 5); get(b[3], 2, 1); get(r[3], 0, 5); get(b[3], 3, 1);
+            endpointBits = 10; deltaBits[0] = deltaBits[1] = deltaBits[2] = 5;
+            break;
+        case 0x01:
+            get(g[2], 5, 1); get(g[3], 4, 1); get(g[3], 5, 1);
+            get(r[0], 0, 7); get(b[3], 0, 1); get(b[3], 1, 1); get(b[2], 4, 1);
+            get(g[0], 0, 7); get(b[2], 5, 1); get(b[3], 2, 1); get(g[2], 4, 1);
+            get(b[0], 0, 7); get(b[3], 3, 1); get(b[3], 5, 1); get(b[3], 4, 1);
+            get(r[1], 0, 6); get(g[2], 0, 4); get(g[1], 0, 6); get(g[3], 0, 4);
+            get(b[1], 0, 6); get(b[2], 0, 4); get(r[2], 0, 6); get(r[3], 0, 6);
+            endpointBits = 7; deltaBits[0] = deltaBits[1] = deltaBits[2] = 6;
+            break;
+        case 0x02:
+            get(r[0], 0, 10); get(g[0], 0, 10); get(b[0], 0, 10);
+            get(r[1], 0, 5); get(r[0], 10, 1); get(g[2], 0, 4);
+            get(g[1], 0, 4); get(g[0], 10, 1); get(b[3], 0, 1); get(g[3], 0, 4);
+            get(b[1], 0, 4); get(b[0], 10, 1); get(b[3], 1, 1); get(b[2], 0, 4);
+            get(r[2], 0, 5); get(b[3], 2, 1); get(r[3], 0, 5); get(b[3], 3, 1);
+            endpointBits = 11; deltaBits[0] = 5; deltaBits[1] = deltaBits[2] = 4;
+            break;
+        case 0x06:
+            get(r[0], 0, 10); get(g[0], 0, 10); get(b[0], 0, 10);
+            get(r[1], 0, 4); get(r[0], 10, 1); get(g[3], 4, 1); get(g[2], 0, 4);
+            get(g[1], 0, 5); get(g[0], 10, 1); get(g[3], 0, 4);
+            get(b[1], 0, 4); get(b[0], 10, 1); get(b[3], 1, 1); get(b[2], 0, 4);
+            get(r[2], 0, 4); get(b[3], 0, 1); get(b[3], 2, 1); get(r[3], 0, 4);
+            get(g[2], 4, 1); get(b[3], 3, 1);
+            endpointBits = 11; deltaBits[0] = 4; deltaBits[1] = 5; deltaBits[2] = 4;
+            break;
+        case 0x0a:
+            get(r[0], 0, 10); get(g[0], 0, 10); get(b[0], 0, 10);
+            get(r[1], 0, 4); get(r[0], 10, 1); get(b[2], 4, 1); get(g[2], 0, 4);
+            get(g[1], 0, 4); get(g[0], 10, 1); get(b[3], 0, 1); get(g[3], 0, 4);
+            get(b[1], 0, 5); get(b[0], 10, 1); get(b[2], 0, 4);
+            get(r[2], 0, 4); get(b[3], 1, 1); get(b[3], 2, 1); get(r[3], 0, 4);
+            get(b[3], 4, 1); get(b[3], 3, 1);
+            endpointBits = 11; deltaBits[0] = deltaBits[1] = 4; deltaBits[2] = 5;
+            break;
+        case 0x0e:
+            get(r[0], 0, 9); get(b[2], 4, 1); get(g[0], 0, 9); get(g[2], 4, 1);
+            get(b[0], 0, 9); get(b[3], 4, 1);
+            get(r[1], 0, 5); get(g[3], 4, 1); get(g[2], 0, 4);
+            get(g[1], 0, 5); get(b[3], 0, 1); get(g[3], 0, 4);
+            get(b[1], 0, 5); get(b[3], 1, 1); get(b[2], 0, 4);
+            get(r[2], 0, 5); get(b[3], 2, 1); get(r[3], 0, 5); get(b[3], 3, 1);
+            endpointBits = 9; deltaBits[0] = deltaBits[1] = deltaBits[2] = 5;
+            break;
+        case 0x12:
+            get(r[0], 0, 8); get(g[3], 4, 1); get(b[2], 4, 1);
+            get(g[0], 0, 8); get(b[3], 2, 1); get(g[2], 4, 1);
+            get(b[0], 0, 8); get(b[3], 3, 1); get(b[3], 4, 1);
+            get(r[1], 0, 6); get(g[2], 0, 4); get(g[1], 0, 5); get(b[3], 0, 1);
+            get(g[3], 0, 4); get(b[1], 0, 5); get(b[3], 1, 1); get(b[2], 0, 4);
+            get(r[2], 0, 6); get(r[3], 0, 6);
+            endpointBits = 8; deltaBits[0] = 6; deltaBits[1] = deltaBits[2] = 5;
+            break;
+        case 0x16:
+            get(r[0], 0, 8); get(b[3], 0, 1); get(b[2], 4, 1);
+            get(g[0], 0, 8); get(g[2], 5, 1); get(g[2], 4, 1);
+            get(b[0], 0, 8); get(g[3], 5, 1); get(b[3], 4, 1);
+            get(r[1], 0, 5); get(g[3], 4, 1); get(g[2], 0, 4); get(g[1], 0, 6);
+            get(g[3], 0, 4); get(b[1], 0, 5); get(b[3], 1, 1); get(b[2], 0, 4);
+            get(r[2], 0, 5); get(b[3], 2, 1); get(r[3], 0, 5); get(b[3], 3, 1);
+            endpointBits = 8; deltaBits[0] = 5; deltaBits[1] = 6; deltaBits[2] = 5;
+            break;
+        case 0x1a:
+            get(r[0], 0, 8); get(b[3], 1, 1); get(b[2], 4, 1);
+            get(g[0], 0, 8); get(b[2], 5, 1); get(g[2], 4, 1);
+            get(b[0], 0, 8); get(b[3], 5, 1); get(b[3], 4, 1);
+            get(r[1], 0, 5); get(g[3], 4, 1); get(g[2], 0, 4); get(g[1], 0, 5);
+            get(b[3], 0, 1); get(g[3], 0, 4); get(b[1], 0, 6); get(b[2], 0, 4);
+            get(r[2], 0, 5); get(b[3], 2, 1); get(r[3], 0, 5); get(b[3], 3, 1);
+            endpointBits = 8; deltaBits[0] = deltaBits[1] = 5; deltaBits[2] = 6;
+            break;
+        case 0x1e:
+            get(r[0], 0, 6); get(g[3], 4, 1); get(b[3], 0, 1); get(b[3], 1, 1); get(b[2], 4, 1);
+            get(g[0], 0, 6); get(g[2], 5, 1); get(b[2], 5, 1); get(b[3], 2, 1); get(g[2], 4, 1);
+            get(b[0], 0, 6); get(g[3], 5, 1); get(b[3], 3, 1); get(b[3], 5, 1); get(b[3], 4, 1);
+            get(r[1], 0, 6); get(g[2], 0, 4); get(g[1], 0, 6); get(g[3], 0, 4);
+            get(b[1], 0, 6); get(b[2], 0, 4); get(r[2], 0, 6); get(r[3], 0, 6);
+            endpointBits = 6; deltaBits[0] = deltaBits[1] = deltaBits[2] = 6;
+            isTransformed = false;
+            break;
+        case 0x03:
+            get(r[0], 0, 10); get(g[0], 0, 10); get(b[0], 0, 10);
+            get(r[1], 0, 10); get(g[1], 0, 10); get(b[1], 0, 10);
+            endpointBits = 10; deltaBits[0] = deltaBits[1] = deltaBits[2] = 10;
+            isTransformed = false;
+            isSingleRegion = true;
+            break;
+        case 0x07:
+            get(r[0], 0, 10); get(g[0], 0, 10); get(b[0], 0, 10);
+            get(r[1], 0, 9); get(r[0], 10, 1); get(g[1], 0, 9); get(g[0], 10, 1);
+            get(b[1], 0, 9); get(b[0], 10, 1);
+            endpointBits = 11; deltaBits[0] = deltaBits[1] = deltaBits[2] = 9;
+            isSingleRegion = true;
+            break;
+        case 0x0b:
+            get(r[0], 0, 10); get(g[0], 0, 10); get(b[0], 0, 10);
+            get(r[1], 0, 8); r[0] |= bits.readReversed(2) << 10;
+            get(g[1], 0, 8); g[0] |= bits.readReversed(2) << 10;
+            get(b[1], 0, 8); b[0] |= bits.readReversed(2) << 10;
+            endpointBits = 12; deltaBits[0] = deltaBits[1] = deltaBits[2] = 8;
+            isSingleRegion = true;
+            break;
+        case 0x0f:
+            get(r[0], 0, 10); get(g[0], 0, 10); get(b[0], 0, 10);
+            get(r[1], 0, 4); r[0] |= bits.readReversed(6) << 10;
+            get(g[1], 0, 4); g[0] |= bits.readReversed(6) << 10;
+            get(b[1], 0, 4); b[0] |= bits.readReversed(6) << 10;
+            endpointBits = 16; deltaBits[0] = deltaBits[1] = deltaBits[2] = 4;
+            isSingleRegion = true;
+            break;
+        default:
+            // Reserved modes decode to black.
+            fill(rgba, 0.0f, 0.0f, 0.0f, 1.0f);
+            return;
+    }
+
+    int partition = isSingleRegion ? 0 : (int)bits.read(5);
+    int numEndpoints = isSingleRegion ? 2 : 4;
+
+    int* endpoints[3] = {r, g, b};
+    for (int c = 0; c < 3; ++c) {
+        int* e = endpoints[c];
+        if (isSigned) {
+            e[0] = signExtend(e[0], endpointBits);
+        }
+
+        for (int i = 1; i < numEndpoints; ++i) {
+            if (isTransformed) {
+                // Deltas relative to the first endpoint
+                e[i] = (e[0] + signExtend(e[i], deltaBits[c])) & ((1 << endpointBits) - 1);
+            }
+
+            if (isSigned) {
+                e[i] = signExtend(e[i], endpointBits);
+            }
+        }
+
+        for (int i = 0; i < numEndpoints; ++i) {
+            e[i] = unquantizeBc6h(e[i], endpointBits, isSigned);
+        }
+    }
+
+    const int indexBits = isSingleRegion ? 4 : 3;
+    const int* weights = weightsForBits(indexBits);
+    int numSubsets = isSingleRegion ? 1 : 2;
+
+    for (int i = 0; i < 16; ++i) {
+        int index = (int)bits.read(indexBits - (isAnchor(numSubsets, partition, i) ? 1 : 0));
+        int subset = subsetOf(numSubsets, partition, i);
+        for (int c = 0; c < 3; ++c) {
+            int value = interpolate(endpoints[c][subset * 2], endpoints[c][subset * 2 + 1], weights[index]);
+            rgba[i * 4 + c] = finishUnquantizeBc6h(value, isSigned);
+        }
+        rgba[i * 4 + 3] = 1.0f;
+    }
+}
+
+void decodeBc7(const uint8_t* block, float* rgba) {
+    BlockBits bits{block};
+
+    int modeIndex = 0;
+    while (modeIndex < 8 && bits.read(1) == 0) {
+        ++modeIndex;
+    }
+
+    // Invalid blocks decode to transparent black.
+    if (modeIndex == 8) {
+        fill(rgba, 0.0f, 0.0f, 0.0f, 0.0f);
+        return;
+    }
+
+    const Bc7Mode& mode = bc7Modes[modeIndex];
+    int partition = (int)bits.read(mode.partitionBits);
+    int rotation = (int)bits.read(mode.rotationBits);
+    int indexSelection = (int)bits.read(mode.indexSelectionBits);
+
+    const int numEndpoints = mode.numSubsets * 2;
+    int endpoints[6][4] = {};
+    for (int c = 0; c < 3; ++c) {
+        for (int e = 0; e < numEndpoints; ++e) {
+            endpoints[e][c] = (int)bits.read(mode.colorBits);
+        }
+    }
+
+    for (int e = 0; e < numEndpoints; ++e) {
+        endpoints[e][3] = (int)bits.read(mode.alphaBits);
+    }
+
+    int colorPrecision = mode.colorBits;
+    int alphaPrecision = mode.alphaBits;
+    if (mode.endpointPBits || mode.sharedPBits) {
+        int pBits[6];
+        if (mode.endpointPBits) {
+            for (int e = 0; e < numEndpoints; ++e) {
+                pBits[e] = (int)bits.read(1);
+            }
+        } else {
+            for (int s = 0; s < mode.numSubsets; ++s) {
+                pBits[s * 2] = pBits[s * 2 + 1] = (int)bits.read(1);
+            }
+        }
+
+        for (int e = 0; e < numEndpoints; ++e) {
+            for (int c = 0; c < 4; ++c) {
+                endpoints[e][c] = (endpoints[e][c] << 1) | pBits[e];
+            }
+        }
+
+        ++colorPrecision;
+        if (alphaPrecision > 0) {
+            ++alphaPrecision;
+        }
+    }
+
+    // Expand endpoints to 8 bits by replicating their most significant bits.
+    for (int e = 0; e < numEndpoints; ++e) {
+        for (int c = 0; c < 3; ++c) {
+            int v = endpoints[e][c] << (8 - colorPrecision);
+            endpoints[e][c] = v | (v >> colorPrecision);
+        }
+
+        if (alphaPrecision > 0) {
+            int v = endpoints[e][3] << (8 - alphaPrecision);
+            endpoints[e][3] = v | (v >> alphaPrecision);
+        } else {
+            endpoints[e][3] = 255;
+        }
+    }
+
+    int indices[16];
+    for (int i = 0; i < 16; ++i) {
+        indices[i] = (int)bits.read(mode.indexBits - (isAnchor(mode.numSubsets, partition, i) ? 1 : 0));
+    }
+
+    int secondaryIndices[16] = {};
+    if (mode.secondaryIndexBits > 0) {
+        for (int i = 0; i < 16; ++i) {
+            secondaryIndices[i] = (int)bits.read(mode.secondaryIndexBits - (i == 0 ? 1 : 0));
+        }
+    }
+
+    for (int i = 0; i < 16; ++i) {
+        const int* e0 = endpoints[subsetOf(mode.numSubsets, partition, i) * 2];
+        const int* e1 = e0 + 4;
+
+        int colorIndex = indices[i], alphaIndex = indices[i];
+        int colorIndexBits = mode.indexBits, alphaIndexBits = mode.indexBits;
+        if (mode.secondaryIndexBits > 0) {
+            alphaIndex = secondaryIndices[i];
+            alphaIndexBits = mode.secondaryIndexBits;
+            if (indexSelection) {
+                swap(colorIndex, alphaIndex);
+                swap(colorIndexBits, alphaIndexBits);
+            }
+        }
+
+        int color[4];
+        for (int c = 0; c < 3; ++c) {
+            color[c] = interpolate(e0[c], e1[c], weightsForBits(colorIndexBits)[colorIndex]);
+        }
+        color[3] = interpolate(e0[3], e1[3], weightsForBits(alphaIndexBits)[alphaIndex]);
+
+        if (rotation > 0) {
+            swap(color[3], color[rotation - 1]);
+        }
+
+        for (int c = 0; c < 4; ++c) {
+            rgba[i * 4 + c] = color[c] / 255.0f;
+        }
+    }
+}
+
+TEV_NAMESPACE_END
@@ -12,15 +12,8 @@ using namespace std;
 
 TEV_NAMESPACE_BEGIN
 
-bool ClipboardImageLoader::canLoadFile(istream& iStream) const {
-    char b[4];
-    iStream.read(b, sizeof(b));
-
-    bool result = !!iStream && iStream.gcount() == sizeof(b) && string(b, sizeof(b)) == "clip";
-
-    iStream.clear();
-    iStream.seekg(0);
-    return result;
+vector<string> ClipboardImageLoader::magicNumbers() const {
+    return {"clip"};
 }
 
 ImageData ClipboardImageLoader::load(istream& iStream, const path&, const string& channelSelector, bool& hasPremultipliedAlpha) const {
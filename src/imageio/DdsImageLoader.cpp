@@ -12,15 +12,8 @@ using namespace std;
 
 TEV_NAMESPACE_BEGIN
 
-bool DdsImageLoader::canLoadFile(istream& iStream) const {
-    char b[4];
-    iStream.read(b, sizeof(b));
-
-    bool result = !!iStream && iStream.gcount() == sizeof(b) && b[0] == 'D' && b[1] == 'D' && b[2] == 'S' && b[3] == ' ';
-
-    iStream.clear();
-    iStream.seekg(0);
-    return result;
+vector<string> DdsImageLoader::magicNumbers() const {
+    return {"DDS "};
 }
 
 static int getDxgiChannelCount(DXGI_FORMAT fmt) {
@@ -153,6 +146,27 @@ static int getDxgiChannelCount(DXGI_FORMAT fmt) {
     }
 }
 
+bool DdsImageLoader::loadHeader(istream& iStream, const path&, const string&, ImageHeader& header) const {
+    // The metadata is fully contained in the magic number, DDS_HEADER, and the optional
+    // DDS_HEADER_DXT10, so there is no need to read the remainder of the file.
+    vector<char> data(4 + 124 + 20);
+    iStream.read(data.data(), data.size());
+
+    DirectX::TexMetadata metadata;
+    if (DirectX::GetMetadataFromDDSMemory(data.data(), (size_t)iStream.gcount(), DirectX::DDS_FLAGS_NONE, metadata) != S_OK) {
+        throw invalid_argument{"Failed to read DDS header."};
+    }
+
+    int numChannels = getDxgiChannelCount(metadata.format);
+    if (numChannels == 0) {
+        throw invalid_argument{tfm::format("Unsupported DXGI format: %d", static_cast<int>(metadata.format))};
+    }
+
+    header.size = {(int)metadata.width, (int)metadata.height};
+    header.channels = makeNChannelNames(numChannels);
+    return true;
+}
+
 ImageData DdsImageLoader::load(istream& iStream, const path&, const string& channelSelector, bool& hasPremultipliedAlpha) const {
     // COM must be initialized on the thread executing load().
     if (CoInitializeEx(nullptr, COINIT_MULTITHREADED) != S_OK) {
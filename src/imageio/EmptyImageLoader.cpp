@@ -11,15 +11,8 @@ using namespace std;
 
 TEV_NAMESPACE_BEGIN
 
-bool EmptyImageLoader::canLoadFile(istream& iStream) const {
-    char b[5];
-    iStream.read(b, sizeof(b));
-
-    bool result = !!iStream && iStream.gcount() == sizeof(b) && string(b, sizeof(b)) == "empty";
-
-    iStream.clear();
-    iStream.seekg(0);
-    return result;
+vector<string> EmptyImageLoader::magicNumbers() const {
+    return {"empty"};
 }
 
 ImageData EmptyImageLoader::load(istream& iStream, const path&, const string&, bool& hasPremultipliedAlpha) const {
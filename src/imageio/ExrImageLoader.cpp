@@ -8,8 +8,10 @@
 #include <ImfInputFile.h>
 #include <ImfInputPart.h>
 #include <ImfMultiPartInputFile.h>
+#include <ImfStandardAttributes.h>
 #include <Iex.h>
 
+#include <array>
 #include <istream>
 
 #include <errno.h>
@@ -74,16 +76,9 @@ private:
     istream& mStream;
 };
 
-bool ExrImageLoader::canLoadFile(istream& iStream) const {
+vector<string> ExrImageLoader::magicNumbers() const {
     // Taken from http://www.openexr.com/ReadingAndWritingImageFiles.pdf
-    char b[4];
-    iStream.read(b, sizeof(b));
-
-    bool result = !!iStream && iStream.gcount() == sizeof(b) && b[0] == 0x76 && b[1] == 0x2f && b[2] == 0x31 && b[3] == 0x01;
-
-    iStream.clear();
-    iStream.seekg(0);
-    return result;
+    return {"\x76\x2f\x31\x01"};
 }
 
 // Helper class for dealing with the raw channels loaded from an exr file.
@@ -137,6 +132,19 @@ public:
         return mName;
     }
 
+    Imf::PixelType type() const {
+        return mImfChannel.type;
+    }
+
+    bool isSubsampled() const {
+        return mImfChannel.xSampling != 1 || mImfChannel.ySampling != 1;
+    }
+
+    template <typename T>
+    const T* typedData() const {
+        return reinterpret_cast<const T*>(mData.data());
+    }
+
 private:
     int bytesPerPixel() const {
         switch (mImfChannel.type) {
@@ -153,34 +161,85 @@ private:
     vector<char> mData;
 };
 
-ImageData ExrImageLoader::load(istream& iStream, const path& path, const string& channelSelector, bool& hasPremultipliedAlpha) const {
-    ImageData result;
+// Copies the R, G, and B channels of a layer while converting them to Rec.709 primaries, such
+// that the conversion needs no additional pass over the pixels.
+template <typename T>
+void copyRgbTyped(const array<const RawChannel*, 3>& rawChannels, const array<Channel*, 3>& channels, const Matrix3f& toRec709, vector<future<void>>& futures) {
+    const T* r = rawChannels[0]->typedData<T>();
+    const T* g = rawChannels[1]->typedData<T>();
+    const T* b = rawChannels[2]->typedData<T>();
+
+    int width = channels[0]->size().x();
+    gThreadPool->parallelForAsync<int>(0, channels[0]->size().y(), [r, g, b, channels, toRec709, width](int y) {
+        for (DenseIndex i = y * (DenseIndex)width; i < (y + 1) * (DenseIndex)width; ++i) {
+            Vector3f rgb = toRec709 * Vector3f{(float)r[i], (float)g[i], (float)b[i]};
+            for (int c = 0; c < 3; ++c) {
+                channels[c]->at(i) = rgb[c];
+            }
+        }
+    }, futures);
+}
+
+void copyRgb(const array<const RawChannel*, 3>& rawChannels, const array<Channel*, 3>& channels, const Matrix3f& toRec709, vector<future<void>>& futures) {
+    switch (rawChannels[0]->type()) {
+        case Imf::HALF:
+            copyRgbTyped<::half>(rawChannels, channels, toRec709, futures); break;
+        case Imf::FLOAT:
+            copyRgbTyped<float>(rawChannels, channels, toRec709, futures); break;
+        case Imf::UINT:
+            copyRgbTyped<uint32_t>(rawChannels, channels, toRec709, futures); break;
+        default:
+            throw runtime_error("Invalid pixel type encountered.");
+    }
+}
+
+// Finds the first part containing a channel that matches the given channelSelector.
+int findPart(Imf::MultiPartInputFile& multiPartFile, const string& channelSelector) {
+    for (int i = 0; i < multiPartFile.parts(); ++i) {
+        const Imf::ChannelList& imfChannels = multiPartFile.header(i).channels();
+        for (Imf::ChannelList::ConstIterator c = imfChannels.begin(); c != imfChannels.end(); ++c) {
+            if (matchesFuzzy(c.name(), channelSelector)) {
+                return i;
+            }
+        }
+    }
 
+    return 0;
+}
+
+bool ExrImageLoader::loadHeader(istream& iStream, const path& path, const string& channelSelector, ImageHeader& header) const {
     StdIStream stdIStream{iStream, path.str().c_str()};
     Imf::MultiPartInputFile multiPartFile{stdIStream};
-    int numParts = multiPartFile.parts();
 
-    if (numParts <= 0) {
+    if (multiPartFile.parts() <= 0) {
         throw invalid_argument{"EXR image does not contain any parts."};
     }
 
-    // Find the first part containing a channel that matches the given channelSubstr.
-    int partIdx = 0;
-    for (int i = 0; i < numParts; ++i) {
-        Imf::InputPart part{multiPartFile, i};
+    // Only the header of the part is read; pixels are not touched until readPixels().
+    const Imf::Header& partHeader = multiPartFile.header(findPart(multiPartFile, channelSelector));
+    Imath::Box2i dw = partHeader.dataWindow();
+    header.size = {dw.max.x - dw.min.x + 1 , dw.max.y - dw.min.y + 1};
 
-        const Imf::ChannelList& imfChannels = part.header().channels();
+    const Imf::ChannelList& imfChannels = partHeader.channels();
+    for (Imf::ChannelList::ConstIterator c = imfChannels.begin(); c != imfChannels.end(); ++c) {
+        header.channels.emplace_back(c.name());
+    }
 
-        for (Imf::ChannelList::ConstIterator c = imfChannels.begin(); c != imfChannels.end(); ++c) {
-            if (matchesFuzzy(c.name(), channelSelector)) {
-                partIdx = i;
-                goto l_foundPart;
-            }
-        }
+    return true;
+}
+
+ImageData ExrImageLoader::load(istream& iStream, const path& path, const string& channelSelector, bool& hasPremultipliedAlpha) const {
+    ImageData result;
+
+    StdIStream stdIStream{iStream, path.str().c_str()};
+    Imf::MultiPartInputFile multiPartFile{stdIStream};
+    int numParts = multiPartFile.parts();
+
+    if (numParts <= 0) {
+        throw invalid_argument{"EXR image does not contain any parts."};
     }
-l_foundPart:
 
-    Imf::InputPart file{multiPartFile, partIdx};
+    Imf::InputPart file{multiPartFile, findPart(multiPartFile, channelSelector)};
     Imath::Box2i dw = file.header().dataWindow();
     Vector2i size = {dw.max.x - dw.min.x + 1 , dw.max.y - dw.min.y + 1};
 
@@ -237,12 +296,78 @@ l_foundPart:
         result.channels.emplace_back(Channel{rawChannel.name(), size});
     }
 
+    // Primaries other than those of sRGB, e.g. of ACEScg or Rec.2020, are converted to the
+    // sRGB primaries that are displayed. Barely differing primaries are left alone, such that
+    // common images load as fast as before.
+    if (Imf::hasChromaticities(file.header())) {
+        const auto& chroma = Imf::chromaticities(file.header());
+        Matrix3f toRec709 = toRec709Matrix(
+            {chroma.red.x, chroma.red.y}, {chroma.green.x, chroma.green.y},
+            {chroma.blue.x, chroma.blue.y}, {chroma.white.x, chroma.white.y}
+        );
+
+        if (!toRec709.isIdentity(1e-3f)) {
+            result.toRec709 = toRec709;
+        }
+    }
+
+    auto findChannel = [&](const string& name) {
+        auto it = find_if(begin(rawChannels), end(rawChannels), [&](const RawChannel& c) { return c.name() == name; });
+        return it == end(rawChannels) ? -1 : (int)(it - begin(rawChannels));
+    };
+
+    vector<bool> isCopied(rawChannels.size(), false);
+    vector<array<size_t, 3>> rgbToConvert;
+    if (!result.toRec709.isIdentity()) {
+        for (const auto& layer : result.layers) {
+            string prefix = layer.empty() ? "" : (layer + ".");
+            array<int, 3> indices = {findChannel(prefix + "R"), findChannel(prefix + "G"), findChannel(prefix + "B")};
+            if (find(begin(indices), end(indices), -1) == end(indices)) {
+                rgbToConvert.push_back({(size_t)indices[0], (size_t)indices[1], (size_t)indices[2]});
+            }
+        }
+    }
+
+    // Only the names of the converted channels are kept, since the raw values of the file
+    // are computed through the inverse conversion if they are ever shown.
+    for (const auto& rgb : rgbToConvert) {
+        for (size_t index : rgb) {
+            result.convertedChannels.emplace_back(rawChannels[index].name());
+        }
+    }
+
     vector<future<void>> futures;
+    for (const auto& rgb : rgbToConvert) {
+        array<const RawChannel*, 3> raw = {&rawChannels[rgb[0]], &rawChannels[rgb[1]], &rawChannels[rgb[2]]};
+        bool canFuse = all_of(begin(raw), end(raw), [&](const RawChannel* c) { return c->type() == raw[0]->type() && !c->isSubsampled(); });
+        if (canFuse) {
+            copyRgb(raw, {&result.channels[rgb[0]], &result.channels[rgb[1]], &result.channels[rgb[2]]}, result.toRec709, futures);
+            isCopied[rgb[0]] = isCopied[rgb[1]] = isCopied[rgb[2]] = true;
+        }
+    }
+
     for (size_t i = 0; i < rawChannels.size(); ++i) {
-        rawChannels[i].copyTo(result.channels[i], futures);
+        if (!isCopied[i]) {
+            rawChannels[i].copyTo(result.channels[i], futures);
+        }
     }
     waitAll(futures);
 
+    // Subsampled or mixed-type channels are converted after copying them.
+    for (const auto& rgb : rgbToConvert) {
+        if (isCopied[rgb[0]]) {
+            continue;
+        }
+
+        array<Channel*, 3> channels = {&result.channels[rgb[0]], &result.channels[rgb[1]], &result.channels[rgb[2]]};
+        gThreadPool->parallelFor<DenseIndex>(0, channels[0]->count(), [&](DenseIndex i) {
+            Vector3f converted = result.toRec709 * Vector3f{channels[0]->at(i), channels[1]->at(i), channels[2]->at(i)};
+            for (int c = 0; c < 3; ++c) {
+                channels[c]->at(i) = converted[c];
+            }
+        });
+    }
+
     hasPremultipliedAlpha = true;
 
     return result;
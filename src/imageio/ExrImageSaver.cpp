@@ -59,7 +59,7 @@ private:
     ostream& mStream;
 };
 
-void ExrImageSaver::save(ostream& oStream, const path& path, const vector<float>& data, const Vector2i& imageSize, int nChannels) const {
+void ExrImageSaver::save(ostream& oStream, const path& path, const PooledVector<float>& data, const Vector2i& imageSize, int nChannels) const {
     vector<string> channelNames = {
         "R", "G", "B", "A",
     };
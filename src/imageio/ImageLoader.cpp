@@ -6,47 +6,268 @@
 #include <tev/imageio/ExrImageLoader.h>
 #include <tev/imageio/ImageLoader.h>
 #include <tev/imageio/PfmImageLoader.h>
+#include <tev/imageio/PnmImageLoader.h>
+#include <tev/imageio/PortableDdsImageLoader.h>
+#include <tev/imageio/RawImageLoader.h>
 #include <tev/imageio/StbiImageLoader.h>
+#include <tev/imageio/SyntheticImageLoader.h>
 #ifdef _WIN32
 #   include <tev/imageio/DdsImageLoader.h>
 #endif
+#include <tev/MemoryStream.h>
+
+#include <algorithm>
 
 using namespace Eigen;
+using namespace filesystem;
 using namespace std;
 
 TEV_NAMESPACE_BEGIN
 
-const vector<unique_ptr<ImageLoader>>& ImageLoader::getLoaders() {
-    auto makeLoaders = [] {
-        vector<unique_ptr<ImageLoader>> imageLoaders;
-        imageLoaders.emplace_back(new ExrImageLoader());
-        imageLoaders.emplace_back(new PfmImageLoader());
-        imageLoaders.emplace_back(new ClipboardImageLoader());
-        imageLoaders.emplace_back(new EmptyImageLoader());
+namespace {
+
+struct MagicNumber {
+    string bytes;
+    const ImageLoader* loader;
+};
+
+struct LoaderRegistry {
+    vector<unique_ptr<ImageLoader>> loaders;
+    vector<int> priorities;
+
+    // The magic numbers of all loaders in the order of the loaders, such that the first match
+    // belongs to the loader with the highest priority.
+    vector<MagicNumber> magicNumbers;
+    size_t maxMagicNumberSize = 0;
+
+    void add(unique_ptr<ImageLoader> loader, int priority) {
+        // Loaders of equal priority keep the order in which they were registered.
+        auto position = upper_bound(begin(priorities), end(priorities), priority, greater<int>{}) - begin(priorities);
+        loaders.insert(begin(loaders) + position, move(loader));
+        priorities.insert(begin(priorities) + position, priority);
+
+        magicNumbers.clear();
+        for (const auto& l : loaders) {
+            for (auto& bytes : l->magicNumbers()) {
+                maxMagicNumberSize = max(maxMagicNumberSize, bytes.size());
+                magicNumbers.push_back({move(bytes), l.get()});
+            }
+        }
+    }
+};
+
+LoaderRegistry& registry() {
+    auto makeRegistry = [] {
+        LoaderRegistry result;
+        result.add(make_unique<ExrImageLoader>(), 0);
+        result.add(make_unique<PfmImageLoader>(), 0);
+        result.add(make_unique<PnmImageLoader>(), 0);
+        result.add(make_unique<ClipboardImageLoader>(), 0);
+        result.add(make_unique<EmptyImageLoader>(), 0);
+        result.add(make_unique<SyntheticImageLoader>(), 0);
 #ifdef _WIN32
-        imageLoaders.emplace_back(new DdsImageLoader());
+        result.add(make_unique<DdsImageLoader>(), 0);
+#else
+        result.add(make_unique<PortableDdsImageLoader>(), 0);
 #endif
-        imageLoaders.emplace_back(new StbiImageLoader());
-        return imageLoaders;
+        result.add(make_unique<RawImageLoader>(), 0);
+        result.add(make_unique<StbiImageLoader>(), 0);
+        return result;
     };
 
-    static const vector<unique_ptr<ImageLoader>> imageLoaders = makeLoaders();
-    return imageLoaders;
+    static LoaderRegistry loaderRegistry = makeRegistry();
+    return loaderRegistry;
 }
 
-vector<Channel> ImageLoader::makeNChannels(int numChannels, Vector2i size) {
-    vector<Channel> channels;
+bool hasExtension(const ImageLoader& loader, const string& extension) {
+    auto extensions = loader.extensions();
+    return find(begin(extensions), end(extensions), extension) != end(extensions);
+}
+
+}
+
+void ImageLoader::registerLoader(unique_ptr<ImageLoader> loader, int priority) {
+    registry().add(move(loader), priority);
+}
+
+const vector<unique_ptr<ImageLoader>>& ImageLoader::getLoaders() {
+    return registry().loaders;
+}
+
+const ImageLoader& ImageLoader::findLoader(istream& iStream, const path& path) {
+    const auto& loaderRegistry = registry();
+
+    string header(loaderRegistry.maxMagicNumberSize, '\0');
+    iStream.read(&header[0], header.size());
+    header.resize(max<streamsize>(iStream.gcount(), 0));
+
+    iStream.clear();
+    iStream.seekg(0);
+
+    // Loaders that claim the path, e.g. through a sidecar file, take precedence over magic
+    // numbers, since their formats consist of arbitrary bytes that may happen to match one.
+    for (const auto& loader : loaderRegistry.loaders) {
+        if (loader->canLoadPath(path)) {
+            return *loader;
+        }
+    }
+
+    string extension = toLower(path.extension());
+
+    // Among the loaders whose magic number matches, the extension picks one if it can.
+    const ImageLoader* match = nullptr;
+    for (const auto& magicNumber : loaderRegistry.magicNumbers) {
+        if (header.compare(0, magicNumber.bytes.size(), magicNumber.bytes) != 0) {
+            continue;
+        }
+
+        if (hasExtension(*magicNumber.loader, extension)) {
+            return *magicNumber.loader;
+        }
+
+        if (!match) {
+            match = magicNumber.loader;
+        }
+    }
+
+    if (match) {
+        return *match;
+    }
+
+    for (const auto& loader : loaderRegistry.loaders) {
+        if (hasExtension(*loader, extension)) {
+            return *loader;
+        }
+    }
+
+    throw invalid_argument{"Unknown image format."};
+}
+
+const vector<pair<string, string>>& ImageLoader::supportedFormats() {
+    static const vector<pair<string, string>> formats = {
+        // HDR formats
+        {"exr",  "OpenEXR image"},
+        {"hdr",  "HDR image"},
+        {"pfm",  "Portable Float Map image"},
+        {"raw",  "Raw binary image"},
+        // LDR formats
+        {"bmp",  "Bitmap Image File"},
+        {"dds",  "DirectDraw Surface image"},
+        {"gif",  "Graphics Interchange Format image"},
+        {"jpg",  "JPEG image"},
+        {"jpeg", "JPEG image"},
+        {"pam",  "Portable Arbitrary Map image"},
+        {"pic",  "PIC image"},
+        {"pgm",  "Portable GrayMap image"},
+        {"png",  "Portable Network Graphics image"},
+        {"pnm",  "Portable AnyMap image"},
+        {"ppm",  "Portable PixMap image"},
+        {"psd",  "PSD image"},
+        {"tga",  "Truevision TGA image"},
+        // Containers
+        {"gz",   "Gzip-compressed image"},
+        {"zip",  "Zip archive of images"},
+    };
+
+    return formats;
+}
+
+vector<string> ImageLoader::makeNChannelNames(int numChannels) {
+    vector<string> names;
     if (numChannels > 1) {
         const vector<string> channelNames = {"R", "G", "B", "A"};
         for (int c = 0; c < numChannels; ++c) {
-            string name = c < (int)channelNames.size() ? channelNames[c] : to_string(c);
-            channels.emplace_back(name, size);
+            names.emplace_back(c < (int)channelNames.size() ? channelNames[c] : to_string(c));
         }
     } else {
-        channels.emplace_back("L", size);
+        names.emplace_back("L");
+    }
+
+    return names;
+}
+
+vector<Channel> ImageLoader::makeNChannels(int numChannels, Vector2i size) {
+    vector<Channel> channels;
+    for (const auto& name : makeNChannelNames(numChannels)) {
+        channels.emplace_back(name, size);
     }
 
     return channels;
 }
 
+vector<char> ImageLoader::readHeaderBytes(istream& iStream, size_t maxBytes) {
+    vector<char> result(maxBytes);
+    iStream.clear();
+    iStream.seekg(0);
+    iStream.read(result.data(), (streamsize)result.size());
+    result.resize((size_t)iStream.gcount());
+
+    iStream.clear();
+    iStream.seekg(0);
+    return result;
+}
+
+size_t ImageLoader::streamSize(istream& iStream) {
+    auto memoryStream = dynamic_cast<MemoryStream*>(&iStream);
+    if (memoryStream && !memoryStream->isComplete()) {
+        throw invalid_argument{"The size of the decompressed file is unknown."};
+    }
+
+    iStream.clear();
+    iStream.seekg(0, ios_base::end);
+    auto end = iStream.tellg();
+    iStream.clear();
+    iStream.seekg(0);
+    if (end < 0) {
+        throw invalid_argument{"Cannot determine the size of the stream."};
+    }
+
+    return (size_t)end;
+}
+
+Matrix3f ImageLoader::toRec709Matrix(Vector2f red, Vector2f green, Vector2f blue, Vector2f white) {
+    // Chromaticities come from the file and must lie in the unit triangle with y > 0, since
+    // y is divided by below. Anything else would turn every pixel into NaN or infinity.
+    for (const Vector2f& xy : {red, green, blue, white}) {
+        if (!xy.allFinite() || xy.x() < 0 || xy.y() <= 0 || xy.sum() > 1) {
+            tlog::warning() << tfm::format("Ignoring invalid chromaticity (%f, %f).", xy.x(), xy.y());
+            return Matrix3f::Identity();
+        }
+    }
+
+    auto toXyz = [](Vector2f xy) {
+        return Vector3d{xy.x() / xy.y(), 1.0, (1.0 - xy.x() - xy.y()) / xy.y()};
+    };
+
+    auto rgbToXyz = [&](Vector2f r, Vector2f g, Vector2f b, Vector2f w) {
+        Matrix3d result;
+        result << toXyz(r), toXyz(g), toXyz(b);
+        // Scale the primaries such that RGB (1, 1, 1) maps to the white point.
+        Vector3d scale = result.inverse() * toXyz(w);
+        return Matrix3d{result * scale.asDiagonal()};
+    };
+
+    const Vector2f rec709White = {0.3127f, 0.3290f};
+    Matrix3d rec709ToXyz = rgbToXyz({0.64f, 0.33f}, {0.30f, 0.60f}, {0.15f, 0.06f}, rec709White);
+
+    // Bradford chromatic adaptation from the white point of the image to that of Rec.709.
+    Matrix3d bradford;
+    bradford <<
+        0.8951, 0.2664, -0.1614,
+        -0.7502, 1.7135, 0.0367,
+        0.0389, -0.0685, 1.0296;
+
+    Vector3d coneScale = (bradford * toXyz(rec709White)).cwiseQuotient(bradford * toXyz(white));
+    Matrix3d adaptation = bradford.inverse() * coneScale.asDiagonal() * bradford;
+
+    Matrix3f result = (rec709ToXyz.inverse() * adaptation * rgbToXyz(red, green, blue, white)).cast<float>();
+    // Collinear primaries span no gamut and hence have no conversion.
+    if (!result.allFinite()) {
+        tlog::warning() << "Ignoring degenerate chromaticities.";
+        return Matrix3f::Identity();
+    }
+
+    return result;
+}
+
 TEV_NAMESPACE_END
@@ -10,27 +10,12 @@ using namespace std;
 
 TEV_NAMESPACE_BEGIN
 
-bool PfmImageLoader::canLoadFile(istream& iStream) const {
-    char b[2];
-    iStream.read(b, sizeof(b));
-
-    bool result = !!iStream && iStream.gcount() == sizeof(b) && b[0] == 'P' && (b[1] == 'F' || b[1] == 'f');
-
-    iStream.clear();
-    iStream.seekg(0);
-    return result;
-}
-
-ImageData PfmImageLoader::load(istream& iStream, const path&, const string& channelSelector, bool& hasPremultipliedAlpha) const {
-    ImageData result;
+namespace {
 
+void readHeader(istream& iStream, Vector2i& size, int& numChannels, float& scale) {
     string magic;
-    Vector2i size;
-    float scale;
-
     iStream >> magic >> size.x() >> size.y() >> scale;
 
-    int numChannels;
     if (magic == "Pf") {
         numChannels = 1;
     } else if (magic == "PF") {
@@ -44,6 +29,29 @@ ImageData PfmImageLoader::load(istream& iStream, const path&, const string& chan
     if (!isfinite(scale) || scale == 0) {
         throw invalid_argument{tfm::format("Invalid PFM scale %f", scale)};
     }
+}
+
+}
+
+vector<string> PfmImageLoader::magicNumbers() const {
+    return {"PF", "Pf"};
+}
+
+bool PfmImageLoader::loadHeader(istream& iStream, const path&, const string&, ImageHeader& header) const {
+    int numChannels;
+    float scale;
+    readHeader(iStream, header.size, numChannels, scale);
+    header.channels = makeNChannelNames(numChannels);
+    return true;
+}
+
+ImageData PfmImageLoader::load(istream& iStream, const path&, const string& channelSelector, bool& hasPremultipliedAlpha) const {
+    ImageData result;
+
+    Vector2i size;
+    int numChannels;
+    float scale;
+    readHeader(iStream, size, numChannels, scale);
 
     bool isPfmLittleEndian = scale < 0;
     scale = abs(scale);
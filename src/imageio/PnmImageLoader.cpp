@@ -0,0 +1,301 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the BSD 3-Clause License within the LICENSE file.
+
+#include <tev/imageio/PnmImageLoader.h>
+#include <tev/MemoryMappedFile.h>
+#include <tev/ThreadPool.h>
+
+#include <cctype>
+#include <limits>
+
+using namespace Eigen;
+using namespace filesystem;
+using namespace std;
+
+TEV_NAMESPACE_BEGIN
+
+namespace {
+
+// Headers are short, even with comments. Longer ones are only read by a full load.
+const size_t MAX_HEADER_BYTES = 64 * 1024;
+
+// Tokenizes the textual header of PNM files, which consists of whitespace-separated
+// tokens interspersed with comments that start with '#' and extend to the end of the line.
+class HeaderReader {
+public:
+    HeaderReader(const char* data, size_t size) : mData{data}, mSize{size} {}
+
+    string token() {
+        skipWhitespaceAndComments();
+
+        size_t start = mPosition;
+        while (mPosition < mSize && !isspace((unsigned char)mData[mPosition])) {
+            ++mPosition;
+        }
+
+        return string{mData + start, mPosition - start};
+    }
+
+    int integer(const char* name) {
+        string str = token();
+        char* end;
+        long value = strtol(str.c_str(), &end, 10);
+        if (str.empty() || *end != '\0' || value < 0 || value > numeric_limits<int>::max()) {
+            throw invalid_argument{tfm::format("Invalid PNM %s '%s'.", name, str)};
+        }
+        return (int)value;
+    }
+
+    string line() {
+        skipWhitespaceAndComments();
+
+        size_t start = mPosition;
+        while (mPosition < mSize && mData[mPosition] != '\n') {
+            ++mPosition;
+        }
+
+        size_t end = mPosition;
+        while (end > start && isspace((unsigned char)mData[end - 1])) {
+            --end;
+        }
+
+        return string{mData + start, end - start};
+    }
+
+    // The raster starts after exactly one whitespace character following the header.
+    size_t rasterOffset() const {
+        return mPosition + 1;
+    }
+
+private:
+    void skipWhitespaceAndComments() {
+        while (mPosition < mSize) {
+            if (mData[mPosition] == '#') {
+                while (mPosition < mSize && mData[mPosition] != '\n') {
+                    ++mPosition;
+                }
+            } else if (isspace((unsigned char)mData[mPosition])) {
+                ++mPosition;
+            } else {
+                break;
+            }
+        }
+    }
+
+    const char* mData;
+    size_t mSize;
+    size_t mPosition = 0;
+};
+
+struct PnmHeader {
+    Vector2i size;
+    int numChannels;
+    int maxValue;
+    string tupleType;
+    size_t rasterOffset;
+};
+
+PnmHeader readHeader(const char* data, size_t dataSize) {
+    HeaderReader header{data, dataSize};
+    PnmHeader result;
+
+    string magic = header.token();
+    Vector2i& size = result.size;
+    int& numChannels = result.numChannels;
+    int& maxValue = result.maxValue;
+    string& tupleType = result.tupleType;
+
+    if (magic == "P5" || magic == "P6") {
+        size.x() = header.integer("width");
+        size.y() = header.integer("height");
+        maxValue = header.integer("maxval");
+        numChannels = magic == "P5" ? 1 : 3;
+        tupleType = magic == "P5" ? "GRAYSCALE" : "RGB";
+    } else if (magic == "P7") {
+        size = {-1, -1};
+        numChannels = -1;
+        maxValue = -1;
+
+        while (true) {
+            istringstream lineStream{header.line()};
+            string key;
+            lineStream >> key;
+
+            if (key == "ENDHDR") {
+                break;
+            } else if (key.empty()) {
+                throw invalid_argument{"PAM header is missing ENDHDR."};
+            } else if (key == "WIDTH") {
+                lineStream >> size.x();
+            } else if (key == "HEIGHT") {
+                lineStream >> size.y();
+            } else if (key == "DEPTH") {
+                lineStream >> numChannels;
+            } else if (key == "MAXVAL") {
+                lineStream >> maxValue;
+            } else if (key == "TUPLTYPE") {
+                // Multiple TUPLTYPE lines are concatenated.
+                string type;
+                getline(lineStream >> ws, type);
+                tupleType += tupleType.empty() ? type : " " + type;
+            }
+
+            if (!lineStream && !lineStream.eof()) {
+                throw invalid_argument{tfm::format("Invalid PAM header entry %s.", key)};
+            }
+        }
+
+        if (size.x() < 0 || size.y() < 0 || numChannels <= 0 || maxValue < 0) {
+            throw invalid_argument{"PAM header is missing WIDTH, HEIGHT, DEPTH, or MAXVAL."};
+        }
+    } else {
+        throw invalid_argument{tfm::format("Invalid magic PNM string %s", magic)};
+    }
+
+    if (maxValue < 1 || maxValue > 65535) {
+        throw invalid_argument{tfm::format("Invalid PNM maxval %d", maxValue)};
+    }
+
+    if ((DenseIndex)size.x() * size.y() == 0) {
+        throw invalid_argument{"Image has zero pixels."};
+    }
+
+    result.rasterOffset = header.rasterOffset();
+    return result;
+}
+
+bool hasAlpha(const PnmHeader& header) {
+    const auto& tupleType = header.tupleType;
+    return tupleType.size() > 6 && tupleType.compare(tupleType.size() - 6, 6, "_ALPHA") == 0;
+}
+
+bool isGrayscale(const PnmHeader& header) {
+    return header.tupleType.rfind("GRAYSCALE", 0) == 0 || header.tupleType.rfind("BLACKANDWHITE", 0) == 0;
+}
+
+// Grayscale images get a luminance channel rather than the generic channel names.
+vector<string> grayscaleChannelNames(const PnmHeader& header) {
+    if (!isGrayscale(header) || header.numChannels != (hasAlpha(header) ? 2 : 1)) {
+        return {};
+    }
+
+    return hasAlpha(header) ? vector<string>{"L", "A"} : vector<string>{"L"};
+}
+
+}
+
+vector<string> PnmImageLoader::magicNumbers() const {
+    // Only the binary variants are supported. The magic number must be followed by whitespace.
+    vector<string> result;
+    for (const char* magic : {"P5", "P6", "P7"}) {
+        for (const char* whitespace : {" ", "\t", "\n", "\r"}) {
+            result.emplace_back(string{magic} + whitespace);
+        }
+    }
+
+    return result;
+}
+
+bool PnmImageLoader::loadHeader(istream& iStream, const path&, const string&, ImageHeader& header) const {
+    auto bytes = readHeaderBytes(iStream, MAX_HEADER_BYTES);
+    PnmHeader pnmHeader = readHeader(bytes.data(), bytes.size());
+
+    header.size = pnmHeader.size;
+    header.channels = grayscaleChannelNames(pnmHeader);
+    if (header.channels.empty()) {
+        header.channels = makeNChannelNames(pnmHeader.numChannels);
+    }
+
+    return true;
+}
+
+ImageData PnmImageLoader::load(istream& iStream, const path& path, const string& channelSelector, bool& hasPremultipliedAlpha) const {
+    ImageData result;
+
+    MemoryMappedFile file{iStream, path};
+    PnmHeader header = readHeader(file.data(), file.size());
+
+    const Vector2i size = header.size;
+    const int numChannels = header.numChannels;
+    const int maxValue = header.maxValue;
+
+    // WIDTH, HEIGHT, and DEPTH of PAM files may each be up to INT_MAX, so their product is
+    // computed such that it can not overflow.
+    const size_t bytesPerSample = maxValue < 256 ? 1 : 2;
+    const size_t rasterOffset = header.rasterOffset;
+    uint64_t rowBytes, rasterEnd;
+    if (!mulAddWithin((uint64_t)size.x() * bytesPerSample, (uint64_t)numChannels, 0, file.size(), rowBytes) ||
+        !mulAddWithin(rowBytes, (uint64_t)size.y(), rasterOffset, file.size(), rasterEnd)) {
+        throw invalid_argument{tfm::format("Not sufficient bytes to read the %dx%d pixels of %d channels.", size.x(), size.y(), numChannels)};
+    }
+
+    auto channelNames = grayscaleChannelNames(header);
+    if (channelNames.empty()) {
+        channelNames = makeNChannelNames(numChannels);
+    }
+
+    // Only selected channels are decoded, which matters for PAM files with many channels.
+    vector<pair<size_t, size_t>> matches;
+    for (size_t i = 0; i < channelNames.size(); ++i) {
+        size_t matchId;
+        if (matchesFuzzy(channelNames[i], channelSelector, &matchId)) {
+            matches.emplace_back(matchId, i);
+        }
+    }
+
+    if (!channelSelector.empty()) {
+        sort(begin(matches), end(matches));
+    }
+
+    for (const auto& match : matches) {
+        result.channels.emplace_back(channelNames[match.second], size);
+    }
+
+    bool isColor = isGrayscale(header) || header.tupleType.rfind("RGB", 0) == 0;
+
+    // Samples of known color tuple types are sRGB-encoded like those of other LDR formats;
+    // everything else (e.g. PAM files with custom tuple types) is considered linear data.
+    // Since the samples are integers, every possible value is converted up front into a
+    // lookup table, avoiding a pow() per sample.
+    const float scale = 1.0f / maxValue;
+    vector<float> colorLut(maxValue + 1);
+    for (int v = 0; v <= maxValue; ++v) {
+        colorLut[v] = isColor ? toLinear(v * scale) : v * scale;
+    }
+
+    const int alphaChannel = hasAlpha(header) ? numChannels - 1 : -1;
+    const uint8_t* raster = reinterpret_cast<const uint8_t*>(file.data()) + rasterOffset;
+
+    gThreadPool->parallelFor<int>(0, size.y(), [&](int y) {
+        const uint8_t* row = raster + (size_t)y * rowBytes;
+        for (size_t i = 0; i < matches.size(); ++i) {
+            int c = (int)matches[i].second;
+            float* dst = &result.channels[i].at({0, y});
+            const float* lut = c == alphaChannel ? nullptr : colorLut.data();
+
+            if (bytesPerSample == 1) {
+                for (int x = 0; x < size.x(); ++x) {
+                    uint8_t v = row[(size_t)x * numChannels + c];
+                    dst[x] = lut ? lut[min((int)v, maxValue)] : v * scale;
+                }
+            } else {
+                // 16-bit samples are big-endian.
+                for (int x = 0; x < size.x(); ++x) {
+                    const uint8_t* sample = row + ((size_t)x * numChannels + c) * 2;
+                    int v = (sample[0] << 8) | sample[1];
+                    dst[x] = lut ? lut[min(v, maxValue)] : v * scale;
+                }
+            }
+        }
+    });
+
+    // PNM can not contain layers, so all channels simply reside
+    // within a topmost root layer.
+    result.layers.emplace_back("");
+
+    hasPremultipliedAlpha = false;
+
+    return result;
+}
+
+TEV_NAMESPACE_END
@@ -0,0 +1,782 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the BSD 3-Clause License within the LICENSE file.
+
+#include <tev/imageio/BcnDecoder.h>
+#include <tev/imageio/PortableDdsImageLoader.h>
+#include <tev/MemoryMappedFile.h>
+#include <tev/ThreadPool.h>
+
+#include <half.h>
+
+#include <cstring>
+#include <limits>
+#include <tuple>
+
+using namespace Eigen;
+using namespace filesystem;
+using namespace std;
+
+TEV_NAMESPACE_BEGIN
+
+namespace {
+
+// The DXGI_FORMAT values (see dxgiformat.h) of all formats that this loader can decode.
+enum EDxgiFormat : uint32_t {
+    DXGI_R32G32B32A32_TYPELESS = 1,
+    DXGI_R32G32B32A32_FLOAT = 2,
+    DXGI_R32G32B32A32_UINT = 3,
+    DXGI_R32G32B32A32_SINT = 4,
+    DXGI_R32G32B32_TYPELESS = 5,
+    DXGI_R32G32B32_FLOAT = 6,
+    DXGI_R32G32B32_UINT = 7,
+    DXGI_R32G32B32_SINT = 8,
+    DXGI_R16G16B16A16_TYPELESS = 9,
+    DXGI_R16G16B16A16_FLOAT = 10,
+    DXGI_R16G16B16A16_UNORM = 11,
+    DXGI_R16G16B16A16_UINT = 12,
+    DXGI_R16G16B16A16_SNORM = 13,
+    DXGI_R16G16B16A16_SINT = 14,
+    DXGI_R32G32_TYPELESS = 15,
+    DXGI_R32G32_FLOAT = 16,
+    DXGI_R32G32_UINT = 17,
+    DXGI_R32G32_SINT = 18,
+    DXGI_R32G8X24_TYPELESS = 19,
+    DXGI_D32_FLOAT_S8X24_UINT = 20,
+    DXGI_R32_FLOAT_X8X24_TYPELESS = 21,
+    DXGI_X32_TYPELESS_G8X24_UINT = 22,
+    DXGI_R10G10B10A2_TYPELESS = 23,
+    DXGI_R10G10B10A2_UNORM = 24,
+    DXGI_R10G10B10A2_UINT = 25,
+    DXGI_R11G11B10_FLOAT = 26,
+    DXGI_R8G8B8A8_TYPELESS = 27,
+    DXGI_R8G8B8A8_UNORM = 28,
+    DXGI_R8G8B8A8_UNORM_SRGB = 29,
+    DXGI_R8G8B8A8_UINT = 30,
+    DXGI_R8G8B8A8_SNORM = 31,
+    DXGI_R8G8B8A8_SINT = 32,
+    DXGI_R16G16_TYPELESS = 33,
+    DXGI_R16G16_FLOAT = 34,
+    DXGI_R16G16_UNORM = 35,
+    DXGI_R16G16_UINT = 36,
+    DXGI_R16G16_SNORM = 37,
+    DXGI_R16G16_SINT = 38,
+    DXGI_R32_TYPELESS = 39,
+    DXGI_D32_FLOAT = 40,
+    DXGI_R32_FLOAT = 41,
+    DXGI_R32_UINT = 42,
+    DXGI_R32_SINT = 43,
+    DXGI_R24G8_TYPELESS = 44,
+    DXGI_D24_UNORM_S8_UINT = 45,
+    DXGI_R24_UNORM_X8_TYPELESS = 46,
+    DXGI_X24_TYPELESS_G8_UINT = 47,
+    DXGI_R8G8_TYPELESS = 48,
+    DXGI_R8G8_UNORM = 49,
+    DXGI_R8G8_UINT = 50,
+    DXGI_R8G8_SNORM = 51,
+    DXGI_R8G8_SINT = 52,
+    DXGI_R16_TYPELESS = 53,
+    DXGI_R16_FLOAT = 54,
+    DXGI_D16_UNORM = 55,
+    DXGI_R16_UNORM = 56,
+    DXGI_R16_UINT = 57,
+    DXGI_R16_SNORM = 58,
+    DXGI_R16_SINT = 59,
+    DXGI_R8_TYPELESS = 60,
+    DXGI_R8_UNORM = 61,
+    DXGI_R8_UINT = 62,
+    DXGI_R8_SNORM = 63,
+    DXGI_R8_SINT = 64,
+    DXGI_A8_UNORM = 65,
+    DXGI_R9G9B9E5_SHAREDEXP = 67,
+    DXGI_BC1_TYPELESS = 70,
+    DXGI_BC1_UNORM = 71,
+    DXGI_BC1_UNORM_SRGB = 72,
+    DXGI_BC2_TYPELESS = 73,
+    DXGI_BC2_UNORM = 74,
+    DXGI_BC2_UNORM_SRGB = 75,
+    DXGI_BC3_TYPELESS = 76,
+    DXGI_BC3_UNORM = 77,
+    DXGI_BC3_UNORM_SRGB = 78,
+    DXGI_BC4_TYPELESS = 79,
+    DXGI_BC4_UNORM = 80,
+    DXGI_BC4_SNORM = 81,
+    DXGI_BC5_TYPELESS = 82,
+    DXGI_BC5_UNORM = 83,
+    DXGI_BC5_SNORM = 84,
+    DXGI_B5G6R5_UNORM = 85,
+    DXGI_B5G5R5A1_UNORM = 86,
+    DXGI_B8G8R8A8_UNORM = 87,
+    DXGI_B8G8R8X8_UNORM = 88,
+    DXGI_R10G10B10_XR_BIAS_A2_UNORM = 89,
+    DXGI_B8G8R8A8_TYPELESS = 90,
+    DXGI_B8G8R8A8_UNORM_SRGB = 91,
+    DXGI_B8G8R8X8_TYPELESS = 92,
+    DXGI_B8G8R8X8_UNORM_SRGB = 93,
+    DXGI_BC6H_TYPELESS = 94,
+    DXGI_BC6H_UF16 = 95,
+    DXGI_BC6H_SF16 = 96,
+    DXGI_BC7_TYPELESS = 97,
+    DXGI_BC7_UNORM = 98,
+    DXGI_BC7_UNORM_SRGB = 99,
+    DXGI_B4G4R4A4_UNORM = 115,
+};
+
+// Header flags, see https://docs.microsoft.com/en-us/windows/win32/direct3ddds/dds-header
+const uint32_t DDPF_ALPHAPIXELS = 0x1;
+const uint32_t DDPF_ALPHA = 0x2;
+const uint32_t DDPF_FOURCC = 0x4;
+const uint32_t DDPF_RGB = 0x40;
+const uint32_t DDPF_LUMINANCE = 0x20000;
+const uint32_t DDPF_BUMPDUDV = 0x80000;
+
+const uint32_t DDSCAPS2_CUBEMAP = 0x200;
+const uint32_t DDSCAPS2_VOLUME = 0x200000;
+
+const uint32_t DDS_RESOURCE_DIMENSION_TEXTURE3D = 4;
+const uint32_t DDS_RESOURCE_MISC_TEXTURECUBE = 0x4;
+const uint32_t DDS_ALPHA_MODE_PREMULTIPLIED = 2;
+
+constexpr uint32_t makeFourCC(char a, char b, char c, char d) {
+    return (uint32_t)(uint8_t)a | ((uint32_t)(uint8_t)b << 8) | ((uint32_t)(uint8_t)c << 16) | ((uint32_t)(uint8_t)d << 24);
+}
+
+enum class ECompression {
+    None,
+    BC1,
+    BC2,
+    BC3,
+    BC4,
+    BC5,
+    BC6H,
+    BC7,
+};
+
+enum class EComponentType {
+    UNorm,
+    SNorm,
+    UInt,
+    SInt,
+    Float,
+    // Unsigned 10 and 11 bit floats of R11G11B10_FLOAT
+    SmallFloat,
+    // Extended range color of R10G10B10_XR_BIAS_A2_UNORM
+    XrBias,
+};
+
+struct Component {
+    int bitOffset;
+    int numBits;
+    EComponentType type;
+};
+
+struct DdsFormat {
+    ECompression compression = ECompression::None;
+    bool isSigned = false;
+    bool isSharedExponent = false;
+    bool isFloat = false;
+
+    // Bytes per pixel for uncompressed formats and bytes per 4x4 block otherwise
+    size_t numBytes = 0;
+
+    int numChannels = 0;
+    Component components[4];
+};
+
+DdsFormat compressed(ECompression compression, int numChannels, bool isSigned = false) {
+    DdsFormat result;
+    result.compression = compression;
+    result.isSigned = isSigned;
+    result.isFloat = compression == ECompression::BC6H;
+    result.numBytes = compression == ECompression::BC1 || compression == ECompression::BC4 ? 8 : 16;
+    result.numChannels = numChannels;
+    return result;
+}
+
+DdsFormat uncompressed(size_t numBytes, initializer_list<Component> components) {
+    DdsFormat result;
+    result.numBytes = numBytes;
+    result.numChannels = (int)components.size();
+    copy(begin(components), end(components), result.components);
+    result.isFloat = result.components[0].type == EComponentType::Float || result.components[0].type == EComponentType::SmallFloat;
+    return result;
+}
+
+// Formats whose channels are equally sized and tightly packed in RGBA order.
+DdsFormat packed(int numChannels, int numBits, EComponentType type) {
+    DdsFormat result;
+    result.numBytes = numChannels * numBits / 8;
+    result.numChannels = numChannels;
+    for (int c = 0; c < numChannels; ++c) {
+        result.components[c] = {c * numBits, numBits, type};
+    }
+    result.isFloat = type == EComponentType::Float;
+    return result;
+}
+
+bool toDdsFormat(uint32_t dxgiFormat, DdsFormat& format) {
+    using T = EComponentType;
+    switch (dxgiFormat) {
+        case DXGI_R32G32B32A32_TYPELESS:
+        case DXGI_R32G32B32A32_FLOAT: format = packed(4, 32, T::Float); return true;
+        case DXGI_R32G32B32A32_UINT: format = packed(4, 32, T::UInt); return true;
+        case DXGI_R32G32B32A32_SINT: format = packed(4, 32, T::SInt); return true;
+        case DXGI_R32G32B32_TYPELESS:
+        case DXGI_R32G32B32_FLOAT: format = packed(3, 32, T::Float); return true;
+        case DXGI_R32G32B32_UINT: format = packed(3, 32, T::UInt); return true;
+        case DXGI_R32G32B32_SINT: format = packed(3, 32, T::SInt); return true;
+        case DXGI_R16G16B16A16_TYPELESS:
+        case DXGI_R16G16B16A16_FLOAT: format = packed(4, 16, T::Float); return true;
+        case DXGI_R16G16B16A16_UNORM: format = packed(4, 16, T::UNorm); return true;
+        case DXGI_R16G16B16A16_UINT: format = packed(4, 16, T::UInt); return true;
+        case DXGI_R16G16B16A16_SNORM: format = packed(4, 16, T::SNorm); return true;
+        case DXGI_R16G16B16A16_SINT: format = packed(4, 16, T::SInt); return true;
+        case DXGI_R32G32_TYPELESS:
+        case DXGI_R32G32_FLOAT: format = packed(2, 32, T::Float); return true;
+        case DXGI_R32G32_UINT: format = packed(2, 32, T::UInt); return true;
+        case DXGI_R32G32_SINT: format = packed(2, 32, T::SInt); return true;
+        case DXGI_R32G8X24_TYPELESS:
+        case DXGI_D32_FLOAT_S8X24_UINT: format = uncompressed(8, {{0, 32, T::Float}, {32, 8, T::UInt}}); return true;
+        case DXGI_R32_FLOAT_X8X24_TYPELESS: format = uncompressed(8, {{0, 32, T::Float}}); return true;
+        case DXGI_X32_TYPELESS_G8X24_UINT: format = uncompressed(8, {{32, 8, T::UInt}}); return true;
+        case DXGI_R10G10B10A2_TYPELESS:
+        case DXGI_R10G10B10A2_UNORM: format = uncompressed(4, {{0, 10, T::UNorm}, {10, 10, T::UNorm}, {20, 10, T::UNorm}, {30, 2, T::UNorm}}); return true;
+        case DXGI_R10G10B10A2_UINT: format = uncompressed(4, {{0, 10, T::UInt}, {10, 10, T::UInt}, {20, 10, T::UInt}, {30, 2, T::UInt}}); return true;
+        case DXGI_R11G11B10_FLOAT: format = uncompressed(4, {{0, 11, T::SmallFloat}, {11, 11, T::SmallFloat}, {22, 10, T::SmallFloat}}); return true;
+        case DXGI_R8G8B8A8_TYPELESS:
+        case DXGI_R8G8B8A8_UNORM:
+        case DXGI_R8G8B8A8_UNORM_SRGB: format = packed(4, 8, T::UNorm); return true;
+        case DXGI_R8G8B8A8_UINT: format = packed(4, 8, T::UInt); return true;
+        case DXGI_R8G8B8A8_SNORM: format = packed(4, 8, T::SNorm); return true;
+        case DXGI_R8G8B8A8_SINT: format = packed(4, 8, T::SInt); return true;
+        case DXGI_R16G16_TYPELESS:
+        case DXGI_R16G16_FLOAT: format = packed(2, 16, T::Float); return true;
+        case DXGI_R16G16_UNORM: format = packed(2, 16, T::UNorm); return true;
+        case DXGI_R16G16_UINT: format = packed(2, 16, T::UInt); return true;
+        case DXGI_R16G16_SNORM: format = packed(2, 16, T::SNorm); return true;
+        case DXGI_R16G16_SINT: format = packed(2, 16, T::SInt); return true;
+        case DXGI_R32_TYPELESS:
+        case DXGI_D32_FLOAT:
+        case DXGI_R32_FLOAT: format = packed(1, 32, T::Float); return true;
+        case DXGI_R32_UINT: format = packed(1, 32, T::UInt); return true;
+        case DXGI_R32_SINT: format = packed(1, 32, T::SInt); return true;
+        case DXGI_R24G8_TYPELESS:
+        case DXGI_D24_UNORM_S8_UINT: format = uncompressed(4, {{0, 24, T::UNorm}, {24, 8, T::UInt}}); return true;
+        case DXGI_R24_UNORM_X8_TYPELESS: format = uncompressed(4, {{0, 24, T::UNorm}}); return true;
+        case DXGI_X24_TYPELESS_G8_UINT: format = uncompressed(4, {{24, 8, T::UInt}}); return true;
+        case DXGI_R8G8_TYPELESS:
+        case DXGI_R8G8_UNORM: format = packed(2, 8, T::UNorm); return true;
+        case DXGI_R8G8_UINT: format = packed(2, 8, T::UInt); return true;
+        case DXGI_R8G8_SNORM: format = packed(2, 8, T::SNorm); return true;
+        case DXGI_R8G8_SINT: format = packed(2, 8, T::SInt); return true;
+        case DXGI_R16_TYPELESS:
+        case DXGI_R16_FLOAT: format = packed(1, 16, T::Float); return true;
+        case DXGI_D16_UNORM:
+        case DXGI_R16_UNORM: format = packed(1, 16, T::UNorm); return true;
+        case DXGI_R16_UINT: format = packed(1, 16, T::UInt); return true;
+        case DXGI_R16_SNORM: format = packed(1, 16, T::SNorm); return true;
+        case DXGI_R16_SINT: format = packed(1, 16, T::SInt); return true;
+        case DXGI_R8_TYPELESS:
+        case DXGI_R8_UNORM:
+        case DXGI_A8_UNORM: format = packed(1, 8, T::UNorm); return true;
+        case DXGI_R8_UINT: format = packed(1, 8, T::UInt); return true;
+        case DXGI_R8_SNORM: format = packed(1, 8, T::SNorm); return true;
+        case DXGI_R8_SINT: format = packed(1, 8, T::SInt); return true;
+        case DXGI_R9G9B9E5_SHAREDEXP:
+            format = uncompressed(4, {{0, 9, T::UInt}, {9, 9, T::UInt}, {18, 9, T::UInt}});
+            format.isSharedExponent = true;
+            format.isFloat = true;
+            return true;
+        case DXGI_BC1_TYPELESS:
+        case DXGI_BC1_UNORM:
+        case DXGI_BC1_UNORM_SRGB: format = compressed(ECompression::BC1, 4); return true;
+        case DXGI_BC2_TYPELESS:
+        case DXGI_BC2_UNORM:
+        case DXGI_BC2_UNORM_SRGB: format = compressed(ECompression::BC2, 4); return true;
+        case DXGI_BC3_TYPELESS:
+        case DXGI_BC3_UNORM:
+        case DXGI_BC3_UNORM_SRGB: format = compressed(ECompression::BC3, 4); return true;
+        case DXGI_BC4_TYPELESS:
+        case DXGI_BC4_UNORM: format = compressed(ECompression::BC4, 1); return true;
+        case DXGI_BC4_SNORM: format = compressed(ECompression::BC4, 1, true); return true;
+        case DXGI_BC5_TYPELESS:
+        case DXGI_BC5_UNORM: format = compressed(ECompression::BC5, 2); return true;
+        case DXGI_BC5_SNORM: format = compressed(ECompression::BC5, 2, true); return true;
+        case DXGI_B5G6R5_UNORM: format = uncompressed(2, {{11, 5, T::UNorm}, {5, 6, T::UNorm}, {0, 5, T::UNorm}}); return true;
+        case DXGI_B5G5R5A1_UNORM: format = uncompressed(2, {{10, 5, T::UNorm}, {5, 5, T::UNorm}, {0, 5, T::UNorm}, {15, 1, T::UNorm}}); return true;
+        case DXGI_B8G8R8A8_TYPELESS:
+        case DXGI_B8G8R8A8_UNORM:
+        case DXGI_B8G8R8A8_UNORM_SRGB: format = uncompressed(4, {{16, 8, T::UNorm}, {8, 8, T::UNorm}, {0, 8, T::UNorm}, {24, 8, T::UNorm}}); return true;
+        case DXGI_B8G8R8X8_TYPELESS:
+        case DXGI_B8G8R8X8_UNORM:
+        case DXGI_B8G8R8X8_UNORM_SRGB: format = uncompressed(4, {{16, 8, T::UNorm}, {8, 8, T::UNorm}, {0, 8, T::UNorm}}); return true;
+        case DXGI_R10G10B10_XR_BIAS_A2_UNORM: format = uncompressed(4, {{0, 10, T::XrBias}, {10, 10, T::XrBias}, {20, 10, T::XrBias}, {30, 2, T::UNorm}}); return true;
+        case DXGI_BC6H_TYPELESS:
+        case DXGI_BC6H_UF16: format = compressed(ECompression::BC6H, 3); return true;
+        case DXGI_BC6H_SF16: format = compressed(ECompression::BC6H, 3, true); return true;
+        case DXGI_BC7_TYPELESS:
+        case DXGI_BC7_UNORM:
+        case DXGI_BC7_UNORM_SRGB: format = compressed(ECompression::BC7, 4); return true;
+        case DXGI_B4G4R4A4_UNORM: format = uncompressed(2, {{8, 4, T::UNorm}, {4, 4, T::UNorm}, {0, 4, T::UNorm}, {12, 4, T::UNorm}}); return true;
+        default: return false;
+    }
+}
+
+int countTrailingZeros(uint32_t value) {
+    int result = 0;
+    while (result < 32 && !(value & (1u << result))) {
+        ++result;
+    }
+    return result;
+}
+
+int countBits(uint32_t value) {
+    int result = 0;
+    for (; value; value &= value - 1) {
+        ++result;
+    }
+    return result;
+}
+
+// Pre-DX10 files describe their pixel format by a FourCC code or by bit masks.
+bool toLegacyDdsFormat(uint32_t flags, uint32_t fourCC, uint32_t bitCount, const uint32_t masks[4], DdsFormat& format, bool& isPremultiplied) {
+    isPremultiplied = false;
+
+    if (flags & DDPF_FOURCC) {
+        switch (fourCC) {
+            case makeFourCC('D', 'X', 'T', '1'): return toDdsFormat(DXGI_BC1_UNORM, format);
+            case makeFourCC('D', 'X', 'T', '2'): isPremultiplied = true; return toDdsFormat(DXGI_BC2_UNORM, format);
+            case makeFourCC('D', 'X', 'T', '3'): return toDdsFormat(DXGI_BC2_UNORM, format);
+            case makeFourCC('D', 'X', 'T', '4'): isPremultiplied = true; return toDdsFormat(DXGI_BC3_UNORM, format);
+            case makeFourCC('D', 'X', 'T', '5'): return toDdsFormat(DXGI_BC3_UNORM, format);
+            case makeFourCC('A', 'T', 'I', '1'):
+            case makeFourCC('B', 'C', '4', 'U'): return toDdsFormat(DXGI_BC4_UNORM, format);
+            case makeFourCC('B', 'C', '4', 'S'): return toDdsFormat(DXGI_BC4_SNORM, format);
+            case makeFourCC('A', 'T', 'I', '2'):
+            case makeFourCC('B', 'C', '5', 'U'): return toDdsFormat(DXGI_BC5_UNORM, format);
+            case makeFourCC('B', 'C', '5', 'S'): return toDdsFormat(DXGI_BC5_SNORM, format);
+            // D3DFORMAT values that are stored in the FourCC field
+            case 36: return toDdsFormat(DXGI_R16G16B16A16_UNORM, format);
+            case 110: return toDdsFormat(DXGI_R16G16B16A16_SNORM, format);
+            case 111: return toDdsFormat(DXGI_R16_FLOAT, format);
+            case 112: return toDdsFormat(DXGI_R16G16_FLOAT, format);
+            case 113: return toDdsFormat(DXGI_R16G16B16A16_FLOAT, format);
+            case 114: return toDdsFormat(DXGI_R32_FLOAT, format);
+            case 115: return toDdsFormat(DXGI_R32G32_FLOAT, format);
+            case 116: return toDdsFormat(DXGI_R32G32B32A32_FLOAT, format);
+            default: return false;
+        }
+    }
+
+    if (!(flags & (DDPF_RGB | DDPF_LUMINANCE | DDPF_ALPHA | DDPF_BUMPDUDV)) || bitCount == 0 || bitCount > 32 || bitCount % 8 != 0) {
+        return false;
+    }
+
+    // Arbitrary bit masks are decoded generically, which covers all the D3DFMT
+    // variants such as A8R8G8B8, X8R8G8B8, R5G6B5, A4L4, or V8U8 alike.
+    EComponentType type = (flags & DDPF_BUMPDUDV) ? EComponentType::SNorm : EComponentType::UNorm;
+    vector<uint32_t> channelMasks;
+    if (flags & DDPF_ALPHA) {
+        channelMasks = {masks[3]};
+    } else {
+        for (int c = 0; c < 3; ++c) {
+            if (masks[c]) {
+                channelMasks.emplace_back(masks[c]);
+            }
+        }
+
+        if ((flags & DDPF_ALPHAPIXELS) && masks[3]) {
+            channelMasks.emplace_back(masks[3]);
+        }
+    }
+
+    if (channelMasks.empty()) {
+        return false;
+    }
+
+    // Masks beyond the pixel's bits would make readComponent read into the next pixel or
+    // past the end of the file.
+    for (uint32_t mask : channelMasks) {
+        if (bitCount < 32 && (mask >> bitCount) != 0) {
+            return false;
+        }
+    }
+
+    format = DdsFormat{};
+    format.numBytes = bitCount / 8;
+    format.numChannels = (int)channelMasks.size();
+    for (int c = 0; c < format.numChannels; ++c) {
+        format.components[c] = {countTrailingZeros(channelMasks[c]), countBits(channelMasks[c]), type};
+    }
+
+    return true;
+}
+
+float toFloat(uint32_t value, const Component& component) {
+    switch (component.type) {
+        case EComponentType::UNorm:
+            return (float)((double)value / (double)((1ull << component.numBits) - 1));
+        case EComponentType::SNorm: {
+            int shift = 32 - component.numBits;
+            int32_t signedValue = (int32_t)(value << shift) >> shift;
+            return max((float)signedValue / (float)((1u << (component.numBits - 1)) - 1), -1.0f);
+        }
+        case EComponentType::UInt:
+            return (float)value;
+        case EComponentType::SInt: {
+            int shift = 32 - component.numBits;
+            return (float)((int32_t)(value << shift) >> shift);
+        }
+        case EComponentType::Float:
+            if (component.numBits == 16) {
+                ::half result;
+                result.setBits((uint16_t)value);
+                return result;
+            } else {
+                float result;
+                memcpy(&result, &value, sizeof(float));
+                return result;
+            }
+        case EComponentType::SmallFloat: {
+            // 10 and 11 bit floats share the exponent layout of half floats and lack the sign.
+            ::half result;
+            result.setBits((uint16_t)(value << (16 - 1 - component.numBits)));
+            return result;
+        }
+        case EComponentType::XrBias:
+            return ((int)value - 0x180) / 510.0f;
+    }
+
+    return 0.0f;
+}
+
+uint32_t readComponent(const uint8_t* pixel, size_t numBytes, const Component& component) {
+    if (component.bitOffset % 8 == 0 && component.numBits % 8 == 0) {
+        uint32_t result = 0;
+        for (int i = 0; i < component.numBits / 8; ++i) {
+            result |= (uint32_t)pixel[component.bitOffset / 8 + i] << (8 * i);
+        }
+        return result;
+    }
+
+    uint64_t word = 0;
+    for (size_t i = 0; i < min(numBytes, sizeof(word)); ++i) {
+        word |= (uint64_t)pixel[i] << (8 * i);
+    }
+
+    return (uint32_t)((word >> component.bitOffset) & ((1ull << component.numBits) - 1));
+}
+
+void decodeBlock(const DdsFormat& format, const uint8_t* block, float* rgba) {
+    switch (format.compression) {
+        case ECompression::BC1: decodeBc1(block, rgba); break;
+        case ECompression::BC2: decodeBc2(block, rgba); break;
+        case ECompression::BC3: decodeBc3(block, rgba); break;
+        case ECompression::BC4: decodeBc4(block, rgba, format.isSigned); break;
+        case ECompression::BC5: decodeBc5(block, rgba, format.isSigned); break;
+        case ECompression::BC6H: decodeBc6h(block, rgba, format.isSigned); break;
+        case ECompression::BC7: decodeBc7(block, rgba); break;
+        case ECompression::None: break;
+    }
+}
+
+size_t surfaceBytes(const DdsFormat& format, Vector2i size) {
+    if (format.compression != ECompression::None) {
+        return (((size_t)size.x() + 3) / 4) * (((size_t)size.y() + 3) / 4) * format.numBytes;
+    }
+    return (size_t)size.x() * size.y() * format.numBytes;
+}
+
+// Decodes a single 2D surface into the channels starting at `channels`.
+void decodeSurface(const DdsFormat& format, const uint8_t* data, Vector2i size, bool isSrgb, Channel* channels) {
+    const int numChannels = format.numChannels;
+    const int numColorChannels = isSrgb ? min(numChannels, 3) : 0;
+
+    if (format.compression != ECompression::None) {
+        const int numBlocksX = (size.x() + 3) / 4;
+        const int numBlocksY = (size.y() + 3) / 4;
+
+        // Decode in parallel over rows of blocks. Each block is decoded into a small
+        // RGBA tile that is then scattered into the channels.
+        gThreadPool->parallelFor<int>(0, numBlocksY, [&](int blockY) {
+            float rgba[16 * 4];
+            for (int blockX = 0; blockX < numBlocksX; ++blockX) {
+                decodeBlock(format, data + ((size_t)blockY * numBlocksX + blockX) * format.numBytes, rgba);
+
+                int numPixelsX = min(4, size.x() - blockX * 4);
+                int numPixelsY = min(4, size.y() - blockY * 4);
+                for (int y = 0; y < numPixelsY; ++y) {
+                    for (int x = 0; x < numPixelsX; ++x) {
+                        const float* pixel = &rgba[(y * 4 + x) * 4];
+                        Vector2i pos = {blockX * 4 + x, blockY * 4 + y};
+                        for (int c = 0; c < numChannels; ++c) {
+                            channels[c].at(pos) = c < numColorChannels ? toLinear(pixel[c]) : pixel[c];
+                        }
+                    }
+                }
+            }
+        });
+
+        return;
+    }
+
+    gThreadPool->parallelFor<int>(0, size.y(), [&](int y) {
+        const uint8_t* row = data + (size_t)y * size.x() * format.numBytes;
+        for (int x = 0; x < size.x(); ++x) {
+            const uint8_t* pixel = row + (size_t)x * format.numBytes;
+
+            if (format.isSharedExponent) {
+                uint32_t word = readComponent(pixel, format.numBytes, {0, 32, EComponentType::UInt});
+                float scale = ldexp(1.0f, (int)(word >> 27) - 15 - 9);
+                for (int c = 0; c < numChannels; ++c) {
+                    channels[c].at({x, y}) = readComponent(pixel, format.numBytes, format.components[c]) * scale;
+                }
+                continue;
+            }
+
+            for (int c = 0; c < numChannels; ++c) {
+                const Component& component = format.components[c];
+                float value = toFloat(readComponent(pixel, format.numBytes, component), component);
+                channels[c].at({x, y}) = c < numColorChannels ? toLinear(value) : value;
+            }
+        }
+    });
+}
+
+uint32_t readUInt32(const uint8_t* data) {
+    return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+struct Surface {
+    size_t offset;
+    string layer;
+};
+
+struct DdsLayout {
+    Vector2i size;
+    DdsFormat format;
+    vector<Surface> surfaces;
+    bool hasPremultipliedAlpha;
+};
+
+// Parses the DDS header and determines which surfaces (cube faces, array slices,
+// or depth slices) are stored where in the file.
+// The magic number, DDS_HEADER, and DDS_HEADER_DXT10.
+const size_t MAX_HEADER_BYTES = 4 + 124 + 20;
+
+// Only reads the headers from `data`, which must hold at least MAX_HEADER_BYTES unless the
+// file is shorter.
+DdsLayout parseLayout(const uint8_t* data, size_t fileSize) {
+    DdsLayout layout;
+
+    // Magic number followed by the 124 byte DDS_HEADER
+    const size_t headerSize = 4 + 124;
+    if (fileSize < headerSize) {
+        throw invalid_argument{"DDS file is too small to contain a header."};
+    }
+
+    uint32_t width = readUInt32(data + 16);
+    uint32_t height = readUInt32(data + 12);
+    if (width == 0 || height == 0 || width > (uint32_t)numeric_limits<int>::max() || height > (uint32_t)numeric_limits<int>::max()) {
+        throw invalid_argument{tfm::format("DDS image has invalid dimensions %dx%d.", width, height)};
+    }
+
+    Vector2i& size = layout.size;
+    size = {(int)width, (int)height};
+    uint32_t depth = readUInt32(data + 24);
+    uint32_t numMips = max(readUInt32(data + 28), 1u);
+    uint32_t pixelFormatFlags = readUInt32(data + 80);
+    uint32_t fourCC = readUInt32(data + 84);
+    uint32_t caps2 = readUInt32(data + 112);
+
+    DdsFormat& format = layout.format;
+    size_t dataOffset = headerSize;
+    bool isVolume = (caps2 & DDSCAPS2_VOLUME) != 0;
+    uint32_t arraySize = 1;
+    uint32_t numFaces = 1;
+    layout.hasPremultipliedAlpha = false;
+
+    if ((pixelFormatFlags & DDPF_FOURCC) && fourCC == makeFourCC('D', 'X', '1', '0')) {
+        // Extended DDS_HEADER_DXT10
+        dataOffset += 20;
+        if (fileSize < dataOffset) {
+            throw invalid_argument{"DDS file is too small to contain a DX10 header."};
+        }
+
+        uint32_t dxgiFormat = readUInt32(data + headerSize);
+        if (!toDdsFormat(dxgiFormat, format)) {
+            throw invalid_argument{tfm::format("Unsupported DXGI format: %d", dxgiFormat)};
+        }
+
+        isVolume = readUInt32(data + headerSize + 4) == DDS_RESOURCE_DIMENSION_TEXTURE3D;
+        numFaces = (readUInt32(data + headerSize + 8) & DDS_RESOURCE_MISC_TEXTURECUBE) ? 6 : 1;
+        arraySize = max(readUInt32(data + headerSize + 12), 1u);
+        layout.hasPremultipliedAlpha = (readUInt32(data + headerSize + 16) & 0x7) == DDS_ALPHA_MODE_PREMULTIPLIED;
+    } else {
+        uint32_t masks[4] = {readUInt32(data + 92), readUInt32(data + 96), readUInt32(data + 100), readUInt32(data + 104)};
+        if (!toLegacyDdsFormat(pixelFormatFlags, fourCC, readUInt32(data + 88), masks, format, layout.hasPremultipliedAlpha)) {
+            throw invalid_argument{tfm::format("Unsupported DDS pixel format (flags %#x, FourCC %#x).", pixelFormatFlags, fourCC)};
+        }
+
+        if (caps2 & DDSCAPS2_CUBEMAP) {
+            // Legacy cube maps may omit faces; each present face sets one bit. Some writers
+            // set none of them for complete cube maps.
+            numFaces = (uint32_t)countBits(caps2 & 0xfc00);
+            if (numFaces == 0) {
+                numFaces = 6;
+            }
+        }
+    }
+
+    // No format takes less than half a byte per pixel. Checking this first keeps the sizes
+    // computed below from overflowing.
+    const size_t availableBytes = fileSize - dataOffset;
+    auto numPixels = (DenseIndex)size.x() * size.y();
+    if ((size_t)numPixels / 2 > availableBytes) {
+        throw invalid_argument{tfm::format("DDS file is truncated (%d bytes for %dx%d pixels)", fileSize, size.x(), size.y())};
+    }
+
+    const size_t topLevelBytes = surfaceBytes(format, size);
+    if (topLevelBytes > availableBytes) {
+        throw invalid_argument{tfm::format("DDS file is truncated (%d vs %d bytes)", fileSize, dataOffset + topLevelBytes)};
+    }
+
+    // Files may claim more mip levels than their size allows, which would shift by 32 or
+    // more bits below.
+    int maxNumMips = 1;
+    while ((max(size.x(), size.y()) >> maxNumMips) > 0) {
+        ++maxNumMips;
+    }
+    numMips = min(numMips, (uint32_t)maxNumMips);
+
+    uint32_t numDepthSlices = isVolume ? max(depth, 1u) : 1;
+    if (numDepthSlices > availableBytes / topLevelBytes) {
+        throw invalid_argument{tfm::format("DDS file is truncated (%d bytes for %d depth slices)", fileSize, numDepthSlices)};
+    }
+
+    // All mip levels of an array slice (or cube face) are stored contiguously before
+    // the next slice. We only decode the topmost mip level of each slice.
+    size_t sliceStride = 0;
+    for (uint32_t level = 0; level < numMips; ++level) {
+        Vector2i levelSize = {max(size.x() >> level, 1), max(size.y() >> level, 1)};
+        sliceStride += surfaceBytes(format, levelSize) * max(numDepthSlices >> level, 1u);
+    }
+
+    uint64_t numSlices = (uint64_t)arraySize * numFaces;
+    if (!isVolume && numSlices > 1 && (sliceStride > availableBytes || numSlices - 1 > (availableBytes - topLevelBytes) / sliceStride)) {
+        throw invalid_argument{tfm::format("DDS file is truncated (%d bytes for %d slices of %d bytes)", fileSize, numSlices, sliceStride)};
+    }
+
+    auto& surfaces = layout.surfaces;
+    if (isVolume) {
+        for (uint32_t z = 0; z < numDepthSlices; ++z) {
+            surfaces.push_back({dataOffset + z * topLevelBytes, tfm::format("depth%d", z)});
+        }
+    } else {
+        static const vector<string> faceNames = {"+X", "-X", "+Y", "-Y", "+Z", "-Z"};
+        for (uint32_t a = 0; a < arraySize; ++a) {
+            for (uint32_t f = 0; f < numFaces; ++f) {
+                string layer;
+                if (numFaces == 6) {
+                    layer = arraySize > 1 ? tfm::format("slice%d.%s", a, faceNames[f]) : faceNames[f];
+                } else if (numFaces > 1 || arraySize > 1) {
+                    layer = tfm::format("slice%d", a * numFaces + f);
+                }
+                surfaces.push_back({dataOffset + (a * numFaces + f) * sliceStride, layer});
+            }
+        }
+    }
+
+    // Images consisting of a single surface have their channels in the root layer.
+    if (surfaces.size() == 1) {
+        surfaces.front().layer = "";
+    }
+
+    for (const auto& surface : surfaces) {
+        if (surface.offset + topLevelBytes > fileSize) {
+            throw invalid_argument{tfm::format("DDS file is truncated (%d vs %d bytes)", fileSize, surface.offset + topLevelBytes)};
+        }
+    }
+
+    return layout;
+}
+
+}
+
+vector<string> PortableDdsImageLoader::magicNumbers() const {
+    return {"DDS "};
+}
+
+bool PortableDdsImageLoader::loadHeader(istream& iStream, const path&, const string&, ImageHeader& header) const {
+    auto bytes = readHeaderBytes(iStream, MAX_HEADER_BYTES);
+    DdsLayout layout = parseLayout(reinterpret_cast<const uint8_t*>(bytes.data()), streamSize(iStream));
+
+    header.size = layout.size;
+    for (const auto& surface : layout.surfaces) {
+        for (const auto& name : makeNChannelNames(layout.format.numChannels)) {
+            header.channels.emplace_back(surface.layer.empty() ? name : tfm::format("%s.%s", surface.layer, name));
+        }
+    }
+
+    return true;
+}
+
+ImageData PortableDdsImageLoader::load(istream& iStream, const path& path, const string& channelSelector, bool& hasPremultipliedAlpha) const {
+    ImageData result;
+
+    MemoryMappedFile file{iStream, path};
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(file.data());
+
+    DdsLayout layout = parseLayout(data, file.size());
+    const auto& format = layout.format;
+    const auto& surfaces = layout.surfaces;
+    Vector2i size = layout.size;
+    hasPremultipliedAlpha = layout.hasPremultipliedAlpha;
+
+    // Match DdsImageLoader: RGB(A) DDS images tend to be in sRGB space, even those not
+    // explicitly stored in an *_SRGB format, so all non-float color data is linearized.
+    const bool isSrgb = !format.isFloat && format.numChannels >= 3;
+
+    // The selector is matched against the names of all channels first, such that only the
+    // surfaces of selected channels are decoded.
+    auto channelNames = makeNChannelNames(format.numChannels);
+    auto fullName = [&](const Surface& surface, const string& name) {
+        return surface.layer.empty() ? name : tfm::format("%s.%s", surface.layer, name);
+    };
+
+    vector<tuple<size_t, size_t, size_t>> matches;
+    for (size_t i = 0; i < surfaces.size(); ++i) {
+        for (size_t c = 0; c < channelNames.size(); ++c) {
+            size_t matchId;
+            if (matchesFuzzy(fullName(surfaces[i], channelNames[c]), channelSelector, &matchId)) {
+                matches.emplace_back(matchId, i, c);
+            }
+        }
+    }
+
+    if (!channelSelector.empty()) {
+        sort(begin(matches), end(matches));
+    }
+
+    vector<vector<Channel>> surfaceChannels(surfaces.size());
+    for (const auto& match : matches) {
+        const auto& surface = surfaces[get<1>(match)];
+        auto& channels = surfaceChannels[get<1>(match)];
+        if (channels.empty()) {
+            for (const auto& name : channelNames) {
+                channels.emplace_back(fullName(surface, name), size);
+            }
+
+            decodeSurface(format, data + surface.offset, size, isSrgb, channels.data());
+        }
+
+        result.channels.emplace_back(move(channels[get<2>(match)]));
+    }
+
+    for (const auto& surface : surfaces) {
+        result.layers.emplace_back(surface.layer);
+    }
+
+    return result;
+}
+
+TEV_NAMESPACE_END
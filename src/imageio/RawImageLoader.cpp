@@ -0,0 +1,741 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the BSD 3-Clause License within the LICENSE file.
+
+#include <tev/imageio/RawImageLoader.h>
+#include <tev/MemoryMappedFile.h>
+#include <tev/ThreadPool.h>
+
+#include <half.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <set>
+
+using namespace Eigen;
+using namespace filesystem;
+using namespace std;
+
+TEV_NAMESPACE_BEGIN
+
+namespace {
+
+enum class EDataType {
+    UInt8,
+    UInt16,
+    UInt32,
+    Int8,
+    Int16,
+    Int32,
+    Float16,
+    Float32,
+    Float64,
+};
+
+bool toDataType(string name, EDataType& dataType) {
+    static const map<string, EDataType> dataTypes = {
+        {"u8", EDataType::UInt8}, {"uint8", EDataType::UInt8},
+        {"u16", EDataType::UInt16}, {"uint16", EDataType::UInt16},
+        {"u32", EDataType::UInt32}, {"uint32", EDataType::UInt32},
+        {"i8", EDataType::Int8}, {"int8", EDataType::Int8},
+        {"i16", EDataType::Int16}, {"int16", EDataType::Int16},
+        {"i32", EDataType::Int32}, {"int32", EDataType::Int32},
+        {"f16", EDataType::Float16}, {"float16", EDataType::Float16}, {"half", EDataType::Float16},
+        {"f32", EDataType::Float32}, {"float32", EDataType::Float32}, {"float", EDataType::Float32},
+        {"f64", EDataType::Float64}, {"float64", EDataType::Float64}, {"double", EDataType::Float64},
+    };
+
+    auto iter = dataTypes.find(toLower(name));
+    if (iter == end(dataTypes)) {
+        return false;
+    }
+
+    dataType = iter->second;
+    return true;
+}
+
+size_t bytesPerElement(EDataType dataType) {
+    switch (dataType) {
+        case EDataType::UInt8:   case EDataType::Int8:    return 1;
+        case EDataType::UInt16:  case EDataType::Int16:   case EDataType::Float16: return 2;
+        case EDataType::UInt32:  case EDataType::Int32:   case EDataType::Float32: return 4;
+        case EDataType::Float64: return 8;
+    }
+
+    throw runtime_error{"Unknown raw data type."};
+}
+
+// Everything needed to interpret a raw blob. Offsets and strides are given in elements
+// (not bytes) and follow the semantics of `IpcPacketUpdateImage`: pixel (x, y) of
+// channel c resides at element `channelOffsets[c] + x * channelStrides[c] + y * rowStrides[c]`
+// after the first `headerBytes` bytes of the file. When no row stride is given, it
+// defaults to `width * channelStrides[c]`, which is exactly the layout of an IPC update.
+struct RawDescriptor {
+    Vector2i size = Vector2i::Zero();
+    int numChannels = 0;
+    vector<string> channelNames;
+
+    EDataType dataType = EDataType::Float32;
+    bool isPlanar = false;
+    bool isLittleEndian = true;
+    bool flipVertically = false;
+    bool hasPremultipliedAlpha = false;
+
+    // Integer data is mapped to [0, 1] (or [-1, 1] if signed) unless specified otherwise.
+    bool normalize = true;
+
+    size_t headerBytes = 0;
+    vector<int64_t> channelOffsets;
+    vector<int64_t> channelStrides;
+    vector<int64_t> rowStrides;
+};
+
+using KeyValues = map<string, vector<string>>;
+
+string trim(const string& str) {
+    size_t begin = str.find_first_not_of(" \t\r\n");
+    if (begin == string::npos) {
+        return "";
+    }
+
+    size_t end = str.find_last_not_of(" \t\r\n");
+    return str.substr(begin, end - begin + 1);
+}
+
+string unquote(const string& str) {
+    if (str.size() >= 2 && (str.front() == '"' || str.front() == '\'') && str.back() == str.front()) {
+        return str.substr(1, str.size() - 2);
+    }
+
+    return str;
+}
+
+// Parses a flat JSON object whose values are scalars or arrays of scalars, which is
+// all a raw descriptor needs. Nested objects are rejected.
+KeyValues parseJsonDescriptor(const string& text) {
+    KeyValues result;
+    size_t i = 0;
+
+    auto fail = [&](const string& what) {
+        throw invalid_argument{tfm::format("Invalid JSON raw descriptor: %s at position %d.", what, i)};
+    };
+
+    auto skipWhitespace = [&]() {
+        while (i < text.size() && isspace((unsigned char)text[i])) {
+            ++i;
+        }
+    };
+
+    auto peek = [&]() {
+        skipWhitespace();
+        return i < text.size() ? text[i] : '\0';
+    };
+
+    auto expect = [&](char c) {
+        if (peek() != c) {
+            fail(tfm::format("expected '%c'", c));
+        }
+        ++i;
+    };
+
+    auto parseScalar = [&]() {
+        string value;
+        if (peek() == '"') {
+            ++i;
+            while (i < text.size() && text[i] != '"') {
+                if (text[i] == '\\' && i + 1 < text.size()) {
+                    ++i;
+                }
+                value += text[i++];
+            }
+
+            if (i >= text.size()) {
+                fail("unterminated string");
+            }
+
+            ++i;
+            return value;
+        }
+
+        size_t start = i;
+        while (i < text.size() && !strchr(",:]} \t\r\n", text[i])) {
+            ++i;
+        }
+
+        if (start == i) {
+            fail("expected a value");
+        }
+
+        return text.substr(start, i - start);
+    };
+
+    expect('{');
+    if (peek() == '}') {
+        return result;
+    }
+
+    while (true) {
+        string key = parseScalar();
+        expect(':');
+
+        vector<string> values;
+        char next = peek();
+        if (next == '[') {
+            ++i;
+            if (peek() != ']') {
+                values.emplace_back(parseScalar());
+                while (peek() == ',') {
+                    ++i;
+                    values.emplace_back(parseScalar());
+                }
+            }
+            expect(']');
+        } else if (next == '{') {
+            fail("nested objects are not supported");
+        } else {
+            values.emplace_back(parseScalar());
+        }
+
+        result[key] = values;
+
+        if (peek() == ',') {
+            ++i;
+            continue;
+        }
+
+        expect('}');
+        break;
+    }
+
+    return result;
+}
+
+// Parses lines of the form `key = value` or `key = value0, value1, ...`.
+// Empty lines and everything after a '#' are ignored.
+KeyValues parseKeyValueDescriptor(const string& text) {
+    KeyValues result;
+
+    istringstream stream{text};
+    string line;
+    size_t lineNumber = 0;
+    while (getline(stream, line)) {
+        ++lineNumber;
+
+        line = trim(line.substr(0, line.find('#')));
+        if (line.empty()) {
+            continue;
+        }
+
+        size_t equalsPosition = line.find('=');
+        if (equalsPosition == string::npos) {
+            throw invalid_argument{tfm::format("Invalid raw descriptor: missing '=' in line %d.", lineNumber)};
+        }
+
+        vector<string> values;
+        for (const auto& value : split(line.substr(equalsPosition + 1), ",")) {
+            string trimmed = unquote(trim(value));
+            if (!trimmed.empty()) {
+                values.emplace_back(trimmed);
+            }
+        }
+
+        result[trim(line.substr(0, equalsPosition))] = values;
+    }
+
+    return result;
+}
+
+string withoutExtension(const string& str) {
+    size_t dotPosition = str.find_last_of('.');
+    size_t slashPosition = str.find_last_of("/\\");
+    if (dotPosition == string::npos || (slashPosition != string::npos && dotPosition < slashPosition)) {
+        return str;
+    }
+
+    return str.substr(0, dotPosition);
+}
+
+bool hasRawExtension(const path& path) {
+    string extension = toLower(path.extension());
+    return extension == "raw" || extension == "bin";
+}
+
+vector<path> sidecarCandidates(const path& imagePath) {
+    vector<path> result = {
+        imagePath.str() + ".json",
+        imagePath.str() + ".desc",
+    };
+
+    // Files that are unambiguously raw may also share their sidecar's stem,
+    // e.g. `beauty.bin` and `beauty.json`.
+    if (hasRawExtension(imagePath)) {
+        string stem = withoutExtension(imagePath.str());
+        result.emplace_back(stem + ".json");
+        result.emplace_back(stem + ".desc");
+    }
+
+    return result;
+}
+
+bool findSidecar(const path& imagePath, path& sidecarPath) {
+    for (const auto& candidate : sidecarCandidates(imagePath)) {
+        if (candidate.is_file()) {
+            sidecarPath = candidate;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool toInteger(const string& str, int64_t& value) {
+    if (str.empty()) {
+        return false;
+    }
+
+    char* end;
+    value = strtoll(str.c_str(), &end, 10);
+    return *end == '\0';
+}
+
+// Sizes and channel counts are stored as int, so larger values would wrap around.
+bool isValidDimension(int64_t value) {
+    return value > 0 && value <= numeric_limits<int>::max();
+}
+
+// Reads as much as possible from a file name following the convention
+// `<anything>_<width>x<height>[_<n>ch][_<dtype>][_le|_be][_planar|_interleaved].<ext>`,
+// where the tokens may appear in any order and may also be separated by dots.
+// Returns whether a resolution was found.
+bool parseFilename(const path& imagePath, RawDescriptor& descriptor) {
+    bool hasSize = false;
+
+    for (const auto& token : split(withoutExtension(imagePath.filename()), "_.")) {
+        string lowerToken = toLower(token);
+        int64_t number;
+
+        size_t xPosition = lowerToken.find('x');
+        if (xPosition != string::npos) {
+            int64_t width, height;
+            if (toInteger(lowerToken.substr(0, xPosition), width) && toInteger(lowerToken.substr(xPosition + 1), height) &&
+                isValidDimension(width) && isValidDimension(height)) {
+                descriptor.size = {(int)width, (int)height};
+                hasSize = true;
+                continue;
+            }
+        }
+
+        if (lowerToken.size() > 2 && lowerToken.compare(lowerToken.size() - 2, 2, "ch") == 0 && toInteger(lowerToken.substr(0, lowerToken.size() - 2), number) && isValidDimension(number)) {
+            descriptor.numChannels = (int)number;
+        } else if (lowerToken == "le") {
+            descriptor.isLittleEndian = true;
+        } else if (lowerToken == "be") {
+            descriptor.isLittleEndian = false;
+        } else if (lowerToken == "planar") {
+            descriptor.isPlanar = true;
+        } else if (lowerToken == "interleaved") {
+            descriptor.isPlanar = false;
+        } else {
+            toDataType(lowerToken, descriptor.dataType);
+        }
+    }
+
+    return hasSize;
+}
+
+void applyDescriptor(const KeyValues& keyValues, const path& sidecarPath, RawDescriptor& descriptor) {
+    auto single = [&](const string& key, const vector<string>& values) -> const string& {
+        if (values.size() != 1) {
+            throw invalid_argument{tfm::format("Raw descriptor %s: '%s' must have exactly one value.", sidecarPath, key)};
+        }
+        return values.front();
+    };
+
+    auto integer = [&](const string& key, const string& value) {
+        int64_t result;
+        if (!toInteger(value, result)) {
+            throw invalid_argument{tfm::format("Raw descriptor %s: '%s' must be an integer, but is '%s'.", sidecarPath, key, value)};
+        }
+        return result;
+    };
+
+    auto dimension = [&](const string& key, const string& value) {
+        int64_t result = integer(key, value);
+        if (!isValidDimension(result)) {
+            throw invalid_argument{tfm::format("Raw descriptor %s: '%s' must be between 1 and %d, but is %d.", sidecarPath, key, numeric_limits<int>::max(), result)};
+        }
+        return (int)result;
+    };
+
+    auto integers = [&](const string& key, const vector<string>& values) {
+        vector<int64_t> result;
+        for (const auto& value : values) {
+            result.emplace_back(integer(key, value));
+        }
+        return result;
+    };
+
+    auto boolean = [&](const string& key, const string& value) {
+        string lowerValue = toLower(value);
+        if (lowerValue == "true" || lowerValue == "1" || lowerValue == "yes") {
+            return true;
+        } else if (lowerValue == "false" || lowerValue == "0" || lowerValue == "no") {
+            return false;
+        }
+        throw invalid_argument{tfm::format("Raw descriptor %s: '%s' must be a boolean, but is '%s'.", sidecarPath, key, value)};
+    };
+
+    for (const auto& kv : keyValues) {
+        const string& key = kv.first;
+        const vector<string>& values = kv.second;
+
+        if (key == "width") {
+            descriptor.size.x() = dimension(key, single(key, values));
+        } else if (key == "height") {
+            descriptor.size.y() = dimension(key, single(key, values));
+        } else if (key == "channels") {
+            // Either the number of channels or their names
+            int64_t numChannels;
+            if (values.size() == 1 && toInteger(values.front(), numChannels)) {
+                descriptor.numChannels = dimension(key, values.front());
+                descriptor.channelNames.clear();
+            } else {
+                descriptor.channelNames = values;
+                descriptor.numChannels = (int)values.size();
+            }
+        } else if (key == "dtype" || key == "type") {
+            if (!toDataType(single(key, values), descriptor.dataType)) {
+                throw invalid_argument{tfm::format("Raw descriptor %s: unknown data type '%s'.", sidecarPath, values.front())};
+            }
+        } else if (key == "layout") {
+            string layout = toLower(single(key, values));
+            if (layout != "planar" && layout != "interleaved") {
+                throw invalid_argument{tfm::format("Raw descriptor %s: layout must be 'planar' or 'interleaved', but is '%s'.", sidecarPath, layout)};
+            }
+            descriptor.isPlanar = layout == "planar";
+        } else if (key == "endianness") {
+            string endianness = toLower(single(key, values));
+            if (endianness != "little" && endianness != "big") {
+                throw invalid_argument{tfm::format("Raw descriptor %s: endianness must be 'little' or 'big', but is '%s'.", sidecarPath, endianness)};
+            }
+            descriptor.isLittleEndian = endianness == "little";
+        } else if (key == "headerBytes") {
+            int64_t headerBytes = integer(key, single(key, values));
+            if (headerBytes < 0) {
+                throw invalid_argument{tfm::format("Raw descriptor %s: headerBytes may not be negative.", sidecarPath)};
+            }
+            descriptor.headerBytes = (size_t)headerBytes;
+        } else if (key == "channelOffsets") {
+            descriptor.channelOffsets = integers(key, values);
+        } else if (key == "channelStrides") {
+            descriptor.channelStrides = integers(key, values);
+        } else if (key == "rowStrides" || key == "rowStride") {
+            descriptor.rowStrides = integers(key, values);
+        } else if (key == "flipVertically") {
+            descriptor.flipVertically = boolean(key, single(key, values));
+        } else if (key == "normalize") {
+            descriptor.normalize = boolean(key, single(key, values));
+        } else if (key == "premultipliedAlpha") {
+            descriptor.hasPremultipliedAlpha = boolean(key, single(key, values));
+        } else {
+            tlog::warning() << tfm::format("Ignoring unknown key '%s' in raw descriptor %s.", key, sidecarPath);
+        }
+    }
+}
+
+template <typename T>
+T loadElement(const char* src, bool shallSwapBytes) {
+    T value;
+    memcpy(&value, src, sizeof(T));
+
+    if (shallSwapBytes) {
+        if constexpr (sizeof(T) == 2) {
+            uint16_t bits;
+            memcpy(&bits, &value, sizeof(T));
+            bits = swapBytes(bits);
+            memcpy(&value, &bits, sizeof(T));
+        } else if constexpr (sizeof(T) == 4) {
+            uint32_t bits;
+            memcpy(&bits, &value, sizeof(T));
+            bits = swapBytes(bits);
+            memcpy(&value, &bits, sizeof(T));
+        } else if constexpr (sizeof(T) == 8) {
+            uint64_t bits;
+            memcpy(&bits, &value, sizeof(T));
+            bits = swapBytes(bits);
+            memcpy(&value, &bits, sizeof(T));
+        }
+    }
+
+    return value;
+}
+
+// Converts one row of a channel. The byte swap is hoisted out of the loop and the
+// stride is a runtime constant, such that the compiler emits vectorized code for
+// the common cases of planar (contiguous) and interleaved data.
+template <typename T, bool SWAP_BYTES, typename F>
+void decodeRow(const char* __restrict src, int64_t strideBytes, int width, float scale, const F& toFloat, float* __restrict dst) {
+    for (int x = 0; x < width; ++x) {
+        dst[x] = scale * toFloat(loadElement<T>(src + x * strideBytes, SWAP_BYTES));
+    }
+}
+
+template <typename T, typename F>
+void decodeRow(const char* src, int64_t strideBytes, int width, bool shallSwapBytes, float scale, const F& toFloat, float* dst) {
+    if (shallSwapBytes) {
+        decodeRow<T, true>(src, strideBytes, width, scale, toFloat, dst);
+    } else {
+        decodeRow<T, false>(src, strideBytes, width, scale, toFloat, dst);
+    }
+}
+
+template <typename T>
+float normalizationFactor(bool normalize) {
+    return normalize ? 1.0f / (float)numeric_limits<T>::max() : 1.0f;
+}
+
+// Like SNORM formats, normalized signed values map both the minimum and its successor to -1,
+// such that they stay within [-1, 1].
+template <typename T>
+float toSignedFloat(T v, bool normalize) {
+    return normalize ? max((float)v, -(float)numeric_limits<T>::max()) : (float)v;
+}
+
+// Combines the information from the file name and the sidecar descriptor and fills in
+// defaults for everything that is not specified. Throws if the described data does not
+// fit into a file of the given size.
+RawDescriptor resolveDescriptor(const path& path, size_t fileSize) {
+    RawDescriptor descriptor;
+    bool hasFilenameSize = parseFilename(path, descriptor);
+
+    class path sidecarPath;
+    bool hasSidecar = findSidecar(path, sidecarPath);
+    if (hasSidecar) {
+        ifstream sidecarStream{nativeString(sidecarPath), ios_base::binary};
+        if (!sidecarStream) {
+            throw invalid_argument{tfm::format("Raw descriptor %s could not be opened.", sidecarPath)};
+        }
+
+        string text{istreambuf_iterator<char>{sidecarStream}, istreambuf_iterator<char>{}};
+        string trimmed = trim(text);
+        applyDescriptor(
+            !trimmed.empty() && trimmed.front() == '{' ? parseJsonDescriptor(trimmed) : parseKeyValueDescriptor(trimmed),
+            sidecarPath,
+            descriptor
+        );
+    }
+
+    if (!hasSidecar && !hasFilenameSize) {
+        throw invalid_argument{tfm::format(
+            "Raw image %s requires a sidecar descriptor (%s) or a resolution in its file name (e.g. 'image_1920x1080_3ch_f32.raw').",
+            path, sidecarCandidates(path).front()
+        )};
+    }
+
+    const Vector2i& size = descriptor.size;
+    auto numPixels = (DenseIndex)size.x() * size.y();
+    if (size.x() <= 0 || size.y() <= 0) {
+        throw invalid_argument{"Image has zero pixels."};
+    }
+
+    if (fileSize < descriptor.headerBytes) {
+        throw invalid_argument{tfm::format("Raw image is smaller (%d bytes) than its header (%d bytes).", fileSize, descriptor.headerBytes)};
+    }
+
+    const size_t elementBytes = bytesPerElement(descriptor.dataType);
+    const size_t numElements = (fileSize - descriptor.headerBytes) / elementBytes;
+
+    int& numChannels = descriptor.numChannels;
+    if (numChannels == 0) {
+        numChannels = (int)descriptor.channelOffsets.size();
+    }
+
+    // Infer the number of channels from the file size if it was not given explicitly.
+    if (numChannels == 0) {
+        if (numElements == 0 || numElements % numPixels != 0) {
+            throw invalid_argument{tfm::format(
+                "Can not infer number of channels: %d elements are not a multiple of %dx%d pixels.",
+                numElements, size.x(), size.y()
+            )};
+        }
+        if (!isValidDimension((int64_t)(numElements / numPixels))) {
+            throw invalid_argument{tfm::format("Raw image has too many channels (%d).", numElements / numPixels)};
+        }
+        numChannels = (int)(numElements / numPixels);
+    }
+
+    auto perChannel = [&](vector<int64_t>& values, const char* name, function<int64_t(int)> defaultValue) {
+        if (values.empty()) {
+            for (int c = 0; c < numChannels; ++c) {
+                values.emplace_back(defaultValue(c));
+            }
+        } else if (values.size() == 1) {
+            values.resize(numChannels, values.front());
+        } else if ((int)values.size() != numChannels) {
+            throw invalid_argument{tfm::format("Raw image has %d channels, but %d %s.", numChannels, values.size(), name)};
+        }
+    };
+
+    // Offsets and strides come from the sidecar and may be arbitrarily large. Each of them is
+    // checked against the number of elements before it enters any product, and all products
+    // are computed such that they can not overflow.
+    auto checkWithinFile = [&](const vector<int64_t>& values, const char* name) {
+        for (int c = 0; c < numChannels; ++c) {
+            if (values[c] < 0 || (uint64_t)values[c] > numElements) {
+                throw invalid_argument{tfm::format("Raw image channel %d has a %s of %d, which is outside of the file.", c, name, values[c])};
+            }
+        }
+    };
+
+    auto product = [&](uint64_t a, uint64_t b, int c) {
+        uint64_t result;
+        if (!mulAddWithin(a, b, 0, numElements, result)) {
+            throw invalid_argument{tfm::format("Not sufficient bytes to read channel %d.", c)};
+        }
+        return (int64_t)result;
+    };
+
+    perChannel(descriptor.channelStrides, "channel strides", [&](int) {
+        return descriptor.isPlanar ? 1 : numChannels;
+    });
+    checkWithinFile(descriptor.channelStrides, "channel stride");
+
+    perChannel(descriptor.rowStrides, "row strides", [&](int c) {
+        return product((uint64_t)size.x(), (uint64_t)descriptor.channelStrides[c], c);
+    });
+    checkWithinFile(descriptor.rowStrides, "row stride");
+
+    perChannel(descriptor.channelOffsets, "channel offsets", [&](int c) {
+        return descriptor.isPlanar ? product((uint64_t)c * size.y(), (uint64_t)descriptor.rowStrides[c], c) : c;
+    });
+    checkWithinFile(descriptor.channelOffsets, "channel offset");
+
+    // Make sure every element we are about to read actually resides within the file.
+    for (int c = 0; c < numChannels; ++c) {
+        uint64_t lastElement;
+        if (!mulAddWithin((uint64_t)size.x() - 1, (uint64_t)descriptor.channelStrides[c], (uint64_t)descriptor.channelOffsets[c], numElements, lastElement) ||
+            !mulAddWithin((uint64_t)size.y() - 1, (uint64_t)descriptor.rowStrides[c], lastElement, numElements, lastElement) ||
+            lastElement >= numElements) {
+            throw invalid_argument{tfm::format("Not sufficient bytes to read channel %d (file has %d bytes).", c, fileSize)};
+        }
+    }
+
+    return descriptor;
+}
+
+}
+
+vector<string> RawImageLoader::extensions() const {
+    // Raw files have no magic number; they are recognized by their path instead.
+    return {"raw", "bin"};
+}
+
+bool RawImageLoader::canLoadPath(const path& path) const {
+    class path sidecarPath;
+    return findSidecar(path, sidecarPath);
+}
+
+bool RawImageLoader::loadHeader(istream& iStream, const path& path, const string&, ImageHeader& header) const {
+    // Only the size of the file is needed to validate the descriptor.
+    RawDescriptor descriptor = resolveDescriptor(path, streamSize(iStream));
+
+    header.size = descriptor.size;
+    header.channels = descriptor.channelNames.empty() ? makeNChannelNames(descriptor.numChannels) : descriptor.channelNames;
+
+    return true;
+}
+
+ImageData RawImageLoader::load(istream& iStream, const path& path, const string& channelSelector, bool& hasPremultipliedAlpha) const {
+    ImageData result;
+
+    MemoryMappedFile file{iStream, path};
+    RawDescriptor descriptor = resolveDescriptor(path, file.size());
+
+    const Vector2i size = descriptor.size;
+    const int numChannels = descriptor.numChannels;
+    const size_t elementBytes = bytesPerElement(descriptor.dataType);
+
+    // Select channels before decoding, such that unselected ones are never read.
+    vector<string> channelNames = descriptor.channelNames.empty() ? makeNChannelNames(numChannels) : descriptor.channelNames;
+    vector<pair<size_t, size_t>> matches;
+    for (size_t i = 0; i < channelNames.size(); ++i) {
+        size_t matchId;
+        if (matchesFuzzy(channelNames[i], channelSelector, &matchId)) {
+            matches.emplace_back(matchId, i);
+        }
+    }
+
+    if (!channelSelector.empty()) {
+        sort(begin(matches), end(matches));
+    }
+
+    set<string> layerNames;
+    for (const auto& match : matches) {
+        layerNames.insert(Channel::head(channelNames[match.second]));
+        result.channels.emplace_back(channelNames[match.second], size);
+    }
+
+    for (const string& layer : layerNames) {
+        result.layers.emplace_back(layer);
+    }
+
+    const char* data = file.data() + descriptor.headerBytes;
+    const bool shallSwapBytes = isSystemLittleEndian() != descriptor.isLittleEndian;
+    const bool normalize = descriptor.normalize;
+
+    gThreadPool->parallelFor<DenseIndex>(0, size.y(), [&](DenseIndex y) {
+        DenseIndex targetY = descriptor.flipVertically ? size.y() - y - 1 : y;
+
+        // Decoding all channels of a row in succession keeps interleaved rows in cache.
+        for (size_t i = 0; i < matches.size(); ++i) {
+            size_t c = matches[i].second;
+            const char* src = data + (descriptor.channelOffsets[c] + y * descriptor.rowStrides[c]) * elementBytes;
+            int64_t strideBytes = descriptor.channelStrides[c] * elementBytes;
+            float* dst = &result.channels[i].at({0, (int)targetY});
+
+            switch (descriptor.dataType) {
+                case EDataType::UInt8:
+                    decodeRow<uint8_t>(src, strideBytes, size.x(), shallSwapBytes, normalizationFactor<uint8_t>(normalize), [](uint8_t v) { return (float)v; }, dst);
+                    break;
+                case EDataType::UInt16:
+                    decodeRow<uint16_t>(src, strideBytes, size.x(), shallSwapBytes, normalizationFactor<uint16_t>(normalize), [](uint16_t v) { return (float)v; }, dst);
+                    break;
+                case EDataType::UInt32:
+                    decodeRow<uint32_t>(src, strideBytes, size.x(), shallSwapBytes, normalizationFactor<uint32_t>(normalize), [](uint32_t v) { return (float)v; }, dst);
+                    break;
+                case EDataType::Int8:
+                    decodeRow<int8_t>(src, strideBytes, size.x(), shallSwapBytes, normalizationFactor<int8_t>(normalize), [normalize](int8_t v) { return toSignedFloat(v, normalize); }, dst);
+                    break;
+                case EDataType::Int16:
+                    decodeRow<int16_t>(src, strideBytes, size.x(), shallSwapBytes, normalizationFactor<int16_t>(normalize), [normalize](int16_t v) { return toSignedFloat(v, normalize); }, dst);
+                    break;
+                case EDataType::Int32:
+                    decodeRow<int32_t>(src, strideBytes, size.x(), shallSwapBytes, normalizationFactor<int32_t>(normalize), [normalize](int32_t v) { return toSignedFloat(v, normalize); }, dst);
+                    break;
+                case EDataType::Float16:
+                    decodeRow<uint16_t>(src, strideBytes, size.x(), shallSwapBytes, 1.0f, [](uint16_t v) {
+                        ::half h;
+                        h.setBits(v);
+                        return (float)h;
+                    }, dst);
+                    break;
+                case EDataType::Float32:
+                    decodeRow<float>(src, strideBytes, size.x(), shallSwapBytes, 1.0f, [](float v) { return v; }, dst);
+                    break;
+                case EDataType::Float64:
+                    decodeRow<double>(src, strideBytes, size.x(), shallSwapBytes, 1.0f, [](double v) { return (float)v; }, dst);
+                    break;
+            }
+        }
+    });
+
+    hasPremultipliedAlpha = descriptor.hasPremultipliedAlpha;
+
+    return result;
+}
+
+TEV_NAMESPACE_END
@@ -4,6 +4,10 @@
 #include <tev/imageio/StbiImageLoader.h>
 #include <tev/ThreadPool.h>
 
+// The GUI links another copy of stb_image through nanovg. Compiling a private copy here keeps
+// the core library self-contained without clashing with that one.
+#define STB_IMAGE_STATIC
+#define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
 using namespace Eigen;
@@ -12,32 +16,57 @@ using namespace std;
 
 TEV_NAMESPACE_BEGIN
 
-bool StbiImageLoader::canLoadFile(istream&) const {
-    // Pretend you can load any file and throw exception on failure.
-    // TODO: Add proper check.
+namespace {
+
+const stbi_io_callbacks callbacks = {
+    // Read
+    [](void* context, char* data, int size) {
+        auto stream = reinterpret_cast<istream*>(context);
+        stream->read(data, size);
+        return (int)stream->gcount();
+    },
+    // Seek
+    [](void* context, int size) {
+        reinterpret_cast<istream*>(context)->seekg(size, ios_base::cur);
+    },
+    // EOF
+    [](void* context) {
+        return (int)!!(*reinterpret_cast<istream*>(context));
+    },
+};
+
+}
+
+vector<string> StbiImageLoader::magicNumbers() const {
+    return {
+        "\x89PNG",                 // PNG
+        "\xff\xd8\xff",             // JPEG
+        "BM",                      // BMP
+        "GIF87a", "GIF89a",        // GIF
+        "8BPS",                    // PSD
+        "\x53\x80\xf6\x34",         // PIC
+        "#?RADIANCE", "#?RGBE",    // Radiance HDR
+    };
+}
+
+vector<string> StbiImageLoader::extensions() const {
+    // TGA files have no magic number.
+    return {"tga"};
+}
+
+bool StbiImageLoader::loadHeader(istream& iStream, const path&, const string&, ImageHeader& header) const {
+    int numChannels;
+    if (!stbi_info_from_callbacks(&callbacks, &iStream, &header.size.x(), &header.size.y(), &numChannels)) {
+        throw invalid_argument{tfm::format("%s", stbi_failure_reason())};
+    }
+
+    header.channels = makeNChannelNames(numChannels);
     return true;
 }
 
 ImageData StbiImageLoader::load(istream& iStream, const path&, const string& channelSelector, bool& hasPremultipliedAlpha) const {
     ImageData result;
 
-    static const stbi_io_callbacks callbacks = {
-        // Read
-        [](void* context, char* data, int size) {
-            auto stream = reinterpret_cast<istream*>(context);
-            stream->read(data, size);
-            return (int)stream->gcount();
-        },
-        // Seek
-        [](void* context, int size) {
-            reinterpret_cast<istream*>(context)->seekg(size, ios_base::cur);
-        },
-        // EOF
-        [](void* context) {
-            return (int)!!(*reinterpret_cast<istream*>(context));
-        },
-    };
-
     void* data;
     int numChannels;
     Vector2i size;
@@ -15,7 +15,7 @@ using namespace std;
 
 TEV_NAMESPACE_BEGIN
 
-void StbiLdrImageSaver::save(ostream& iStream, const path& path, const vector<char>& data, const Vector2i& imageSize, int nChannels) const {
+void StbiLdrImageSaver::save(ostream& iStream, const path& path, const PooledVector<char>& data, const Vector2i& imageSize, int nChannels) const {
     static const auto stbiOStreamWrite = [](void* context, void* data, int size) {
         reinterpret_cast<ostream*>(context)->write(reinterpret_cast<char*>(data), size);
     };
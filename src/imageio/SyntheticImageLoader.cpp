@@ -0,0 +1,256 @@
+// This file was developed by Thomas Müller <thomas94@gmx.net>.
+// It is published under the BSD 3-Clause License within the LICENSE file.
+
+#include <tev/imageio/SyntheticImageLoader.h>
+#include <tev/ThreadPool.h>
+
+#include <algorithm>
+#include <cctype>
+#include <limits>
+
+using namespace Eigen;
+using namespace filesystem;
+using namespace std;
+
+TEV_NAMESPACE_BEGIN
+
+namespace {
+
+const string MAGIC = "synthetic:";
+
+// Synthetic images serve testing and benchmarking, for which 16 GiB of samples suffice. Larger
+// descriptors are rejected rather than attempting allocations that can not succeed.
+const uint64_t MAX_NUM_SAMPLES = 1ull << 32;
+
+enum class EPattern {
+    Gradient,
+    Noise,
+    Checkerboard,
+};
+
+struct SyntheticDescriptor {
+    Vector2i size = {0, 0};
+    int numChannels = 4;
+    int numLayers = 1;
+    EPattern pattern = EPattern::Gradient;
+    bool hasNans = false;
+    uint32_t seed = 0;
+};
+
+bool toInteger(const string& str, int& value) {
+    if (str.empty() || str.size() > 9 || !all_of(begin(str), end(str), [](char c) { return isdigit((unsigned char)c); })) {
+        return false;
+    }
+
+    value = stoi(str);
+    return true;
+}
+
+bool toPositiveInteger(const string& str, int& value) {
+    return toInteger(str, value) && value > 0;
+}
+
+bool endsWith(const string& str, const string& suffix) {
+    return str.size() > suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+SyntheticDescriptor parseDescriptor(const string& spec) {
+    if (spec.compare(0, MAGIC.size(), MAGIC) != 0) {
+        throw invalid_argument{tfm::format("Invalid magic synthetic string %s", spec)};
+    }
+
+    auto tokens = split(spec.substr(MAGIC.size()), ":");
+
+    SyntheticDescriptor result;
+    string resolution = toLower(tokens.front());
+    size_t xPosition = resolution.find('x');
+    if (xPosition == string::npos ||
+        !toPositiveInteger(resolution.substr(0, xPosition), result.size.x()) ||
+        !toPositiveInteger(resolution.substr(xPosition + 1), result.size.y())) {
+        throw invalid_argument{tfm::format("Synthetic image must start with its resolution, e.g. 'synthetic:1920x1080', but is '%s'.", spec)};
+    }
+
+    for (size_t i = 1; i < tokens.size(); ++i) {
+        string token = toLower(tokens[i]);
+        if (endsWith(token, "ch")) {
+            if (!toPositiveInteger(token.substr(0, token.size() - 2), result.numChannels)) {
+                throw invalid_argument{tfm::format("Invalid synthetic channel count '%s'.", token)};
+            }
+        } else if (endsWith(token, "layers") || endsWith(token, "layer")) {
+            if (!toPositiveInteger(token.substr(0, token.find("layer")), result.numLayers)) {
+                throw invalid_argument{tfm::format("Invalid synthetic layer count '%s'.", token)};
+            }
+        } else if (token.compare(0, 4, "seed") == 0) {
+            int seed;
+            if (!toInteger(token.substr(4), seed)) {
+                throw invalid_argument{tfm::format("Invalid synthetic seed '%s'.", token)};
+            }
+            result.seed = (uint32_t)seed;
+        } else if (token == "gradient") {
+            result.pattern = EPattern::Gradient;
+        } else if (token == "noise") {
+            result.pattern = EPattern::Noise;
+        } else if (token == "checkerboard" || token == "checker") {
+            result.pattern = EPattern::Checkerboard;
+        } else if (token == "nan") {
+            result.hasNans = true;
+        } else {
+            throw invalid_argument{tfm::format("Unknown synthetic image option '%s'.", tokens[i])};
+        }
+    }
+
+    if ((DenseIndex)result.size.x() * result.size.y() > numeric_limits<int>::max()) {
+        throw invalid_argument{tfm::format("Synthetic image %dx%d has too many pixels.", result.size.x(), result.size.y())};
+    }
+
+    uint64_t numChannels, numSamples;
+    if (!mulAddWithin((uint64_t)result.numChannels, (uint64_t)result.numLayers, 0, MAX_NUM_SAMPLES, numChannels) ||
+        !mulAddWithin((uint64_t)result.size.x() * result.size.y(), numChannels, 0, MAX_NUM_SAMPLES, numSamples)) {
+        throw invalid_argument{tfm::format(
+            "Synthetic image %dx%d with %d channels in %d layers has more than %d samples.",
+            result.size.x(), result.size.y(), result.numChannels, result.numLayers, MAX_NUM_SAMPLES
+        )};
+    }
+
+    return result;
+}
+
+SyntheticDescriptor readDescriptor(istream& iStream) {
+    string spec;
+    getline(iStream, spec);
+    return parseDescriptor(spec);
+}
+
+vector<string> channelNames(const SyntheticDescriptor& descriptor, const vector<string>& layerChannelNames) {
+    vector<string> names;
+    for (int l = 0; l < descriptor.numLayers; ++l) {
+        string prefix = descriptor.numLayers > 1 ? tfm::format("layer%d.", l) : "";
+        for (const auto& name : layerChannelNames) {
+            names.emplace_back(prefix + name);
+        }
+    }
+
+    return names;
+}
+
+// Stateless hash (lowbias32 by Chris Wellons), such that every pixel can be generated
+// independently and in parallel while the result remains deterministic.
+uint32_t hash(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+float random(uint32_t x, uint32_t y, uint32_t c, uint32_t seed) {
+    return hash(x ^ hash(y ^ hash(c ^ hash(seed)))) * (1.0f / 4294967296.0f);
+}
+
+}
+
+vector<string> SyntheticImageLoader::magicNumbers() const {
+    return {MAGIC};
+}
+
+bool SyntheticImageLoader::isSyntheticPath(const string& path) {
+    return path.compare(0, MAGIC.size(), MAGIC) == 0;
+}
+
+bool SyntheticImageLoader::loadHeader(istream& iStream, const path&, const string&, ImageHeader& header) const {
+    auto descriptor = readDescriptor(iStream);
+    header.size = descriptor.size;
+    header.channels = channelNames(descriptor, makeNChannelNames(descriptor.numChannels));
+    return true;
+}
+
+ImageData SyntheticImageLoader::load(istream& iStream, const path&, const string& channelSelector, bool& hasPremultipliedAlpha) const {
+    ImageData result;
+
+    auto descriptor = readDescriptor(iStream);
+    const Vector2i size = descriptor.size;
+    auto names = channelNames(descriptor, makeNChannelNames(descriptor.numChannels));
+
+    // Only the selected channels are generated.
+    vector<pair<size_t, size_t>> matches;
+    for (size_t i = 0; i < names.size(); ++i) {
+        size_t matchId;
+        if (matchesFuzzy(names[i], channelSelector, &matchId)) {
+            matches.emplace_back(matchId, i);
+        }
+    }
+
+    if (!channelSelector.empty()) {
+        sort(begin(matches), end(matches));
+    }
+
+    vector<size_t> channelIndices;
+    for (const auto& match : matches) {
+        result.channels.emplace_back(names[match.second], size);
+        channelIndices.emplace_back(match.second);
+
+        string layer = Channel::head(names[match.second]);
+        if (find(begin(result.layers), end(result.layers), layer) == end(result.layers)) {
+            result.layers.emplace_back(layer);
+        }
+    }
+
+    const int checkerSize = max(max(size.x(), size.y()) / 16, 1);
+    const Vector2f invSize = size.cast<float>().cwiseInverse();
+
+    // Rows of all channels are generated in one go, which keeps all threads busy even
+    // for images with few, but large channels.
+    gThreadPool->parallelFor<DenseIndex>(0, (DenseIndex)result.channels.size() * size.y(), [&](DenseIndex i) {
+        auto& channel = result.channels[i / size.y()];
+        const uint32_t c = (uint32_t)channelIndices[i / size.y()];
+        const int y = (int)(i % size.y());
+
+        const bool isAlpha = Channel::tail(channel.name()) == "A";
+        float* row = &channel.at({0, y});
+
+        for (int x = 0; x < size.x(); ++x) {
+            float value;
+            if (isAlpha) {
+                value = 1;
+            } else {
+                switch (descriptor.pattern) {
+                    case EPattern::Gradient: {
+                        // Each channel is a gradient in a different direction, such that
+                        // color channels are distinguishable.
+                        float u = (x + 0.5f) * invSize.x(), v = (y + 0.5f) * invSize.y();
+                        switch (c % 3) {
+                            case 0:  value = u; break;
+                            case 1:  value = v; break;
+                            default: value = 1 - 0.5f * (u + v); break;
+                        }
+                        break;
+                    }
+                    case EPattern::Noise:
+                        value = random(x, y, c, descriptor.seed);
+                        break;
+                    case EPattern::Checkerboard:
+                        value = ((x / checkerSize + y / checkerSize + c) % 2) == 0 ? 1.0f : 0.1f;
+                        break;
+                    default:
+                        value = 0;
+                        break;
+                }
+            }
+
+            // Roughly one in a thousand values is replaced by NaN to exercise the
+            // handling of invalid values throughout tev.
+            if (descriptor.hasNans && random(x, y, c, descriptor.seed + 1) < 0.001f) {
+                value = numeric_limits<float>::quiet_NaN();
+            }
+
+            row[x] = value;
+        }
+    });
+
+    hasPremultipliedAlpha = false;
+
+    return result;
+}
+
+TEV_NAMESPACE_END
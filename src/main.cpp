@@ -1,10 +1,13 @@
 // This file was developed by Thomas Müller <thomas94@gmx.net>.
 // It is published under the BSD 3-Clause License within the LICENSE file.
 
+#include <tev/Headless.h>
 #include <tev/Image.h>
 #include <tev/ImageViewer.h>
 #include <tev/Ipc.h>
+#include <tev/SharedImageCache.h>
 #include <tev/ThreadPool.h>
+#include <tev/imageio/SyntheticImageLoader.h>
 
 #include <args.hxx>
 #include <ImfThreading.h>
@@ -16,9 +19,18 @@
 #include <GLFW/glfw3native.h>
 #endif
 
+#ifdef _WIN32
+#   include <fcntl.h>
+#   include <io.h>
+#endif
+
 #include <atomic>
+#include <cctype>
+#include <cerrno>
 #include <chrono>
+#include <cstdlib>
 #include <iostream>
+#include <limits>
 #include <thread>
 
 using namespace args;
@@ -27,25 +39,11 @@ using namespace std;
 
 TEV_NAMESPACE_BEGIN
 
-ThreadPool* gThreadPool = new ThreadPool{};
-
-// Image viewer is a static variable to allow other
-// parts of the program to easily schedule operations
-// onto the main nanogui thread loop.
-// In a truly modular program, this would never be required,
-// but OpenGL's state-machine nature throws a wrench into
-// modularity.
-// Currently, the only use case is the destruction of
-// OpenGL textures, which _must_ happen on the thread
-// on which the GL context is "current".
+// Image viewer is a static variable to allow IPC packets, which
+// arrive on a background thread, to schedule operations onto the
+// main nanogui thread loop.
 static ImageViewer* sImageViewer = nullptr;
 
-void scheduleToMainThread(const std::function<void()>& fun) {
-    if (sImageViewer) {
-        sImageViewer->scheduleToUiThread(fun);
-    }
-}
-
 void handleIpcPacket(const IpcPacket& packet, const std::shared_ptr<BackgroundImagesLoader>& imagesLoader) {
     switch (packet.type()) {
         case IpcPacket::OpenImage:
@@ -55,6 +53,12 @@ void handleIpcPacket(const IpcPacket& packet, const std::shared_ptr<BackgroundIm
             break;
         }
 
+        case IpcPacket::OpenImageData: {
+            auto info = packet.interpretAsOpenImageData();
+            imagesLoader->enqueueData(ensureUtf8(info.imageName), move(info.imageData), ensureUtf8(info.channelSelector), info.grabFocus);
+            break;
+        }
+
         case IpcPacket::ReloadImage: {
             while (!sImageViewer) { }
             auto info = packet.interpretAsReloadImage();
@@ -130,6 +134,31 @@ void handleIpcPacket(const IpcPacket& packet, const std::shared_ptr<BackgroundIm
     }
 }
 
+// Parses lines of the form `@<numBytes> <name>`, which announce image data on stdin. Returns
+// false for other lines and throws invalid_argument if the size exceeds the 4 GiB that IPC
+// packets are limited to.
+bool parseImageDataHeader(const string& line, size_t& numBytes, string& imageName) {
+    if (line.size() < 4 || line[0] != '@' || !isdigit((unsigned char)line[1])) {
+        return false;
+    }
+
+    size_t separator = line.find(' ');
+    if (separator == string::npos || separator + 1 == line.size() || line.find_first_not_of("0123456789", 1) != separator) {
+        return false;
+    }
+
+    imageName = line.substr(separator + 1);
+
+    errno = 0;
+    unsigned long long size = strtoull(line.c_str() + 1, nullptr, 10);
+    if (errno == ERANGE || size > numeric_limits<uint32_t>::max()) {
+        throw invalid_argument{tfm::format("Image data of '%s' must be smaller than 4 GiB, but is %s bytes.", imageName, line.substr(1, separator - 1))};
+    }
+
+    numBytes = (size_t)size;
+    return true;
+}
+
 int mainFunc(const vector<string>& arguments) {
     ArgumentParser parser{
         "tev — The EXR Viewer\n"
@@ -139,6 +168,59 @@ int mainFunc(const vector<string>& arguments) {
         "Its source code is available under the BSD 3-Clause License at https://tom94.net",
     };
 
+    ValueFlag<float> blurFlag{
+        parser,
+        "SIGMA",
+        "Blur the image and the reference by a Gaussian with a standard deviation of SIGMA pixels before comparing them, "
+        "such that the comparison of noisy renders is not dominated by the noise. Default is 0.",
+        {"blur"},
+    };
+
+    ValueFlag<float> compressIdleFlag{
+        parser,
+        "SECONDS",
+        "Losslessly compress the pixels of images in memory once they have not been viewed for SECONDS. "
+        "Compressed images are decompressed as soon as they are needed again. Default is no compression.",
+        {"compress-idle"},
+    };
+
+    ValueFlag<int> downsampleFlag{
+        parser,
+        "FACTOR",
+        "Average blocks of FACTOR x FACTOR pixels of the image and the reference before comparing them. Default is 1.",
+        {"downsample"},
+    };
+
+    Flag diffFlag{
+        parser,
+        "DIFF",
+        "Compare images without opening a window and report the error of every metric per channel group. "
+        "Each image is compared against REFERENCE if given and otherwise images are compared in pairs, "
+        "i.e. the first image against the second, the third against the fourth, and so on. "
+        "The exit code is 1 if an error exceeds THRESHOLD and 2 if an image could not be loaded.",
+        {"diff"},
+    };
+
+    ValueFlag<string> exportDirFlag{
+        parser,
+        "EXPORT_DIR",
+        "The directory that --headless saves the exports of IPC clients to, whose paths must be relative to it. "
+        "Exports are refused unless it is given.",
+        {"export-dir"},
+    };
+
+    ValueFlag<string> exportFlag{
+        parser,
+        "EXPORT",
+        "Save the images to files named according to the given pattern without opening a window, "
+        "e.g. 'out/{name}.png'. '{name}' is replaced by the file name of an image without extension, "
+        "'{dir}' by its directory, and '{index}' by its position. The extension selects the file format. "
+        "LDR formats are tonemapped according to EXPOSURE, OFFSET, GAMMA, and TONEMAP. "
+        "If REFERENCE is given, the error in terms of METRIC is exported instead. "
+        "The exit code is 2 if an image could not be loaded and 3 if an image could not be saved.",
+        {"export"},
+    };
+
     ValueFlag<float> exposureFlag{
         parser,
         "EXPOSURE",
@@ -146,6 +228,18 @@ int mainFunc(const vector<string>& arguments) {
         {'e', "exposure"},
     };
 
+    ValueFlagList<string> expressionFlag{
+        parser,
+        "EXPRESSION",
+        "Add a channel that is computed from other channels of the same image, e.g. "
+        "'Y = 0.2126*R + 0.7152*G + 0.0722*B'. Expressions may use numbers, channel names, "
+        "+ - * / ^, comparisons < <= > >= that yield 0 or 1, and the functions abs, sqrt, exp, "
+        "log, min, max, and pow. Channel names containing other characters than letters, digits, "
+        "'_', and '.' must be enclosed in single quotes. Images lacking an input channel are left "
+        "unchanged. Can be given multiple times.",
+        {"expression"},
+    };
+
     ValueFlag<string> filterFlag{
         parser,
         "FILTER",
@@ -155,6 +249,14 @@ int mainFunc(const vector<string>& arguments) {
         {'f', "filter"},
     };
 
+    ValueFlag<string> formatFlag{
+        parser,
+        "FORMAT",
+        "The format of the report of --stats and --diff: 'json' or 'csv'. "
+        "Default is 'csv' if OUTPUT ends in '.csv' and 'json' otherwise.",
+        {"format"},
+    };
+
     ValueFlag<float> gammaFlag{
         parser,
         "GAMMA",
@@ -162,6 +264,23 @@ int mainFunc(const vector<string>& arguments) {
         {'g', "gamma"},
     };
 
+    ValueFlag<string> groupFlag{
+        parser,
+        "GROUP",
+        "The channel group to --export. The first group whose name contains GROUP is used. "
+        "Default is the first group of each image.",
+        {"group"},
+    };
+
+    Flag headlessFlag{
+        parser,
+        "HEADLESS",
+        "Run as a service without a window that keeps images in memory and answers the queries of IPC clients, "
+        "such as statistics and exports, in addition to opening, creating, updating, and closing images. "
+        "Queries of different clients are processed in parallel.",
+        {"headless"},
+    };
+
     HelpFlag helpFlag{
         parser,
         "HELP",
@@ -194,6 +313,14 @@ int mainFunc(const vector<string>& arguments) {
         {"max", "maximize"},
     };
 
+    ValueFlag<float> memoryBudgetFlag{
+        parser,
+        "MEMORY_BUDGET",
+        "The memory in GiB that --headless may use for decoded images. Beyond it, the least recently "
+        "used images are evicted and reloaded from disk once they are used again. Default is no limit.",
+        {"memory-budget"},
+    };
+
     ValueFlag<string> metricFlag{
         parser,
         "METRIC",
@@ -222,6 +349,63 @@ int mainFunc(const vector<string>& arguments) {
         {'o', "offset"},
     };
 
+    ValueFlag<string> outputFlag{
+        parser,
+        "OUTPUT",
+        "The file to write the report of --stats and --diff to. Default is stdout.",
+        {"output"},
+    };
+
+    Flag overwriteFlag{
+        parser,
+        "OVERWRITE",
+        "Allow the exports of IPC clients to --headless to replace existing files.",
+        {"overwrite"},
+    };
+
+    ValueFlag<string> referenceFlag{
+        parser,
+        "REFERENCE",
+        "The reference image that --diff and --export compare all images against.",
+        {'r', "reference"},
+    };
+
+    ValueFlag<string> resampleFlag{
+        parser,
+        "RESAMPLE",
+        "How a reference of a different resolution than the image is compared against it. "
+        "The available resamplings are:\n"
+        "CENTERED - Compare center-aligned pixels without resampling\n"
+        "BOX      - Box filter\n"
+        "BILINEAR - Bilinear (tent) filter\n"
+        "LANCZOS  - Lanczos filter with 3 lobes\n"
+        "Default is BILINEAR.",
+        {"resample"},
+    };
+
+    Flag sharedCacheFlag{
+        parser,
+        "SHARED CACHE",
+        "Share decoded images with other tev instances on this machine that also use this flag, "
+        "such that each file is decoded once. Images are kept in shared memory until no instance displays them anymore.",
+        {"shared-cache"},
+    };
+
+    Flag statsFlag{
+        parser,
+        "STATS",
+        "Report the mean, minimum, and maximum of every channel group of the images without opening a window.",
+        {"stats"},
+    };
+
+    ValueFlag<float> thresholdFlag{
+        parser,
+        "THRESHOLD",
+        "The largest acceptable mean error per channel group of --diff in terms of METRIC. "
+        "For the signed error E, the magnitude of the mean is used.",
+        {"threshold"},
+    };
+
     ValueFlag<string> tonemapFlag{
         parser,
         "TONEMAP",
@@ -252,7 +436,14 @@ int mainFunc(const vector<string>& arguments) {
         "selector is encountered only channels containing "
         "elements from the current selector will be loaded. This is "
         "especially useful for selectively loading a specific "
-        "part of a multi-part EXR file.",
+        "part of a multi-part EXR file. "
+        "Sequences of frames can be opened as a single image via frame patterns "
+        "such as 'render.####.exr' or 'render.%04d.exr', optionally followed by "
+        "a frame range such as '@1-100' or '@1-100x2'. "
+        "Directories and glob patterns such as 'renders/**/*.exr' open all "
+        "matching images, but only decode them once they are viewed. "
+        "Pseudo-paths such as 'synthetic:4096x4096:16ch:noise' generate images "
+        "procedurally, e.g. for stress testing.",
     };
 
     // Parse command line arguments and react to parsing
@@ -280,9 +471,131 @@ int mainFunc(const vector<string>& arguments) {
         return 0;
     }
 
+    // Expressions apply to all images, so they must be known before any image is loaded.
+    vector<ChannelExpression> channelExpressions;
+    for (const auto& definition : get(expressionFlag)) {
+        try {
+            channelExpressions.emplace_back(definition);
+        } catch (const invalid_argument& e) {
+            cerr << e.what() << endl;
+            return -2;
+        }
+    }
+    Image::setChannelExpressions(channelExpressions);
+
+    if (sharedCacheFlag) {
+        SharedImageCache::setEnabled(true);
+    }
+
+    ComparisonFilter comparisonFilter;
+    if (blurFlag)       { comparisonFilter.blurSigma = max(get(blurFlag), 0.0f); }
+    if (downsampleFlag) { comparisonFilter.downsampling = max(get(downsampleFlag), 1); }
+    if (resampleFlag) {
+        try {
+            comparisonFilter.resampling = toResampling(get(resampleFlag));
+        } catch (const invalid_argument& e) {
+            cerr << e.what() << endl;
+            return -2;
+        }
+    }
+
+    // The headless modes neither open a window nor communicate with other instances.
+    if (statsFlag || diffFlag || exportFlag) {
+        HeadlessSettings settings;
+
+        string channelSelector;
+        for (const auto& imageFile : get(imageFiles)) {
+            if (!imageFile.empty() && imageFile[0] == ':') {
+                channelSelector = imageFile.substr(1);
+                continue;
+            }
+
+            settings.images.push_back({imageFile, channelSelector});
+        }
+
+        if (referenceFlag) {
+            settings.hasReference = true;
+            settings.reference = {get(referenceFlag), ""};
+        }
+
+        if (thresholdFlag) {
+            settings.hasThreshold = true;
+            settings.threshold = get(thresholdFlag);
+        }
+
+        if (metricFlag) {
+            settings.metric = toMetric(get(metricFlag));
+        }
+
+        settings.comparisonFilter = comparisonFilter;
+
+        if (outputFlag) {
+            settings.outputPath = get(outputFlag);
+        }
+
+        if (exportFlag) {
+            settings.exportPattern = get(exportFlag);
+        }
+
+        if (groupFlag) {
+            settings.channelGroup = get(groupFlag);
+        }
+
+        if (exposureFlag) { settings.displaySettings.exposure = get(exposureFlag); }
+        if (gammaFlag)    { settings.displaySettings.gamma = get(gammaFlag); }
+        if (offsetFlag)   { settings.displaySettings.offset = get(offsetFlag); }
+        if (tonemapFlag)  { settings.displaySettings.tonemap = toTonemap(get(tonemapFlag)); }
+
+        if (formatFlag) {
+            settings.format = toReportFormat(get(formatFlag));
+        } else {
+            settings.format = toLower(path{settings.outputPath}.extension()) == "csv" ? EReportFormat::Csv : EReportFormat::Json;
+        }
+
+        // Keep stdout free of anything but the report.
+        if (settings.outputPath.empty() && !exportFlag) {
+            tlog::Logger::global()->hideSeverity(tlog::ESeverity::Info);
+            tlog::Logger::global()->hideSeverity(tlog::ESeverity::Success);
+        }
+
+        Imf::setGlobalThreadCount(thread::hardware_concurrency());
+
+        if (exportFlag) {
+            return exportImagesHeadless(settings);
+        }
+
+        return diffFlag ? compareImagesHeadless(settings) : computeStatisticsHeadless(settings);
+    }
+
     const string hostname = hostnameFlag ? get(hostnameFlag) : "127.0.0.1:14158";
     auto ipc = make_shared<Ipc>(hostname);
 
+    if (headlessFlag) {
+        Imf::setGlobalThreadCount(thread::hardware_concurrency());
+
+        size_t memoryBudget = memoryBudgetFlag ? (size_t)(get(memoryBudgetFlag) * 1024 * 1024 * 1024) : 0;
+        HeadlessServer server{ipc, memoryBudget};
+        server.setComparisonFilter(comparisonFilter);
+        if (exportDirFlag) {
+            server.setExportDirectory(get(exportDirFlag), overwriteFlag);
+        }
+
+        string channelSelector;
+        for (const auto& imageFile : get(imageFiles)) {
+            if (!imageFile.empty() && imageFile[0] == ':') {
+                channelSelector = imageFile.substr(1);
+                continue;
+            }
+
+            server.open(imageFile, channelSelector);
+        }
+
+        // Runs until the process is terminated.
+        atomic<bool> shallShutdown{false};
+        server.run(shallShutdown);
+        return 0;
+    }
+
     // If we're not the primary instance and did not request to open a new window,
     // simply send the to-be-opened images to the primary instance.
     if (!ipc->isPrimaryInstance() && !newWindowFlag) {
@@ -295,7 +608,17 @@ int mainFunc(const vector<string>& arguments) {
 
             try {
                 IpcPacket packet;
-                packet.setOpenImage(path{imageFile}.make_absolute().str(), channelSelector, true);
+                // Frame patterns and globs do not exist on disk and can therefore not be resolved
+                // by make_absolute(). Anchoring them at the working directory suffices. Synthetic
+                // images are not files at all and are sent as-is.
+                path imagePath = imageFile;
+                if (imagePath.exists()) {
+                    imagePath = imagePath.make_absolute();
+                } else if (!imagePath.is_absolute() && !SyntheticImageLoader::isSyntheticPath(imageFile)) {
+                    imagePath = path::getcwd() / imagePath;
+                }
+
+                packet.setOpenImage(imagePath.str(), channelSelector, true);
                 ipc->sendToPrimaryInstance(packet);
             } catch (const runtime_error& e) {
                 tlog::error() << tfm::format("Invalid file '%s': %s", imageFile, e.what());
@@ -309,17 +632,29 @@ int mainFunc(const vector<string>& arguments) {
 
     tlog::info() << "Loading window...";
 
-    shared_ptr<BackgroundImagesLoader> imagesLoader = make_shared<BackgroundImagesLoader>();
+    // Wake up the main loop whenever images finish loading such that they are displayed right away.
+    shared_ptr<BackgroundImagesLoader> imagesLoader = make_shared<BackgroundImagesLoader>([] { glfwPostEmptyEvent(); });
 
     atomic<bool> shallShutdown{false};
 
     // Spawn a background thread that opens images passed via stdin.
     // To allow whitespace characters in filenames, we use the convention that
-    // paths in stdin must be separated by newlines.
+    // paths in stdin must be separated by newlines. A line of the form
+    // `@<numBytes> <name>` is instead followed by the bytes of an encoded image
+    // file, which is then opened under the given name without touching the disk.
     thread stdinThread{[&]() {
+#ifdef _WIN32
+        // Image data must reach us unaltered by newline conversion.
+        _setmode(_fileno(stdin), _O_BINARY);
+#endif
+
         string channelSelector;
         while (!shallShutdown) {
             for (string line; getline(cin, line);) {
+                if (!line.empty() && line.back() == '\r') {
+                    line.pop_back();
+                }
+
                 string imageFile = tev::ensureUtf8(line);
 
                 if (imageFile.empty()) {
@@ -331,6 +666,37 @@ int mainFunc(const vector<string>& arguments) {
                     continue;
                 }
 
+                size_t numBytes;
+                string imageName;
+                bool isImageData;
+                try {
+                    isImageData = parseImageDataHeader(imageFile, numBytes, imageName);
+                } catch (const invalid_argument& e) {
+                    // The data can not be skipped reliably, so subsequent lines may be garbage.
+                    tlog::error() << e.what();
+                    continue;
+                }
+
+                if (isImageData) {
+                    vector<char> data;
+                    try {
+                        data.resize(numBytes);
+                    } catch (const bad_alloc&) {
+                        tlog::error() << tfm::format("Skipping image data of '%s', since its %d bytes do not fit into memory.", imageName, numBytes);
+                        cin.ignore((streamsize)numBytes);
+                        continue;
+                    }
+
+                    cin.read(data.data(), (streamsize)numBytes);
+                    if ((size_t)cin.gcount() != numBytes) {
+                        tlog::error() << tfm::format("Image data of '%s' ended after %d of %d bytes.", imageName, cin.gcount(), numBytes);
+                        break;
+                    }
+
+                    imagesLoader->enqueueData(imageName, move(data), channelSelector, false);
+                    continue;
+                }
+
                 imagesLoader->enqueue(imageFile, channelSelector, false);
             }
 
@@ -352,7 +718,15 @@ int mainFunc(const vector<string>& arguments) {
     if (ipc->isPrimaryInstance()) {
         ipcThread = thread{[&]() {
             while (!shallShutdown) {
-                ipc->receiveFromSecondaryInstance([&](const IpcPacket& packet) {
+                ipc->receiveFromSecondaryInstance([&](const IpcPacket& packet, int clientId) {
+                    // Clients wait for the replies to their queries, so they must not go unanswered.
+                    if (packet.type() == IpcPacket::QueryImages || packet.type() == IpcPacket::ComputeStatistics || packet.type() == IpcPacket::ExportImage) {
+                        IpcPacket reply;
+                        reply.setReply(false, "Queries are only answered by headless instances of tev (--headless).");
+                        ipc->sendToSecondaryInstance(clientId, reply);
+                        return;
+                    }
+
                     try {
                         handleIpcPacket(packet, imagesLoader);
                     } catch (const runtime_error& e) {
@@ -416,11 +790,13 @@ int mainFunc(const vector<string>& arguments) {
     sImageViewer->redraw();
 
     // Apply parameter flags
+    if (compressIdleFlag) { sImageViewer->setIdleCompressionDelay(get(compressIdleFlag)); }
     if (exposureFlag) { sImageViewer->setExposure(get(exposureFlag)); }
     if (filterFlag)   { sImageViewer->setFilter(get(filterFlag)); }
     if (gammaFlag)    { sImageViewer->setGamma(get(gammaFlag)); }
     if (metricFlag)   { sImageViewer->setMetric(toMetric(get(metricFlag))); }
     if (offsetFlag)   { sImageViewer->setOffset(get(offsetFlag)); }
+    if (blurFlag || downsampleFlag || resampleFlag) { sImageViewer->setComparisonFilter(comparisonFilter); }
     if (tonemapFlag)  { sImageViewer->setTonemap(toTonemap(get(tonemapFlag))); }
 
     // Refresh only every 250ms if there are no user interactions.
@@ -468,7 +844,7 @@ int main(int argc, char* argv[]) {
 #endif
         }
 
-        tev::mainFunc(arguments);
+        return tev::mainFunc(arguments);
     } catch (const exception& e) {
         tlog::error() << tfm::format("Uncaught exception: %s", e.what());
         return 1;
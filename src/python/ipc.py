@@ -7,6 +7,7 @@
 Interfaces with tev's IPC protocol to remote control tev with Python.
 """
 
+import json
 import socket
 import struct
 import numpy as np
@@ -49,6 +50,29 @@ class TevIpc:
 
         self._socket.sendall(data_bytes)
 
+    """
+        Opens an image from the bytes of an encoded file, e.g. an EXR or PNG, without writing
+        them to disk. `name` takes the place of the path and its extension helps to recognize
+        formats without a magic number.
+    """
+    def open_image_data(self, name: str, data: bytes, channel_selector: str = "", grab_focus = True):
+        if self._socket is None:
+            raise Exception("Communication was not started")
+
+        data_bytes = bytearray()
+        data_bytes.extend(struct.pack("<I", 0)) # reserved for length
+        data_bytes.extend(struct.pack("<b", 12)) # open image data
+        data_bytes.extend(struct.pack("<b", grab_focus)) # grab focus
+        data_bytes.extend(bytes(name, "UTF-8")) # image name
+        data_bytes.extend(struct.pack("<b", 0)) # string terminator
+        data_bytes.extend(bytes(channel_selector, "UTF-8")) # channels to load
+        data_bytes.extend(struct.pack("<b", 0)) # string terminator
+        data_bytes.extend(struct.pack("<Q", len(data))) # number of bytes
+        data_bytes.extend(data) # encoded image file
+        data_bytes[0:4] = struct.pack("<I", len(data_bytes))
+
+        self._socket.sendall(data_bytes)
+
     """
         Reloads the image with specified path from the disk of the machine tev is running on.
     """
@@ -162,4 +186,88 @@ class TevIpc:
                 data_bytes.extend(tile_dense.tobytes()) # data
                 data_bytes[0:4] = struct.pack("<I", len(data_bytes))
 
-                self._socket.sendall(data_bytes)
\ No newline at end of file
+                self._socket.sendall(data_bytes)
+
+    """
+        Lists the images held by a headless tev instance (`tev --headless`) along with the
+        bytes of memory each of them holds.
+    """
+    def query_images(self):
+        return self._query_images()["images"]
+
+    """
+        Returns the bytes of memory held by a headless tev instance per category, as well as
+        their high-water marks and the statistics of its pool of large buffers.
+    """
+    def query_memory(self):
+        reply = self._query_images()
+        return {"memory": reply["memory"], "peak_memory": reply["peakMemory"], "buffer_pool": reply["bufferPool"]}
+
+    def _query_images(self):
+        data_bytes = bytearray()
+        data_bytes.extend(struct.pack("<I", 0)) # reserved for length
+        data_bytes.extend(struct.pack("<b", 8)) # query images
+        data_bytes[0:4] = struct.pack("<I", len(data_bytes))
+
+        return self._query(data_bytes)
+
+    """
+        Computes the mean, minimum, and maximum of each channel group of an image held by a
+        headless tev instance. If a reference is given, the statistics of the error in terms
+        of `metric` are computed instead.
+    """
+    def compute_statistics(self, name: str, reference: str = "", channel_group: str = "", metric: str = "E"):
+        data_bytes = bytearray()
+        data_bytes.extend(struct.pack("<I", 0)) # reserved for length
+        data_bytes.extend(struct.pack("<b", 9)) # compute statistics
+        for string in [name, reference, channel_group, metric]:
+            data_bytes.extend(bytes(string, "UTF-8"))
+            data_bytes.extend(struct.pack("<b", 0)) # string terminator
+        data_bytes[0:4] = struct.pack("<I", len(data_bytes))
+
+        return self._query(data_bytes)
+
+    """
+        Saves an image held by a headless tev instance to a path on the machine tev is running on,
+        which is relative to the directory that tev was started with via `--export-dir`.
+    """
+    def export_image(self, name: str, path: str, reference: str = "", channel_group: str = "", metric: str = "E", exposure = 0.0, offset = 0.0, gamma = 2.2, tonemap: str = "sRGB"):
+        data_bytes = bytearray()
+        data_bytes.extend(struct.pack("<I", 0)) # reserved for length
+        data_bytes.extend(struct.pack("<b", 10)) # export image
+        for string in [name, reference, channel_group, metric, path]:
+            data_bytes.extend(bytes(string, "UTF-8"))
+            data_bytes.extend(struct.pack("<b", 0)) # string terminator
+        data_bytes.extend(struct.pack("<fff", exposure, offset, gamma))
+        data_bytes.extend(bytes(tonemap, "UTF-8"))
+        data_bytes.extend(struct.pack("<b", 0)) # string terminator
+        data_bytes[0:4] = struct.pack("<I", len(data_bytes))
+
+        return self._query(data_bytes)
+
+    def _query(self, data_bytes):
+        if self._socket is None:
+            raise Exception("Communication was not started")
+
+        self._socket.sendall(data_bytes)
+
+        length = struct.unpack("<I", self._receive(4))[0]
+        payload = self._receive(length - 4)
+        if payload[0] != 11:
+            raise Exception("Expected a reply from tev")
+
+        success = payload[1] == 1
+        message = payload[2:payload.index(0, 2)].decode("UTF-8")
+        if not success:
+            raise Exception(message)
+
+        return json.loads(message)
+
+    def _receive(self, length: int):
+        data = bytearray()
+        while len(data) < length:
+            chunk = self._socket.recv(length - len(data))
+            if not chunk:
+                raise Exception("Connection to tev was closed")
+            data.extend(chunk)
+        return bytes(data)